@@ -0,0 +1,556 @@
+#include "assetarchive.h"
+#include "utility.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static uint64_t AlignUp(const uint64_t value, const uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool AssetArchive::Open(string_t path)
+{
+    m_mapping    = nullptr;
+    m_size       = 0;
+    m_entries    = nullptr;
+    m_assetCount = 0;
+
+#ifdef WIN32
+    m_file        = nullptr;
+    m_fileMapping = nullptr;
+
+    const HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    LARGE_INTEGER fileSize = {};
+
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        PrintWarning("Asset archive: failed to open \'%s\'.", path);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        return false;
+    }
+
+    const HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void*  mapping     = fileMapping ? MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+    if (!mapping)
+    {
+        PrintWarning("Asset archive: failed to map \'%s\'.", path);
+        if (fileMapping) CloseHandle(fileMapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file        = file;
+    m_fileMapping = fileMapping;
+    m_mapping     = static_cast<const byte_t*>(mapping);
+    m_size        = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+    const int file = open(path, O_RDONLY);
+
+    struct stat status = {};
+
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        PrintWarning("Asset archive: failed to open \'%s\'.", path);
+        if (file >= 0) close(file);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+    // The mapping keeps a reference to the file.
+    close(file);
+
+    if (mapping == MAP_FAILED)
+    {
+        PrintWarning("Asset archive: failed to map \'%s\'.", path);
+        return false;
+    }
+
+    m_mapping = static_cast<const byte_t*>(mapping);
+    m_size    = static_cast<uint64_t>(status.st_size);
+#endif
+
+    // Only the index is validated; the payloads are not touched.
+    AssetArchiveHeader header = {};
+
+    bool isValid = (m_size >= sizeof(header));
+
+    if (isValid)
+    {
+        memcpy(&header, m_mapping, sizeof(header));
+
+        isValid = (header.magic     == ASSET_ARCHIVE_MAGIC)     &&
+                  (header.version   == ASSET_ARCHIVE_VERSION)   &&
+                  (header.alignment == ASSET_ARCHIVE_ALIGNMENT) &&
+                  (header.fileSize  == m_size)                  &&
+                  (header.assetCount <= (m_size - sizeof(header)) / sizeof(AssetEntry));
+    }
+
+    if (isValid)
+    {
+        m_entries    = reinterpret_cast<const AssetEntry*>(m_mapping + sizeof(header));
+        m_assetCount = header.assetCount;
+
+        for (uint32_t i = 0; i < m_assetCount && isValid; i++)
+        {
+            const AssetEntry& entry = m_entries[i];
+
+            isValid = (entry.offset % ASSET_ARCHIVE_ALIGNMENT == 0) &&
+                      (entry.offset <= m_size) && (entry.size <= m_size - entry.offset) &&
+                      (entry.type <= ASSET_TYPE_BLOB) &&
+                      (i == 0 || m_entries[i - 1].nameHash < entry.nameHash);
+        }
+    }
+
+    if (!isValid)
+    {
+        PrintWarning("Asset archive: \'%s\' is not a valid archive (version %u expected).", path,
+                     ASSET_ARCHIVE_VERSION);
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void AssetArchive::Close()
+{
+    if (!m_mapping) return;
+
+#ifdef WIN32
+    UnmapViewOfFile(m_mapping);
+    CloseHandle(m_fileMapping);
+    CloseHandle(m_file);
+
+    m_file        = nullptr;
+    m_fileMapping = nullptr;
+#else
+    munmap(const_cast<byte_t*>(m_mapping), static_cast<size_t>(m_size));
+#endif
+
+    m_mapping    = nullptr;
+    m_size       = 0;
+    m_entries    = nullptr;
+    m_assetCount = 0;
+}
+
+uint32_t AssetArchive::AssetCount() const
+{
+    return m_assetCount;
+}
+
+const AssetEntry& AssetArchive::Entry(const uint32_t index) const
+{
+    assert(index < m_assetCount);
+
+    return m_entries[index];
+}
+
+const AssetEntry* AssetArchive::Find(string_t name) const
+{
+    return Find(HashName(name));
+}
+
+const AssetEntry* AssetArchive::Find(const uint64_t nameHash) const
+{
+    const AssetEntry* end   = m_entries + m_assetCount;
+    const AssetEntry* entry = std::lower_bound(m_entries, end, nameHash,
+                                               [](const AssetEntry& e, const uint64_t hash)
+                                               {
+                                                   return e.nameHash < hash;
+                                               });
+
+    return (entry != end && entry->nameHash == nameHash) ? entry : nullptr;
+}
+
+const byte_t* AssetArchive::Data(const AssetEntry& entry) const
+{
+    return m_mapping + entry.offset;
+}
+
+void AssetArchive::Prefetch(const AssetEntry& entry) const
+{
+    if (entry.size == 0) return;
+
+#ifdef WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = {};
+    range.VirtualAddress = const_cast<byte_t*>(m_mapping + entry.offset);
+    range.NumberOfBytes  = static_cast<SIZE_T>(entry.size);
+
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // The payloads are aligned to ASSET_ARCHIVE_ALIGNMENT, but the pages may be larger.
+    static const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    const uint64_t begin = entry.offset & ~(pageSize - 1);
+
+    madvise(const_cast<byte_t*>(m_mapping + begin), static_cast<size_t>(entry.offset + entry.size - begin),
+            MADV_WILLNEED);
+#endif
+}
+
+uint64_t AssetArchive::FileSize() const
+{
+    return m_size;
+}
+
+uint64_t AssetArchive::HashName(string_t name)
+{
+    return HashBytes(name, strlen(name));
+}
+
+uint64_t AssetArchive::ImageSize(const uint32_t format, const uint32_t width, const uint32_t height)
+{
+    // Ranges of consecutive VkFormat values which share the size of their texels (or blocks).
+    struct FormatRange
+    {
+        VkFormat first;
+        VkFormat last;
+        uint32_t blockSize;   // In bytes
+        uint32_t blockExtent; // In texels, in both dimensions
+    };
+
+    static const FormatRange ranges[] =
+    {
+        { VK_FORMAT_R4G4_UNORM_PACK8,        VK_FORMAT_R4G4_UNORM_PACK8,         1, 1 },
+        { VK_FORMAT_R4G4B4A4_UNORM_PACK16,   VK_FORMAT_A1R5G5B5_UNORM_PACK16,    2, 1 },
+        { VK_FORMAT_R8_UNORM,                VK_FORMAT_R8_SRGB,                  1, 1 },
+        { VK_FORMAT_R8G8_UNORM,              VK_FORMAT_R8G8_SRGB,                2, 1 },
+        { VK_FORMAT_R8G8B8_UNORM,            VK_FORMAT_B8G8R8_SRGB,              3, 1 },
+        { VK_FORMAT_R8G8B8A8_UNORM,          VK_FORMAT_A2B10G10R10_SINT_PACK32,  4, 1 },
+        { VK_FORMAT_R16_UNORM,               VK_FORMAT_R16_SFLOAT,               2, 1 },
+        { VK_FORMAT_R16G16_UNORM,            VK_FORMAT_R16G16_SFLOAT,            4, 1 },
+        { VK_FORMAT_R16G16B16_UNORM,         VK_FORMAT_R16G16B16_SFLOAT,         6, 1 },
+        { VK_FORMAT_R16G16B16A16_UNORM,      VK_FORMAT_R16G16B16A16_SFLOAT,      8, 1 },
+        { VK_FORMAT_R32_UINT,                VK_FORMAT_R32_SFLOAT,               4, 1 },
+        { VK_FORMAT_R32G32_UINT,             VK_FORMAT_R32G32_SFLOAT,            8, 1 },
+        { VK_FORMAT_R32G32B32_UINT,          VK_FORMAT_R32G32B32_SFLOAT,        12, 1 },
+        { VK_FORMAT_R32G32B32A32_UINT,       VK_FORMAT_R32G32B32A32_SFLOAT,     16, 1 },
+        { VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_E5B9G9R9_UFLOAT_PACK32,   4, 1 },
+        { VK_FORMAT_BC1_RGB_UNORM_BLOCK,     VK_FORMAT_BC1_RGBA_SRGB_BLOCK,      8, 4 },
+        { VK_FORMAT_BC2_UNORM_BLOCK,         VK_FORMAT_BC3_SRGB_BLOCK,          16, 4 },
+        { VK_FORMAT_BC4_UNORM_BLOCK,         VK_FORMAT_BC4_SNORM_BLOCK,          8, 4 },
+        { VK_FORMAT_BC5_UNORM_BLOCK,         VK_FORMAT_BC7_SRGB_BLOCK,          16, 4 }
+    };
+
+    for (const FormatRange& range : ranges)
+    {
+        if (format >= static_cast<uint32_t>(range.first) && format <= static_cast<uint32_t>(range.last))
+        {
+            const uint64_t blockColumns = (width  + range.blockExtent - 1) / range.blockExtent;
+            const uint64_t blockRows    = (height + range.blockExtent - 1) / range.blockExtent;
+
+            return blockColumns * blockRows * range.blockSize;
+        }
+    }
+
+    return 0;
+}
+
+bool AssetArchive::Write(string_t path, const AssetSource* sources, const uint32_t count)
+{
+    // The index is sorted by the name hash, while the payloads stay in the order of the sources.
+    std::vector<AssetEntry> entries(count);
+
+    uint64_t offset = AlignUp(sizeof(AssetArchiveHeader) + count * sizeof(AssetEntry), ASSET_ARCHIVE_ALIGNMENT);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const AssetSource& source = sources[i];
+
+        entries[i] = { HashName(source.name), offset, source.size, source.type, source.format,
+                       source.width, source.height };
+
+        offset = AlignUp(offset + source.size, ASSET_ARCHIVE_ALIGNMENT);
+    }
+
+    // The last payload is not padded.
+    const uint64_t fileSize = (count > 0) ? entries[count - 1].offset + entries[count - 1].size
+                                          : sizeof(AssetArchiveHeader);
+
+    std::vector<uint32_t> order(count);
+
+    for (uint32_t i = 0; i < count; i++) order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&entries](const uint32_t a, const uint32_t b)
+    {
+        return entries[a].nameHash < entries[b].nameHash;
+    });
+
+    for (uint32_t i = 1; i < count; i++)
+    {
+        if (entries[order[i - 1]].nameHash == entries[order[i]].nameHash)
+        {
+            PrintWarning("Asset archive: \'%s\' and \'%s\' have the same name hash.", sources[order[i - 1]].name,
+                         sources[order[i]].name);
+            return false;
+        }
+    }
+
+    std::vector<AssetEntry> index(count);
+
+    for (uint32_t i = 0; i < count; i++) index[i] = entries[order[i]];
+
+    AssetArchiveHeader header = {};
+    header.magic      = ASSET_ARCHIVE_MAGIC;
+    header.version    = ASSET_ARCHIVE_VERSION;
+    header.assetCount = count;
+    header.alignment  = ASSET_ARCHIVE_ALIGNMENT;
+    header.fileSize   = fileSize;
+
+    // Write to a temporary file, and replace the old file once the new one is complete.
+    const std::string tempPath = std::string(path) + ".tmp";
+
+    FILE* file = OpenFile(tempPath.c_str(), "wb");
+
+    bool isWritten = false;
+
+    if (file)
+    {
+        static const byte_t padding[ASSET_ARCHIVE_ALIGNMENT] = {};
+
+        uint64_t position = sizeof(header) + count * sizeof(AssetEntry);
+
+        isWritten = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+                    (count == 0 || fwrite(index.data(), count * sizeof(AssetEntry), 1, file) == 1);
+
+        for (uint32_t i = 0; i < count && isWritten; i++)
+        {
+            const size_t paddingSize = static_cast<size_t>(entries[i].offset - position);
+
+            isWritten = (paddingSize == 0 || fwrite(padding, paddingSize, 1, file) == 1) &&
+                        (sources[i].size == 0 ||
+                         fwrite(sources[i].data, static_cast<size_t>(sources[i].size), 1, file) == 1);
+
+            position = entries[i].offset + entries[i].size;
+        }
+
+        isWritten = (fflush(file) == 0) && isWritten;
+        isWritten = (fclose(file) == 0) && isWritten;
+    }
+
+    std::error_code error;
+
+    if (isWritten)
+    {
+        // Replaces the destination atomically.
+        std::filesystem::rename(tempPath, path, error);
+    }
+
+    if (!isWritten || error)
+    {
+        PrintWarning("Asset archive: failed to write \'%s\'.", path);
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+// Reports the throughput, and the distribution of the latencies (in microseconds).
+static void PrintLoadStatistics(string_t name, std::vector<double>& latencies, const double totalTime,
+                                const uint64_t totalSize)
+{
+    std::sort(latencies.begin(), latencies.end());
+
+    const size_t count = latencies.size();
+
+    PrintInfo("  %-16s %7.2f GB/s | latency: %8.1f us median, %8.1f us p99, %8.1f us max", name,
+              static_cast<double>(totalSize) / (totalTime * 1e9), latencies[count / 2],
+              latencies[std::min(count * 99 / 100, count - 1)], latencies[count - 1]);
+}
+
+void BenchmarkAssetArchive(const uint32_t sizeMiB)
+{
+    using Clock = std::chrono::steady_clock;
+
+    ASSERT(sizeMiB > 0, "The benchmark requires assets.");
+
+    // Deterministic, so that the runs are comparable.
+    uint32_t seed = 1;
+
+    const auto random = [&seed]()
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+        return seed >> 8;
+    };
+
+    // The payloads are slices of a pool of random bytes, rather than unique, to keep the set-up fast.
+    const uint64_t maxAssetSize = 2048 * 2048 * 4;
+
+    std::vector<byte_t> pool(2 * maxAssetSize);
+
+    for (byte_t& b : pool) b = static_cast<byte_t>(random());
+
+    // A mix of meshes (32-byte vertices) and RGBA8 images, from 32 KiB to 16 MiB.
+    std::vector<AssetSource> sources;
+    std::vector<std::string> names;
+
+    uint64_t totalSize = 0;
+
+    while (totalSize < (static_cast<uint64_t>(sizeMiB) << 20))
+    {
+        AssetSource source = {};
+
+        if (random() % 4 == 0)
+        {
+            const uint32_t side = 256u << (random() % 4);
+
+            names.push_back("image" + std::to_string(sources.size()));
+            source.type   = ASSET_TYPE_IMAGE;
+            source.format = VK_FORMAT_R8G8B8A8_UNORM;
+            source.width  = side;
+            source.height = side;
+            source.size   = 4ull * side * side;
+        }
+        else
+        {
+            const uint32_t vertexCount = 1024u << (random() % 7);
+
+            names.push_back("mesh" + std::to_string(sources.size()));
+            source.type   = ASSET_TYPE_MESH;
+            source.format = 32;
+            source.width  = vertexCount;
+            source.height = 3 * vertexCount;
+            source.size   = 32ull * vertexCount + 4ull * source.height;
+        }
+
+        source.data = pool.data() + random() % maxAssetSize;
+
+        sources.push_back(source);
+        totalSize += source.size;
+    }
+
+    // The names are set once the vector no longer reallocates.
+    for (size_t i = 0; i < sources.size(); i++) sources[i].name = names[i].c_str();
+
+    const uint32_t    assetCount = static_cast<uint32_t>(sources.size());
+    const std::string path       = (std::filesystem::temp_directory_path() / "magma_asset_bench.mga").string();
+
+    Clock::time_point start = Clock::now();
+
+    if (!AssetArchive::Write(path.c_str(), sources.data(), assetCount)) return;
+
+    const std::chrono::duration<double> writeTime = Clock::now() - start;
+
+    // The destination stands for the staging memory of the uploader (or any host-visible allocation).
+    std::vector<byte_t> destination(maxAssetSize, 0);
+
+    // The assets are loaded in random order, as a streaming system would.
+    std::vector<uint32_t> order(assetCount);
+
+    for (uint32_t i = 0; i < assetCount; i++) order[i] = i;
+
+    for (uint32_t i = assetCount - 1; i > 0; i--) std::swap(order[i], order[random() % (i + 1)]);
+
+    std::vector<uint64_t> hashes(assetCount);
+
+    for (uint32_t i = 0; i < assetCount; i++) hashes[i] = AssetArchive::HashName(sources[i].name);
+
+    std::vector<double> latencies(assetCount);
+
+    // 1. Read into heap memory, then copy: the path the archive avoids.
+    FILE* file = OpenFile(path.c_str(), "rb");
+
+    ASSERT(file, "Failed to open the asset archive \'%s\'.", path.c_str());
+
+    AssetArchive archive;
+
+    ASSERT(archive.Open(path.c_str()), "Failed to open the asset archive \'%s\'.", path.c_str());
+
+    const Clock::time_point readStart = Clock::now();
+
+    for (uint32_t i = 0; i < assetCount; i++)
+    {
+        const Clock::time_point assetStart = Clock::now();
+
+        const AssetEntry* entry = archive.Find(hashes[order[i]]);
+        byte_t*           data  = new byte_t[entry->size];
+
+#ifdef _MSC_VER
+        _fseeki64(file, static_cast<int64_t>(entry->offset), SEEK_SET);
+#else
+        fseeko(file, static_cast<off_t>(entry->offset), SEEK_SET);
+#endif
+
+        ASSERT(fread(data, static_cast<size_t>(entry->size), 1, file) == 1, "Failed to read an asset.");
+
+        memcpy(destination.data(), data, static_cast<size_t>(entry->size));
+
+        delete[] data;
+
+        latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - assetStart).count();
+    }
+
+    const std::chrono::duration<double> readTime = Clock::now() - readStart;
+
+    fclose(file);
+    archive.Close();
+
+    std::vector<double> readLatencies = latencies;
+
+    // 2. Copy from a new mapping: the first access of each page faults (the file cache is warm in both cases).
+    const Clock::time_point openStart = Clock::now();
+
+    ASSERT(archive.Open(path.c_str()), "Failed to open the asset archive \'%s\'.", path.c_str());
+
+    const std::chrono::duration<double, std::micro> openTime = Clock::now() - openStart;
+
+    const Clock::time_point mapStart = Clock::now();
+
+    for (uint32_t i = 0; i < assetCount; i++)
+    {
+        const Clock::time_point assetStart = Clock::now();
+
+        const AssetEntry* entry = archive.Find(hashes[order[i]]);
+
+        archive.Prefetch(*entry);
+
+        memcpy(destination.data(), archive.Data(*entry), static_cast<size_t>(entry->size));
+
+        latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - assetStart).count();
+    }
+
+    const std::chrono::duration<double> mapTime = Clock::now() - mapStart;
+
+    // The payloads must match the sources.
+    for (uint32_t i = 0; i < assetCount; i++)
+    {
+        const AssetEntry* entry = archive.Find(sources[i].name);
+
+        ASSERT(entry && entry->size == sources[i].size && entry->type == static_cast<uint32_t>(sources[i].type) &&
+               memcmp(archive.Data(*entry), sources[i].data, static_cast<size_t>(sources[i].size)) == 0,
+               "The asset \'%s\' does not match its source.", sources[i].name);
+    }
+
+    const uint64_t fileSize = archive.FileSize();
+
+    archive.Close();
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+
+    PrintInfo("Asset archive benchmark (%u assets, %.1f MiB, written in %.1f ms, opened in %.1f us):", assetCount,
+              static_cast<double>(fileSize) / (1 << 20), 1000.0 * writeTime.count(), openTime.count());
+    PrintLoadStatistics("read + copy:", readLatencies, readTime.count(), totalSize);
+    PrintLoadStatistics("mmap:", latencies, mapTime.count(), totalSize);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "definitions.h"
+
+#define ASSET_ARCHIVE_MAGIC     0x5241474Du // 'MGAR'
+#define ASSET_ARCHIVE_VERSION   1
+#define ASSET_ARCHIVE_ALIGNMENT 4096        // Of the payloads within the file: a page, and any copy offset alignment
+
+enum AssetType : uint32_t
+{
+    ASSET_TYPE_MESH,    // Vertices, followed by the indices (uint32_t)
+    ASSET_TYPE_IMAGE,   // Texels of the first mip level, tightly packed
+    ASSET_TYPE_BLOB     // Anything else
+};
+
+// At the beginning of the file, followed by the index (AssetEntry[assetCount]), and then by the payloads.
+struct AssetArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t assetCount;
+    uint32_t alignment;   // ASSET_ARCHIVE_ALIGNMENT
+    uint64_t fileSize;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(AssetArchiveHeader) == 32, "The layout of the file must not change.");
+
+// The entries of the index are sorted by their name hash (see AssetArchive::HashName()).
+struct AssetEntry
+{
+    uint64_t nameHash;
+    uint64_t offset;      // Of the payload, from the beginning of the file (aligned)
+    uint64_t size;        // Of the payload
+    uint32_t type;        // AssetType
+    uint32_t format;      // Images: VkFormat. Meshes: bytes per vertex
+    uint32_t width;       // Images: in texels. Meshes: vertex count
+    uint32_t height;      // Images: in texels. Meshes: index count
+};
+
+static_assert(sizeof(AssetEntry) == 40, "The layout of the file must not change.");
+
+// The input of AssetArchive::Write().
+struct AssetSource
+{
+    string_t    name;
+    AssetType   type;
+    uint32_t    format;   // See AssetEntry
+    uint32_t    width;
+    uint32_t    height;
+    const void* data;
+    uint64_t    size;
+};
+
+// Read-only archive of assets, memory-mapped rather than read. The index is used in place, and the payloads
+// are never parsed nor copied to the heap: Data() points into the mapping, so it can be passed directly
+// to VulkanAsyncUploader (which copies it into the staging memory), or copied into a VulkanUploadRing allocation
+// or any host-visible allocation. The pages are read on demand by the OS, and are shared with the file cache.
+// Thread-safe once opened.
+class AssetArchive
+{
+public:
+
+    // Returns 'false' (and prints a warning) if the file cannot be mapped, or is not a valid archive.
+    bool Open(string_t path);
+
+    // The pointers returned by Data() are invalidated.
+    void Close();
+
+    uint32_t          AssetCount() const;
+    const AssetEntry& Entry(const uint32_t index) const;
+
+    // Returns nullptr if there is no such asset. O(log(assetCount)).
+    const AssetEntry* Find(string_t name) const;
+    const AssetEntry* Find(const uint64_t nameHash) const;
+
+    // The payload of the asset, valid until Close().
+    const byte_t* Data(const AssetEntry& entry) const;
+
+    // Asks the OS to read the payload ahead, so that the first access does not fault page by page.
+    void Prefetch(const AssetEntry& entry) const;
+
+    uint64_t FileSize() const;
+
+    static uint64_t HashName(string_t name);
+
+    // The size of the first mip level of an image, tightly packed (in blocks for block-compressed formats).
+    // Returns 0 if the format (a VkFormat) is not supported, e.g. depth/stencil or multi-planar.
+    static uint64_t ImageSize(const uint32_t format, const uint32_t width, const uint32_t height);
+
+    // Packs the assets into a new archive (see 'tools/assetpacker.cpp'). The names must be unique.
+    // Returns 'false' (and prints a warning) on failure.
+    static bool Write(string_t path, const AssetSource* sources, const uint32_t count);
+
+private:
+
+    const byte_t*     m_mapping;
+    uint64_t          m_size;
+    const AssetEntry* m_entries;   // Within the mapping
+    uint32_t          m_assetCount;
+#ifdef WIN32
+    void*             m_file;      // HANDLE
+    void*             m_fileMapping;
+#endif
+};
+
+// Writes a synthetic archive of meshes and images (about 'sizeMiB' in total) to a temporary file,
+// and measures the throughput and the latency of loading the assets from the mapping,
+// against reading them into heap memory first.
+void BenchmarkAssetArchive(const uint32_t sizeMiB);
@@ -0,0 +1,269 @@
+#include "asynccompute.h"
+#include "utility.h"
+
+#include <cassert>
+
+// Stages and accesses of the commands which may be recorded by a compute pass.
+#define VK_COMPUTE_PASS_STAGES   (VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+#define VK_COMPUTE_PASS_WRITES   (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT)
+#define VK_COMPUTE_PASS_ACCESSES (VK_ACCESS_SHADER_READ_BIT  | VK_ACCESS_TRANSFER_READ_BIT | VK_COMPUTE_PASS_WRITES)
+
+void VulkanAsyncCompute::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                VulkanQueueScheduler* scheduler, VulkanGpuProfiler* graphicsProfiler,
+                                const uint32_t computeQueueFamilyIndex, const uint32_t graphicsQueueFamilyIndex,
+                                const bool isDedicatedQueue, const uint32_t frameCount,
+                                const float timestampPeriod, const uint32_t timestampValidBits)
+{
+    assert(frameCount <= VK_MAX_ASYNC_COMPUTE_FRAMES);
+
+    m_device                   = device;
+    m_allocator                = allocator;
+    m_scheduler                = scheduler;
+    m_graphicsProfiler         = graphicsProfiler;
+    m_computeQueueFamilyIndex  = computeQueueFamilyIndex;
+    m_graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+    m_isDedicatedQueue         = isDedicatedQueue;
+    m_isEnabled                = true;
+    m_isAsync                  = false;
+    m_frameCount               = frameCount;
+    m_frameIndex               = 0;
+    m_passCount                = 0;
+    m_consumerStages           = 0;
+    m_globalLayout             = VK_NULL_HANDLE;
+    m_globalSet                = VK_NULL_HANDLE;
+
+    if (!m_isDedicatedQueue)
+    {
+        PrintInfo("There is no dedicated compute queue. Compute passes are executed by the graphics queue.");
+        return;
+    }
+
+    VkCommandPoolCreateInfo commandPoolInfo = {};
+    commandPoolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = m_computeQueueFamilyIndex;
+
+    for (uint32_t i = 0; i < m_frameCount; i++)
+    {
+        CHECK_INT(vkCreateCommandPool(m_device, &commandPoolInfo, m_allocator, &m_commandPools[i]),
+                  "Failed to create a command pool.");
+
+        VkCommandBufferAllocateInfo commandBufferInfo = {};
+        commandBufferInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool        = m_commandPools[i];
+        commandBufferInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferInfo.commandBufferCount = 1;
+
+        CHECK_INT(vkAllocateCommandBuffers(m_device, &commandBufferInfo, &m_commandBuffers[i]),
+                  "Failed to allocate a command buffer.");
+    }
+
+    m_profiler.Create(m_device, m_allocator, m_frameCount, timestampPeriod, timestampValidBits, "GPU compute");
+}
+
+void VulkanAsyncCompute::Destroy()
+{
+    if (!m_isDedicatedQueue) return;
+
+    // The caller waits for the frames in flight (which wait for their passes) to retire.
+    m_profiler.Destroy();
+
+    for (uint32_t i = 0; i < m_frameCount; i++)
+    {
+        // Destroying the pool also frees its command buffers.
+        vkDestroyCommandPool(m_device, m_commandPools[i], m_allocator);
+
+        m_commandPools[i]   = VK_NULL_HANDLE;
+        m_commandBuffers[i] = VK_NULL_HANDLE;
+    }
+}
+
+void VulkanAsyncCompute::Enable(const bool enable)
+{
+    m_isEnabled = enable;
+}
+
+bool VulkanAsyncCompute::IsAsync() const
+{
+    return m_isAsync;
+}
+
+void VulkanAsyncCompute::BeginFrame(const uint32_t frameIndex)
+{
+    assert(frameIndex < m_frameCount);
+    assert(m_passCount == 0 && "The passes of the previous frame have not been submitted.");
+
+    m_frameIndex     = frameIndex;
+    m_isAsync        = m_isEnabled && m_isDedicatedQueue;
+    m_consumerStages = 0;
+
+    if (!m_isDedicatedQueue) return;
+
+    // The graphics queue has waited for the passes of the frame which previously used the slot.
+    CHECK_INT(vkResetCommandPool(m_device, m_commandPools[m_frameIndex], 0),
+              "Failed to reset a command pool.");
+}
+
+void VulkanAsyncCompute::SetGlobalDescriptorSet(VkPipelineLayout layout, VkDescriptorSet set)
+{
+    m_globalLayout = layout;
+    m_globalSet    = set;
+}
+
+void VulkanAsyncCompute::AddPass(VkCommandBuffer graphicsCommandBuffer, const VulkanComputePass& pass)
+{
+    ASSERT(pass.bufferOutputCount + pass.imageOutputCount <= VK_MAX_COMPUTE_PASS_OUTPUTS,
+           "The compute pass \'%s\' has too many outputs.", pass.name);
+    ASSERT(pass.consumerStages != 0, "The compute pass \'%s\' has no consumer stages.", pass.name);
+
+    if (!m_isAsync)
+    {
+        // Execute the pass in place, and make its outputs visible to the consumers.
+        m_graphicsProfiler->BeginScope(graphicsCommandBuffer, pass.name);
+        pass.record(graphicsCommandBuffer, pass.userData);
+        m_graphicsProfiler->EndScope(graphicsCommandBuffer);
+
+        VkMemoryBarrier barrier = {};
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_COMPUTE_PASS_WRITES;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+        vkCmdPipelineBarrier(graphicsCommandBuffer, VK_COMPUTE_PASS_STAGES, pass.consumerStages,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+        return;
+    }
+
+    VkCommandBuffer commandBuffer = m_commandBuffers[m_frameIndex];
+
+    if (m_passCount == 0)
+    {
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        CHECK_INT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+                  "Failed to begin recording a command buffer.");
+
+        m_profiler.BeginFrame(commandBuffer, m_frameIndex);
+
+        if (m_globalSet)
+        {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_globalLayout,
+                                    0, 1, &m_globalSet, 0, nullptr);
+        }
+    }
+    else
+    {
+        // The pass may consume the outputs of the previous passes.
+        VkMemoryBarrier barrier = {};
+        barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_COMPUTE_PASS_WRITES;
+        barrier.dstAccessMask = VK_COMPUTE_PASS_ACCESSES;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_COMPUTE_PASS_STAGES, VK_COMPUTE_PASS_STAGES,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    m_passCount++;
+    m_consumerStages |= pass.consumerStages;
+
+    m_profiler.BeginScope(commandBuffer, pass.name);
+    pass.record(commandBuffer, pass.userData);
+    m_profiler.EndScope(commandBuffer);
+
+    // Within the same queue family, the semaphore makes the outputs visible to the graphics queue.
+    if (m_computeQueueFamilyIndex == m_graphicsQueueFamilyIndex) return;
+
+    VkBufferMemoryBarrier bufferBarriers[VK_MAX_COMPUTE_PASS_OUTPUTS];
+    VkImageMemoryBarrier  imageBarriers[VK_MAX_COMPUTE_PASS_OUTPUTS];
+
+    for (uint32_t i = 0; i < pass.bufferOutputCount; i++)
+    {
+        VkBufferMemoryBarrier& barrier = bufferBarriers[i];
+        barrier                        = {};
+        barrier.sType                  = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask          = VK_COMPUTE_PASS_WRITES;
+        barrier.dstAccessMask          = 0;
+        barrier.srcQueueFamilyIndex    = m_computeQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex    = m_graphicsQueueFamilyIndex;
+        barrier.buffer                 = pass.bufferOutputs[i].buffer;
+        barrier.offset                 = pass.bufferOutputs[i].offset;
+        barrier.size                   = pass.bufferOutputs[i].size;
+    }
+
+    for (uint32_t i = 0; i < pass.imageOutputCount; i++)
+    {
+        VkImageMemoryBarrier& barrier = imageBarriers[i];
+        barrier                       = {};
+        barrier.sType                 = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask         = VK_COMPUTE_PASS_WRITES;
+        barrier.dstAccessMask         = 0;
+        barrier.oldLayout             = pass.imageOutputs[i].layout;
+        barrier.newLayout             = pass.imageOutputs[i].layout;
+        barrier.srcQueueFamilyIndex   = m_computeQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex   = m_graphicsQueueFamilyIndex;
+        barrier.image                 = pass.imageOutputs[i].image;
+        barrier.subresourceRange      = pass.imageOutputs[i].range;
+    }
+
+    // Release the ownership to the graphics queue family.
+    vkCmdPipelineBarrier(commandBuffer, VK_COMPUTE_PASS_STAGES, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, pass.bufferOutputCount, bufferBarriers, pass.imageOutputCount, imageBarriers);
+
+    // The matching acquisition. Its execution is chained to the semaphore wait (at the consumer stages).
+    for (uint32_t i = 0; i < pass.bufferOutputCount; i++)
+    {
+        bufferBarriers[i].srcAccessMask = 0;
+        bufferBarriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+    for (uint32_t i = 0; i < pass.imageOutputCount; i++)
+    {
+        imageBarriers[i].srcAccessMask = 0;
+        imageBarriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+    vkCmdPipelineBarrier(graphicsCommandBuffer, pass.consumerStages, pass.consumerStages, 0,
+                         0, nullptr, pass.bufferOutputCount, bufferBarriers, pass.imageOutputCount, imageBarriers);
+}
+
+VulkanTimelineWait VulkanAsyncCompute::Submit()
+{
+    VulkanTimelineWait graphicsWait = { VK_QUEUE_TYPE_COMPUTE, 0, 0 };
+
+    if (m_passCount == 0) return graphicsWait;
+
+    VkCommandBuffer commandBuffer = m_commandBuffers[m_frameIndex];
+
+    m_profiler.EndFrame(commandBuffer);
+
+    CHECK_INT(vkEndCommandBuffer(commandBuffer),
+              "Failed to end recording a command buffer.");
+
+    // The previous frame of the graphics queue may still be reading the outputs.
+    const VulkanTimelineWait computeWait = { VK_QUEUE_TYPE_GRAPHICS,
+                                             m_scheduler->LastSubmittedValue(VK_QUEUE_TYPE_GRAPHICS),
+                                             VK_COMPUTE_PASS_STAGES };
+
+    VulkanSubmission submission = {};
+    submission.commandBufferCount = 1;
+    submission.commandBuffers     = &commandBuffer;
+
+    if (computeWait.value > 0)
+    {
+        submission.waitCount = 1;
+        submission.waits     = &computeWait;
+    }
+
+    graphicsWait.value = m_scheduler->Submit(VK_QUEUE_TYPE_COMPUTE, submission);
+    graphicsWait.stage = m_consumerStages;
+
+    m_passCount = 0;
+
+    return graphicsWait;
+}
+
+float VulkanAsyncCompute::FrameTime() const
+{
+    return m_isDedicatedQueue ? m_profiler.FrameTime() : 0.0f;
+}
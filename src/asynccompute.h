@@ -0,0 +1,110 @@
+#pragma once
+
+#include "gpuprofiler.h"
+#include "queuescheduler.h"
+
+#define VK_MAX_ASYNC_COMPUTE_FRAMES 4
+#define VK_MAX_COMPUTE_PASS_OUTPUTS 16 // Buffers and images, per pass
+
+// Records the commands of a compute pass.
+using VulkanComputePassFunction = void (*)(VkCommandBuffer commandBuffer, void* userData);
+
+// Buffer range written by a compute pass.
+struct VulkanComputeBufferOutput
+{
+    VkBuffer                         buffer;
+    VkDeviceSize                     offset;
+    VkDeviceSize                     size;
+};
+
+// Image subresource range written by a compute pass. The pass leaves it in 'layout'.
+struct VulkanComputeImageOutput
+{
+    VkImage                          image;
+    VkImageSubresourceRange          range;
+    VkImageLayout                    layout;
+};
+
+// Describes a compute pass whose results are consumed by the graphics queue later in the same frame.
+// The pass must overwrite its outputs entirely: their previous contents are discarded.
+struct VulkanComputePass
+{
+    string_t                         name;           // Points to a string literal
+    VulkanComputePassFunction        record;
+    void*                            userData;
+    VkPipelineStageFlags             consumerStages; // Graphics stages which read the outputs
+
+    uint32_t                         bufferOutputCount;
+    const VulkanComputeBufferOutput* bufferOutputs;
+
+    uint32_t                         imageOutputCount;
+    const VulkanComputeImageOutput*  imageOutputs;
+};
+
+// Executes compute passes on the dedicated compute queue, concurrently with the graphics work of the frame.
+// The passes of a frame are recorded into a single command buffer, which is submitted right before
+// the graphics command buffer. The graphics queue waits for it only at the consumer stages,
+// so graphics work at the other stages overlaps with it. The compute queue waits for the previous frame
+// of the graphics queue, which may still be reading the outputs. If the queue families differ,
+// the ownership of the outputs is transferred to the graphics queue family.
+// If the compute queue is the graphics queue (or async compute is disabled), the passes are recorded
+// into the graphics command buffer instead, followed by a pipeline barrier.
+class VulkanAsyncCompute
+{
+public:
+
+    // 'isDedicatedQueue': 'false' if the compute queue is the graphics queue.
+    // 'timestampPeriod', 'timestampValidBits': of the compute queue family (see VulkanGpuProfiler).
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, VulkanQueueScheduler* scheduler,
+                VulkanGpuProfiler* graphicsProfiler, const uint32_t computeQueueFamilyIndex,
+                const uint32_t graphicsQueueFamilyIndex, const bool isDedicatedQueue, const uint32_t frameCount,
+                const float timestampPeriod, const uint32_t timestampValidBits);
+    void Destroy();
+
+    // Takes effect at the beginning of the next frame.
+    void Enable(const bool enable);
+
+    // Returns 'true' if the passes of the current frame execute on the dedicated compute queue.
+    bool IsAsync() const;
+
+    // Must be called when recording of the frame in the slot 'frameIndex' begins.
+    // The GPU must have finished executing the frame which previously used the slot.
+    void BeginFrame(const uint32_t frameIndex);
+
+    // The descriptor set is bound (as set 0, to the compute bind point) at the beginning
+    // of the command buffer of the compute queue.
+    void SetGlobalDescriptorSet(VkPipelineLayout layout, VkDescriptorSet set);
+
+    // Records the pass. Also records the acquisition of its outputs into the graphics command buffer,
+    // so the graphics commands recorded afterwards may consume them.
+    void AddPass(VkCommandBuffer graphicsCommandBuffer, const VulkanComputePass& pass);
+
+    // Submits the passes of the frame. Must be called before the graphics command buffer is submitted.
+    // Returns the dependency of the graphics submission (with 'value == 0' if there is none).
+    VulkanTimelineWait Submit();
+
+    // Returns the GPU time (in milliseconds) of the compute queue for the most recent frame
+    // for which the results are available.
+    float FrameTime() const;
+
+private:
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VulkanQueueScheduler*        m_scheduler;
+    VulkanGpuProfiler*           m_graphicsProfiler;
+    VulkanGpuProfiler            m_profiler;
+    uint32_t                     m_computeQueueFamilyIndex;
+    uint32_t                     m_graphicsQueueFamilyIndex;
+    bool                         m_isDedicatedQueue;
+    bool                         m_isEnabled;
+    bool                         m_isAsync;
+    uint32_t                     m_frameCount;
+    uint32_t                     m_frameIndex;
+    VkCommandPool                m_commandPools[VK_MAX_ASYNC_COMPUTE_FRAMES]; // Reset at the beginning of the frame
+    VkCommandBuffer              m_commandBuffers[VK_MAX_ASYNC_COMPUTE_FRAMES];
+    uint32_t                     m_passCount;      // Of the current frame
+    VkPipelineStageFlags         m_consumerStages; // Of the current frame
+    VkPipelineLayout             m_globalLayout;   // Optional
+    VkDescriptorSet              m_globalSet;
+};
@@ -0,0 +1,456 @@
+#include "asyncuploader.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+#define VK_ASYNC_UPLOAD_STAGING_ALIGNMENT 16
+
+static VkDeviceSize LeastCommonMultiple(const VkDeviceSize a, const VkDeviceSize b)
+{
+    VkDeviceSize x = a, y = b;
+
+    while (y != 0)
+    {
+        const VkDeviceSize r = x % y;
+
+        x = y;
+        y = r;
+    }
+
+    return a / x * b;
+}
+
+void VulkanAsyncUploader::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                 VulkanMemoryAllocator* memoryAllocator, VulkanQueueScheduler* scheduler,
+                                 const VkPhysicalDeviceLimits& limits, const uint32_t transferQueueFamilyIndex,
+                                 const uint32_t graphicsQueueFamilyIndex, const VkDeviceSize stagingSize)
+{
+    m_device                   = device;
+    m_allocator                = allocator;
+    m_memoryAllocator          = memoryAllocator;
+    m_scheduler                = scheduler;
+    m_transferQueueFamilyIndex = transferQueueFamilyIndex;
+    m_graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+    m_copyOffsetAlignment      = std::max(limits.optimalBufferCopyOffsetAlignment, VkDeviceSize{ 1 });
+    m_renderThread             = std::this_thread::get_id();
+    m_recordIndex              = 0;
+    m_retireIndex              = 0;
+    m_nextSerial               = 1;
+    m_stagingSize              = stagingSize;
+    m_stagingHead              = 0;
+    m_stagingTail              = 0;
+    m_acquireSerial            = 0;
+    m_acquireValue             = 0;
+    m_acquiredSerial           = 0;
+
+    // Command buffers are reset individually, when their batch is recorded again.
+    VkCommandPoolCreateInfo commandPoolInfo = {};
+    commandPoolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                                       VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolInfo.queueFamilyIndex = m_transferQueueFamilyIndex;
+
+    CHECK_INT(vkCreateCommandPool(m_device, &commandPoolInfo, m_allocator, &m_commandPool),
+              "Failed to create a command pool.");
+
+    VkCommandBufferAllocateInfo commandBufferInfo = {};
+    commandBufferInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.commandPool        = m_commandPool;
+    commandBufferInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandBufferCount = 1;
+
+    for (Batch& batch : m_batches)
+    {
+        CHECK_INT(vkAllocateCommandBuffers(m_device, &commandBufferInfo, &batch.commandBuffer),
+                  "Failed to allocate a command buffer.");
+
+        batch.state         = BATCH_FREE;
+        batch.serial        = 0;
+        batch.timelineValue = 0;
+        batch.stagingEnd    = 0;
+    }
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size               = m_stagingSize;
+    bufferInfo.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    CHECK_INT(m_memoryAllocator->CreateBuffer(bufferInfo, VK_MEMORY_USAGE_CPU_TO_GPU, nullptr,
+                                              &m_stagingBuffer, &m_stagingAllocation),
+              "Failed to create the staging buffer.");
+}
+
+void VulkanAsyncUploader::Destroy()
+{
+    // Copies which have not been submitted are discarded.
+    m_scheduler->WaitForCompletion(VK_QUEUE_TYPE_TRANSFER, m_scheduler->LastSubmittedValue(VK_QUEUE_TYPE_TRANSFER));
+
+    // Destroying the pool also frees its command buffers.
+    vkDestroyCommandPool(m_device, m_commandPool, m_allocator);
+    m_commandPool = VK_NULL_HANDLE;
+
+    m_memoryAllocator->DestroyBuffer(m_stagingBuffer, m_stagingAllocation);
+    m_stagingBuffer = VK_NULL_HANDLE;
+
+    for (Batch& batch : m_batches)
+    {
+        batch.bufferBarriers.clear();
+        batch.imageBarriers.clear();
+    }
+
+    m_acquireBufferBarriers.clear();
+    m_acquireImageBarriers.clear();
+}
+
+void VulkanAsyncUploader::Retire()
+{
+    const uint64_t completedValue = m_scheduler->CompletedValue(VK_QUEUE_TYPE_TRANSFER);
+
+    // Batches complete in the submission order.
+    while (m_batches[m_retireIndex].state == BATCH_SUBMITTED &&
+           m_batches[m_retireIndex].timelineValue <= completedValue)
+    {
+        Batch& batch = m_batches[m_retireIndex];
+
+        // The graphics queue must acquire the resources before using them.
+        m_acquireBufferBarriers.insert(m_acquireBufferBarriers.end(),
+                                       batch.bufferBarriers.begin(), batch.bufferBarriers.end());
+        m_acquireImageBarriers.insert(m_acquireImageBarriers.end(),
+                                      batch.imageBarriers.begin(), batch.imageBarriers.end());
+
+        m_acquireSerial = batch.serial;
+        m_acquireValue  = batch.timelineValue;
+        m_stagingTail   = std::max(m_stagingTail, batch.stagingEnd);
+
+        batch.state = BATCH_FREE;
+        batch.bufferBarriers.clear();
+        batch.imageBarriers.clear();
+
+        m_retireIndex = (m_retireIndex + 1) % VK_MAX_ASYNC_UPLOAD_BATCHES;
+    }
+}
+
+void VulkanAsyncUploader::WaitForOldestBatch(std::unique_lock<std::mutex>& lock)
+{
+    const Batch& batch = m_batches[m_retireIndex];
+
+    assert(batch.state == BATCH_SUBMITTED);
+
+    const uint64_t value = batch.timelineValue;
+
+    // Let the other threads proceed while the transfer queue works.
+    lock.unlock();
+    m_scheduler->WaitForCompletion(VK_QUEUE_TYPE_TRANSFER, value);
+    lock.lock();
+
+    Retire();
+}
+
+VulkanAsyncUploader::Batch& VulkanAsyncUploader::RecordingBatch(std::unique_lock<std::mutex>& lock)
+{
+    for (;;)
+    {
+        Batch& batch = m_batches[m_recordIndex];
+
+        if (batch.state == BATCH_RECORDING) return batch;
+
+        if (batch.state == BATCH_FREE)
+        {
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            // Implicitly resets the command buffer.
+            CHECK_INT(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo),
+                      "Failed to begin recording a command buffer.");
+
+            batch.state      = BATCH_RECORDING;
+            batch.serial     = m_nextSerial++;
+            batch.stagingEnd = m_stagingHead;
+
+            return batch;
+        }
+
+        // All batches are in flight; the next one to record is the oldest one.
+        WaitForOldestBatch(lock);
+    }
+}
+
+uint64_t VulkanAsyncUploader::AllocateStaging(std::unique_lock<std::mutex>& lock, const VkDeviceSize size,
+                                              const VkDeviceSize maxSize, const VkDeviceSize alignment,
+                                              VkDeviceSize* allocatedSize)
+{
+    assert(size <= m_stagingSize && size <= maxSize);
+
+    for (;;)
+    {
+        // Nothing is pending: start over from the beginning of the buffer, so that the padding
+        // skipped at the end does not prevent large allocations.
+        if (m_stagingTail == m_stagingHead)
+        {
+            m_stagingHead = (m_stagingHead + m_stagingSize - 1) / m_stagingSize * m_stagingSize;
+            m_stagingTail = m_stagingHead;
+        }
+
+        // The offset within the buffer is aligned (the alignment does not necessarily divide the size).
+        const uint64_t     base   = m_stagingHead - m_stagingHead % m_stagingSize;
+        const VkDeviceSize offset = (m_stagingHead % m_stagingSize + alignment - 1) / alignment * alignment;
+
+        uint64_t     position   = base + offset;
+        VkDeviceSize contiguous = (offset < m_stagingSize) ? (m_stagingSize - offset) : 0;
+
+        // Allocations do not wrap around the end of the buffer.
+        if (contiguous < size)
+        {
+            position   = base + m_stagingSize;
+            contiguous = m_stagingSize;
+        }
+
+        const uint64_t     used      = position - m_stagingTail;
+        const VkDeviceSize available = (used < m_stagingSize) ? (m_stagingSize - used) : 0;
+        const VkDeviceSize allocated = std::min({ maxSize, contiguous, available });
+
+        if (allocated >= size && allocated > 0)
+        {
+            m_stagingHead  = position + allocated;
+            *allocatedSize = allocated;
+
+            return position % m_stagingSize;
+        }
+
+        // Out of staging memory. Wait for the oldest batch, or submit the current one.
+        const uint64_t tail = m_stagingTail;
+
+        Retire();
+
+        if (m_stagingTail != tail) continue;
+
+        if (m_batches[m_retireIndex].state == BATCH_SUBMITTED)
+        {
+            WaitForOldestBatch(lock);
+        }
+        else if (std::this_thread::get_id() == m_renderThread)
+        {
+            SubmitLocked();
+        }
+        else
+        {
+            m_submitted.wait(lock);
+        }
+
+        // The batch may have changed.
+        RecordingBatch(lock);
+    }
+}
+
+uint64_t VulkanAsyncUploader::UploadBuffer(VkBuffer buffer, const VkDeviceSize offset, const void* data,
+                                           const VkDeviceSize size)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    const byte_t* source = static_cast<const byte_t*>(data);
+
+    uint64_t serial = 0;
+
+    // Large uploads are split into several chunks, so that they can be pipelined.
+    for (VkDeviceSize copied = 0; copied < size;)
+    {
+        RecordingBatch(lock);
+
+        // Accept smaller chunks rather than wait for the staging memory.
+        const VkDeviceSize maxChunkSize = std::min(size - copied, m_stagingSize / 4);
+        const VkDeviceSize minChunkSize = std::min(maxChunkSize, static_cast<VkDeviceSize>(64 << 10));
+
+        VkDeviceSize chunkSize;
+
+        const uint64_t stagingOffset = AllocateStaging(lock, minChunkSize, maxChunkSize,
+                                                       VK_ASYNC_UPLOAD_STAGING_ALIGNMENT, &chunkSize);
+
+        // The lock has been held since the staging memory was allocated, so this is the same batch.
+        Batch& batch = RecordingBatch(lock);
+
+        memcpy(m_stagingAllocation.mapped + stagingOffset, source + copied, chunkSize);
+
+        VkBufferCopy region = {};
+        region.srcOffset    = stagingOffset;
+        region.dstOffset    = offset + copied;
+        region.size         = chunkSize;
+
+        vkCmdCopyBuffer(batch.commandBuffer, m_stagingBuffer, buffer, 1, &region);
+
+        if (m_transferQueueFamilyIndex != m_graphicsQueueFamilyIndex)
+        {
+            // Release the ownership to the graphics queue family.
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask       = 0;
+            barrier.srcQueueFamilyIndex = m_transferQueueFamilyIndex;
+            barrier.dstQueueFamilyIndex = m_graphicsQueueFamilyIndex;
+            barrier.buffer              = buffer;
+            barrier.offset              = region.dstOffset;
+            barrier.size                = region.size;
+
+            vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+            // The matching acquisition.
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+            batch.bufferBarriers.push_back(barrier);
+        }
+
+        batch.stagingEnd = m_stagingHead;
+
+        serial  = batch.serial;
+        copied += chunkSize;
+    }
+
+    return serial;
+}
+
+uint64_t VulkanAsyncUploader::UploadImage(VkImage image, const VkImageSubresourceLayers& subresource,
+                                          const VkExtent3D& extent, const VkDeviceSize texelBlockSize,
+                                          const void* data, const VkDeviceSize size, const VkImageLayout finalLayout)
+{
+    ASSERT(size <= m_stagingSize, "The image is too large for the staging buffer.");
+    assert(texelBlockSize > 0);
+
+    // The buffer offset of a copy to an image must be a multiple of the texel block size and of 4.
+    const VkDeviceSize alignment = LeastCommonMultiple(LeastCommonMultiple(texelBlockSize, 4),
+                                                       m_copyOffsetAlignment);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    RecordingBatch(lock);
+
+    VkDeviceSize allocatedSize;
+
+    const uint64_t stagingOffset = AllocateStaging(lock, size, size, alignment, &allocatedSize);
+
+    Batch& batch = RecordingBatch(lock);
+
+    memcpy(m_stagingAllocation.mapped + stagingOffset, data, size);
+
+    const VkImageSubresourceRange range = { subresource.aspectMask, subresource.mipLevel, 1,
+                                            subresource.baseArrayLayer, subresource.layerCount };
+
+    // The previous contents are discarded.
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask       = 0;
+    barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = image;
+    barrier.subresourceRange    = range;
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset      = stagingOffset;
+    region.imageSubresource  = subresource;
+    region.imageExtent       = extent;
+
+    vkCmdCopyBufferToImage(batch.commandBuffer, m_stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &region);
+
+    // Transition to the final layout. The semaphore signal makes the writes available,
+    // so there is no need for a destination access mask.
+    const bool isOwnershipTransfer = (m_transferQueueFamilyIndex != m_graphicsQueueFamilyIndex);
+
+    barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask       = 0;
+    barrier.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout           = finalLayout;
+    barrier.srcQueueFamilyIndex = isOwnershipTransfer ? m_transferQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = isOwnershipTransfer ? m_graphicsQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (isOwnershipTransfer)
+    {
+        // The matching acquisition must perform the same layout transition.
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+        batch.imageBarriers.push_back(barrier);
+    }
+
+    batch.stagingEnd = m_stagingHead;
+
+    return batch.serial;
+}
+
+bool VulkanAsyncUploader::IsComplete(const uint64_t ticket) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return ticket <= m_acquiredSerial;
+}
+
+void VulkanAsyncUploader::SubmitLocked()
+{
+    Batch& batch = m_batches[m_recordIndex];
+
+    if (batch.state != BATCH_RECORDING) return;
+
+    CHECK_INT(vkEndCommandBuffer(batch.commandBuffer),
+              "Failed to end recording a command buffer.");
+
+    VulkanSubmission submission = {};
+    submission.commandBufferCount = 1;
+    submission.commandBuffers     = &batch.commandBuffer;
+
+    batch.timelineValue = m_scheduler->Submit(VK_QUEUE_TYPE_TRANSFER, submission);
+    batch.state         = BATCH_SUBMITTED;
+
+    m_recordIndex = (m_recordIndex + 1) % VK_MAX_ASYNC_UPLOAD_BATCHES;
+
+    // Wake up the threads waiting for staging memory.
+    m_submitted.notify_all();
+}
+
+void VulkanAsyncUploader::Submit()
+{
+    assert(std::this_thread::get_id() == m_renderThread);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    SubmitLocked();
+}
+
+uint64_t VulkanAsyncUploader::AcquireCompleted(VkCommandBuffer commandBuffer)
+{
+    assert(std::this_thread::get_id() == m_renderThread);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Retire();
+
+    if (m_acquireValue == 0) return 0;
+
+    if (!m_acquireBufferBarriers.empty() || !m_acquireImageBarriers.empty())
+    {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                             0, nullptr,
+                             static_cast<uint32_t>(m_acquireBufferBarriers.size()), m_acquireBufferBarriers.data(),
+                             static_cast<uint32_t>(m_acquireImageBarriers.size()),  m_acquireImageBarriers.data());
+
+        m_acquireBufferBarriers.clear();
+        m_acquireImageBarriers.clear();
+    }
+
+    const uint64_t waitValue = m_acquireValue;
+
+    m_acquiredSerial = m_acquireSerial;
+    m_acquireValue   = 0;
+
+    return waitValue;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "memoryallocator.h"
+#include "queuescheduler.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define VK_ASYNC_UPLOAD_STAGING_SIZE (32u << 20) // Size of the staging ring buffer
+#define VK_MAX_ASYNC_UPLOAD_BATCHES  8           // Batches of copies in flight
+
+// Streams buffer and image data to the device using the transfer queue.
+// Copies are batched, and the batches are submitted once per frame, so that large uploads
+// do not delay the graphics queue. If the transfer queue belongs to a different queue family,
+// the ownership of the resources is released by the transfer queue, and acquired by the graphics queue.
+// Uploads may be issued from any thread. Submit() and AcquireCompleted() must be called by the render thread,
+// which is the thread calling Create().
+class VulkanAsyncUploader
+{
+public:
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, VulkanMemoryAllocator* memoryAllocator,
+                VulkanQueueScheduler* scheduler, const VkPhysicalDeviceLimits& limits,
+                const uint32_t transferQueueFamilyIndex, const uint32_t graphicsQueueFamilyIndex,
+                const VkDeviceSize stagingSize = VK_ASYNC_UPLOAD_STAGING_SIZE);
+    void Destroy();
+
+    // Copy the data into the buffer/image (its entire subresource region). The image ends up in 'finalLayout'.
+    // 'texelBlockSize' is the size of a texel (or of a compressed block) of the format of the image, in bytes.
+    // Return a ticket which can be passed to IsComplete(). Block if the staging memory is exhausted.
+    uint64_t UploadBuffer(VkBuffer buffer, const VkDeviceSize offset, const void* data, const VkDeviceSize size);
+    uint64_t UploadImage(VkImage image, const VkImageSubresourceLayers& subresource, const VkExtent3D& extent,
+                         const VkDeviceSize texelBlockSize, const void* data, const VkDeviceSize size,
+                         const VkImageLayout finalLayout);
+
+    // Returns 'true' once the upload can be used by the graphics queue, i.e. by commands recorded
+    // after the call to AcquireCompleted() which acquired it.
+    bool IsComplete(const uint64_t ticket) const;
+
+    // Submits the copies recorded since the last call to the transfer queue.
+    void Submit();
+
+    // Records the acquisition of the resources whose uploads have completed into the graphics command buffer.
+    // Returns the value of the transfer queue timeline the submission of the command buffer must wait for
+    // (with VK_PIPELINE_STAGE_ALL_COMMANDS_BIT), or 0 if there is nothing to wait for.
+    // The wait does not stall: the transfers have already completed.
+    uint64_t AcquireCompleted(VkCommandBuffer commandBuffer);
+
+private:
+
+    enum BatchState
+    {
+        BATCH_FREE,
+        BATCH_RECORDING,
+        BATCH_SUBMITTED
+    };
+
+    struct Batch
+    {
+        BatchState                         state;
+        VkCommandBuffer                    commandBuffer;
+        uint64_t                           serial;        // Used as the ticket
+        uint64_t                           timelineValue; // Of the transfer queue
+        uint64_t                           stagingEnd;    // Staging memory to reclaim upon completion
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<VkImageMemoryBarrier>  imageBarriers;
+    };
+
+    Batch&   RecordingBatch(std::unique_lock<std::mutex>& lock);
+    uint64_t AllocateStaging(std::unique_lock<std::mutex>& lock, const VkDeviceSize size, const VkDeviceSize maxSize,
+                             const VkDeviceSize alignment, VkDeviceSize* allocatedSize);
+    void     WaitForOldestBatch(std::unique_lock<std::mutex>& lock);
+    void     SubmitLocked();
+    void     Retire();
+
+    VkDevice                           m_device;
+    const VkAllocationCallbacks*       m_allocator;
+    VulkanMemoryAllocator*             m_memoryAllocator;
+    VulkanQueueScheduler*              m_scheduler;
+    uint32_t                           m_transferQueueFamilyIndex;
+    uint32_t                           m_graphicsQueueFamilyIndex;
+    VkDeviceSize                       m_copyOffsetAlignment;
+    std::thread::id                    m_renderThread;
+    VkCommandPool                      m_commandPool;
+    Batch                              m_batches[VK_MAX_ASYNC_UPLOAD_BATCHES];
+    uint32_t                           m_recordIndex;   // Batch which is (or will be) recording
+    uint32_t                           m_retireIndex;   // Oldest submitted batch
+    uint64_t                           m_nextSerial;
+    VkBuffer                           m_stagingBuffer;
+    VulkanAllocation                   m_stagingAllocation;
+    VkDeviceSize                       m_stagingSize;
+    uint64_t                           m_stagingHead;   // Monotonic; modulo the size gives the offset
+    uint64_t                           m_stagingTail;
+    std::vector<VkBufferMemoryBarrier> m_acquireBufferBarriers;
+    std::vector<VkImageMemoryBarrier>  m_acquireImageBarriers;
+    uint64_t                           m_acquireSerial;  // Of the most recent retired batch
+    uint64_t                           m_acquireValue;   // Its timeline value
+    uint64_t                           m_acquiredSerial; // Of the most recent acquired batch
+    mutable std::mutex                 m_mutex;
+    std::condition_variable            m_submitted;
+};
@@ -0,0 +1,713 @@
+#include "benchmarkworkloads.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+static_assert(VK_MAX_GPU_CULLING_FRAMES >= VK_MAX_FRAMES_IN_FLIGHT, "Insufficient number of GPU culling frames.");
+
+// SPIR-V of 'cullingbenchmark.vert', generated at build time.
+static const uint32_t cullingDrawShaderCode[] = {
+    #include "cullingbenchmark.vert.inc"
+};
+
+// The mesh of the instances of the culling workload: a cube in [-1, 1], with the indices after the vertices.
+// Vertex 'v' has the coordinates -1 or 1 according to its bits 0 (X), 1 (Y) and 2 (Z).
+static const float cubeVertices[8][3] = {
+    { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f },
+    { -1.0f, -1.0f,  1.0f }, { 1.0f, -1.0f,  1.0f }, { -1.0f, 1.0f,  1.0f }, { 1.0f, 1.0f,  1.0f }
+};
+
+static const uint16_t cubeIndices[36] = {
+    0, 2, 6, 0, 6, 4, // -X
+    1, 5, 7, 1, 7, 3, // +X
+    0, 4, 5, 0, 5, 1, // -Y
+    2, 3, 7, 2, 7, 6, // +Y
+    0, 1, 3, 0, 3, 2, // -Z
+    4, 6, 7, 4, 7, 5  // +Z
+};
+
+static const VkDeviceSize cubeIndexOffset = sizeof(cubeVertices);
+
+static const uint32_t cubeTriangleCount = sizeof(cubeIndices) / sizeof(cubeIndices[0]) / 3;
+
+static_assert(cubeIndexOffset % sizeof(uint16_t) == 0, "The indices must be aligned.");
+
+void VulkanBenchmarkWorkloads::Create(VulkanRenderBackEnd* backEnd)
+{
+    ASSERT(backEnd->DescriptorAllocator(), "The sync primitives must be created before the workloads.");
+
+    *this = VulkanBenchmarkWorkloads();
+
+    m_backEnd = backEnd;
+    m_backEnd->SetFrameRecordHook(Record, this);
+}
+
+void VulkanBenchmarkWorkloads::Destroy()
+{
+    if (!m_backEnd) return;
+
+    m_backEnd->SetFrameRecordHook(nullptr, nullptr);
+
+    DestroyComputeWorkload();
+    DestroyCullingWorkload();
+
+    m_backEnd = nullptr;
+}
+
+void VulkanBenchmarkWorkloads::Record(VkCommandBuffer commandBuffer, const uint32_t frameIndex, void* userData)
+{
+    VulkanBenchmarkWorkloads* workloads = static_cast<VulkanBenchmarkWorkloads*>(userData);
+
+    if (workloads->m_gpuCulling)
+    {
+        workloads->m_gpuCulling->BeginFrame(frameIndex);
+    }
+
+    if (workloads->m_computeBuffers[0])
+    {
+        workloads->RecordComputeWorkload(commandBuffer);
+    }
+
+    if (workloads->m_recordingDrawCount > 0)
+    {
+        workloads->RecordRecordingWorkload(commandBuffer);
+    }
+
+    if (workloads->m_gpuCulling)
+    {
+        workloads->RecordCullingWorkload(commandBuffer, frameIndex);
+    }
+}
+
+void VulkanBenchmarkWorkloads::SetComputeWorkload(const uint32_t size)
+{
+    DestroyComputeWorkload();
+
+    if (size == 0) return;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size               = size;
+    bufferInfo.usage              = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    bufferInfo.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        CHECK_INT(m_backEnd->MemoryAllocator()->CreateBuffer(bufferInfo, VK_MEMORY_USAGE_GPU_ONLY, nullptr,
+                                                             &m_computeBuffers[i], &m_computeAllocations[i]),
+                  "Failed to create a benchmark buffer.");
+    }
+}
+
+void VulkanBenchmarkWorkloads::DestroyComputeWorkload()
+{
+    if (!m_computeBuffers[0]) return;
+
+    // The buffers may still be in use.
+    m_backEnd->WaitIdle();
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        m_backEnd->MemoryAllocator()->DestroyBuffer(m_computeBuffers[i], m_computeAllocations[i]);
+
+        m_computeBuffers[i]     = VK_NULL_HANDLE;
+        m_computeAllocations[i] = {};
+    }
+}
+
+void VulkanBenchmarkWorkloads::RecordComputeWorkload(VkCommandBuffer commandBuffer)
+{
+    // There are no shaders yet, so both sides are bandwidth-bound fills.
+    // The output of the compute pass is declared as the input of indirect draws,
+    // so the graphics work at the other stages can overlap with it.
+    const VulkanComputeBufferOutput output = { m_computeBuffers[0], 0, VK_WHOLE_SIZE };
+
+    VulkanComputePass pass = {};
+    pass.name              = "Benchmark compute";
+    pass.userData          = &m_computeBuffers[0];
+    pass.consumerStages    = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    pass.bufferOutputCount = 1;
+    pass.bufferOutputs     = &output;
+    pass.record            = [](VkCommandBuffer commandBuffer, void* userData)
+    {
+        vkCmdFillBuffer(commandBuffer, *static_cast<VkBuffer*>(userData), 0, VK_WHOLE_SIZE, 0);
+    };
+
+    m_backEnd->AddComputePass(pass);
+
+    m_backEnd->GpuProfiler()->BeginScope(commandBuffer, "Benchmark graphics");
+    vkCmdFillBuffer(commandBuffer, m_computeBuffers[1], 0, VK_WHOLE_SIZE, 0);
+    m_backEnd->GpuProfiler()->EndScope(commandBuffer);
+}
+
+void VulkanBenchmarkWorkloads::SetRecordingWorkload(const uint32_t drawCount)
+{
+    m_recordingDrawCount = drawCount;
+}
+
+void VulkanBenchmarkWorkloads::RecordRecordingWorkload(VkCommandBuffer commandBuffer)
+{
+    // Read by the workers.
+    m_recordingExtent = m_backEnd->SwapChainDimensions();
+
+    m_backEnd->GpuProfiler()->BeginScope(commandBuffer, "Benchmark recording");
+
+    // There are no pipelines yet, so each item only sets the dynamic state of a draw.
+    m_backEnd->RecordParallel(m_recordingDrawCount, 256, [](VkCommandBuffer commandBuffer, const uint32_t begin,
+                                                            const uint32_t end, void* userData)
+    {
+        const VkExtent2D& extent = *static_cast<const VkExtent2D*>(userData);
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(extent.width),
+                                          static_cast<float>(extent.height), 0.0f, 1.0f };
+            const VkRect2D   scissor  = { { 0, 0 }, extent };
+
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+            vkCmdSetStencilReference(commandBuffer, VK_STENCIL_FACE_FRONT_AND_BACK, i & 0xFF);
+        }
+    }, &m_recordingExtent);
+
+    m_backEnd->GpuProfiler()->EndScope(commandBuffer);
+}
+
+void VulkanBenchmarkWorkloads::SetCullingWorkload(const uint32_t instanceCount, const VulkanCullingDrawPath drawPath)
+{
+    DestroyCullingWorkload();
+
+    if (instanceCount == 0) return;
+
+    TRACE_FUNCTION();
+
+    VkDevice                      device          = m_backEnd->Device();
+    const VkAllocationCallbacks*  allocator       = m_backEnd->AllocationCallbacks();
+    VulkanMemoryAllocator*        memoryAllocator = m_backEnd->MemoryAllocator();
+    const VulkanDeviceProperties& dp              = m_backEnd->DeviceProperties();
+    const VkExtent2D              dimensions      = m_backEnd->SwapChainDimensions();
+
+    // The depth the instances are culled against is synthetic (see below). The draws have a depth buffer
+    // of the same size, which is not presented.
+    const uint32_t depthWidth  = 1280;
+    const uint32_t depthHeight = std::max(depthWidth * dimensions.height / dimensions.width, 1u);
+
+    m_cullingExtent = { depthWidth, depthHeight };
+
+    m_depthPyramid = new VulkanDepthPyramid;
+    m_depthPyramid->Create(device, allocator, memoryAllocator, m_backEnd->DescriptorAllocator(),
+                           m_backEnd->GpuProfiler(), m_backEnd->PipelineCache(), depthWidth, depthHeight);
+
+    // All the supported features are enabled. Those of the draw paths before 'drawPath' are hidden.
+    const bool drawIndirectCount = (drawPath <= VK_CULLING_DRAW_PATH_COUNT) &&
+                                   dp.physicalDeviceFeatures12.drawIndirectCount;
+    const bool multiDrawIndirect = (drawPath <= VK_CULLING_DRAW_PATH_MULTI) &&
+                                   dp.physicalDeviceFeatures.multiDrawIndirect;
+
+    m_gpuCulling = new VulkanGpuCulling;
+    m_gpuCulling->Create(device, allocator, memoryAllocator, m_backEnd->GpuProfiler(), m_depthPyramid,
+                         m_backEnd->PipelineCache(), instanceCount, m_backEnd->FrameCount(), drawIndirectCount,
+                         multiDrawIndirect, dp.physicalDeviceProperties.limits.maxDrawIndirectCount);
+    m_gpuCulling->SetInstanceCount(instanceCount);
+
+    // Deterministic, so that the runs are comparable. The frustum covers a fraction of the cube,
+    // so the instances are culled by all of its planes.
+    std::vector<VulkanGpuInstance> instances(instanceCount);
+
+    uint32_t seed = 1;
+
+    const auto random = [&seed](const float min, const float max)
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+        return min + (max - min) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+    };
+
+    // Without 'drawIndirectFirstInstance', the draws cannot select their instance: they all read the attributes
+    // of the first one, which still draws the same number of primitives.
+    const bool isFirstInstanceSupported = dp.physicalDeviceFeatures.drawIndirectFirstInstance;
+
+    for (uint32_t i = 0; i < instanceCount; i++)
+    {
+        VulkanGpuInstance& instance = instances[i];
+        instance.center[0]     = random(-250.0f, 250.0f);
+        instance.center[1]     = random(-250.0f, 250.0f);
+        instance.center[2]     = random(-250.0f, 250.0f);
+        instance.radius        = random(0.5f, 2.0f);
+        instance.indexCount    = 36; // A cube
+        instance.firstIndex    = 0;
+        instance.vertexOffset  = 0;
+        instance.firstInstance = isFirstInstanceSupported ? i : 0;
+    }
+
+    // Camera at the origin, looking down +Z.
+    const float zNear = 0.1f;
+    const float zFar  = 500.0f;
+
+    const Mat4    projection = Perspective(1.0471976f, static_cast<float>(dimensions.width) /
+                                                       static_cast<float>(dimensions.height), zNear, zFar);
+    const Frustum frustum    = ExtractFrustum(projection);
+
+    for (uint32_t p = 0; p < 6; p++)
+    {
+        StoreVec4(m_cullingView.planes[p], frustum.planes[p]);
+    }
+
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        StoreVec4(m_cullingView.viewProjection[c], projection.c[c]);
+    }
+
+    // A wall at Z = 100 covers the left 60% of the depth of the previous frame (the early phase),
+    // and the right 60% of the depth of the early draws (the late phase): the instances behind
+    // the middle are culled by both, and those behind the sides are found visible again by the late phase.
+    const float wallDepth = (zFar / (zFar - zNear)) * (1.0f - zNear / 100.0f);
+
+    std::vector<float> depths[VK_GPU_CULLING_PHASE_COUNT];
+    std::vector<float> pyramids[VK_GPU_CULLING_PHASE_COUNT];
+
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        const uint32_t wallBegin = (p == VK_GPU_CULLING_EARLY) ? 0                  : depthWidth * 2 / 5;
+        const uint32_t wallEnd   = (p == VK_GPU_CULLING_EARLY) ? depthWidth * 3 / 5 : depthWidth;
+
+        depths[p].resize(depthWidth * depthHeight);
+
+        for (uint32_t y = 0; y < depthHeight; y++)
+        {
+            for (uint32_t x = 0; x < depthWidth; x++)
+            {
+                depths[p][y * depthWidth + x] = (x >= wallBegin && x < wallEnd) ? wallDepth : 1.0f;
+            }
+        }
+
+        VulkanDepthPyramid::BuildReference(depths[p].data(), depthWidth, depthHeight, &pyramids[p]);
+
+        // A color image: the transfer queue may not support copies to depth aspects.
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+        imageInfo.format        = VK_FORMAT_R32_SFLOAT;
+        imageInfo.extent        = { depthWidth, depthHeight, 1 };
+        imageInfo.mipLevels     = 1;
+        imageInfo.arrayLayers   = 1;
+        imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        CHECK_INT(memoryAllocator->CreateImage(imageInfo, VK_MEMORY_USAGE_GPU_ONLY, nullptr, &m_cullingDepthImages[p],
+                                               &m_cullingDepthAllocations[p]),
+                  "Failed to create a culling benchmark depth image.");
+
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image            = m_cullingDepthImages[p];
+        viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format           = imageInfo.format;
+        viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        CHECK_INT(vkCreateImageView(device, &viewInfo, allocator, &m_cullingDepthViews[p]),
+                  "Failed to create a view of a culling benchmark depth image.");
+
+        const VkImageSubresourceLayers subresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+
+        m_backEnd->Uploader()->UploadImage(m_cullingDepthImages[p], subresource, imageInfo.extent, sizeof(float),
+                                           depths[p].data(), depths[p].size() * sizeof(float),
+                                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    // Tolerances of the comparison with the GPU: a few ULPs of the coordinates (up to 250 units from the origin)
+    // for the plane distances, and of the depth (in [0, 1]) for the occlusion tests.
+    const float planeEpsilon = 1e-3f;
+    const float depthEpsilon = 1e-5f;
+
+    // Without pyramids, everything in the frustum is found visible by the early phase.
+    VulkanGpuCulling::CountVisibleInstances(instances.data(), instanceCount, m_cullingView, nullptr, nullptr,
+                                            depthWidth, depthHeight, 0.0f, 0.0f, m_cullingExpectedCounts,
+                                            &m_cullingBoundaryCount);
+
+    m_cullingFrustumCount = m_cullingExpectedCounts[VK_GPU_CULLING_EARLY];
+
+    VulkanGpuCulling::CountVisibleInstances(instances.data(), instanceCount, m_cullingView,
+                                            pyramids[VK_GPU_CULLING_EARLY].data(),
+                                            pyramids[VK_GPU_CULLING_LATE].data(), depthWidth, depthHeight,
+                                            planeEpsilon, depthEpsilon, m_cullingExpectedCounts,
+                                            &m_cullingBoundaryCount);
+
+    CreateCullingDraws();
+
+    // The data is copied to the staging memory right away. The tickets are completed in order,
+    // so the mesh is complete along with the instances.
+    m_backEnd->Uploader()->UploadBuffer(m_cullingMeshBuffer, 0, cubeVertices, sizeof(cubeVertices));
+    m_backEnd->Uploader()->UploadBuffer(m_cullingMeshBuffer, cubeIndexOffset, cubeIndices, sizeof(cubeIndices));
+
+    m_cullingUploadTicket = m_backEnd->Uploader()->UploadBuffer(m_gpuCulling->InstanceBuffer(), 0, instances.data(),
+                                                                instanceCount * sizeof(VulkanGpuInstance));
+}
+
+void VulkanBenchmarkWorkloads::CreateCullingDraws()
+{
+    VkDevice                      device          = m_backEnd->Device();
+    const VkAllocationCallbacks*  allocator       = m_backEnd->AllocationCallbacks();
+    VulkanMemoryAllocator*        memoryAllocator = m_backEnd->MemoryAllocator();
+    const VulkanDeviceProperties& dp              = m_backEnd->DeviceProperties();
+
+    // The draws are depth-only, and the depth buffer is never sampled: D16 is supported as a depth attachment
+    // by all the implementations.
+    const VkFormat depthFormat = VK_FORMAT_D16_UNORM;
+
+    VkShaderModuleCreateInfo shaderInfo = {};
+    shaderInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderInfo.codeSize = sizeof(cullingDrawShaderCode);
+    shaderInfo.pCode    = cullingDrawShaderCode;
+
+    CHECK_INT(vkCreateShaderModule(device, &shaderInfo, allocator, &m_cullingShaderModule),
+              "Failed to create the culling benchmark shader module.");
+
+    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                                    sizeof(m_cullingView.viewProjection) };
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges    = &pushConstantRange;
+
+    CHECK_INT(vkCreatePipelineLayout(device, &layoutInfo, allocator, &m_cullingPipelineLayout),
+              "Failed to create the culling benchmark pipeline layout.");
+
+    // The early draws clear the depth, and the late draws add to it. Both passes are compatible,
+    // so they share the framebuffer and the pipeline.
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        const bool isEarly = (p == VK_GPU_CULLING_EARLY);
+
+        VkAttachmentDescription attachment = {};
+        attachment.format         = depthFormat;
+        attachment.samples        = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp         = isEarly ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachment.storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout  = isEarly ? VK_IMAGE_LAYOUT_UNDEFINED
+                                            : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        attachment.finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        const VkAttachmentReference depthReference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        // The depth written by the previous passes (of this frame, or of the previous one).
+        VkSubpassDependency dependency = {};
+        dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass    = 0;
+        dependency.srcStageMask  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.dstStageMask  = dependency.srcStageMask;
+        dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments    = &attachment;
+        renderPassInfo.subpassCount    = 1;
+        renderPassInfo.pSubpasses      = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies   = &dependency;
+
+        CHECK_INT(vkCreateRenderPass(device, &renderPassInfo, allocator, &m_cullingRenderPasses[p]),
+                  "Failed to create a culling benchmark render pass.");
+    }
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+    imageInfo.format        = depthFormat;
+    imageInfo.extent        = { m_cullingExtent.width, m_cullingExtent.height, 1 };
+    imageInfo.mipLevels     = 1;
+    imageInfo.arrayLayers   = 1;
+    imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage         = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    CHECK_INT(memoryAllocator->CreateImage(imageInfo, VK_MEMORY_USAGE_GPU_ONLY, nullptr, &m_cullingDrawDepthImage,
+                                           &m_cullingDrawDepthAllocation),
+              "Failed to create the culling benchmark depth buffer.");
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image            = m_cullingDrawDepthImage;
+    viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format           = depthFormat;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+    CHECK_INT(vkCreateImageView(device, &viewInfo, allocator, &m_cullingDrawDepthView),
+              "Failed to create a view of the culling benchmark depth buffer.");
+
+    VkFramebufferCreateInfo framebufferInfo = {};
+    framebufferInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass      = m_cullingRenderPasses[VK_GPU_CULLING_EARLY];
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments    = &m_cullingDrawDepthView;
+    framebufferInfo.width           = m_cullingExtent.width;
+    framebufferInfo.height          = m_cullingExtent.height;
+    framebufferInfo.layers          = 1;
+
+    CHECK_INT(vkCreateFramebuffer(device, &framebufferInfo, allocator, &m_cullingFramebuffer),
+              "Failed to create the culling benchmark framebuffer.");
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size        = sizeof(cubeVertices) + sizeof(cubeIndices);
+    bufferInfo.usage       = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    CHECK_INT(memoryAllocator->CreateBuffer(bufferInfo, VK_MEMORY_USAGE_GPU_ONLY, nullptr, &m_cullingMeshBuffer,
+                                            &m_cullingMeshAllocation),
+              "Failed to create the culling benchmark mesh buffer.");
+
+    // Binding 0: the cube; binding 1: the bounding spheres of the instances.
+    VulkanPipelineDescription& description = m_cullingPipelineDescription;
+    description                      = {};
+    description.layout               = m_cullingPipelineLayout;
+    description.stageCount           = 1;
+    description.stages[0]            = { VK_SHADER_STAGE_VERTEX_BIT, m_cullingShaderModule,
+                                         HashBytes(cullingDrawShaderCode, sizeof(cullingDrawShaderCode)), "main" };
+    description.vertexBindingCount   = 2;
+    description.vertexBindings[0]    = { 0, sizeof(cubeVertices[0]), VK_VERTEX_INPUT_RATE_VERTEX };
+    description.vertexBindings[1]    = { 1, sizeof(VulkanGpuInstance), VK_VERTEX_INPUT_RATE_INSTANCE };
+    description.vertexAttributeCount = 2;
+    description.vertexAttributes[0]  = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+    description.vertexAttributes[1]  = { 1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(VulkanGpuInstance, center) };
+    description.topology             = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    description.polygonMode          = VK_POLYGON_MODE_FILL;
+    description.cullMode             = VK_CULL_MODE_NONE;
+    description.frontFace            = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    description.depthTestEnable      = VK_TRUE;
+    description.depthWriteEnable     = VK_TRUE;
+    description.depthCompareOp       = VK_COMPARE_OP_LESS;
+    description.renderPass           = m_cullingRenderPasses[VK_GPU_CULLING_EARLY];
+    description.depthStencilFormat   = depthFormat;
+    description.sampleCount          = VK_SAMPLE_COUNT_1_BIT;
+
+    // Starts the compilation: the draws are skipped until the pipeline is ready.
+    m_backEnd->RequestPipeline(description);
+
+    // The primitives drawn by each frame are counted, to validate the draws against the visible counts.
+    if (dp.physicalDeviceFeatures.pipelineStatisticsQuery)
+    {
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolInfo.queryCount         = m_backEnd->FrameCount();
+        queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT;
+
+        CHECK_INT(vkCreateQueryPool(device, &queryPoolInfo, allocator, &m_cullingQueryPool),
+                  "Failed to create the culling benchmark query pool.");
+    }
+
+    m_cullingDrawnCount = VK_GPU_CULLING_NO_RESULT;
+}
+
+bool VulkanBenchmarkWorkloads::GetCullingResult(uint32_t visibleCounts[VK_GPU_CULLING_PHASE_COUNT],
+                                                uint32_t expectedCounts[VK_GPU_CULLING_PHASE_COUNT],
+                                                uint32_t* frustumCount, uint32_t* boundaryCount,
+                                                uint32_t* drawnCount) const
+{
+    if (!m_gpuCulling) return false;
+
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        const VulkanGpuCullingPhase phase = static_cast<VulkanGpuCullingPhase>(p);
+
+        if (m_gpuCulling->VisibleCount(phase) == VK_GPU_CULLING_NO_RESULT) return false;
+
+        visibleCounts[p]  = m_gpuCulling->VisibleCount(phase);
+        expectedCounts[p] = m_cullingExpectedCounts[p];
+    }
+
+    *frustumCount  = m_cullingFrustumCount;
+    *boundaryCount = m_cullingBoundaryCount;
+    *drawnCount    = m_cullingDrawnCount;
+
+    return true;
+}
+
+void VulkanBenchmarkWorkloads::DestroyCullingWorkload()
+{
+    if (!m_gpuCulling) return;
+
+    // The buffers may still be in use.
+    m_backEnd->WaitIdle();
+
+    // The pipeline belongs to the pipeline state cache, but its compilation reads the shader module
+    // and the render pass.
+    while (!m_backEnd->IsPipelineReady(m_cullingPipelineDescription))
+    {
+        std::this_thread::yield();
+    }
+
+    VkDevice                     device    = m_backEnd->Device();
+    const VkAllocationCallbacks* allocator = m_backEnd->AllocationCallbacks();
+
+    vkDestroyQueryPool(device, m_cullingQueryPool, allocator);
+    vkDestroyFramebuffer(device, m_cullingFramebuffer, allocator);
+    vkDestroyImageView(device, m_cullingDrawDepthView, allocator);
+    m_backEnd->MemoryAllocator()->DestroyImage(m_cullingDrawDepthImage, m_cullingDrawDepthAllocation);
+    m_backEnd->MemoryAllocator()->DestroyBuffer(m_cullingMeshBuffer, m_cullingMeshAllocation);
+
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        vkDestroyRenderPass(device, m_cullingRenderPasses[p], allocator);
+        m_cullingRenderPasses[p] = VK_NULL_HANDLE;
+    }
+
+    vkDestroyPipelineLayout(device, m_cullingPipelineLayout, allocator);
+    vkDestroyShaderModule(device, m_cullingShaderModule, allocator);
+
+    m_cullingQueryPool      = VK_NULL_HANDLE;
+    m_cullingFramebuffer    = VK_NULL_HANDLE;
+    m_cullingDrawDepthView  = VK_NULL_HANDLE;
+    m_cullingDrawDepthImage = VK_NULL_HANDLE;
+    m_cullingMeshBuffer     = VK_NULL_HANDLE;
+    m_cullingPipelineLayout = VK_NULL_HANDLE;
+    m_cullingShaderModule   = VK_NULL_HANDLE;
+
+    for (uint32_t i = 0; i < VK_MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_isCullingQueryRecorded[i] = false;
+    }
+
+    m_gpuCulling->Destroy();
+    m_depthPyramid->Destroy();
+
+    delete m_gpuCulling;
+    delete m_depthPyramid;
+    m_gpuCulling   = nullptr;
+    m_depthPyramid = nullptr;
+
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        vkDestroyImageView(device, m_cullingDepthViews[p], allocator);
+        m_backEnd->MemoryAllocator()->DestroyImage(m_cullingDepthImages[p], m_cullingDepthAllocations[p]);
+
+        m_cullingDepthViews[p]  = VK_NULL_HANDLE;
+        m_cullingDepthImages[p] = VK_NULL_HANDLE;
+    }
+}
+
+void VulkanBenchmarkWorkloads::RecordCullingWorkload(VkCommandBuffer commandBuffer, const uint32_t frameIndex)
+{
+    // The frame which previously used the slot has retired, so its primitives have been counted.
+    if (m_isCullingQueryRecorded[frameIndex])
+    {
+        uint64_t primitiveCount;
+
+        if (vkGetQueryPoolResults(m_backEnd->Device(), m_cullingQueryPool, frameIndex, 1, sizeof(primitiveCount),
+                                  &primitiveCount, sizeof(primitiveCount), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        {
+            m_cullingDrawnCount = static_cast<uint32_t>(primitiveCount / cubeTriangleCount);
+        }
+
+        m_isCullingQueryRecorded[frameIndex] = false;
+    }
+
+    // Never stall on the uploads.
+    if (!m_backEnd->Uploader()->IsComplete(m_cullingUploadTicket)) return;
+
+    // The depth of the previous frame, as if it had been built at the end of it.
+    if (!m_depthPyramid->IsBuilt())
+    {
+        m_depthPyramid->Record(commandBuffer, m_cullingDepthViews[VK_GPU_CULLING_EARLY],
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    m_gpuCulling->RecordCulling(commandBuffer, m_cullingView);
+
+    // Null until the pipeline is compiled: the instances are still culled, and their visible counts read back.
+    const VkPipeline pipeline = m_backEnd->RequestPipeline(m_cullingPipelineDescription);
+
+    const bool isCounted = pipeline && m_cullingQueryPool;
+
+    if (isCounted)
+    {
+        vkCmdResetQueryPool(commandBuffer, m_cullingQueryPool, frameIndex, 1);
+        vkCmdBeginQuery(commandBuffer, m_cullingQueryPool, frameIndex, 0);
+    }
+
+    RecordCullingDraws(commandBuffer, pipeline, VK_GPU_CULLING_EARLY);
+
+    // The instances are culled against a synthetic depth, rather than against that of the draws: the late culling
+    // uses the pyramid of the synthetic depth of the early draws, and the pyramid of the late draws, which serves
+    // the next frame, is the synthetic depth of the previous frame again. The results can thus be compared with
+    // the reference (see VulkanGpuCulling::CountVisibleInstances()).
+    m_depthPyramid->Record(commandBuffer, m_cullingDepthViews[VK_GPU_CULLING_LATE],
+                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    m_gpuCulling->RecordLateCulling(commandBuffer);
+
+    RecordCullingDraws(commandBuffer, pipeline, VK_GPU_CULLING_LATE);
+
+    if (isCounted)
+    {
+        vkCmdEndQuery(commandBuffer, m_cullingQueryPool, frameIndex);
+        m_isCullingQueryRecorded[frameIndex] = true;
+    }
+
+    m_depthPyramid->Record(commandBuffer, m_cullingDepthViews[VK_GPU_CULLING_EARLY],
+                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void VulkanBenchmarkWorkloads::RecordCullingDraws(VkCommandBuffer commandBuffer, VkPipeline pipeline,
+                                                  const VulkanGpuCullingPhase phase)
+{
+    if (!pipeline) return;
+
+    static string_t scopeNames[VK_GPU_CULLING_PHASE_COUNT] = { "Benchmark early draws", "Benchmark late draws" };
+
+    m_backEnd->GpuProfiler()->BeginScope(commandBuffer, scopeNames[phase]);
+
+    VkClearValue clearValue = {};
+    clearValue.depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo beginInfo = {};
+    beginInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    beginInfo.renderPass      = m_cullingRenderPasses[phase];
+    beginInfo.framebuffer     = m_cullingFramebuffer;
+    beginInfo.renderArea      = { { 0, 0 }, m_cullingExtent };
+    beginInfo.clearValueCount = 1;
+    beginInfo.pClearValues    = &clearValue;
+
+    vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    const VkViewport   viewport   = { 0.0f, 0.0f, static_cast<float>(m_cullingExtent.width),
+                                      static_cast<float>(m_cullingExtent.height), 0.0f, 1.0f };
+    const VkRect2D     scissor    = { { 0, 0 }, m_cullingExtent };
+    const VkBuffer     buffers[2] = { m_cullingMeshBuffer, m_gpuCulling->InstanceBuffer() };
+    const VkDeviceSize offsets[2] = { 0, 0 };
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkCmdPushConstants(commandBuffer, m_cullingPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(m_cullingView.viewProjection), m_cullingView.viewProjection);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_cullingMeshBuffer, cubeIndexOffset, VK_INDEX_TYPE_UINT16);
+
+    m_gpuCulling->RecordDraws(commandBuffer, phase);
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    m_backEnd->GpuProfiler()->EndScope(commandBuffer);
+}
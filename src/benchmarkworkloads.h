@@ -0,0 +1,98 @@
+#pragma once
+
+#include "gpuculling.h"
+#include "renderbackend.h"
+
+// How the culling workload draws the visible instances (see VulkanGpuCulling). The GPU is asked for
+// the first path it supports, starting from the given one, so that the fallbacks can be measured on any GPU.
+enum VulkanCullingDrawPath : uint32_t
+{
+    VK_CULLING_DRAW_PATH_COUNT,  // vkCmdDrawIndexedIndirectCount() of the compacted draws
+    VK_CULLING_DRAW_PATH_MULTI,  // A multi-draw of all the draws, the culled ones without instances
+    VK_CULLING_DRAW_PATH_SINGLE  // A draw call per instance
+};
+
+// Synthetic GPU workloads, used to measure parts of the back-end in isolation. They are recorded at the beginning
+// of every frame, through the frame record hook of the back-end (see VulkanRenderBackEnd::SetFrameRecordHook()).
+// Each workload is disabled until its Set*() function is called with a non-zero size.
+class VulkanBenchmarkWorkloads
+{
+public:
+
+    // Installs the frame record hook. 'backEnd' must outlive the workloads, and its sync primitives must be created.
+    void Create(VulkanRenderBackEnd* backEnd);
+
+    // Removes the hook, and destroys the workloads. Must be called before the sync primitives are destroyed.
+    void Destroy();
+
+    // Adds a compute pass, and graphics work it can overlap with, each writing 'size' bytes of memory.
+    // Used to measure the benefit of async compute. 0 removes it. Must be called outside of BeginFrame() / EndFrame().
+    void SetComputeWorkload(const uint32_t size);
+
+    // Adds 'drawCount' items recorded in parallel, each setting the dynamic state of a draw.
+    // Used to measure the scaling of command recording. 0 removes it.
+    void SetRecordingWorkload(const uint32_t drawCount);
+
+    // Adds 'instanceCount' random instances culled against a fixed frustum and a synthetic depth buffer
+    // on the GPU, in two phases (see VulkanGpuCulling), and drawn as depth-only cubes along 'drawPath'.
+    // Used to measure the cost of GPU-driven culling. 0 removes it.
+    // Must be called outside of BeginFrame() / EndFrame().
+    void SetCullingWorkload(const uint32_t instanceCount, const VulkanCullingDrawPath drawPath);
+
+    // Returns 'false' until the GPU has culled the instances of the workload at least once.
+    // Per phase (see VulkanGpuCullingPhase): 'visibleCounts': found by the GPU, 'expectedCounts': computed
+    // on the CPU. 'frustumCount': the number of instances in the frustum, for reference. 'boundaryCount':
+    // the number of instances the GPU may classify differently (see VulkanGpuCulling::CountVisibleInstances()).
+    // 'drawnCount': the number of instances drawn by both phases of the same frame, which should be the sum of
+    // its visible counts, or VK_GPU_CULLING_NO_RESULT without pipeline statistics queries.
+    bool GetCullingResult(uint32_t visibleCounts[VK_GPU_CULLING_PHASE_COUNT],
+                          uint32_t expectedCounts[VK_GPU_CULLING_PHASE_COUNT],
+                          uint32_t* frustumCount, uint32_t* boundaryCount, uint32_t* drawnCount) const;
+
+private:
+
+    // The frame record hook.
+    static void Record(VkCommandBuffer commandBuffer, const uint32_t frameIndex, void* userData);
+
+    void DestroyComputeWorkload();
+    void CreateCullingDraws();
+    void DestroyCullingWorkload();
+
+    void RecordComputeWorkload(VkCommandBuffer commandBuffer);
+    void RecordRecordingWorkload(VkCommandBuffer commandBuffer);
+    void RecordCullingWorkload(VkCommandBuffer commandBuffer, const uint32_t frameIndex);
+    void RecordCullingDraws(VkCommandBuffer commandBuffer, VkPipeline pipeline, const VulkanGpuCullingPhase phase);
+
+    VulkanRenderBackEnd*         m_backEnd;
+
+    VkBuffer                     m_computeBuffers[2];     // Written by the compute and the graphics work, respectively
+    VulkanAllocation             m_computeAllocations[2];
+
+    uint32_t                     m_recordingDrawCount;
+    VkExtent2D                   m_recordingExtent;       // Of the viewport and scissor of the draws
+
+    VulkanGpuCulling*            m_gpuCulling;            // Optional
+    VulkanDepthPyramid*          m_depthPyramid;          // Of the culling workload
+    VkImage                      m_cullingDepthImages[VK_GPU_CULLING_PHASE_COUNT]; // Synthetic depth of each phase
+    VkImageView                  m_cullingDepthViews[VK_GPU_CULLING_PHASE_COUNT];
+    VulkanAllocation             m_cullingDepthAllocations[VK_GPU_CULLING_PHASE_COUNT];
+    VulkanCullingView            m_cullingView;
+    uint64_t                     m_cullingUploadTicket;   // The instances can be culled once the uploads are complete
+    uint32_t                     m_cullingExpectedCounts[VK_GPU_CULLING_PHASE_COUNT];
+    uint32_t                     m_cullingFrustumCount;
+    uint32_t                     m_cullingBoundaryCount;  // Instances within the tolerance of the reference
+    VkShaderModule               m_cullingShaderModule;   // Of the draws
+    VkPipelineLayout             m_cullingPipelineLayout;
+    VkRenderPass                 m_cullingRenderPasses[VK_GPU_CULLING_PHASE_COUNT]; // Clears, and keeps the depth
+    VkImage                      m_cullingDrawDepthImage; // Written by the draws
+    VkImageView                  m_cullingDrawDepthView;
+    VulkanAllocation             m_cullingDrawDepthAllocation;
+    VkFramebuffer                m_cullingFramebuffer;
+    VkExtent2D                   m_cullingExtent;         // Of the depth images
+    VkBuffer                     m_cullingMeshBuffer;     // The vertices, then the indices of the cube
+    VulkanAllocation             m_cullingMeshAllocation;
+    VulkanPipelineDescription    m_cullingPipelineDescription;
+    VkQueryPool                  m_cullingQueryPool;      // Primitives drawn by each frame slot (optional)
+    bool                         m_isCullingQueryRecorded[VK_MAX_FRAMES_IN_FLIGHT];
+    uint32_t                     m_cullingDrawnCount;     // Of the most recent frame which has retired
+};
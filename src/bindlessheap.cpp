@@ -0,0 +1,298 @@
+#include "bindlessheap.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+static const VkDescriptorType descriptorTypes[VK_BINDLESS_TYPE_COUNT] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_SAMPLER
+};
+
+static string_t typeNames[VK_BINDLESS_TYPE_COUNT] = { "sampled images", "storage buffers", "samplers" };
+
+bool VulkanBindlessHeap::IsSupported(const VkPhysicalDeviceVulkan12Features& features)
+{
+    // Samplers are covered by the sampled image feature.
+    return features.descriptorIndexing &&
+           features.runtimeDescriptorArray &&
+           features.descriptorBindingPartiallyBound &&
+           features.descriptorBindingUpdateUnusedWhilePending &&
+           features.descriptorBindingSampledImageUpdateAfterBind &&
+           features.descriptorBindingStorageBufferUpdateAfterBind &&
+           features.shaderSampledImageArrayNonUniformIndexing &&
+           features.shaderStorageBufferArrayNonUniformIndexing;
+}
+
+void VulkanBindlessHeap::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                const VkPhysicalDeviceVulkan12Properties& properties)
+{
+    m_device    = device;
+    m_allocator = allocator;
+
+    m_capacities[VK_BINDLESS_SAMPLED_IMAGE]  = std::min({ VK_BINDLESS_MAX_SAMPLED_IMAGES,
+                                                          properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                                          properties.maxDescriptorSetUpdateAfterBindSampledImages });
+    m_capacities[VK_BINDLESS_STORAGE_BUFFER] = std::min({ VK_BINDLESS_MAX_STORAGE_BUFFERS,
+                                                          properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                                          properties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+    m_capacities[VK_BINDLESS_SAMPLER]        = std::min({ VK_BINDLESS_MAX_SAMPLERS,
+                                                          properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                                          properties.maxDescriptorSetUpdateAfterBindSamplers });
+
+    // Images and buffers also count towards the per-stage limit of resources (samplers do not).
+    const uint32_t maxResources = properties.maxPerStageUpdateAfterBindResources;
+
+    if (m_capacities[VK_BINDLESS_SAMPLED_IMAGE] + m_capacities[VK_BINDLESS_STORAGE_BUFFER] > maxResources)
+    {
+        m_capacities[VK_BINDLESS_SAMPLED_IMAGE]  = std::min(m_capacities[VK_BINDLESS_SAMPLED_IMAGE], maxResources / 2);
+        m_capacities[VK_BINDLESS_STORAGE_BUFFER] = std::min(m_capacities[VK_BINDLESS_STORAGE_BUFFER],
+                                                            maxResources - m_capacities[VK_BINDLESS_SAMPLED_IMAGE]);
+    }
+
+    // The descriptors are written after the set has been bound, and while it is in use by the frames in flight
+    // (which never access the descriptors being written). The slots which are not in use may be left empty.
+    const VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT          |
+                                                 VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                                 VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+    VkDescriptorSetLayoutBinding bindings[VK_BINDLESS_TYPE_COUNT]     = {};
+    VkDescriptorBindingFlags     bindingFlags[VK_BINDLESS_TYPE_COUNT] = {};
+    VkDescriptorPoolSize         poolSizes[VK_BINDLESS_TYPE_COUNT]    = {};
+
+    for (uint32_t t = 0; t < VK_BINDLESS_TYPE_COUNT; t++)
+    {
+        bindings[t].binding         = t;
+        bindings[t].descriptorType  = descriptorTypes[t];
+        bindings[t].descriptorCount = m_capacities[t];
+        bindings[t].stageFlags      = VK_SHADER_STAGE_ALL;
+
+        bindingFlags[t] = bindingFlag;
+
+        poolSizes[t].type            = descriptorTypes[t];
+        poolSizes[t].descriptorCount = m_capacities[t];
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+    bindingFlagsInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount  = VK_BINDLESS_TYPE_COUNT;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+    setLayoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.pNext        = &bindingFlagsInfo;
+    setLayoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    setLayoutInfo.bindingCount = VK_BINDLESS_TYPE_COUNT;
+    setLayoutInfo.pBindings    = bindings;
+
+    CHECK_INT(vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, m_allocator, &m_setLayout),
+              "Failed to create the bindless descriptor set layout.");
+
+    const VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_ALL, 0, VK_BINDLESS_PUSH_CONSTANT_SIZE };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount         = 1;
+    pipelineLayoutInfo.pSetLayouts            = &m_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+
+    CHECK_INT(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout),
+              "Failed to create the bindless pipeline layout.");
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets       = 1;
+    poolInfo.poolSizeCount = VK_BINDLESS_TYPE_COUNT;
+    poolInfo.pPoolSizes    = poolSizes;
+
+    CHECK_INT(vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, &m_pool),
+              "Failed to create the bindless descriptor pool.");
+
+    VkDescriptorSetAllocateInfo setInfo = {};
+    setInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool     = m_pool;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts        = &m_setLayout;
+
+    CHECK_INT(vkAllocateDescriptorSets(m_device, &setInfo, &m_set),
+              "Failed to allocate the bindless descriptor set.");
+
+    // Hand out the lowest indices first, to keep the used part of the arrays compact.
+    for (uint32_t t = 0; t < VK_BINDLESS_TYPE_COUNT; t++)
+    {
+        m_freeSlots[t].resize(m_capacities[t]);
+
+        for (uint32_t i = 0; i < m_capacities[t]; i++)
+        {
+            m_freeSlots[t][i] = m_capacities[t] - 1 - i;
+        }
+
+        m_peakCounts[t] = 0;
+    }
+
+    PrintInfo("Bindless heap: %u sampled images, %u storage buffers, %u samplers.",
+              m_capacities[VK_BINDLESS_SAMPLED_IMAGE], m_capacities[VK_BINDLESS_STORAGE_BUFFER],
+              m_capacities[VK_BINDLESS_SAMPLER]);
+}
+
+void VulkanBindlessHeap::Destroy()
+{
+    PrintInfo("Bindless heap: peak usage %u sampled images, %u storage buffers, %u samplers.",
+              m_peakCounts[VK_BINDLESS_SAMPLED_IMAGE], m_peakCounts[VK_BINDLESS_STORAGE_BUFFER],
+              m_peakCounts[VK_BINDLESS_SAMPLER]);
+
+    // Destroying the pool also frees the set.
+    vkDestroyDescriptorPool(m_device,      m_pool,           m_allocator);
+    vkDestroyPipelineLayout(m_device,      m_pipelineLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout,      m_allocator);
+
+    for (std::vector<uint32_t>& freeSlots : m_freeSlots)
+    {
+        freeSlots.clear();
+    }
+
+    m_removals.clear();
+}
+
+uint32_t VulkanBindlessHeap::AllocateSlot(const VulkanBindlessType type)
+{
+    std::vector<uint32_t>& freeSlots = m_freeSlots[type];
+
+    if (freeSlots.empty())
+    {
+        PrintWarning("Bindless heap: out of %s (%u).", typeNames[type], m_capacities[type]);
+        return VK_BINDLESS_INVALID_INDEX;
+    }
+
+    const uint32_t index = freeSlots.back();
+    freeSlots.pop_back();
+
+    m_peakCounts[type] = std::max(m_peakCounts[type], m_capacities[type] - static_cast<uint32_t>(freeSlots.size()));
+
+    return index;
+}
+
+uint32_t VulkanBindlessHeap::AddSampledImage(VkImageView view, const VkImageLayout layout)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint32_t index = AllocateSlot(VK_BINDLESS_SAMPLED_IMAGE);
+
+    if (index == VK_BINDLESS_INVALID_INDEX) return index;
+
+    const VkDescriptorImageInfo imageInfo = { VK_NULL_HANDLE, view, layout };
+
+    VkWriteDescriptorSet write = {};
+    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet          = m_set;
+    write.dstBinding      = VK_BINDLESS_SAMPLED_IMAGE;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo      = &imageInfo;
+
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+    return index;
+}
+
+uint32_t VulkanBindlessHeap::AddStorageBuffer(VkBuffer buffer, const VkDeviceSize offset, const VkDeviceSize range)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint32_t index = AllocateSlot(VK_BINDLESS_STORAGE_BUFFER);
+
+    if (index == VK_BINDLESS_INVALID_INDEX) return index;
+
+    const VkDescriptorBufferInfo bufferInfo = { buffer, offset, range };
+
+    VkWriteDescriptorSet write = {};
+    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet          = m_set;
+    write.dstBinding      = VK_BINDLESS_STORAGE_BUFFER;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo     = &bufferInfo;
+
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+    return index;
+}
+
+uint32_t VulkanBindlessHeap::AddSampler(VkSampler sampler)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint32_t index = AllocateSlot(VK_BINDLESS_SAMPLER);
+
+    if (index == VK_BINDLESS_INVALID_INDEX) return index;
+
+    const VkDescriptorImageInfo imageInfo = { sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+
+    VkWriteDescriptorSet write = {};
+    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet          = m_set;
+    write.dstBinding      = VK_BINDLESS_SAMPLER;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType  = VK_DESCRIPTOR_TYPE_SAMPLER;
+    write.pImageInfo      = &imageInfo;
+
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void VulkanBindlessHeap::Remove(const VulkanBindlessType type, const uint32_t index, const uint64_t frameSerial)
+{
+    assert(index < m_capacities[type]);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    assert(m_removals.empty() || m_removals.back().frameSerial <= frameSerial);
+
+    // The descriptor is left as is: the frames in flight may still access it.
+    m_removals.push_back({ type, index, frameSerial });
+}
+
+void VulkanBindlessHeap::Collect(const uint64_t retiredFrameSerial)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    while (!m_removals.empty() && m_removals.front().frameSerial <= retiredFrameSerial)
+    {
+        const Removal& removal = m_removals.front();
+
+        m_freeSlots[removal.type].push_back(removal.index);
+        m_removals.pop_front();
+    }
+}
+
+void VulkanBindlessHeap::Bind(VkCommandBuffer commandBuffer, const VkPipelineBindPoint bindPoint) const
+{
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, m_pipelineLayout, 0, 1, &m_set, 0, nullptr);
+}
+
+VkPipelineLayout VulkanBindlessHeap::PipelineLayout() const
+{
+    return m_pipelineLayout;
+}
+
+VkDescriptorSetLayout VulkanBindlessHeap::SetLayout() const
+{
+    return m_setLayout;
+}
+
+VkDescriptorSet VulkanBindlessHeap::Set() const
+{
+    return m_set;
+}
+
+uint32_t VulkanBindlessHeap::Capacity(const VulkanBindlessType type) const
+{
+    return m_capacities[type];
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Upper bounds of the descriptor arrays; they are further limited by the device.
+#define VK_BINDLESS_MAX_SAMPLED_IMAGES  (1u << 16)
+#define VK_BINDLESS_MAX_STORAGE_BUFFERS (1u << 16)
+#define VK_BINDLESS_MAX_SAMPLERS        (1u << 10)
+
+// Size of the push constant range of the pipeline layout. 128 bytes are guaranteed by the specification.
+#define VK_BINDLESS_PUSH_CONSTANT_SIZE  128
+
+#define VK_BINDLESS_INVALID_INDEX       UINT32_MAX
+
+// Corresponds to the binding of the descriptor array in the set (and in the shaders).
+enum VulkanBindlessType : uint32_t
+{
+    VK_BINDLESS_SAMPLED_IMAGE,  // layout(set = 0, binding = 0) uniform texture2D images[];
+    VK_BINDLESS_STORAGE_BUFFER, // layout(set = 0, binding = 1) buffer Buffers { ... } buffers[];
+    VK_BINDLESS_SAMPLER,        // layout(set = 0, binding = 2) uniform sampler samplers[];
+    VK_BINDLESS_TYPE_COUNT
+};
+
+// Global descriptor set containing all the resources, which the shaders access by index.
+// The set is allocated once, and bound once per command buffer, together with the pipeline layout
+// shared by all the pipelines. Draws pass the indices of their resources via push constants,
+// so no descriptor sets are allocated, updated or bound on the hot path.
+// The descriptors are written when the resources are added (update-after-bind), and the slots
+// of the removed resources are only reused once the frames in flight which may access them have retired.
+// All the methods may be called from any thread.
+class VulkanBindlessHeap
+{
+public:
+
+    // Returns 'true' if the device supports the required descriptor indexing features.
+    static bool IsSupported(const VkPhysicalDeviceVulkan12Features& features);
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                const VkPhysicalDeviceVulkan12Properties& properties);
+
+    // The GPU must be idle.
+    void Destroy();
+
+    // Return the index of the descriptor, or VK_BINDLESS_INVALID_INDEX if the array is full.
+    // The resource must remain valid until it is removed, and the frame it was removed in has retired.
+    uint32_t AddSampledImage(VkImageView view, const VkImageLayout layout);
+    uint32_t AddStorageBuffer(VkBuffer buffer, const VkDeviceSize offset = 0, const VkDeviceSize range = VK_WHOLE_SIZE);
+    uint32_t AddSampler(VkSampler sampler);
+
+    // The slot is reused once the frame 'frameSerial' has retired.
+    void Remove(const VulkanBindlessType type, const uint32_t index, const uint64_t frameSerial);
+
+    // Recycles the slots removed in the frames up to (and including) 'retiredFrameSerial'.
+    void Collect(const uint64_t retiredFrameSerial);
+
+    // Binds the set as set 0 of the shared pipeline layout.
+    void Bind(VkCommandBuffer commandBuffer, const VkPipelineBindPoint bindPoint) const;
+
+    // Shared by all the pipelines which access the heap. Push constants are visible to all the stages.
+    VkPipelineLayout      PipelineLayout() const;
+    VkDescriptorSetLayout SetLayout()      const;
+    VkDescriptorSet       Set()            const;
+
+    uint32_t Capacity(const VulkanBindlessType type) const;
+
+private:
+
+    struct Removal
+    {
+        VulkanBindlessType type;
+        uint32_t           index;
+        uint64_t           frameSerial;
+    };
+
+    uint32_t AllocateSlot(const VulkanBindlessType type);
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VkDescriptorSetLayout        m_setLayout;
+    VkPipelineLayout             m_pipelineLayout;
+    VkDescriptorPool             m_pool;
+    VkDescriptorSet              m_set;
+    uint32_t                     m_capacities[VK_BINDLESS_TYPE_COUNT];
+    std::vector<uint32_t>        m_freeSlots[VK_BINDLESS_TYPE_COUNT]; // The next slot to use last
+    std::deque<Removal>          m_removals;                         // In the order of the frames
+    uint32_t                     m_peakCounts[VK_BINDLESS_TYPE_COUNT];
+    mutable std::mutex           m_mutex;                            // Guards the slots and the descriptor writes
+};
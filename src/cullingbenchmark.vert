@@ -0,0 +1,17 @@
+#version 450
+
+// Depth-only draws of the instances of the GPU culling benchmark (see VulkanBenchmarkWorkloads): a cube around
+// the bounding sphere of each instance. Compiled to SPIR-V at build time, and embedded into 'benchmarkworkloads.cpp'.
+
+layout(location = 0) in vec3 position; // Of the cube, in [-1, 1]
+layout(location = 1) in vec4 sphere;   // Per instance (VulkanGpuInstance): center (xyz) and radius (w)
+
+layout(push_constant) uniform View
+{
+    mat4 viewProjection;
+};
+
+void main()
+{
+    gl_Position = viewProjection * vec4(sphere.xyz + sphere.w * position, 1.0);
+}
@@ -0,0 +1,353 @@
+#include "cullingkernels.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// The planes, as scalars.
+struct FrustumPlanes
+{
+    float p[6][4];
+};
+
+static FrustumPlanes GetPlanes(const Frustum& frustum)
+{
+    FrustumPlanes planes;
+
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        StoreVec4(planes.p[i], frustum.planes[i]);
+    }
+
+    return planes;
+}
+
+static inline bool IsSphereVisible(const FrustumPlanes& planes, const SphereBoundsSoA& spheres, const uint32_t i)
+{
+    for (uint32_t p = 0; p < 6; p++)
+    {
+        const float* plane = planes.p[p];
+
+        const float distance = plane[0] * spheres.x[i] + plane[1] * spheres.y[i] +
+                               plane[2] * spheres.z[i] + plane[3];
+
+        if (distance < -spheres.radius[i]) return false;
+    }
+
+    return true;
+}
+
+static inline bool IsBoxVisible(const FrustumPlanes& planes, const BoxBoundsSoA& boxes, const uint32_t i)
+{
+    for (uint32_t p = 0; p < 6; p++)
+    {
+        const float* plane = planes.p[p];
+
+        // Distance from the center, and projection of the extents onto the normal.
+        const float distance = plane[0] * boxes.centerX[i] + plane[1] * boxes.centerY[i] +
+                               plane[2] * boxes.centerZ[i] + plane[3];
+        const float radius   = fabsf(plane[0]) * boxes.extentX[i] + fabsf(plane[1]) * boxes.extentY[i] +
+                               fabsf(plane[2]) * boxes.extentZ[i];
+
+        if (distance < -radius) return false;
+    }
+
+    return true;
+}
+
+uint32_t CullSpheresScalar(const Frustum& frustum, const SphereBoundsSoA& spheres, const uint32_t count,
+                           uint32_t* visibleIndices)
+{
+    const FrustumPlanes planes = GetPlanes(frustum);
+
+    uint32_t visibleCount = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (IsSphereVisible(planes, spheres, i))
+        {
+            visibleIndices[visibleCount++] = i;
+        }
+    }
+
+    return visibleCount;
+}
+
+uint32_t CullBoxesScalar(const Frustum& frustum, const BoxBoundsSoA& boxes, const uint32_t count,
+                         uint32_t* visibleIndices)
+{
+    const FrustumPlanes planes = GetPlanes(frustum);
+
+    uint32_t visibleCount = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (IsBoxVisible(planes, boxes, i))
+        {
+            visibleIndices[visibleCount++] = i;
+        }
+    }
+
+    return visibleCount;
+}
+
+#ifdef MAGMA_SIMD_SSE
+
+// MAGMA_SIMD_WIDTH floats, one per object. The comparisons match the scalar ones (NaN included).
+#ifdef MAGMA_SIMD_AVX2
+    using Lanes = __m256;
+
+    static inline Lanes LoadLanes(const float* p)           { return _mm256_loadu_ps(p); }
+    static inline Lanes SplatLanes(const float s)           { return _mm256_set1_ps(s); }
+    static inline Lanes Add(const Lanes a, const Lanes b)   { return _mm256_add_ps(a, b); }
+    static inline Lanes Mul(const Lanes a, const Lanes b)   { return _mm256_mul_ps(a, b); }
+    static inline Lanes Negate(const Lanes a)               { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static inline Lanes And(const Lanes a, const Lanes b)   { return _mm256_and_ps(a, b); }
+    static inline Lanes NotLess(const Lanes a, const Lanes b) { return _mm256_cmp_ps(a, b, _CMP_NLT_UQ); }
+    static inline Lanes AllSet()                            { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static inline uint32_t MoveMask(const Lanes a)          { return static_cast<uint32_t>(_mm256_movemask_ps(a)); }
+#else
+    using Lanes = __m128;
+
+    static inline Lanes LoadLanes(const float* p)           { return _mm_loadu_ps(p); }
+    static inline Lanes SplatLanes(const float s)           { return _mm_set1_ps(s); }
+    static inline Lanes Add(const Lanes a, const Lanes b)   { return _mm_add_ps(a, b); }
+    static inline Lanes Mul(const Lanes a, const Lanes b)   { return _mm_mul_ps(a, b); }
+    static inline Lanes Negate(const Lanes a)               { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+    static inline Lanes And(const Lanes a, const Lanes b)   { return _mm_and_ps(a, b); }
+    static inline Lanes NotLess(const Lanes a, const Lanes b) { return _mm_cmpnlt_ps(a, b); }
+    static inline Lanes AllSet()                            { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static inline uint32_t MoveMask(const Lanes a)          { return static_cast<uint32_t>(_mm_movemask_ps(a)); }
+#endif
+
+// The planes, broadcast to all the lanes.
+struct FrustumLanes
+{
+    Lanes p[6][4];
+    Lanes absNormals[6][3];
+};
+
+static FrustumLanes GetLanes(const FrustumPlanes& planes)
+{
+    FrustumLanes lanes;
+
+    for (uint32_t p = 0; p < 6; p++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            lanes.p[p][c] = SplatLanes(planes.p[p][c]);
+        }
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            lanes.absNormals[p][c] = SplatLanes(fabsf(planes.p[p][c]));
+        }
+    }
+
+    return lanes;
+}
+
+// Writes the indices of the visible objects without branches. The index of an invisible object
+// is overwritten by the next one (or is past the end of the visible ones).
+static inline uint32_t AppendVisible(const uint32_t mask, const uint32_t first, uint32_t visibleCount,
+                                     uint32_t* visibleIndices)
+{
+    for (uint32_t lane = 0; lane < MAGMA_SIMD_WIDTH; lane++)
+    {
+        visibleIndices[visibleCount] = first + lane;
+        visibleCount += (mask >> lane) & 1;
+    }
+
+    return visibleCount;
+}
+
+uint32_t CullSpheres(const Frustum& frustum, const SphereBoundsSoA& spheres, const uint32_t count,
+                     uint32_t* visibleIndices)
+{
+    const FrustumPlanes planes = GetPlanes(frustum);
+    const FrustumLanes  lanes  = GetLanes(planes);
+
+    uint32_t visibleCount = 0;
+    uint32_t i            = 0;
+
+    for (; i + MAGMA_SIMD_WIDTH <= count; i += MAGMA_SIMD_WIDTH)
+    {
+        const Lanes x         = LoadLanes(spheres.x + i);
+        const Lanes y         = LoadLanes(spheres.y + i);
+        const Lanes z         = LoadLanes(spheres.z + i);
+        const Lanes minRadius = Negate(LoadLanes(spheres.radius + i));
+
+        Lanes visible = AllSet();
+
+        for (uint32_t p = 0; p < 6; p++)
+        {
+            const Lanes distance = Add(Add(Add(Mul(lanes.p[p][0], x), Mul(lanes.p[p][1], y)),
+                                           Mul(lanes.p[p][2], z)), lanes.p[p][3]);
+
+            visible = And(visible, NotLess(distance, minRadius));
+        }
+
+        visibleCount = AppendVisible(MoveMask(visible), i, visibleCount, visibleIndices);
+    }
+
+    for (; i < count; i++)
+    {
+        if (IsSphereVisible(planes, spheres, i))
+        {
+            visibleIndices[visibleCount++] = i;
+        }
+    }
+
+    return visibleCount;
+}
+
+uint32_t CullBoxes(const Frustum& frustum, const BoxBoundsSoA& boxes, const uint32_t count,
+                   uint32_t* visibleIndices)
+{
+    const FrustumPlanes planes = GetPlanes(frustum);
+    const FrustumLanes  lanes  = GetLanes(planes);
+
+    uint32_t visibleCount = 0;
+    uint32_t i            = 0;
+
+    for (; i + MAGMA_SIMD_WIDTH <= count; i += MAGMA_SIMD_WIDTH)
+    {
+        const Lanes cx = LoadLanes(boxes.centerX + i);
+        const Lanes cy = LoadLanes(boxes.centerY + i);
+        const Lanes cz = LoadLanes(boxes.centerZ + i);
+        const Lanes ex = LoadLanes(boxes.extentX + i);
+        const Lanes ey = LoadLanes(boxes.extentY + i);
+        const Lanes ez = LoadLanes(boxes.extentZ + i);
+
+        Lanes visible = AllSet();
+
+        for (uint32_t p = 0; p < 6; p++)
+        {
+            const Lanes distance = Add(Add(Add(Mul(lanes.p[p][0], cx), Mul(lanes.p[p][1], cy)),
+                                           Mul(lanes.p[p][2], cz)), lanes.p[p][3]);
+            const Lanes radius   = Add(Add(Mul(lanes.absNormals[p][0], ex), Mul(lanes.absNormals[p][1], ey)),
+                                       Mul(lanes.absNormals[p][2], ez));
+
+            visible = And(visible, NotLess(distance, Negate(radius)));
+        }
+
+        visibleCount = AppendVisible(MoveMask(visible), i, visibleCount, visibleIndices);
+    }
+
+    for (; i < count; i++)
+    {
+        if (IsBoxVisible(planes, boxes, i))
+        {
+            visibleIndices[visibleCount++] = i;
+        }
+    }
+
+    return visibleCount;
+}
+
+#else
+
+uint32_t CullSpheres(const Frustum& frustum, const SphereBoundsSoA& spheres, const uint32_t count,
+                     uint32_t* visibleIndices)
+{
+    return CullSpheresScalar(frustum, spheres, count, visibleIndices);
+}
+
+uint32_t CullBoxes(const Frustum& frustum, const BoxBoundsSoA& boxes, const uint32_t count,
+                   uint32_t* visibleIndices)
+{
+    return CullBoxesScalar(frustum, boxes, count, visibleIndices);
+}
+
+#endif // MAGMA_SIMD_SSE
+
+// Returns the shortest time (in nanoseconds) of several runs of the kernel, and its visible count.
+template <typename Kernel>
+static double TimeKernel(Kernel kernel, uint32_t* visibleCount)
+{
+    using Clock = std::chrono::steady_clock;
+
+    double bestTime = 1e30;
+
+    for (uint32_t run = 0; run < 20; run++)
+    {
+        const Clock::time_point start = Clock::now();
+
+        *visibleCount = kernel();
+
+        const std::chrono::duration<double, std::nano> duration = Clock::now() - start;
+
+        bestTime = std::min(bestTime, duration.count());
+    }
+
+    return bestTime;
+}
+
+void BenchmarkCullingKernels(const uint32_t objectCount)
+{
+    ASSERT(objectCount > 0, "The benchmark requires objects.");
+
+    // Deterministic, so that the runs are comparable. The frustum covers a fraction of the cube.
+    // Arrays: sphere centers (3) and radii, box centers (3) and extents (3).
+    std::vector<float> data(10 * static_cast<size_t>(objectCount));
+
+    uint32_t seed = 1;
+
+    const auto random = [&seed](const float min, const float max)
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+        return min + (max - min) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+    };
+
+    const float* arrays[10];
+
+    for (uint32_t a = 0; a < 10; a++)
+    {
+        float* array = &data[a * static_cast<size_t>(objectCount)];
+
+        const bool isSize = (a == 3 || a >= 7);
+
+        for (uint32_t i = 0; i < objectCount; i++)
+        {
+            array[i] = isSize ? random(0.5f, 2.0f) : random(-250.0f, 250.0f);
+        }
+
+        arrays[a] = array;
+    }
+
+    const SphereBoundsSoA spheres = { arrays[0], arrays[1], arrays[2], arrays[3] };
+    const BoxBoundsSoA    boxes   = { arrays[4], arrays[5], arrays[6], arrays[7], arrays[8], arrays[9] };
+
+    const Frustum frustum = ExtractFrustum(Perspective(1.0471976f, 16.0f / 9.0f, 0.1f, 500.0f));
+
+    std::vector<uint32_t> scalarIndices(objectCount), simdIndices(objectCount);
+
+    PrintInfo("Culling kernels (%u objects, %s, %u objects per iteration):", objectCount, MAGMA_SIMD_NAME,
+              MAGMA_SIMD_WIDTH);
+
+    for (uint32_t kind = 0; kind < 2; kind++)
+    {
+        uint32_t scalarCount, simdCount;
+
+        const double scalarTime = TimeKernel([&]()
+        {
+            return (kind == 0) ? CullSpheresScalar(frustum, spheres, objectCount, scalarIndices.data())
+                               : CullBoxesScalar(frustum, boxes, objectCount, scalarIndices.data());
+        }, &scalarCount);
+
+        const double simdTime = TimeKernel([&]()
+        {
+            return (kind == 0) ? CullSpheres(frustum, spheres, objectCount, simdIndices.data())
+                               : CullBoxes(frustum, boxes, objectCount, simdIndices.data());
+        }, &simdCount);
+
+        const bool isMatch = (scalarCount == simdCount) &&
+                             std::equal(scalarIndices.begin(), scalarIndices.begin() + scalarCount,
+                                        simdIndices.begin());
+
+        PrintInfo("  %s: scalar %6.3f objects/ns | %s %6.3f objects/ns (%5.2fx) | %u visible, %s",
+                  (kind == 0) ? "Spheres" : "Boxes  ", objectCount / scalarTime, MAGMA_SIMD_NAME,
+                  objectCount / simdTime, scalarTime / simdTime, simdCount, isMatch ? "match" : "MISMATCH");
+    }
+}
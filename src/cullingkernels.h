@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vectormath.h"
+
+// Bounding spheres in structure-of-arrays layout, so that the kernels load the same member
+// of MAGMA_SIMD_WIDTH objects at once. The arrays do not have to be aligned or padded.
+struct SphereBoundsSoA
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* radius;
+};
+
+// Axis-aligned bounding boxes in structure-of-arrays layout (see SphereBoundsSoA).
+struct BoxBoundsSoA
+{
+    const float* centerX;
+    const float* centerY;
+    const float* centerZ;
+    const float* extentX; // Half of the size
+    const float* extentY;
+    const float* extentZ;
+};
+
+// Frustum culling kernels. Test the objects [0, 'count') against all the planes of the frustum,
+// write the indices of the visible ones to 'visibleIndices' (in order, which must have room for 'count' indices),
+// and return the number of visible objects. An object intersecting a plane is visible.
+// The SIMD kernels test MAGMA_SIMD_WIDTH objects at a time, branch-free, and perform the same operations
+// in the same order as the scalar ones, so their results are identical. Without SIMD, they are the scalar ones.
+uint32_t CullSpheres(const Frustum& frustum, const SphereBoundsSoA& spheres, const uint32_t count,
+                     uint32_t* visibleIndices);
+uint32_t CullBoxes(const Frustum& frustum, const BoxBoundsSoA& boxes, const uint32_t count,
+                   uint32_t* visibleIndices);
+
+// One object at a time, with an early exit. Used as the baseline of the SIMD kernels.
+uint32_t CullSpheresScalar(const Frustum& frustum, const SphereBoundsSoA& spheres, const uint32_t count,
+                           uint32_t* visibleIndices);
+uint32_t CullBoxesScalar(const Frustum& frustum, const BoxBoundsSoA& boxes, const uint32_t count,
+                         uint32_t* visibleIndices);
+
+// Measures the throughput of the kernels (objects culled per nanosecond) against the scalar baseline,
+// with 'objectCount' random objects, and checks that the results match. Prints a report.
+void BenchmarkCullingKernels(const uint32_t objectCount);
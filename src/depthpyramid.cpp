@@ -0,0 +1,290 @@
+#include "depthpyramid.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+// SPIR-V of 'depthpyramid.comp', generated at build time.
+static const uint32_t pyramidShaderCode[] = {
+    #include "depthpyramid.comp.inc"
+};
+
+// Matches the push constants of the shader.
+struct VulkanDepthPyramidConstants
+{
+    uint32_t sourceSize[2];
+    uint32_t sourceOffset;
+    uint32_t isSourceDepth;
+    uint32_t destinationSize[2];
+    uint32_t destinationOffset;
+};
+
+void VulkanDepthPyramid::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                VulkanMemoryAllocator* memoryAllocator, VulkanDescriptorAllocator* descriptorAllocator,
+                                VulkanGpuProfiler* profiler, VkPipelineCache pipelineCache, const uint32_t width,
+                                const uint32_t height)
+{
+    assert(width > 0 && height > 0);
+
+    m_device              = device;
+    m_allocator           = allocator;
+    m_memoryAllocator     = memoryAllocator;
+    m_descriptorAllocator = descriptorAllocator;
+    m_profiler            = profiler;
+    m_width               = width;
+    m_height              = height;
+    m_isBuilt             = false;
+
+    uint32_t totalSize;
+    m_levelCount = GetLevels(width, height, m_levels, &totalSize);
+
+    const VkShaderStageFlags stage = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    const VkDescriptorSetLayoutBinding bindings[] = {
+        { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stage, nullptr }, // Depth
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }  // Pyramid
+    };
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+    setLayoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+    setLayoutInfo.pBindings    = bindings;
+
+    CHECK_INT(vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, m_allocator, &m_setLayout),
+              "Failed to create the depth pyramid descriptor set layout.");
+
+    const VkPushConstantRange pushConstantRange = { stage, 0, sizeof(VulkanDepthPyramidConstants) };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount         = 1;
+    pipelineLayoutInfo.pSetLayouts            = &m_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+
+    CHECK_INT(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout),
+              "Failed to create the depth pyramid pipeline layout.");
+
+    VkShaderModuleCreateInfo shaderInfo = {};
+    shaderInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderInfo.codeSize = sizeof(pyramidShaderCode);
+    shaderInfo.pCode    = pyramidShaderCode;
+
+    VkShaderModule shader;
+
+    CHECK_INT(vkCreateShaderModule(m_device, &shaderInfo, m_allocator, &shader),
+              "Failed to create the depth pyramid shader module.");
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shader;
+    pipelineInfo.stage.pName  = "main";
+    pipelineInfo.layout       = m_pipelineLayout;
+
+    CHECK_INT(vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, m_allocator, &m_pipeline),
+              "Failed to create the depth pyramid pipeline.");
+
+    // The pipeline keeps the code.
+    vkDestroyShaderModule(m_device, shader, m_allocator);
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter    = VK_FILTER_NEAREST;
+    samplerInfo.minFilter    = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    CHECK_INT(vkCreateSampler(m_device, &samplerInfo, m_allocator, &m_sampler),
+              "Failed to create the depth pyramid sampler.");
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size               = totalSize * sizeof(float);
+    bufferInfo.usage              = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferInfo.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    CHECK_INT(m_memoryAllocator->CreateBuffer(bufferInfo, VK_MEMORY_USAGE_GPU_ONLY, nullptr, &m_buffer,
+                                              &m_allocation),
+              "Failed to create the depth pyramid buffer.");
+}
+
+void VulkanDepthPyramid::Destroy()
+{
+    m_memoryAllocator->DestroyBuffer(m_buffer, m_allocation);
+
+    vkDestroySampler(m_device, m_sampler, m_allocator);
+    vkDestroyPipeline(m_device, m_pipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, m_allocator);
+
+    m_buffer         = VK_NULL_HANDLE;
+    m_sampler        = VK_NULL_HANDLE;
+    m_pipeline       = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_setLayout      = VK_NULL_HANDLE;
+}
+
+void VulkanDepthPyramid::Record(VkCommandBuffer commandBuffer, VkImageView depthView, const VkImageLayout depthLayout)
+{
+    TRACE_FUNCTION();
+
+    if (m_profiler)
+    {
+        m_profiler->BeginScope(commandBuffer, "Depth pyramid");
+    }
+
+    // The depth view may change from frame to frame (e.g. with the frame in flight).
+    VulkanDescriptorBinding setBindings[2] = {};
+    setBindings[0].binding = 0;
+    setBindings[0].type    = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    setBindings[0].image   = { m_sampler, depthView, depthLayout };
+    setBindings[1].binding = 1;
+    setBindings[1].type    = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    setBindings[1].buffer  = { m_buffer, 0, VK_WHOLE_SIZE };
+
+    const VkDescriptorSet set = m_descriptorAllocator->Allocate(m_setLayout, setBindings, 2);
+
+    // The previous contents may still be read by the culling.
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set,
+                            0, nullptr);
+
+    // Each level is reduced from the previous one.
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    for (uint32_t l = 0; l < m_levelCount; l++)
+    {
+        const VulkanDepthPyramidLevel& level = m_levels[l];
+
+        VulkanDepthPyramidConstants constants = {};
+        constants.sourceSize[0]      = (l == 0) ? m_width  : m_levels[l - 1].width;
+        constants.sourceSize[1]      = (l == 0) ? m_height : m_levels[l - 1].height;
+        constants.sourceOffset       = (l == 0) ? 0        : m_levels[l - 1].offset;
+        constants.isSourceDepth      = (l == 0) ? 1        : 0;
+        constants.destinationSize[0] = level.width;
+        constants.destinationSize[1] = level.height;
+        constants.destinationOffset  = level.offset;
+
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                           &constants);
+        vkCmdDispatch(commandBuffer, (level.width  + VK_DEPTH_PYRAMID_GROUP_SIZE - 1) / VK_DEPTH_PYRAMID_GROUP_SIZE,
+                                     (level.height + VK_DEPTH_PYRAMID_GROUP_SIZE - 1) / VK_DEPTH_PYRAMID_GROUP_SIZE, 1);
+
+        // The last barrier makes the pyramid visible to the culling.
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    m_isBuilt = true;
+
+    if (m_profiler)
+    {
+        m_profiler->EndScope(commandBuffer);
+    }
+}
+
+bool VulkanDepthPyramid::IsBuilt() const
+{
+    return m_isBuilt;
+}
+
+VkBuffer VulkanDepthPyramid::Buffer() const
+{
+    return m_buffer;
+}
+
+uint32_t VulkanDepthPyramid::Width() const
+{
+    return m_width;
+}
+
+uint32_t VulkanDepthPyramid::Height() const
+{
+    return m_height;
+}
+
+uint32_t VulkanDepthPyramid::LevelCount() const
+{
+    return m_levelCount;
+}
+
+const VulkanDepthPyramidLevel* VulkanDepthPyramid::Levels() const
+{
+    return m_levels;
+}
+
+uint32_t VulkanDepthPyramid::GetLevels(const uint32_t width, const uint32_t height,
+                                       VulkanDepthPyramidLevel levels[VK_MAX_DEPTH_PYRAMID_LEVELS],
+                                       uint32_t* totalSize)
+{
+    uint32_t levelCount = 0;
+    uint32_t w          = width;
+    uint32_t h          = height;
+
+    *totalSize = 0;
+
+    do
+    {
+        ASSERT(levelCount < VK_MAX_DEPTH_PYRAMID_LEVELS, "The depth buffer is too large for the pyramid.");
+
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+
+        levels[levelCount++] = { w, h, *totalSize, 0 };
+
+        *totalSize += w * h;
+    }
+    while (w > 1 || h > 1);
+
+    return levelCount;
+}
+
+void VulkanDepthPyramid::BuildReference(const float* depth, const uint32_t width, const uint32_t height,
+                                        std::vector<float>* pyramid)
+{
+    VulkanDepthPyramidLevel levels[VK_MAX_DEPTH_PYRAMID_LEVELS];
+    uint32_t                totalSize;
+
+    const uint32_t levelCount = GetLevels(width, height, levels, &totalSize);
+
+    pyramid->resize(totalSize);
+
+    for (uint32_t l = 0; l < levelCount; l++)
+    {
+        const float*   source       = (l == 0) ? depth  : pyramid->data() + levels[l - 1].offset;
+        const uint32_t sourceWidth  = (l == 0) ? width  : levels[l - 1].width;
+        const uint32_t sourceHeight = (l == 0) ? height : levels[l - 1].height;
+
+        float* destination = pyramid->data() + levels[l].offset;
+
+        for (uint32_t y = 0; y < levels[l].height; y++)
+        {
+            const uint32_t y0 = 2 * y;
+            const uint32_t y1 = std::min(y0 + 1, sourceHeight - 1);
+
+            for (uint32_t x = 0; x < levels[l].width; x++)
+            {
+                const uint32_t x0 = 2 * x;
+                const uint32_t x1 = std::min(x0 + 1, sourceWidth - 1);
+
+                destination[y * levels[l].width + x] =
+                    std::max(std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+                             std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+            }
+        }
+    }
+}
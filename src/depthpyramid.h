@@ -0,0 +1,83 @@
+#pragma once
+
+#include "descriptorallocator.h"
+#include "gpuprofiler.h"
+#include "memoryallocator.h"
+
+#include <vector>
+
+#define VK_DEPTH_PYRAMID_GROUP_SIZE 8  // Texels per workgroup, per dimension (see 'depthpyramid.comp')
+#define VK_MAX_DEPTH_PYRAMID_LEVELS 16 // Enough for 65536 x 65536 depth buffers
+
+// A level of the pyramid, stored at 'offset' (in floats) in the pyramid buffer.
+struct VulkanDepthPyramidLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t offset;
+    uint32_t unused;
+};
+
+// Hierarchical depth (Hi-Z) used for occlusion culling (see VulkanGpuCulling).
+// Each texel of the first level holds the farthest depth of 2x2 texels of the depth buffer, and each texel
+// of the next levels the farthest depth of 2x2 texels of the previous level, down to a single texel.
+// The sizes are rounded up, so that each texel covers exactly (2^(level + 1))^2 depth texels (clamped to the edges).
+// The levels are reduced by a compute shader, without relying on min/max sampler reductions,
+// and live in a storage buffer rather than in an image. The reduction is exact, so the pyramid
+// matches BuildReference() bit for bit on every implementation.
+class VulkanDepthPyramid
+{
+public:
+
+    // 'width' and 'height': of the depth buffer. 'profiler': times the reduction (optional).
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, VulkanMemoryAllocator* memoryAllocator,
+                VulkanDescriptorAllocator* descriptorAllocator, VulkanGpuProfiler* profiler,
+                VkPipelineCache pipelineCache, const uint32_t width, const uint32_t height);
+
+    // The GPU must be idle.
+    void Destroy();
+
+    // Records the reduction of the depth into the pyramid. 'depthView': a view of the depth aspect of the depth
+    // buffer (or of any float image whose first channel holds the depth), in 'depthLayout'. The depth writes
+    // must be visible to compute shaders. The results are visible to the compute shaders recorded afterwards.
+    // Uses a descriptor set of the current frame of the descriptor allocator.
+    void Record(VkCommandBuffer commandBuffer, VkImageView depthView, const VkImageLayout depthLayout);
+
+    // Whether the pyramid has been built at least once.
+    bool IsBuilt() const;
+
+    // float[TotalSize()]
+    VkBuffer Buffer() const;
+
+    uint32_t                       Width() const;  // Of the depth buffer
+    uint32_t                       Height() const;
+    uint32_t                       LevelCount() const;
+    const VulkanDepthPyramidLevel* Levels() const;
+
+    // Returns the number of levels of a depth buffer of the size, and the total size (in floats).
+    static uint32_t GetLevels(const uint32_t width, const uint32_t height,
+                              VulkanDepthPyramidLevel levels[VK_MAX_DEPTH_PYRAMID_LEVELS], uint32_t* totalSize);
+
+    // Reference implementation, used to validate the results of the GPU. 'depth': float[width * height].
+    static void BuildReference(const float* depth, const uint32_t width, const uint32_t height,
+                               std::vector<float>* pyramid);
+
+private:
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VulkanMemoryAllocator*       m_memoryAllocator;
+    VulkanDescriptorAllocator*   m_descriptorAllocator;
+    VulkanGpuProfiler*           m_profiler;       // Optional
+    VkDescriptorSetLayout        m_setLayout;
+    VkPipelineLayout             m_pipelineLayout;
+    VkPipeline                   m_pipeline;
+    VkSampler                    m_sampler;        // Nearest; only used for texel fetches
+    VkBuffer                     m_buffer;
+    VulkanAllocation             m_allocation;
+    uint32_t                     m_width;
+    uint32_t                     m_height;
+    uint32_t                     m_levelCount;
+    VulkanDepthPyramidLevel      m_levels[VK_MAX_DEPTH_PYRAMID_LEVELS];
+    bool                         m_isBuilt;
+};
@@ -0,0 +1,296 @@
+#include "descriptorallocator.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Descriptors per set, on average, for each type. Pools are sized for VK_DESCRIPTOR_POOL_SET_COUNT sets.
+static const VkDescriptorPoolSize poolSizeRatios[] = {
+    { VK_DESCRIPTOR_TYPE_SAMPLER,                1 },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+    { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          4 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          1 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,   1 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,   1 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         2 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         2 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 }
+};
+
+static bool IsImageDescriptor(const VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_SAMPLER       || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+           type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+}
+
+void VulkanDescriptorAllocator::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                       JobSystem* jobSystem, const uint32_t frameCount)
+{
+    assert(frameCount <= VK_MAX_DESCRIPTOR_ALLOCATOR_FRAMES);
+
+    m_device          = device;
+    m_allocator       = allocator;
+    m_workerCount     = jobSystem->WorkerCount();
+    m_frameCount      = frameCount;
+    m_frameIndex      = 0;
+    m_pools           = new ThreadPools[m_frameCount * m_workerCount];
+    m_frameSetCount   = 0;
+    m_totalSetCount   = 0;
+    m_staticUsedCount = 0;
+    m_staticHitCount  = 0;
+    m_staticMissCount = 0;
+
+    // Pools are created on demand.
+    for (uint32_t i = 0; i < m_frameCount * m_workerCount; i++)
+    {
+        m_pools[i].usedCount = 0;
+        m_pools[i].setCount  = 0;
+    }
+}
+
+void VulkanDescriptorAllocator::Destroy()
+{
+    const VulkanDescriptorStatistics stats = Statistics();
+
+    PrintInfo("Descriptor allocator: %u per-frame pools, %u static sets in %u pools (%.1f%% cache hits).",
+              stats.poolCount, stats.staticSetCount, stats.staticPoolCount,
+              100.0 * stats.staticHitCount / std::max<uint64_t>(stats.staticHitCount + stats.staticMissCount, 1));
+
+    // Destroying the pools also frees their sets.
+    for (uint32_t i = 0; i < m_frameCount * m_workerCount; i++)
+    {
+        for (VkDescriptorPool pool : m_pools[i].pools)
+        {
+            vkDestroyDescriptorPool(m_device, pool, m_allocator);
+        }
+    }
+
+    for (VkDescriptorPool pool : m_staticPools)
+    {
+        vkDestroyDescriptorPool(m_device, pool, m_allocator);
+    }
+
+    delete[] m_pools;
+    m_pools = nullptr;
+
+    m_staticPools.clear();
+    m_staticSets.clear();
+}
+
+void VulkanDescriptorAllocator::BeginFrame(const uint32_t frameIndex)
+{
+    assert(frameIndex < m_frameCount);
+
+    // The previous frame is complete (on the CPU), so its allocations can be counted.
+    ThreadPools* previousPools = &m_pools[m_frameIndex * m_workerCount];
+
+    m_frameSetCount = 0;
+
+    for (uint32_t w = 0; w < m_workerCount; w++)
+    {
+        m_frameSetCount += previousPools[w].setCount;
+    }
+
+    m_totalSetCount += m_frameSetCount;
+    m_frameIndex     = frameIndex;
+
+    ThreadPools* pools = &m_pools[m_frameIndex * m_workerCount];
+
+    for (uint32_t w = 0; w < m_workerCount; w++)
+    {
+        // Only reset the pools which have been used. This frees all of their sets at once.
+        for (uint32_t p = 0; p < pools[w].usedCount; p++)
+        {
+            CHECK_INT(vkResetDescriptorPool(m_device, pools[w].pools[p], 0),
+                      "Failed to reset a descriptor pool.");
+        }
+
+        pools[w].usedCount = 0;
+        pools[w].setCount  = 0;
+    }
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::CreatePool() const
+{
+    VkDescriptorPoolSize poolSizes[sizeof(poolSizeRatios) / sizeof(poolSizeRatios[0])];
+
+    for (uint32_t i = 0; i < sizeof(poolSizeRatios) / sizeof(poolSizeRatios[0]); i++)
+    {
+        poolSizes[i].type            = poolSizeRatios[i].type;
+        poolSizes[i].descriptorCount = poolSizeRatios[i].descriptorCount * VK_DESCRIPTOR_POOL_SET_COUNT;
+    }
+
+    // Sets are never freed individually, so the pool does not need to track them.
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets       = VK_DESCRIPTOR_POOL_SET_COUNT;
+    poolInfo.poolSizeCount = sizeof(poolSizes) / sizeof(poolSizes[0]);
+    poolInfo.pPoolSizes    = poolSizes;
+
+    VkDescriptorPool pool;
+
+    CHECK_INT(vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, &pool),
+              "Failed to create a descriptor pool.");
+
+    return pool;
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::AllocateFromPools(std::vector<VkDescriptorPool>& pools,
+                                                             uint32_t* usedCount, VkDescriptorSetLayout layout) const
+{
+    VkDescriptorSetAllocateInfo setInfo = {};
+    setInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts        = &layout;
+
+    // Try the current pool first. If it is exhausted, move on to the next one (which is empty).
+    for (uint32_t attempt = 0; attempt < 2; attempt++)
+    {
+        if (*usedCount == 0 || attempt > 0)
+        {
+            if (*usedCount == pools.size())
+            {
+                pools.push_back(CreatePool());
+            }
+
+            (*usedCount)++;
+        }
+
+        setInfo.descriptorPool = pools[*usedCount - 1];
+
+        VkDescriptorSet set;
+
+        const VkResult result = vkAllocateDescriptorSets(m_device, &setInfo, &set);
+
+        if (result == VK_SUCCESS)
+        {
+            return set;
+        }
+
+        ASSERT(result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL,
+               "Failed to allocate a descriptor set.");
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+void VulkanDescriptorAllocator::WriteSet(VkDescriptorSet set, const VulkanDescriptorBinding* bindings,
+                                         const uint32_t bindingCount) const
+{
+    ASSERT(bindingCount <= VK_MAX_DESCRIPTOR_SET_BINDINGS, "Too many bindings (%u).", bindingCount);
+
+    VkWriteDescriptorSet writes[VK_MAX_DESCRIPTOR_SET_BINDINGS] = {};
+
+    for (uint32_t i = 0; i < bindingCount; i++)
+    {
+        writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet          = set;
+        writes[i].dstBinding      = bindings[i].binding;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType  = bindings[i].type;
+
+        if (IsImageDescriptor(bindings[i].type))
+        {
+            writes[i].pImageInfo  = &bindings[i].image;
+        }
+        else
+        {
+            writes[i].pBufferInfo = &bindings[i].buffer;
+        }
+    }
+
+    vkUpdateDescriptorSets(m_device, bindingCount, writes, 0, nullptr);
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::Allocate(VkDescriptorSetLayout layout,
+                                                    const VulkanDescriptorBinding* bindings,
+                                                    const uint32_t bindingCount)
+{
+    // The pools of the worker are not accessed by any other thread.
+    ThreadPools& pools = m_pools[m_frameIndex * m_workerCount + JobSystem::WorkerIndex()];
+
+    const VkDescriptorSet set = AllocateFromPools(pools.pools, &pools.usedCount, layout);
+
+    ASSERT(set, "The descriptor set layout does not fit into an empty pool.");
+
+    pools.setCount++;
+
+    if (bindingCount > 0)
+    {
+        WriteSet(set, bindings, bindingCount);
+    }
+
+    return set;
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::GetStaticSet(VkDescriptorSetLayout layout,
+                                                        const VulkanDescriptorBinding* bindings,
+                                                        const uint32_t bindingCount)
+{
+    // Hash the members (rather than the structures), since the padding is undefined.
+    uint64_t key = HashBytes(&layout, sizeof(layout));
+
+    for (uint32_t i = 0; i < bindingCount; i++)
+    {
+        key = HashBytes(&bindings[i].binding, sizeof(bindings[i].binding), key);
+        key = HashBytes(&bindings[i].type,    sizeof(bindings[i].type),    key);
+
+        if (IsImageDescriptor(bindings[i].type))
+        {
+            key = HashBytes(&bindings[i].image.sampler,     sizeof(bindings[i].image.sampler),     key);
+            key = HashBytes(&bindings[i].image.imageView,   sizeof(bindings[i].image.imageView),   key);
+            key = HashBytes(&bindings[i].image.imageLayout, sizeof(bindings[i].image.imageLayout), key);
+        }
+        else
+        {
+            key = HashBytes(&bindings[i].buffer, sizeof(bindings[i].buffer), key);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_staticMutex);
+
+    const auto it = m_staticSets.find(key);
+
+    if (it != m_staticSets.end())
+    {
+        m_staticHitCount++;
+        return it->second;
+    }
+
+    TRACE_FUNCTION();
+
+    m_staticMissCount++;
+
+    const VkDescriptorSet set = AllocateFromPools(m_staticPools, &m_staticUsedCount, layout);
+
+    ASSERT(set, "The descriptor set layout does not fit into an empty pool.");
+
+    WriteSet(set, bindings, bindingCount);
+
+    m_staticSets.emplace(key, set);
+
+    return set;
+}
+
+VulkanDescriptorStatistics VulkanDescriptorAllocator::Statistics() const
+{
+    VulkanDescriptorStatistics stats = {};
+    stats.frameSetCount = m_frameSetCount;
+    stats.totalSetCount = m_totalSetCount;
+
+    for (uint32_t i = 0; i < m_frameCount * m_workerCount; i++)
+    {
+        stats.poolCount += static_cast<uint32_t>(m_pools[i].pools.size());
+    }
+
+    std::lock_guard<std::mutex> lock(m_staticMutex);
+
+    stats.staticPoolCount = static_cast<uint32_t>(m_staticPools.size());
+    stats.staticSetCount  = static_cast<uint32_t>(m_staticSets.size());
+    stats.staticHitCount  = m_staticHitCount;
+    stats.staticMissCount = m_staticMissCount;
+
+    return stats;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "jobsystem.h"
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define VK_MAX_DESCRIPTOR_ALLOCATOR_FRAMES 4
+#define VK_MAX_DESCRIPTOR_SET_BINDINGS     16  // Written per set
+#define VK_DESCRIPTOR_POOL_SET_COUNT       256 // Sets per pool
+
+// Contents of a binding of a descriptor set (a single descriptor).
+struct VulkanDescriptorBinding
+{
+    uint32_t               binding;
+    VkDescriptorType       type;
+    VkDescriptorImageInfo  image;  // For samplers and images
+    VkDescriptorBufferInfo buffer; // For buffers
+};
+
+struct VulkanDescriptorStatistics
+{
+    uint64_t frameSetCount;   // Allocated during the previous frame
+    uint64_t totalSetCount;   // Allocated since the creation of the allocator (static sets excluded)
+    uint32_t poolCount;       // Per-frame pools (of all the frames in flight and workers)
+    uint32_t staticPoolCount;
+    uint32_t staticSetCount;  // Cached
+    uint64_t staticHitCount;  // Lookups of the static sets found in the cache
+    uint64_t staticMissCount;
+};
+
+// Fallback for the descriptors which are not accessed via the bindless heap (see VulkanBindlessHeap).
+// Per-frame sets are allocated by bumping through a growable list of pools, which is owned by a single worker
+// for a single frame in flight. The pools of a frame are reset in bulk once the frame retires, so the sets
+// are never freed individually. Allocation takes constant time, unless the current pool is exhausted.
+// Static sets (which do not change from frame to frame) are cached, keyed by their layout and contents,
+// and live until the allocator is destroyed.
+class VulkanDescriptorAllocator
+{
+public:
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, JobSystem* jobSystem,
+                const uint32_t frameCount);
+
+    // The GPU must be idle.
+    void Destroy();
+
+    // Must be called when recording of the frame in the slot 'frameIndex' begins.
+    // The GPU must have finished executing the frame which previously used the slot.
+    void BeginFrame(const uint32_t frameIndex);
+
+    // Allocates a set which is valid until the end of the current frame, and writes the bindings (if any).
+    // May be called by several workers of the job system at the same time.
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout, const VulkanDescriptorBinding* bindings = nullptr,
+                             const uint32_t bindingCount = 0);
+
+    // Returns the cached set with the same layout and contents, or creates it. The resources must outlive
+    // the allocator. May be called from any thread.
+    VkDescriptorSet GetStaticSet(VkDescriptorSetLayout layout, const VulkanDescriptorBinding* bindings,
+                                 const uint32_t bindingCount);
+
+    // Must not be called while sets are being allocated.
+    VulkanDescriptorStatistics Statistics() const;
+
+private:
+
+    // Owned by a single worker, for a single frame.
+    struct alignas(64) ThreadPools
+    {
+        std::vector<VkDescriptorPool> pools;       // Created on demand, and reused
+        uint32_t                      usedCount;   // The last one is the current pool
+        uint64_t                      setCount;    // Allocated during the frame
+    };
+
+    VkDescriptorPool CreatePool() const;
+
+    // Returns VK_NULL_HANDLE if all the pools of the list are exhausted.
+    VkDescriptorSet AllocateFromPools(std::vector<VkDescriptorPool>& pools, uint32_t* usedCount,
+                                      VkDescriptorSetLayout layout) const;
+
+    void WriteSet(VkDescriptorSet set, const VulkanDescriptorBinding* bindings, const uint32_t bindingCount) const;
+
+    VkDevice                                      m_device;
+    const VkAllocationCallbacks*                  m_allocator;
+    uint32_t                                      m_workerCount;
+    uint32_t                                      m_frameCount;
+    uint32_t                                      m_frameIndex;
+    ThreadPools*                                  m_pools;           // [frame][worker]
+    uint64_t                                      m_frameSetCount;   // Of the previous frame
+    uint64_t                                      m_totalSetCount;   // Of the frames before the current one
+    std::vector<VkDescriptorPool>                 m_staticPools;
+    uint32_t                                      m_staticUsedCount;
+    std::unordered_map<uint64_t, VkDescriptorSet> m_staticSets;      // Keyed by the hash of the layout and contents
+    uint64_t                                      m_staticHitCount;
+    uint64_t                                      m_staticMissCount;
+    mutable std::mutex                            m_staticMutex;     // Guards the static sets (and their pools)
+};
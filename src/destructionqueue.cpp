@@ -0,0 +1,76 @@
+#include "destructionqueue.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <cassert>
+
+void VulkanDestructionQueue::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                    VulkanMemoryAllocator* memoryAllocator)
+{
+    m_device          = device;
+    m_allocator       = allocator;
+    m_memoryAllocator = memoryAllocator;
+}
+
+void VulkanDestructionQueue::Destroy()
+{
+    Collect(UINT64_MAX);
+}
+
+void VulkanDestructionQueue::EnqueueHandle(const VkObjectType type, const uint64_t handle,
+                                           const uint64_t frameSerial)
+{
+    assert(m_entries.empty() || m_entries.back().frameSerial <= frameSerial);
+
+    m_entries.push_back({ type, handle, frameSerial, {} });
+}
+
+void VulkanDestructionQueue::EnqueueAllocation(const VulkanAllocation& allocation, const uint64_t frameSerial)
+{
+    assert(m_entries.empty() || m_entries.back().frameSerial <= frameSerial);
+
+    m_entries.push_back({ VK_OBJECT_TYPE_DEVICE_MEMORY, 0, frameSerial, allocation });
+}
+
+void VulkanDestructionQueue::Collect(const uint64_t retiredFrameSerial)
+{
+    if (m_entries.empty() || m_entries.front().frameSerial > retiredFrameSerial) return;
+
+    TRACE_FUNCTION();
+
+    while (!m_entries.empty() && m_entries.front().frameSerial <= retiredFrameSerial)
+    {
+        DestroyObject(m_entries.front());
+        m_entries.pop_front();
+    }
+}
+
+void VulkanDestructionQueue::DestroyObject(const Entry& entry) const
+{
+    switch (entry.type)
+    {
+        case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+            vkDestroySwapchainKHR(m_device, reinterpret_cast<VkSwapchainKHR>(entry.handle), m_allocator);
+            break;
+        case VK_OBJECT_TYPE_IMAGE:
+            vkDestroyImage(m_device, reinterpret_cast<VkImage>(entry.handle), m_allocator);
+            break;
+        case VK_OBJECT_TYPE_BUFFER:
+            vkDestroyBuffer(m_device, reinterpret_cast<VkBuffer>(entry.handle), m_allocator);
+            break;
+        case VK_OBJECT_TYPE_DEVICE_MEMORY:
+            m_memoryAllocator->Free(entry.allocation);
+            break;
+        case VK_OBJECT_TYPE_IMAGE_VIEW:
+            vkDestroyImageView(m_device, reinterpret_cast<VkImageView>(entry.handle), m_allocator);
+            break;
+        case VK_OBJECT_TYPE_FRAMEBUFFER:
+            vkDestroyFramebuffer(m_device, reinterpret_cast<VkFramebuffer>(entry.handle), m_allocator);
+            break;
+        case VK_OBJECT_TYPE_SEMAPHORE:
+            vkDestroySemaphore(m_device, reinterpret_cast<VkSemaphore>(entry.handle), m_allocator);
+            break;
+        default:
+            ASSERT(false, "Unsupported object type: %i.", static_cast<int>(entry.type));
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "memoryallocator.h"
+
+#include <deque>
+
+// Defers the destruction of objects until the frames which may use them have retired,
+// so that objects can be replaced (e.g. when the swap chain is re-created) without waiting for the GPU.
+// Frames are identified by their serial numbers. Since the frames retire in order, once the fence of a frame
+// has been waited for, the objects of this frame and of all the earlier ones can be destroyed.
+class VulkanDestructionQueue
+{
+public:
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, VulkanMemoryAllocator* memoryAllocator);
+
+    // Destroys all the remaining objects. The GPU must be idle.
+    void Destroy();
+
+    // Destroys the object once the frame 'frameSerial' has retired.
+    // Supported types: swap chains, images, buffers, image views, framebuffers and semaphores.
+    template <typename T>
+    void Enqueue(const VkObjectType type, const T handle, const uint64_t frameSerial)
+    {
+        EnqueueHandle(type, reinterpret_cast<uint64_t>(handle), frameSerial);
+    }
+
+    // Frees the memory once the frame 'frameSerial' has retired.
+    void EnqueueAllocation(const VulkanAllocation& allocation, const uint64_t frameSerial);
+
+    // Destroys the objects of the frames up to (and including) 'retiredFrameSerial'.
+    void Collect(const uint64_t retiredFrameSerial);
+
+private:
+
+    struct Entry
+    {
+        VkObjectType     type;        // VK_OBJECT_TYPE_DEVICE_MEMORY for allocations
+        uint64_t         handle;
+        uint64_t         frameSerial;
+        VulkanAllocation allocation;
+    };
+
+    void EnqueueHandle(const VkObjectType type, const uint64_t handle, const uint64_t frameSerial);
+    void DestroyObject(const Entry& entry) const;
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VulkanMemoryAllocator*       m_memoryAllocator;
+    std::deque<Entry>            m_entries; // In the order of the frames
+};
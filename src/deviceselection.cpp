@@ -0,0 +1,201 @@
+#include "deviceselection.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cctype>
+
+#define VK_DEVICE_SELECTION_MAGIC   0x5344474D // 'MGDS'
+#define VK_DEVICE_SELECTION_VERSION 1
+
+struct DeviceSelectionFile
+{
+    uint32_t               magic;
+    uint32_t               version;
+    uint64_t               devicesHash;
+    VulkanPhysicalDeviceId selectedId;
+};
+
+VulkanPhysicalDeviceId GetPhysicalDeviceId(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    VulkanPhysicalDeviceId id = {};
+    id.vendorID      = properties.vendorID;
+    id.deviceID      = properties.deviceID;
+    id.driverVersion = properties.driverVersion;
+
+    // VkPhysicalDeviceIDProperties is core in Vulkan 1.1, and is the only structure needed, so the UUID
+    // is available on 1.1 devices too (unlike with VkPhysicalDeviceVulkan11Properties, which requires 1.2).
+    if (properties.apiVersion >= VK_API_VERSION_1_1)
+    {
+        VkPhysicalDeviceIDProperties idProperties = {};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &idProperties;
+
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        memcpy(id.deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+    }
+
+    return id;
+}
+
+uint64_t HashPhysicalDeviceIds(const VulkanPhysicalDeviceId* ids, const uint32_t count)
+{
+    static_assert(sizeof(VulkanPhysicalDeviceId) == VK_UUID_SIZE + 3 * sizeof(uint32_t), "Unexpected padding.");
+
+    return HashBytes(ids, count * sizeof(VulkanPhysicalDeviceId), count);
+}
+
+uint64_t ScorePhysicalDevice(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& properties,
+                             const VkQueueFamilyProperties* queueFamilies, const uint32_t queueFamilyCount)
+{
+    uint64_t score = 0;
+
+    switch (properties.deviceType)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   score += 1000000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 500000;  break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    score += 250000;  break;
+        default:                                                      break;
+    }
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    VkDeviceSize deviceLocalSize = 0;
+
+    // Integrated GPUs may report system memory as device-local, which their type accounts for.
+    for (uint32_t h = 0; h < memoryProperties.memoryHeapCount; h++)
+    {
+        if (memoryProperties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            deviceLocalSize = std::max(deviceLocalSize, memoryProperties.memoryHeaps[h].size);
+        }
+    }
+
+    // 10 points per MiB, capped at 32 GiB: less than the difference between the device types.
+    score += 10 * std::min<uint64_t>(deviceLocalSize >> 20, 32 * 1024);
+
+    bool hasDedicatedCompute  = false;
+    bool hasDedicatedTransfer = false;
+    bool hasGraphicsTimestamp = false;
+
+    for (uint32_t f = 0; f < queueFamilyCount; f++)
+    {
+        const VkQueueFlags queueFlags = queueFamilies[f].queueFlags;
+
+        if (queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            hasGraphicsTimestamp |= (queueFamilies[f].timestampValidBits > 0);
+        }
+        else if (queueFlags & VK_QUEUE_COMPUTE_BIT)
+        {
+            hasDedicatedCompute = true;
+        }
+        else if (queueFlags & VK_QUEUE_TRANSFER_BIT)
+        {
+            hasDedicatedTransfer = true;
+        }
+    }
+
+    // See VulkanAsyncCompute and VulkanAsyncUploader.
+    score += hasDedicatedCompute  ? 20000 : 0;
+    score += hasDedicatedTransfer ? 10000 : 0;
+
+    // Required by the GPU profiler.
+    score += hasGraphicsTimestamp                          ? 10000 : 0;
+    score += properties.limits.timestampComputeAndGraphics ? 5000  : 0;
+
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+
+    score += limits.maxImageDimension2D        / 16;   // 16384 -> 1024
+    score += limits.maxComputeSharedMemorySize / 64;   // 32 KiB -> 512
+    score += std::min(limits.maxPerStageDescriptorSampledImages, 1u << 20) / 1024;
+
+    return score;
+}
+
+bool MatchesPhysicalDevice(string_t selector, const uint32_t index, const VulkanPhysicalDeviceId& id)
+{
+    const size_t length = strlen(selector);
+
+    // Indices are short, UUIDs are not.
+    if (length > 0 && length < 2 * VK_UUID_SIZE && strspn(selector, "0123456789") == length)
+    {
+        return static_cast<uint32_t>(atoi(selector)) == index;
+    }
+
+    char uuid[2 * VK_UUID_SIZE + 1];
+    FormatDeviceUuid(id.deviceUUID, uuid);
+
+    size_t n = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (selector[i] == '-') continue;
+
+        if (n == 2 * VK_UUID_SIZE || tolower(static_cast<unsigned char>(selector[i])) != uuid[n]) return false;
+
+        n++;
+    }
+
+    return n == 2 * VK_UUID_SIZE;
+}
+
+void FormatDeviceUuid(const uint8_t uuid[VK_UUID_SIZE], char (&string)[2 * VK_UUID_SIZE + 1])
+{
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    {
+        snprintf(&string[2 * i], 3, "%02x", uuid[i]);
+    }
+}
+
+bool LoadDeviceSelection(string_t path, const uint64_t devicesHash, VulkanPhysicalDeviceId* selectedId)
+{
+    FILE* file = OpenFile(path, "rb");
+
+    if (!file) return false;
+
+    DeviceSelectionFile contents = {};
+
+    const bool isValid = (fread(&contents, sizeof(contents), 1, file) == 1) &&
+                         (contents.magic       == VK_DEVICE_SELECTION_MAGIC)  &&
+                         (contents.version     == VK_DEVICE_SELECTION_VERSION) &&
+                         (contents.devicesHash == devicesHash);
+
+    fclose(file);
+
+    if (isValid)
+    {
+        *selectedId = contents.selectedId;
+    }
+
+    return isValid;
+}
+
+void SaveDeviceSelection(string_t path, const uint64_t devicesHash, const VulkanPhysicalDeviceId& selectedId)
+{
+    DeviceSelectionFile contents = {};
+    contents.magic       = VK_DEVICE_SELECTION_MAGIC;
+    contents.version     = VK_DEVICE_SELECTION_VERSION;
+    contents.devicesHash = devicesHash;
+    contents.selectedId  = selectedId;
+
+    FILE* file = OpenFile(path, "wb");
+
+    // A partially written file fails to load, which only costs a full device scan.
+    if (!file || fwrite(&contents, sizeof(contents), 1, file) != 1)
+    {
+        PrintWarning("Failed to save the device selection to \'%s\'.", path);
+    }
+
+    if (file)
+    {
+        fclose(file);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <vulkan/vulkan.h>
+
+#define VK_DEVICE_SELECTION_CACHE_PATH "device_selection.bin"
+
+// Identifies a physical device (and its driver) across runs.
+struct VulkanPhysicalDeviceId
+{
+    uint8_t  deviceUUID[VK_UUID_SIZE]; // Zero for devices older than Vulkan 1.1
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+};
+
+VulkanPhysicalDeviceId GetPhysicalDeviceId(VkPhysicalDevice physicalDevice);
+
+// Returns the hash of the IDs of the devices. Changes if a device or a driver is added, removed or updated.
+uint64_t HashPhysicalDeviceIds(const VulkanPhysicalDeviceId* ids, const uint32_t count);
+
+// Ranks a compatible device: the higher the score, the better the device.
+// In order of importance: the type of the device, the size of the device-local memory,
+// the queue families dedicated to compute and transfers, timestamp support, and the limits.
+uint64_t ScorePhysicalDevice(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& properties,
+                             const VkQueueFamilyProperties* queueFamilies, const uint32_t queueFamilyCount);
+
+// Returns 'true' if the selector matches the device.
+// The selector is either the index of the device (e.g. "1"), or its UUID (hexadecimal digits, dashes are ignored).
+bool MatchesPhysicalDevice(string_t selector, const uint32_t index, const VulkanPhysicalDeviceId& id);
+
+// Formats the UUID as 32 hexadecimal digits (e.g. to be used as a selector).
+void FormatDeviceUuid(const uint8_t uuid[VK_UUID_SIZE], char (&string)[2 * VK_UUID_SIZE + 1]);
+
+// The selection is only valid for the set of devices it was made for (see HashPhysicalDeviceIds()).
+bool LoadDeviceSelection(string_t path, const uint64_t devicesHash, VulkanPhysicalDeviceId* selectedId);
+void SaveDeviceSelection(string_t path, const uint64_t devicesHash, const VulkanPhysicalDeviceId& selectedId);
@@ -0,0 +1,476 @@
+#include "drawqueue.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#define VK_DRAW_KEY_MESH_SHIFT     VK_DRAW_KEY_DEPTH_BITS
+#define VK_DRAW_KEY_MATERIAL_SHIFT (VK_DRAW_KEY_MESH_SHIFT + VK_DRAW_KEY_MESH_BITS)
+#define VK_DRAW_KEY_SET_SHIFT      (VK_DRAW_KEY_MATERIAL_SHIFT + VK_DRAW_KEY_MATERIAL_BITS)
+#define VK_DRAW_KEY_PIPELINE_SHIFT (VK_DRAW_KEY_SET_SHIFT + VK_DRAW_KEY_SET_BITS)
+
+// State which changes between two draws.
+#define VK_DRAW_CHANGE_PIPELINE 0x1
+#define VK_DRAW_CHANGE_SET      0x2
+#define VK_DRAW_CHANGE_MATERIAL 0x4
+#define VK_DRAW_CHANGE_MESH     0x8
+#define VK_DRAW_CHANGE_ALL      0xF
+
+static inline uint32_t KeyField(const uint64_t key, const uint32_t shift, const uint32_t bits)
+{
+    return static_cast<uint32_t>(key >> shift) & ((1u << bits) - 1);
+}
+
+static inline uint32_t KeyPipeline(const uint64_t key)
+{
+    return KeyField(key, VK_DRAW_KEY_PIPELINE_SHIFT, VK_DRAW_KEY_PIPELINE_BITS);
+}
+
+static inline uint32_t KeySet(const uint64_t key)
+{
+    return KeyField(key, VK_DRAW_KEY_SET_SHIFT, VK_DRAW_KEY_SET_BITS);
+}
+
+static inline uint32_t KeyMaterial(const uint64_t key)
+{
+    return KeyField(key, VK_DRAW_KEY_MATERIAL_SHIFT, VK_DRAW_KEY_MATERIAL_BITS);
+}
+
+static inline uint32_t KeyMesh(const uint64_t key)
+{
+    return KeyField(key, VK_DRAW_KEY_MESH_SHIFT, VK_DRAW_KEY_MESH_BITS);
+}
+
+// Draws with the same state can be merged.
+static inline uint64_t KeyState(const uint64_t key)
+{
+    return key >> VK_DRAW_KEY_DEPTH_BITS;
+}
+
+// 'previousKey' is null for the first draw, which sets all the state. A new pipeline layout may disturb the bound
+// descriptor set and push constants, so they are set again. The null descriptor sets are not bound.
+static uint32_t GetStateChanges(const VkPipelineLayout* layouts, const VkDescriptorSet* sets,
+                                const uint64_t* previousKey, const uint64_t key)
+{
+    uint32_t changes = VK_DRAW_CHANGE_ALL;
+
+    if (previousKey)
+    {
+        changes = 0;
+
+        if (KeyPipeline(key) != KeyPipeline(*previousKey))
+        {
+            changes |= VK_DRAW_CHANGE_PIPELINE;
+
+            if (layouts[KeyPipeline(key)] != layouts[KeyPipeline(*previousKey)])
+            {
+                changes |= VK_DRAW_CHANGE_SET | VK_DRAW_CHANGE_MATERIAL;
+            }
+        }
+
+        if (KeySet(key)      != KeySet(*previousKey))      changes |= VK_DRAW_CHANGE_SET;
+        if (KeyMaterial(key) != KeyMaterial(*previousKey)) changes |= VK_DRAW_CHANGE_MATERIAL;
+        if (KeyMesh(key)     != KeyMesh(*previousKey))     changes |= VK_DRAW_CHANGE_MESH;
+    }
+
+    if (sets[KeySet(key)] == VK_NULL_HANDLE) changes &= ~VK_DRAW_CHANGE_SET;
+
+    return changes;
+}
+
+// Accumulates the binds of the state changes.
+static void CountBinds(const uint32_t changes, VulkanDrawQueueStatistics* statistics)
+{
+    statistics->pipelineBindCount += (changes & VK_DRAW_CHANGE_PIPELINE) ? 1 : 0;
+    statistics->setBindCount      += (changes & VK_DRAW_CHANGE_SET)      ? 1 : 0;
+    statistics->materialBindCount += (changes & VK_DRAW_CHANGE_MATERIAL) ? 1 : 0;
+    statistics->meshBindCount     += (changes & VK_DRAW_CHANGE_MESH)     ? 1 : 0;
+}
+
+// Vertex and index buffers are bound separately.
+static uint32_t TotalBindCount(const VulkanDrawQueueStatistics& statistics)
+{
+    return statistics.pipelineBindCount + statistics.setBindCount + statistics.materialBindCount +
+           2 * statistics.meshBindCount;
+}
+
+void RadixSort(uint64_t* keys, uint32_t* values, uint64_t* scratchKeys, uint32_t* scratchValues,
+               const uint32_t count)
+{
+    TRACE_FUNCTION();
+
+    if (count < 2) return;
+
+    // The histograms of all the digits, in a single pass.
+    uint32_t histograms[8][256] = {};
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint64_t key = keys[i];
+
+        for (uint32_t d = 0; d < 8; d++)
+        {
+            histograms[d][(key >> (8 * d)) & 0xFF]++;
+        }
+    }
+
+    uint64_t* srcKeys   = keys;
+    uint32_t* srcValues = values;
+    uint64_t* dstKeys   = scratchKeys;
+    uint32_t* dstValues = scratchValues;
+
+    for (uint32_t d = 0; d < 8; d++)
+    {
+        const uint32_t shift = 8 * d;
+
+        // All the keys have the same digit: the pass would not reorder anything.
+        if (histograms[d][(srcKeys[0] >> shift) & 0xFF] == count) continue;
+
+        uint32_t offsets[256];
+        uint32_t offset = 0;
+
+        for (uint32_t b = 0; b < 256; b++)
+        {
+            offsets[b] = offset;
+            offset    += histograms[d][b];
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t slot = offsets[(srcKeys[i] >> shift) & 0xFF]++;
+
+            dstKeys[slot]   = srcKeys[i];
+            dstValues[slot] = srcValues[i];
+        }
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    if (srcKeys != keys)
+    {
+        memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+
+void VulkanDrawQueue::Create(const uint32_t maxDrawCount)
+{
+    m_draws.reserve(maxDrawCount);
+    m_keys.reserve(maxDrawCount);
+    m_drawIndices.reserve(maxDrawCount);
+    m_scratchKeys.reserve(maxDrawCount);
+    m_scratchIndices.reserve(maxDrawCount);
+    m_instanceData.reserve(maxDrawCount);
+    m_batches.reserve(maxDrawCount);
+
+    m_statistics = {};
+}
+
+void VulkanDrawQueue::Destroy()
+{
+    *this = VulkanDrawQueue();
+}
+
+uint32_t VulkanDrawQueue::AddPipeline(VkPipeline pipeline, VkPipelineLayout layout,
+                                      const VkShaderStageFlags pushConstantStages)
+{
+    ASSERT(m_pipelines.size() < VK_MAX_DRAW_PIPELINES, "Too many pipelines (%u at most).", VK_MAX_DRAW_PIPELINES);
+
+    m_pipelines.push_back(pipeline);
+    m_layouts.push_back(layout);
+    m_pushConstantStages.push_back(pushConstantStages);
+
+    return static_cast<uint32_t>(m_pipelines.size() - 1);
+}
+
+uint32_t VulkanDrawQueue::AddDescriptorSet(VkDescriptorSet set)
+{
+    ASSERT(m_sets.size() < VK_MAX_DRAW_SETS, "Too many descriptor sets (%u at most).", VK_MAX_DRAW_SETS);
+
+    m_sets.push_back(set);
+
+    return static_cast<uint32_t>(m_sets.size() - 1);
+}
+
+uint32_t VulkanDrawQueue::AddMesh(const VulkanDrawMesh& mesh)
+{
+    ASSERT(m_meshes.size() < VK_MAX_DRAW_MESHES, "Too many meshes (%u at most).", VK_MAX_DRAW_MESHES);
+
+    m_meshes.push_back(mesh);
+
+    return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+void VulkanDrawQueue::Reset()
+{
+    m_draws.clear();
+    m_keys.clear();
+    m_drawIndices.clear();
+    m_instanceData.clear();
+    m_batches.clear();
+}
+
+void VulkanDrawQueue::Submit(const VulkanDraw& draw)
+{
+    assert(draw.pipeline < m_pipelines.size() && draw.descriptorSet < m_sets.size() &&
+           draw.material < VK_MAX_DRAW_MATERIALS && draw.mesh < m_meshes.size());
+
+    m_draws.push_back(draw);
+}
+
+uint64_t VulkanDrawQueue::MakeKey(const VulkanDraw& draw)
+{
+    // The bits of a non-negative float sort like the float itself. Keep the most significant ones.
+    const float depth = (draw.depth > 0.0f) ? draw.depth : 0.0f; // NaN included
+
+    uint32_t depthBits;
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    return (static_cast<uint64_t>(draw.pipeline)      << VK_DRAW_KEY_PIPELINE_SHIFT) |
+           (static_cast<uint64_t>(draw.descriptorSet) << VK_DRAW_KEY_SET_SHIFT)      |
+           (static_cast<uint64_t>(draw.material)      << VK_DRAW_KEY_MATERIAL_SHIFT) |
+           (static_cast<uint64_t>(draw.mesh)          << VK_DRAW_KEY_MESH_SHIFT)     |
+           (depthBits >> (32 - VK_DRAW_KEY_DEPTH_BITS));
+}
+
+void VulkanDrawQueue::Sort()
+{
+    TRACE_FUNCTION();
+
+    const uint32_t drawCount = static_cast<uint32_t>(m_draws.size());
+
+    m_keys.resize(drawCount);
+    m_drawIndices.resize(drawCount);
+    m_scratchKeys.resize(drawCount);
+    m_scratchIndices.resize(drawCount);
+    m_instanceData.resize(drawCount);
+    m_batches.clear();
+
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        m_keys[i]        = MakeKey(m_draws[i]);
+        m_drawIndices[i] = i;
+    }
+
+    // Without sorting nor merging, for comparison.
+    VulkanDrawQueueStatistics unsorted = {};
+
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        CountBinds(GetStateChanges(m_layouts.data(), m_sets.data(), (i == 0) ? nullptr : &m_keys[i - 1], m_keys[i]),
+                   &unsorted);
+    }
+
+    RadixSort(m_keys.data(), m_drawIndices.data(), m_scratchKeys.data(), m_scratchIndices.data(), drawCount);
+
+    m_statistics = {};
+
+    // Merge the runs of draws with the same state.
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        m_instanceData[i] = m_draws[m_drawIndices[i]].instanceData;
+
+        if (!m_batches.empty() && KeyState(m_batches.back().key) == KeyState(m_keys[i]))
+        {
+            m_batches.back().instanceCount++;
+            continue;
+        }
+
+        CountBinds(GetStateChanges(m_layouts.data(), m_sets.data(), m_batches.empty() ? nullptr : &m_batches.back().key,
+                                   m_keys[i]),
+                   &m_statistics);
+
+        m_batches.push_back({ m_keys[i], i, 1 });
+    }
+
+    m_statistics.drawCount         = drawCount;
+    m_statistics.drawCallCount     = static_cast<uint32_t>(m_batches.size());
+    m_statistics.bindCount         = TotalBindCount(m_statistics);
+    m_statistics.unsortedBindCount = TotalBindCount(unsorted);
+}
+
+const uint32_t* VulkanDrawQueue::InstanceData() const
+{
+    return m_instanceData.data();
+}
+
+uint32_t VulkanDrawQueue::InstanceCount() const
+{
+    return static_cast<uint32_t>(m_instanceData.size());
+}
+
+void VulkanDrawQueue::Record(VkCommandBuffer commandBuffer) const
+{
+    TRACE_FUNCTION();
+
+    for (size_t b = 0; b < m_batches.size(); b++)
+    {
+        const Batch&           batch    = m_batches[b];
+        const uint32_t         pipeline = KeyPipeline(batch.key);
+        const VkPipelineLayout layout   = m_layouts[pipeline];
+        const VulkanDrawMesh&  mesh     = m_meshes[KeyMesh(batch.key)];
+
+        // The same changes as counted by Sort().
+        const uint32_t changes = GetStateChanges(m_layouts.data(), m_sets.data(),
+                                                 (b == 0) ? nullptr : &m_batches[b - 1].key, batch.key);
+
+        if (changes & VK_DRAW_CHANGE_PIPELINE)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines[pipeline]);
+        }
+
+        if (changes & VK_DRAW_CHANGE_SET)
+        {
+            const VkDescriptorSet set = m_sets[KeySet(batch.key)];
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &set,
+                                    0, nullptr);
+        }
+
+        if (changes & VK_DRAW_CHANGE_MATERIAL)
+        {
+            const uint32_t material = KeyMaterial(batch.key);
+
+            vkCmdPushConstants(commandBuffer, layout, m_pushConstantStages[pipeline], 0, sizeof(material),
+                               &material);
+        }
+
+        if (changes & VK_DRAW_CHANGE_MESH)
+        {
+            const VkDeviceSize offset = 0;
+
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &offset);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, mesh.indexType);
+        }
+
+        vkCmdDrawIndexed(commandBuffer, mesh.indexCount, batch.instanceCount, mesh.firstIndex, mesh.vertexOffset,
+                         batch.firstInstance);
+    }
+}
+
+VulkanDrawQueueStatistics VulkanDrawQueue::Statistics() const
+{
+    return m_statistics;
+}
+
+void BenchmarkDrawQueue(const uint32_t drawCount)
+{
+    using Clock = std::chrono::steady_clock;
+
+    ASSERT(drawCount > 0, "The benchmark requires draws.");
+
+    // A mesh is drawn with one of 2 materials, and a material implies its pipeline and descriptor set.
+    // The handles are never used (nothing is recorded), and all the pipelines share the same layout. The sets
+    // only need to be distinct from the null set, which is never bound.
+    const uint32_t pipelineCount = 16;
+    const uint32_t setCount      = 64;
+    const uint32_t meshCount     = 256;
+
+    VulkanDrawQueue queue;
+    queue.Create(drawCount);
+
+    for (uint32_t p = 0; p < pipelineCount; p++) queue.AddPipeline(VK_NULL_HANDLE, VK_NULL_HANDLE);
+    for (uint64_t s = 1; s <= setCount; s++)
+    {
+        VkDescriptorSet set;
+        static_assert(sizeof(set) == sizeof(s), "Non-dispatchable handles have 64 bits.");
+        memcpy(&set, &s, sizeof(set));
+
+        queue.AddDescriptorSet(set);
+    }
+
+    for (uint32_t m = 0; m < meshCount; m++)     queue.AddMesh({});
+
+    // Deterministic, so that the runs are comparable.
+    uint32_t seed = 1;
+
+    const auto random = [&seed]()
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+        return seed >> 8;
+    };
+
+    std::vector<VulkanDraw> draws(drawCount);
+
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        const uint32_t mesh     = random() % meshCount;
+        const uint32_t material = 2 * mesh + random() % 2;
+
+        draws[i] = { material % pipelineCount, material % setCount, material, mesh,
+                     1.0f + static_cast<float>(random() % 500000) / 1000.0f, i };
+
+        queue.Submit(draws[i]);
+    }
+
+    // Radix sort against std::sort (of the same key and index pairs).
+    std::vector<uint64_t> keys(drawCount), sortedKeys(drawCount), scratchKeys(drawCount);
+    std::vector<uint32_t> indices(drawCount), sortedIndices(drawCount), scratchIndices(drawCount);
+    std::vector<std::pair<uint64_t, uint32_t>> pairs(drawCount);
+
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        keys[i]    = VulkanDrawQueue::MakeKey(draws[i]);
+        indices[i] = i;
+    }
+
+    double radixTime = 1e30, stdTime = 1e30, queueTime = 1e30;
+
+    for (uint32_t run = 0; run < 10; run++)
+    {
+        sortedKeys    = keys;
+        sortedIndices = indices;
+
+        Clock::time_point start = Clock::now();
+
+        RadixSort(sortedKeys.data(), sortedIndices.data(), scratchKeys.data(), scratchIndices.data(), drawCount);
+
+        std::chrono::duration<double, std::milli> duration = Clock::now() - start;
+        radixTime = std::min(radixTime, duration.count());
+
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            pairs[i] = { keys[i], i };
+        }
+
+        start = Clock::now();
+
+        std::sort(pairs.begin(), pairs.end());
+
+        duration = Clock::now() - start;
+        stdTime  = std::min(stdTime, duration.count());
+
+        start = Clock::now();
+
+        queue.Sort();
+
+        duration  = Clock::now() - start;
+        queueTime = std::min(queueTime, duration.count());
+    }
+
+    // The index breaks the ties of std::sort, which makes it stable, like the radix sort.
+    bool isMatch = true;
+
+    for (uint32_t i = 0; i < drawCount; i++)
+    {
+        isMatch = isMatch && (sortedKeys[i] == pairs[i].first) && (sortedIndices[i] == pairs[i].second);
+    }
+
+    const VulkanDrawQueueStatistics statistics = queue.Statistics();
+
+    PrintInfo("Draw queue benchmark (%u draws, %u meshes, %u materials):", drawCount, meshCount, 2 * meshCount);
+    PrintInfo("  Radix sort %7.3f ms | std::sort %7.3f ms (%5.2fx) | %s | Sort() %7.3f ms", radixTime, stdTime,
+              stdTime / radixTime, isMatch ? "match" : "MISMATCH", queueTime);
+    PrintInfo("  Draw calls: %u -> %u | binds: %u -> %u (%u saved, %5.1f%%)", statistics.drawCount,
+              statistics.drawCallCount, statistics.unsortedBindCount, statistics.bindCount,
+              statistics.unsortedBindCount - statistics.bindCount,
+              100.0 * (statistics.unsortedBindCount - statistics.bindCount) / statistics.unsortedBindCount);
+    PrintInfo("  Binds: %u pipelines, %u descriptor sets, %u materials, %u meshes", statistics.pipelineBindCount,
+              statistics.setBindCount, statistics.materialBindCount, statistics.meshBindCount);
+
+    queue.Destroy();
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+// Layout of the sort keys, from the most significant bits (the most expensive state changes) down.
+// The draws are sorted by state first, and front to back (by depth) within the same state.
+#define VK_DRAW_KEY_PIPELINE_BITS 10
+#define VK_DRAW_KEY_SET_BITS      10
+#define VK_DRAW_KEY_MATERIAL_BITS 14
+#define VK_DRAW_KEY_MESH_BITS     14
+#define VK_DRAW_KEY_DEPTH_BITS    16
+
+#define VK_MAX_DRAW_PIPELINES (1u << VK_DRAW_KEY_PIPELINE_BITS)
+#define VK_MAX_DRAW_SETS      (1u << VK_DRAW_KEY_SET_BITS)
+#define VK_MAX_DRAW_MATERIALS (1u << VK_DRAW_KEY_MATERIAL_BITS)
+#define VK_MAX_DRAW_MESHES    (1u << VK_DRAW_KEY_MESH_BITS)
+
+static_assert(VK_DRAW_KEY_PIPELINE_BITS + VK_DRAW_KEY_SET_BITS + VK_DRAW_KEY_MATERIAL_BITS +
+              VK_DRAW_KEY_MESH_BITS + VK_DRAW_KEY_DEPTH_BITS == 64, "The sort key must have 64 bits.");
+
+struct VulkanDrawMesh
+{
+    VkBuffer    vertexBuffer;
+    VkBuffer    indexBuffer;
+    VkIndexType indexType;
+    uint32_t    indexCount;
+    uint32_t    firstIndex;
+    int32_t     vertexOffset;
+};
+
+// The state indices are returned by the Add*() functions of the queue.
+struct VulkanDraw
+{
+    uint32_t pipeline;
+    uint32_t descriptorSet; // Bound as set 1 (set 0 is the bindless set), unless null
+    uint32_t material;
+    uint32_t mesh;
+    float    depth;         // View space distance; negative values are clamped to 0
+    uint32_t instanceData;  // Copied to the instance data of the draw (e.g. the index of the object)
+};
+
+struct VulkanDrawQueueStatistics
+{
+    uint32_t drawCount;          // Submitted
+    uint32_t drawCallCount;      // Recorded, once the identical draws are merged into instanced draws
+    uint32_t bindCount;          // vkCmdBind*() and vkCmdPushConstants() calls
+    uint32_t unsortedBindCount;  // The same, with the draws in submission order, and without merging
+    uint32_t pipelineBindCount;
+    uint32_t setBindCount;
+    uint32_t materialBindCount;
+    uint32_t meshBindCount;      // Vertex and index buffers
+};
+
+// Draw submission queue. Each draw is reduced to a 64-bit key packing its state (pipeline, descriptor set,
+// material and mesh) and its quantized depth, and the keys are radix-sorted once all the draws are submitted.
+// The sorted draws only bind the state which changes between them, and adjacent draws with the same state
+// are merged into a single instanced draw. The per-draw 'instanceData' values are laid out in the sorted order,
+// so that the shaders can fetch them with gl_InstanceIndex (the first instance of a merged draw is its offset).
+// The state objects are registered once (Add*()), and referenced by index. Not thread-safe.
+class VulkanDrawQueue
+{
+public:
+
+    // 'maxDrawCount': the capacity reserved up front (the queue grows beyond it).
+    void Create(const uint32_t maxDrawCount);
+    void Destroy();
+
+    // The material index is pushed at offset 0, so 'layout' must declare a push constant range covering it,
+    // for exactly 'pushConstantStages' (VK_SHADER_STAGE_ALL for the layout of VulkanBindlessHeap).
+    uint32_t AddPipeline(VkPipeline pipeline, VkPipelineLayout layout,
+                         const VkShaderStageFlags pushConstantStages = VK_SHADER_STAGE_ALL);
+    // A null set is never bound, for the draws which only use the bindless set (e.g. with the layout of
+    // VulkanBindlessHeap, which has no set 1). The pipelines of the draws with a non-null set need a layout of
+    // their own, with the bindless set layout as set 0 and the layout of the set as set 1.
+    uint32_t AddDescriptorSet(VkDescriptorSet set);
+    uint32_t AddMesh(const VulkanDrawMesh& mesh);
+
+    // Removes the submitted draws (typically at the beginning of the frame). The state objects are kept.
+    void Reset();
+
+    void Submit(const VulkanDraw& draw);
+
+    // Sorts the submitted draws, merges them, and computes the statistics. Must be called before Record().
+    void Sort();
+
+    // The instance data of the sorted draws. Must be made available to the shaders before the draws execute.
+    const uint32_t* InstanceData() const;
+    uint32_t        InstanceCount() const;
+
+    // Records the sorted draws, inside a render pass.
+    void Record(VkCommandBuffer commandBuffer) const;
+
+    // Of the last Sort().
+    VulkanDrawQueueStatistics Statistics() const;
+
+    static uint64_t MakeKey(const VulkanDraw& draw);
+
+private:
+
+    // Draws merged into a single (instanced) draw call.
+    struct Batch
+    {
+        uint64_t key;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+    };
+
+    std::vector<VkPipeline>         m_pipelines;
+    std::vector<VkPipelineLayout>   m_layouts;             // Of the pipelines
+    std::vector<VkShaderStageFlags> m_pushConstantStages;  // Of the layouts
+    std::vector<VkDescriptorSet>    m_sets;
+    std::vector<VulkanDrawMesh>     m_meshes;
+    std::vector<VulkanDraw>         m_draws;               // In submission order
+    std::vector<uint64_t>           m_keys;                // Sorted
+    std::vector<uint32_t>           m_drawIndices;         // Of the sorted keys
+    std::vector<uint64_t>           m_scratchKeys;
+    std::vector<uint32_t>           m_scratchIndices;
+    std::vector<uint32_t>           m_instanceData;        // In sorted order
+    std::vector<Batch>              m_batches;
+    VulkanDrawQueueStatistics       m_statistics;
+};
+
+// Sorts the keys, and their values along with them (stable). Least significant digit first, 8 bits per pass;
+// the passes over bytes which are identical in all the keys are skipped. The scratch arrays hold 'count' items.
+void RadixSort(uint64_t* keys, uint32_t* values, uint64_t* scratchKeys, uint32_t* scratchValues,
+               const uint32_t count);
+
+// Measures the sort against std::sort, and the binds and draw calls saved, with 'drawCount' random draws
+// of a synthetic scene. Prints a report.
+void BenchmarkDrawQueue(const uint32_t drawCount);
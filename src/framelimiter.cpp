@@ -0,0 +1,49 @@
+#include "framelimiter.h"
+#include "tracer.h"
+
+#include <algorithm>
+#include <thread>
+
+// The OS scheduler may oversleep by a few milliseconds. The remainder of the wait is spent spinning.
+#define FRAME_LIMITER_SPIN_TIME std::chrono::milliseconds(2)
+
+void FrameLimiter::SetFrameRate(const float framesPerSecond)
+{
+    if (framesPerSecond > 0.0f)
+    {
+        m_framePeriod = std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(1.0 / framesPerSecond));
+    }
+    else
+    {
+        m_framePeriod = Clock::duration::zero();
+    }
+
+    m_nextFrameTime = Clock::time_point();
+}
+
+void FrameLimiter::Wait()
+{
+    if (m_framePeriod == Clock::duration::zero()) return;
+
+    TRACE_FUNCTION();
+
+    Clock::time_point now = Clock::now();
+
+    if (now < m_nextFrameTime)
+    {
+        if (m_nextFrameTime - now > FRAME_LIMITER_SPIN_TIME)
+        {
+            std::this_thread::sleep_until(m_nextFrameTime - FRAME_LIMITER_SPIN_TIME);
+        }
+
+        do
+        {
+            std::this_thread::yield();
+            now = Clock::now();
+        } while (now < m_nextFrameTime);
+    }
+
+    // Do not try to catch up after a hitch.
+    m_nextFrameTime = std::max(m_nextFrameTime, now - m_framePeriod) + m_framePeriod;
+}
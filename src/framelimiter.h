@@ -0,0 +1,25 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <chrono>
+
+// Caps the frame rate on the CPU: each call to Wait() returns at most once per frame period.
+// The frames keep a steady cadence, but a frame which starts late does not make the next ones start early.
+class FrameLimiter
+{
+public:
+
+    // 0 removes the cap.
+    void SetFrameRate(const float framesPerSecond);
+
+    // Blocks until the beginning of the next frame period.
+    void Wait();
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration   m_framePeriod;   // 0 if the frame rate is not capped
+    Clock::time_point m_nextFrameTime;
+};
@@ -0,0 +1,602 @@
+#include "gpuculling.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// SPIR-V of 'gpuculling.comp', generated at build time.
+static const uint32_t cullingShaderCode[] = {
+    #include "gpuculling.comp.inc"
+};
+
+// Matches the uniform buffer of the shader (std140).
+struct VulkanGpuCullingConstants
+{
+    float                   planes[6][4];
+    float                   viewProjection[4][4];
+    VulkanDepthPyramidLevel levels[VK_MAX_DEPTH_PYRAMID_LEVELS];
+    uint32_t                instanceCount;
+    uint32_t                compact;
+    uint32_t                levelCount;
+    uint32_t                depthWidth;
+    uint32_t                depthHeight;
+};
+
+// Matches the push constants of the shader.
+struct VulkanGpuCullingPhaseConstants
+{
+    uint32_t phase;
+    uint32_t useOcclusion;
+};
+
+// The largest 'minUniformBufferOffsetAlignment' allowed by the specification.
+#define VK_GPU_CULLING_CONSTANTS_ALIGNMENT 256
+
+static const VkDeviceSize constantsStride = (sizeof(VulkanGpuCullingConstants) + VK_GPU_CULLING_CONSTANTS_ALIGNMENT - 1) &
+                                            ~static_cast<VkDeviceSize>(VK_GPU_CULLING_CONSTANTS_ALIGNMENT - 1);
+
+static void CreateBuffer(VulkanMemoryAllocator* memoryAllocator, const VkDeviceSize size,
+                         const VkBufferUsageFlags usage, const VulkanMemoryUsage memoryUsage,
+                         VkBuffer* buffer, VulkanAllocation* allocation)
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size               = size;
+    bufferInfo.usage              = usage;
+    bufferInfo.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    CHECK_INT(memoryAllocator->CreateBuffer(bufferInfo, memoryUsage, nullptr, buffer, allocation),
+              "Failed to create a GPU culling buffer.");
+}
+
+void VulkanGpuCulling::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                              VulkanMemoryAllocator* memoryAllocator, VulkanGpuProfiler* profiler,
+                              const VulkanDepthPyramid* depthPyramid,
+                              VkPipelineCache pipelineCache, const uint32_t maxInstanceCount,
+                              const uint32_t frameCount, const bool drawIndirectCount, const bool multiDrawIndirect,
+                              const uint32_t maxDrawIndirectCount)
+{
+    assert(maxInstanceCount > 0 && frameCount <= VK_MAX_GPU_CULLING_FRAMES);
+
+    m_device                       = device;
+    m_allocator                    = allocator;
+    m_memoryAllocator              = memoryAllocator;
+    m_profiler                     = profiler;
+    m_depthPyramid                 = depthPyramid;
+    m_maxInstanceCount             = maxInstanceCount;
+    m_instanceCount                = 0;
+    m_frameCount                   = frameCount;
+    m_frameIndex                   = 0;
+    m_maxDrawIndirectCount         = std::max(maxDrawIndirectCount, 1u);
+    m_isDrawIndirectCountSupported = drawIndirectCount && maxInstanceCount <= maxDrawIndirectCount;
+    m_isMultiDrawIndirectSupported = multiDrawIndirect;
+
+    std::fill_n(m_visibleCounts, VK_GPU_CULLING_PHASE_COUNT, VK_GPU_CULLING_NO_RESULT);
+    std::fill_n(&m_isFrameRecorded[0][0], VK_MAX_GPU_CULLING_FRAMES * VK_GPU_CULLING_PHASE_COUNT, false);
+
+    if (!m_isDrawIndirectCountSupported)
+    {
+        PrintWarning("Indirect draw counts are not supported; culled instances are drawn with no instances%s.",
+                     m_isMultiDrawIndirectSupported ? "" : ", one draw call each");
+    }
+
+    const VkShaderStageFlags stage = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    const VkDescriptorSetLayoutBinding bindings[] = {
+        { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }, // Instances
+        { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }, // Early draws
+        { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }, // Late draws
+        { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }, // Counts
+        { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }, // Retest
+        { 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1, stage, nullptr }, // Pyramid
+        { 6, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, stage, nullptr }  // Constants
+    };
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+    setLayoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+    setLayoutInfo.pBindings    = bindings;
+
+    CHECK_INT(vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, m_allocator, &m_setLayout),
+              "Failed to create the GPU culling descriptor set layout.");
+
+    const VkPushConstantRange pushConstantRange = { stage, 0, sizeof(VulkanGpuCullingPhaseConstants) };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount         = 1;
+    pipelineLayoutInfo.pSetLayouts            = &m_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+
+    CHECK_INT(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_allocator, &m_pipelineLayout),
+              "Failed to create the GPU culling pipeline layout.");
+
+    VkShaderModuleCreateInfo shaderInfo = {};
+    shaderInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderInfo.codeSize = sizeof(cullingShaderCode);
+    shaderInfo.pCode    = cullingShaderCode;
+
+    VkShaderModule shader;
+
+    CHECK_INT(vkCreateShaderModule(m_device, &shaderInfo, m_allocator, &shader),
+              "Failed to create the GPU culling shader module.");
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shader;
+    pipelineInfo.stage.pName  = "main";
+    pipelineInfo.layout       = m_pipelineLayout;
+
+    CHECK_INT(vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, m_allocator, &m_pipeline),
+              "Failed to create the GPU culling pipeline.");
+
+    // The pipeline keeps the code.
+    vkDestroyShaderModule(m_device, shader, m_allocator);
+
+    CreateBuffer(m_memoryAllocator, maxInstanceCount * sizeof(VulkanGpuInstance),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_USAGE_GPU_ONLY, &m_instanceBuffer, &m_instanceAllocation);
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        CreateBuffer(m_memoryAllocator, maxInstanceCount * sizeof(VkDrawIndexedIndirectCommand),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                     VK_MEMORY_USAGE_GPU_ONLY, &m_drawBuffers[p], &m_drawAllocations[p]);
+    }
+
+    CreateBuffer(m_memoryAllocator, VK_GPU_CULLING_PHASE_COUNT * sizeof(uint32_t),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT   | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_USAGE_GPU_ONLY, &m_countBuffer, &m_countAllocation);
+    CreateBuffer(m_memoryAllocator, maxInstanceCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_USAGE_GPU_ONLY, &m_retestBuffer, &m_retestAllocation);
+    CreateBuffer(m_memoryAllocator, m_frameCount * constantsStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                 VK_MEMORY_USAGE_CPU_TO_GPU, &m_constantsBuffer, &m_constantsAllocation);
+    CreateBuffer(m_memoryAllocator, m_frameCount * VK_GPU_CULLING_PHASE_COUNT * sizeof(uint32_t),
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_USAGE_GPU_TO_CPU, &m_readbackBuffer,
+                 &m_readbackAllocation);
+
+    // The set refers to the buffers, so it has the same lifetime: it comes from a pool of its own
+    // (rather than from the static sets of VulkanDescriptorAllocator, which outlive their resources).
+    const VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         6 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 }
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets       = 1;
+    poolInfo.poolSizeCount = sizeof(poolSizes) / sizeof(poolSizes[0]);
+    poolInfo.pPoolSizes    = poolSizes;
+
+    CHECK_INT(vkCreateDescriptorPool(m_device, &poolInfo, m_allocator, &m_descriptorPool),
+              "Failed to create the GPU culling descriptor pool.");
+
+    VkDescriptorSetAllocateInfo setInfo = {};
+    setInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool     = m_descriptorPool;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts        = &m_setLayout;
+
+    CHECK_INT(vkAllocateDescriptorSets(m_device, &setInfo, &m_set),
+              "Failed to allocate the GPU culling descriptor set.");
+
+    // The buffers never change, so the set is never updated. The constants of the frame are selected
+    // with the dynamic offset. Without a pyramid, the shader never reads it, and any buffer will do.
+    const VkBuffer setBuffers[6] = {
+        m_instanceBuffer, m_drawBuffers[VK_GPU_CULLING_EARLY], m_drawBuffers[VK_GPU_CULLING_LATE], m_countBuffer,
+        m_retestBuffer, depthPyramid ? depthPyramid->Buffer() : m_retestBuffer
+    };
+
+    VkDescriptorBufferInfo bufferInfos[7];
+    VkWriteDescriptorSet   writes[7] = {};
+
+    for (uint32_t b = 0; b < 6; b++)
+    {
+        bufferInfos[b] = { setBuffers[b], 0, VK_WHOLE_SIZE };
+    }
+
+    bufferInfos[6] = { m_constantsBuffer, 0, sizeof(VulkanGpuCullingConstants) };
+
+    for (uint32_t b = 0; b < 7; b++)
+    {
+        writes[b].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[b].dstSet          = m_set;
+        writes[b].dstBinding      = b;
+        writes[b].descriptorCount = 1;
+        writes[b].descriptorType  = (b == 6) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+                                             : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[b].pBufferInfo     = &bufferInfos[b];
+    }
+
+    vkUpdateDescriptorSets(m_device, 7, writes, 0, nullptr);
+}
+
+void VulkanGpuCulling::Destroy()
+{
+    m_memoryAllocator->DestroyBuffer(m_readbackBuffer,  m_readbackAllocation);
+    m_memoryAllocator->DestroyBuffer(m_constantsBuffer, m_constantsAllocation);
+    m_memoryAllocator->DestroyBuffer(m_retestBuffer,    m_retestAllocation);
+    m_memoryAllocator->DestroyBuffer(m_countBuffer,     m_countAllocation);
+
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        m_memoryAllocator->DestroyBuffer(m_drawBuffers[p], m_drawAllocations[p]);
+    }
+
+    m_memoryAllocator->DestroyBuffer(m_instanceBuffer,  m_instanceAllocation);
+
+    // Destroying the pool also frees the set.
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, m_allocator);
+    vkDestroyPipeline(m_device, m_pipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, m_allocator);
+
+    m_descriptorPool = VK_NULL_HANDLE;
+    m_pipeline       = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+    m_setLayout      = VK_NULL_HANDLE;
+    m_set            = VK_NULL_HANDLE;
+}
+
+VkBuffer VulkanGpuCulling::InstanceBuffer() const
+{
+    return m_instanceBuffer;
+}
+
+void VulkanGpuCulling::SetInstanceCount(const uint32_t count)
+{
+    assert(count <= m_maxInstanceCount);
+
+    m_instanceCount = count;
+}
+
+void VulkanGpuCulling::BeginFrame(const uint32_t frameIndex)
+{
+    assert(frameIndex < m_frameCount);
+
+    m_frameIndex = frameIndex;
+
+    // The frame which previously used the slot has retired, so its counts have landed.
+    const VkDeviceSize readbackSize = VK_GPU_CULLING_PHASE_COUNT * sizeof(uint32_t);
+
+    m_memoryAllocator->Invalidate(m_readbackAllocation, frameIndex * readbackSize, readbackSize);
+
+    for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+    {
+        if (m_isFrameRecorded[frameIndex][p])
+        {
+            m_visibleCounts[p] = reinterpret_cast<const uint32_t*>(m_readbackAllocation.mapped)
+                                 [frameIndex * VK_GPU_CULLING_PHASE_COUNT + p];
+        }
+
+        m_isFrameRecorded[frameIndex][p] = false;
+    }
+}
+
+void VulkanGpuCulling::RecordCulling(VkCommandBuffer commandBuffer, const VulkanCullingView& view)
+{
+    TRACE_FUNCTION();
+
+    if (m_profiler)
+    {
+        m_profiler->BeginScope(commandBuffer, "GPU culling");
+    }
+
+    // The previous frame may still be drawing with (or copying) the counts and the draws it has written.
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdFillBuffer(commandBuffer, m_countBuffer, 0, VK_GPU_CULLING_PHASE_COUNT * sizeof(uint32_t), 0);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // The slot of the frame is no longer read by the GPU (see BeginFrame()).
+    VulkanGpuCullingConstants constants = {};
+    constants.instanceCount = m_instanceCount;
+    constants.compact       = m_isDrawIndirectCountSupported ? 1 : 0;
+
+    std::copy_n(&view.planes[0][0],         6 * 4, &constants.planes[0][0]);
+    std::copy_n(&view.viewProjection[0][0], 4 * 4, &constants.viewProjection[0][0]);
+
+    if (m_depthPyramid)
+    {
+        constants.levelCount  = m_depthPyramid->LevelCount();
+        constants.depthWidth  = m_depthPyramid->Width();
+        constants.depthHeight = m_depthPyramid->Height();
+
+        std::copy_n(m_depthPyramid->Levels(), constants.levelCount, constants.levels);
+    }
+
+    const VkDeviceSize constantsOffset = m_frameIndex * constantsStride;
+
+    memcpy(static_cast<uint8_t*>(m_constantsAllocation.mapped) + constantsOffset, &constants, sizeof(constants));
+    m_memoryAllocator->Flush(m_constantsAllocation, constantsOffset, sizeof(constants));
+
+    // The pyramid is that of the previous frame.
+    RecordDispatch(commandBuffer, VK_GPU_CULLING_EARLY, m_depthPyramid && m_depthPyramid->IsBuilt());
+
+    if (m_profiler)
+    {
+        m_profiler->EndScope(commandBuffer);
+    }
+}
+
+void VulkanGpuCulling::RecordLateCulling(VkCommandBuffer commandBuffer)
+{
+    TRACE_FUNCTION();
+
+    if (!m_depthPyramid)
+    {
+        return;
+    }
+
+    assert(m_isFrameRecorded[m_frameIndex][VK_GPU_CULLING_EARLY]);
+
+    if (m_profiler)
+    {
+        m_profiler->BeginScope(commandBuffer, "GPU late culling");
+    }
+
+    RecordDispatch(commandBuffer, VK_GPU_CULLING_LATE, true);
+
+    if (m_profiler)
+    {
+        m_profiler->EndScope(commandBuffer);
+    }
+}
+
+void VulkanGpuCulling::RecordDispatch(VkCommandBuffer commandBuffer, const VulkanGpuCullingPhase phase,
+                                      const bool useOcclusion)
+{
+    const VulkanGpuCullingPhaseConstants constants = { phase, useOcclusion ? 1u : 0u };
+    const uint32_t                       offset    = static_cast<uint32_t>(m_frameIndex * constantsStride);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_set,
+                            1, &offset);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(commandBuffer, (m_instanceCount + VK_GPU_CULLING_GROUP_SIZE - 1) / VK_GPU_CULLING_GROUP_SIZE,
+                  1, 1);
+
+    // The late phase also reads the retest flags written by the early one.
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+                              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // Read by the host once the fence of the frame is signaled.
+    const VkBufferCopy region = { phase * sizeof(uint32_t),
+                                  (m_frameIndex * VK_GPU_CULLING_PHASE_COUNT + phase) * sizeof(uint32_t),
+                                  sizeof(uint32_t) };
+
+    vkCmdCopyBuffer(commandBuffer, m_countBuffer, m_readbackBuffer, 1, &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    m_isFrameRecorded[m_frameIndex][phase] = true;
+}
+
+void VulkanGpuCulling::RecordDraws(VkCommandBuffer commandBuffer, const VulkanGpuCullingPhase phase) const
+{
+    // Without occlusion culling, everything is drawn by the early phase.
+    if (phase == VK_GPU_CULLING_LATE && !m_depthPyramid)
+    {
+        return;
+    }
+
+    const uint32_t stride     = sizeof(VkDrawIndexedIndirectCommand);
+    const VkBuffer drawBuffer = m_drawBuffers[phase];
+
+    if (m_isDrawIndirectCountSupported)
+    {
+        vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, 0, m_countBuffer, phase * sizeof(uint32_t),
+                                      m_instanceCount, stride);
+    }
+    else if (m_isMultiDrawIndirectSupported)
+    {
+        for (uint32_t first = 0; first < m_instanceCount; first += m_maxDrawIndirectCount)
+        {
+            const uint32_t count = std::min(m_instanceCount - first, m_maxDrawIndirectCount);
+
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, static_cast<VkDeviceSize>(first) * stride, count,
+                                     stride);
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < m_instanceCount; i++)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, static_cast<VkDeviceSize>(i) * stride, 1, stride);
+        }
+    }
+}
+
+uint32_t VulkanGpuCulling::VisibleCount(const VulkanGpuCullingPhase phase) const
+{
+    return m_visibleCounts[phase];
+}
+
+// The tests of 'gpuculling.comp', in the same order. A positive 'bias' (in world units for the planes,
+// in depth units for the pyramid) favors visibility, a negative one favors culling.
+static bool IsInFrustum(const VulkanGpuInstance& instance, const VulkanCullingView& view, const float bias)
+{
+    bool visible = true;
+
+    for (uint32_t p = 0; p < 6; p++)
+    {
+        const float* plane = view.planes[p];
+
+        const float distance = plane[0] * instance.center[0] + plane[1] * instance.center[1] +
+                               plane[2] * instance.center[2] + plane[3];
+
+        visible = visible && distance >= -instance.radius - bias;
+    }
+
+    return visible;
+}
+
+static bool IsOccluded(const VulkanGpuInstance& instance, const VulkanCullingView& view, const float* pyramid,
+                       const VulkanDepthPyramidLevel* levels, const uint32_t levelCount,
+                       const uint32_t depthWidth, const uint32_t depthHeight, const float bias)
+{
+    const float (*vp)[4] = view.viewProjection;
+    const float  r       = instance.radius;
+
+    float minX = 1.0f, minY = 1.0f, minZ = 1.0f;
+    float maxX = -1.0f, maxY = -1.0f;
+
+    for (uint32_t c = 0; c < 8; c++)
+    {
+        const float cx = (c & 1) ? instance.center[0] + r : instance.center[0] - r;
+        const float cy = (c & 2) ? instance.center[1] + r : instance.center[1] - r;
+        const float cz = (c & 4) ? instance.center[2] + r : instance.center[2] - r;
+
+        const float x = vp[0][0] * cx + vp[1][0] * cy + vp[2][0] * cz + vp[3][0];
+        const float y = vp[0][1] * cx + vp[1][1] * cy + vp[2][1] * cz + vp[3][1];
+        const float z = vp[0][2] * cx + vp[1][2] * cy + vp[2][2] * cz + vp[3][2];
+        const float w = vp[0][3] * cx + vp[1][3] * cy + vp[2][3] * cz + vp[3][3];
+
+        if (z < 0.0f || w <= 0.0f) return false;
+
+        minX = std::min(minX, x / w);
+        minY = std::min(minY, y / w);
+        minZ = std::min(minZ, z / w);
+        maxX = std::max(maxX, x / w);
+        maxY = std::max(maxY, y / w);
+    }
+
+    const float u0 = std::min(std::max(minX * 0.5f + 0.5f, 0.0f), 1.0f) * static_cast<float>(depthWidth);
+    const float v0 = std::min(std::max(minY * 0.5f + 0.5f, 0.0f), 1.0f) * static_cast<float>(depthHeight);
+    const float u1 = std::min(std::max(maxX * 0.5f + 0.5f, 0.0f), 1.0f) * static_cast<float>(depthWidth);
+    const float v1 = std::min(std::max(maxY * 0.5f + 0.5f, 0.0f), 1.0f) * static_cast<float>(depthHeight);
+
+    const uint32_t x0 = std::min(static_cast<uint32_t>(u0), depthWidth  - 1);
+    const uint32_t y0 = std::min(static_cast<uint32_t>(v0), depthHeight - 1);
+    const uint32_t x1 = std::min(static_cast<uint32_t>(u1), depthWidth  - 1);
+    const uint32_t y1 = std::min(static_cast<uint32_t>(v1), depthHeight - 1);
+
+    for (uint32_t l = 0; l < levelCount; l++)
+    {
+        const uint32_t tx0 = x0 >> (l + 1);
+        const uint32_t ty0 = y0 >> (l + 1);
+        const uint32_t tx1 = x1 >> (l + 1);
+        const uint32_t ty1 = y1 >> (l + 1);
+
+        if (tx1 - tx0 > 1 || ty1 - ty0 > 1) continue;
+
+        const float*   level = pyramid + levels[l].offset;
+        const uint32_t width = levels[l].width;
+
+        const float depth = std::max(std::max(level[ty0 * width + tx0], level[ty0 * width + tx1]),
+                                     std::max(level[ty1 * width + tx0], level[ty1 * width + tx1]));
+
+        return minZ > depth + bias;
+    }
+
+    return false;
+}
+
+// Returns the phase which finds the instance visible, or VK_GPU_CULLING_PHASE_COUNT if it is culled.
+static VulkanGpuCullingPhase ClassifyInstance(const VulkanGpuInstance& instance, const VulkanCullingView& view,
+                                              const float* earlyPyramid, const float* latePyramid,
+                                              const VulkanDepthPyramidLevel* levels, const uint32_t levelCount,
+                                              const uint32_t depthWidth, const uint32_t depthHeight,
+                                              const float planeBias, const float depthBias)
+{
+    if (!IsInFrustum(instance, view, planeBias))
+    {
+        return VK_GPU_CULLING_PHASE_COUNT;
+    }
+
+    if (!earlyPyramid ||
+        !IsOccluded(instance, view, earlyPyramid, levels, levelCount, depthWidth, depthHeight, depthBias))
+    {
+        return VK_GPU_CULLING_EARLY;
+    }
+
+    if (latePyramid &&
+        !IsOccluded(instance, view, latePyramid, levels, levelCount, depthWidth, depthHeight, depthBias))
+    {
+        return VK_GPU_CULLING_LATE;
+    }
+
+    return VK_GPU_CULLING_PHASE_COUNT;
+}
+
+void VulkanGpuCulling::CountVisibleInstances(const VulkanGpuInstance* instances, const uint32_t count,
+                                             const VulkanCullingView& view, const float* earlyPyramid,
+                                             const float* latePyramid, const uint32_t depthWidth,
+                                             const uint32_t depthHeight, const float planeEpsilon,
+                                             const float depthEpsilon,
+                                             uint32_t visibleCounts[VK_GPU_CULLING_PHASE_COUNT],
+                                             uint32_t* boundaryCount)
+{
+    VulkanDepthPyramidLevel levels[VK_MAX_DEPTH_PYRAMID_LEVELS];
+    uint32_t                levelCount = 0;
+    uint32_t                totalSize;
+
+    if (earlyPyramid || latePyramid)
+    {
+        levelCount = VulkanDepthPyramid::GetLevels(depthWidth, depthHeight, levels, &totalSize);
+    }
+
+    visibleCounts[VK_GPU_CULLING_EARLY] = 0;
+    visibleCounts[VK_GPU_CULLING_LATE]  = 0;
+
+    *boundaryCount = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const VulkanGpuInstance& instance = instances[i];
+
+        const VulkanGpuCullingPhase phase = ClassifyInstance(instance, view, earlyPyramid, latePyramid, levels,
+                                                             levelCount, depthWidth, depthHeight, 0.0f, 0.0f);
+
+        if (phase != VK_GPU_CULLING_PHASE_COUNT)
+        {
+            visibleCounts[phase]++;
+        }
+
+        // Each test is monotonic in its bias, so the instance is within the band of a test
+        // if and only if the outcome differs between the two edges of the bands.
+        const VulkanGpuCullingPhase culledPhase  = ClassifyInstance(instance, view, earlyPyramid, latePyramid,
+                                                                    levels, levelCount, depthWidth, depthHeight,
+                                                                    -planeEpsilon, -depthEpsilon);
+        const VulkanGpuCullingPhase visiblePhase = ClassifyInstance(instance, view, earlyPyramid, latePyramid,
+                                                                    levels, levelCount, depthWidth, depthHeight,
+                                                                    planeEpsilon, depthEpsilon);
+
+        if (culledPhase != visiblePhase)
+        {
+            (*boundaryCount)++;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "depthpyramid.h"
+#include "gpuprofiler.h"
+#include "memoryallocator.h"
+#include "vectormath.h"
+
+#define VK_GPU_CULLING_GROUP_SIZE 64  // Instances per workgroup (see 'gpuculling.comp')
+#define VK_MAX_GPU_CULLING_FRAMES 4
+#define VK_GPU_CULLING_NO_RESULT  UINT32_MAX
+
+// Bounding sphere and draw arguments of an instance. Matches the layout of the shader.
+struct VulkanGpuInstance
+{
+    float    center[3];
+    float    radius;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t  vertexOffset;
+    uint32_t firstInstance; // gl_InstanceIndex of the draw; typically the index of the per-instance data
+};
+
+static_assert(sizeof(VulkanGpuInstance) == 32, "The layout must match the shader.");
+
+// The camera the instances are culled for.
+struct VulkanCullingView
+{
+    float planes[6][4];          // Of the view frustum (see Frustum)
+    float viewProjection[4][4];  // Column-major (see Mat4)
+};
+
+// The instances are culled in two phases when occlusion culling is enabled.
+enum VulkanGpuCullingPhase : uint32_t
+{
+    VK_GPU_CULLING_EARLY, // Against the depth pyramid of the previous frame
+    VK_GPU_CULLING_LATE,  // The instances occluded in the early phase, against the pyramid of the early draws
+    VK_GPU_CULLING_PHASE_COUNT
+};
+
+// GPU-driven frustum and occlusion culling. The instances live in a device-local storage buffer.
+// Each frame, a compute shader tests their bounding spheres against the frustum, and writes
+// an indirect draw per instance into another buffer, which is then consumed by a single indirect draw call.
+// The CPU cost does not depend on the number of instances, except for the fallback paths:
+// - with 'drawIndirectCount', the visible draws are compacted, and the GPU reads the draw count from a buffer;
+// - with 'multiDrawIndirect' only, all the draws are issued, and the culled ones have no instances;
+// - otherwise, one indirect draw call is recorded per instance.
+// With a depth pyramid (see VulkanDepthPyramid), the instances are also tested against the depth of the scene:
+// 1. early culling, against the pyramid of the previous frame, and early draws;
+// 2. the pyramid is rebuilt from the depth of the early draws;
+// 3. late culling: the instances occluded in the early phase are tested again against the new pyramid
+//    (the previous depth is only an estimate), and late draws of the ones which turn out to be visible.
+// The pyramid also serves the early phase of the next frame. Nothing visible is ever culled,
+// while the occluders of the previous frame save most of the shading of the occluded instances.
+// The number of visible instances of each phase is also copied to host memory, and read back once the frame retires.
+class VulkanGpuCulling
+{
+public:
+
+    // 'maxDrawIndirectCount': see VkPhysicalDeviceLimits. 'profiler': times the culling (optional).
+    // 'depthPyramid': enables occlusion culling (optional); must outlive the culling.
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, VulkanMemoryAllocator* memoryAllocator,
+                VulkanGpuProfiler* profiler, const VulkanDepthPyramid* depthPyramid, VkPipelineCache pipelineCache,
+                const uint32_t maxInstanceCount, const uint32_t frameCount, const bool drawIndirectCount,
+                const bool multiDrawIndirect, const uint32_t maxDrawIndirectCount);
+
+    // The GPU must be idle.
+    void Destroy();
+
+    // The buffer the instances must be copied to (e.g. with VulkanAsyncUploader). It may also be bound
+    // as a vertex buffer, for per-instance attributes (firstInstance of the draws is that of the instances).
+    VkBuffer InstanceBuffer() const;
+
+    // The instances [0, 'count') are culled. At most 'maxInstanceCount'.
+    void SetInstanceCount(const uint32_t count);
+
+    // Must be called when recording of the frame in the slot 'frameIndex' begins.
+    // The GPU must have finished executing the frame which previously used the slot.
+    void BeginFrame(const uint32_t frameIndex);
+
+    // Records the early culling pass (the only one without a depth pyramid), once per frame.
+    // Occlusion culling starts once the pyramid has been built. The results are visible to the draws
+    // (and to the late culling pass) recorded afterwards.
+    void RecordCulling(VkCommandBuffer commandBuffer, const VulkanCullingView& view);
+
+    // Records the late culling pass, after the early one, once the pyramid has been rebuilt from the depth
+    // of the early draws. Does nothing without a depth pyramid.
+    void RecordLateCulling(VkCommandBuffer commandBuffer);
+
+    // Records the draws of the instances found visible by the phase. A graphics pipeline (and the index buffer)
+    // must be bound.
+    void RecordDraws(VkCommandBuffer commandBuffer, const VulkanGpuCullingPhase phase) const;
+
+    // The number of instances found visible by the phase during the most recent frame which has retired,
+    // or VK_GPU_CULLING_NO_RESULT if no such frame has recorded the phase yet.
+    uint32_t VisibleCount(const VulkanGpuCullingPhase phase) const;
+
+    // Reference implementation, used to validate the results of the GPU. The pyramids (see
+    // VulkanDepthPyramid::BuildReference()) are those of the early and late phases (null to skip a phase).
+    // The GPU evaluates the same tests with a different rounding (e.g. fused multiply-adds), so an instance
+    // within 'planeEpsilon' of a plane, or within 'depthEpsilon' of the depth of the pyramid, may legitimately
+    // be classified differently. Their number is returned in 'boundaryCount': the counts of the GPU are
+    // consistent with the reference as long as they do not differ from it by more than that.
+    static void CountVisibleInstances(const VulkanGpuInstance* instances, const uint32_t count,
+                                      const VulkanCullingView& view, const float* earlyPyramid,
+                                      const float* latePyramid, const uint32_t depthWidth,
+                                      const uint32_t depthHeight, const float planeEpsilon,
+                                      const float depthEpsilon, uint32_t visibleCounts[VK_GPU_CULLING_PHASE_COUNT],
+                                      uint32_t* boundaryCount);
+
+private:
+
+    void RecordDispatch(VkCommandBuffer commandBuffer, const VulkanGpuCullingPhase phase, const bool useOcclusion);
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VulkanMemoryAllocator*       m_memoryAllocator;
+    VulkanGpuProfiler*           m_profiler;          // Optional
+    const VulkanDepthPyramid*    m_depthPyramid;      // Optional
+    VkDescriptorSetLayout        m_setLayout;
+    VkPipelineLayout             m_pipelineLayout;
+    VkPipeline                   m_pipeline;
+    VkDescriptorPool             m_descriptorPool;    // Of the set
+    VkDescriptorSet              m_set;
+    VkBuffer                     m_instanceBuffer;    // VulkanGpuInstance[maxInstanceCount]
+    VulkanAllocation             m_instanceAllocation;
+    VkBuffer                     m_drawBuffers[VK_GPU_CULLING_PHASE_COUNT]; // VkDrawIndexedIndirectCommand[maxInstanceCount]
+    VulkanAllocation             m_drawAllocations[VK_GPU_CULLING_PHASE_COUNT];
+    VkBuffer                     m_countBuffer;       // uint32_t[VK_GPU_CULLING_PHASE_COUNT]
+    VulkanAllocation             m_countAllocation;
+    VkBuffer                     m_retestBuffer;      // uint32_t[maxInstanceCount]: occluded in the early phase
+    VulkanAllocation             m_retestAllocation;
+    VkBuffer                     m_constantsBuffer;   // VulkanGpuCullingConstants[frameCount] (aligned)
+    VulkanAllocation             m_constantsAllocation;
+    VkBuffer                     m_readbackBuffer;    // uint32_t[frameCount][VK_GPU_CULLING_PHASE_COUNT]
+    VulkanAllocation             m_readbackAllocation;
+    uint32_t                     m_maxInstanceCount;
+    uint32_t                     m_instanceCount;
+    uint32_t                     m_frameCount;
+    uint32_t                     m_frameIndex;
+    uint32_t                     m_visibleCounts[VK_GPU_CULLING_PHASE_COUNT]; // Of the most recent frame which has retired
+    uint32_t                     m_maxDrawIndirectCount;
+    bool                         m_isDrawIndirectCountSupported;
+    bool                         m_isMultiDrawIndirectSupported;
+    bool                         m_isFrameRecorded[VK_MAX_GPU_CULLING_FRAMES][VK_GPU_CULLING_PHASE_COUNT]; // The slot holds a result
+};
@@ -0,0 +1,194 @@
+#include "gpuprofiler.h"
+#include "utility.h"
+
+#include <cassert>
+
+#define VK_GPU_PROFILER_QUERIES (2 * VK_MAX_GPU_PROFILER_SCOPES)
+
+void VulkanGpuProfiler::Create(VkDevice device, const VkAllocationCallbacks* allocator, const uint32_t frameCount,
+                               const float timestampPeriod, const uint32_t timestampValidBits, string_t name)
+{
+    assert(frameCount <= VK_MAX_GPU_PROFILER_FRAMES);
+
+    m_device        = device;
+    m_allocator     = allocator;
+    m_frameCount    = frameCount;
+    m_tickPeriodMs  = 1e-6 * static_cast<double>(timestampPeriod);
+    m_timestampMask = (timestampValidBits >= 64) ? UINT64_MAX : ((1ull << timestampValidBits) - 1);
+    m_enabled       = (timestampValidBits > 0);
+    m_current       = nullptr;
+    m_openScope     = UINT32_MAX;
+    m_skippedScopes = 0;
+    m_hasOverflowed = false;
+    m_timingCount   = 0;
+    m_traceTrack    = nullptr;
+
+    if (!m_enabled)
+    {
+        PrintWarning("The queue does not support timestamps. GPU profiling (\'%s\') is disabled.", name);
+        return;
+    }
+
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = VK_GPU_PROFILER_QUERIES;
+
+    for (uint32_t i = 0; i < m_frameCount; i++)
+    {
+        CHECK_INT(vkCreateQueryPool(m_device, &queryPoolInfo, m_allocator, &m_frames[i].pool),
+                  "Failed to create a query pool.");
+
+        m_frames[i].scopeCount = 0;
+    }
+
+    m_traceTrack = TraceCreateTrack(name);
+}
+
+void VulkanGpuProfiler::Destroy()
+{
+    if (!m_enabled) return;
+
+    for (uint32_t i = 0; i < m_frameCount; i++)
+    {
+        vkDestroyQueryPool(m_device, m_frames[i].pool, m_allocator);
+        m_frames[i].pool = VK_NULL_HANDLE;
+    }
+}
+
+void VulkanGpuProfiler::ReadBackResults(FrameQueries& queries)
+{
+    if (queries.scopeCount == 0) return;
+
+    uint64_t timestamps[VK_GPU_PROFILER_QUERIES];
+
+    // The frame has retired, so the results are available, and there is no need to wait.
+    VkResult result = vkGetQueryPoolResults(m_device, queries.pool, 0, 2 * queries.scopeCount,
+                                            sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                            VK_QUERY_RESULT_64_BIT);
+
+    // Keep the results of the previous frame if the current ones are incomplete.
+    if (result != VK_SUCCESS) return;
+
+    for (uint32_t s = 0; s < queries.scopeCount; s++)
+    {
+        const uint64_t begin = timestamps[2 * s]     & m_timestampMask;
+        const uint64_t end   = timestamps[2 * s + 1] & m_timestampMask;
+        // Account for a possible wrap-around.
+        const uint64_t ticks = (end - begin) & m_timestampMask;
+
+        m_timings[s].name         = queries.scopes[s].name;
+        m_timings[s].parent       = queries.scopes[s].parent;
+        m_timings[s].depth        = queries.scopes[s].depth;
+        m_timings[s].milliseconds = static_cast<float>(static_cast<double>(ticks) * m_tickPeriodMs);
+    }
+
+    m_timingCount = queries.scopeCount;
+
+    if (TraceIsEnabled())
+    {
+        // The GPU and the CPU clocks are not calibrated. Approximate the start of the frame on the GPU
+        // by the end of its recording on the CPU, which puts a lower bound on the start time.
+        const uint64_t frameBegin = timestamps[0] & m_timestampMask;
+
+        for (uint32_t s = 0; s < queries.scopeCount; s++)
+        {
+            const uint64_t begin   = ((timestamps[2 * s] & m_timestampMask) - frameBegin) & m_timestampMask;
+            const uint64_t beginNs = queries.cpuTimeNs + static_cast<uint64_t>(1e6 * m_tickPeriodMs * begin);
+            const uint64_t endNs   = beginNs + static_cast<uint64_t>(1e6 * m_timings[s].milliseconds);
+
+            TraceRecordZone(m_traceTrack, m_timings[s].name, beginNs, endNs);
+        }
+    }
+}
+
+void VulkanGpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, const uint32_t frameIndex)
+{
+    if (!m_enabled) return;
+
+    assert(frameIndex < m_frameCount);
+    assert(m_openScope == UINT32_MAX && "The previous frame has unterminated scopes.");
+
+    m_current = &m_frames[frameIndex];
+
+    ReadBackResults(*m_current);
+
+    m_current->scopeCount = 0;
+
+    vkCmdResetQueryPool(commandBuffer, m_current->pool, 0, VK_GPU_PROFILER_QUERIES);
+
+    BeginScope(commandBuffer, "Frame");
+}
+
+void VulkanGpuProfiler::EndFrame(VkCommandBuffer commandBuffer)
+{
+    if (!m_enabled) return;
+
+    EndScope(commandBuffer);
+
+    assert(m_openScope == UINT32_MAX && "Unterminated GPU profiler scope.");
+
+    m_current->cpuTimeNs = TraceNow();
+}
+
+void VulkanGpuProfiler::BeginScope(VkCommandBuffer commandBuffer, string_t name)
+{
+    if (!m_enabled) return;
+
+    assert(m_current && "BeginFrame() has not been called.");
+
+    if (m_current->scopeCount == VK_MAX_GPU_PROFILER_SCOPES)
+    {
+        // The query pool has a fixed size, so the overflow recurs every frame. It is reported once.
+        if (!m_hasOverflowed)
+        {
+            PrintWarning("Too many GPU profiler scopes (more than %u). Skipping scope \'%s\' and the following ones.",
+                         VK_MAX_GPU_PROFILER_SCOPES, name);
+            m_hasOverflowed = true;
+        }
+
+        m_skippedScopes++;
+        return;
+    }
+
+    const uint32_t s = m_current->scopeCount++;
+
+    Scope& scope = m_current->scopes[s];
+    scope.name   = name;
+    scope.parent = m_openScope;
+    scope.depth  = (m_openScope == UINT32_MAX) ? 0 : (m_current->scopes[m_openScope].depth + 1);
+
+    m_openScope = s;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_current->pool, 2 * s);
+}
+
+void VulkanGpuProfiler::EndScope(VkCommandBuffer commandBuffer)
+{
+    if (!m_enabled) return;
+
+    if (m_skippedScopes > 0)
+    {
+        m_skippedScopes--;
+        return;
+    }
+
+    assert(m_openScope != UINT32_MAX && "EndScope() without a matching BeginScope().");
+
+    const uint32_t s = m_openScope;
+
+    m_openScope = m_current->scopes[s].parent;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_current->pool, 2 * s + 1);
+}
+
+uint32_t VulkanGpuProfiler::GetScopeTimings(const GpuScopeTiming** timings) const
+{
+    *timings = m_timings;
+    return m_timingCount;
+}
+
+float VulkanGpuProfiler::FrameTime() const
+{
+    return (m_timingCount > 0) ? m_timings[0].milliseconds : 0.0f;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "definitions.h"
+#include "tracer.h"
+
+#include <vulkan/vulkan.h>
+
+#define VK_MAX_GPU_PROFILER_SCOPES 64
+#define VK_MAX_GPU_PROFILER_FRAMES 4
+
+// GPU time of a named scope (e.g. a render pass) of a frame.
+struct GpuScopeTiming
+{
+    string_t name;         // Points to a string literal
+    uint32_t parent;       // Index of the enclosing scope; UINT32_MAX for the frame itself
+    uint32_t depth;        // Nesting level; 0 for the frame itself
+    float    milliseconds;
+};
+
+// Measures GPU execution time of hierarchical named scopes using timestamp queries.
+// There is one query pool per frame in flight; the results of a frame are read back
+// once the frame has retired (which is right before its slot is reused), so readback never stalls.
+class VulkanGpuProfiler
+{
+public:
+
+    // 'timestampPeriod': the number of nanoseconds per timestamp tick (see VkPhysicalDeviceLimits).
+    // 'timestampValidBits': see VkQueueFamilyProperties. Profiling is disabled if it is 0.
+    // 'name': of the trace track which receives the scopes. Must point to a string literal.
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, const uint32_t frameCount,
+                const float timestampPeriod, const uint32_t timestampValidBits, string_t name = "GPU");
+    void Destroy();
+
+    // Must be called when recording of the frame in the slot 'frameIndex' begins.
+    // The GPU must have finished executing the frame which previously used the slot.
+    void BeginFrame(VkCommandBuffer commandBuffer, const uint32_t frameIndex);
+
+    // Must be called before recording of the frame ends.
+    void EndFrame(VkCommandBuffer commandBuffer);
+
+    // Scopes must be nested properly. 'name' must point to a string literal.
+    void BeginScope(VkCommandBuffer commandBuffer, string_t name);
+    void EndScope(VkCommandBuffer commandBuffer);
+
+    // Returns the number of scopes of the most recent frame for which the results are available.
+    // The first scope is the entire frame; the rest are in the order they begin.
+    uint32_t GetScopeTimings(const GpuScopeTiming** timings) const;
+
+    // Returns the GPU time (in milliseconds) of the most recent frame for which the results are available.
+    float FrameTime() const;
+
+private:
+
+    struct Scope
+    {
+        string_t name;
+        uint32_t parent;
+        uint32_t depth;
+    };
+
+    struct FrameQueries
+    {
+        VkQueryPool pool;
+        uint32_t    scopeCount; // Each scope uses 2 queries: [begin, end]
+        Scope       scopes[VK_MAX_GPU_PROFILER_SCOPES];
+        uint64_t    cpuTimeNs;  // CPU time (see TraceNow()) at the end of recording
+    };
+
+    void ReadBackResults(FrameQueries& queries);
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    uint32_t                     m_frameCount;
+    double                       m_tickPeriodMs;
+    uint64_t                     m_timestampMask;
+    bool                         m_enabled;
+    FrameQueries                 m_frames[VK_MAX_GPU_PROFILER_FRAMES];
+    FrameQueries*                m_current;
+    uint32_t                     m_openScope;     // Innermost scope which has not ended yet
+    uint32_t                     m_skippedScopes; // Scopes which did not fit into the query pool
+    bool                         m_hasOverflowed; // The overflow of the query pool has been reported
+    uint32_t                     m_timingCount;
+    GpuScopeTiming               m_timings[VK_MAX_GPU_PROFILER_SCOPES];
+    TraceTrack*                  m_traceTrack;    // Receives the GPU scopes if CPU tracing is enabled
+};
@@ -0,0 +1,365 @@
+#include "hostallocator.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+#define VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE 16
+#define VK_HOST_ALLOCATOR_MAX_BLOCK_SIZE (VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE << (VK_HOST_ALLOCATOR_SIZE_CLASSES - 1))
+#define VK_HOST_ALLOCATOR_LARGE_CLASS    UINT8_MAX
+
+// Precedes every allocation, so that it can be freed and reallocated without a lookup.
+struct AllocationHeader
+{
+    uint64_t size;      // Requested size
+    uint32_t offset;    // From the beginning of the block to the allocation
+    uint8_t  sizeClass; // VK_HOST_ALLOCATOR_LARGE_CLASS if not pooled
+    uint8_t  scope;
+    uint8_t  padding[2];
+};
+
+static_assert(sizeof(AllocationHeader) == VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE, "Unexpected allocation header size.");
+static_assert(VK_HOST_ALLOCATOR_MAX_BLOCK_SIZE <= VK_HOST_ALLOCATOR_SLAB_SIZE, "Slabs are too small.");
+
+static void* AlignedAlloc(const size_t size, const size_t alignment)
+{
+#ifdef _MSC_VER
+    return _aligned_malloc(size, alignment);
+#else
+    void* memory = nullptr;
+    return (posix_memalign(&memory, alignment, size) == 0) ? memory : nullptr;
+#endif
+}
+
+static void AlignedFree(void* memory)
+{
+#ifdef _MSC_VER
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+static inline AllocationHeader* GetHeader(void* memory)
+{
+    return reinterpret_cast<AllocationHeader*>(static_cast<byte_t*>(memory) - sizeof(AllocationHeader));
+}
+
+// Returns the index of the smallest size class which can hold 'blockSize' bytes.
+static inline uint32_t GetSizeClass(const size_t blockSize)
+{
+    uint32_t sizeClass = 0;
+
+    while ((static_cast<size_t>(VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE) << sizeClass) < blockSize)
+    {
+        sizeClass++;
+    }
+
+    return sizeClass;
+}
+
+VulkanHostAllocator::VulkanHostAllocator()
+{
+    m_callbacks.pUserData             = this;
+    m_callbacks.pfnAllocation         = AllocationCallback;
+    m_callbacks.pfnReallocation       = ReallocationCallback;
+    m_callbacks.pfnFree               = FreeCallback;
+    m_callbacks.pfnInternalAllocation = InternalAllocationCallback;
+    m_callbacks.pfnInternalFree       = InternalFreeCallback;
+
+    for (Arena& arena : m_arenas)
+    {
+        std::fill_n(arena.freeLists, VK_HOST_ALLOCATOR_SIZE_CLASSES, nullptr);
+        arena.slabs = nullptr;
+
+        Counters& c = arena.counters;
+        c.liveBytes            = 0;
+        c.peakLiveBytes        = 0;
+        c.liveAllocations      = 0;
+        c.totalAllocations     = 0;
+        c.frameAllocations     = 0;
+        c.lastFrameAllocations = 0;
+        c.pooledAllocations    = 0;
+        c.reservedSlabBytes    = 0;
+        c.internalBytes        = 0;
+    }
+}
+
+VulkanHostAllocator::~VulkanHostAllocator()
+{
+    for (uint32_t s = 0; s < VK_HOST_ALLOCATOR_SCOPES; s++)
+    {
+        Arena& arena = m_arenas[s];
+
+        if (arena.counters.liveAllocations > 0)
+        {
+            PrintWarning("Host allocator: %llu allocations leaked in scope %u.",
+                         static_cast<unsigned long long>(arena.counters.liveAllocations.load()), s);
+        }
+
+        for (Slab* slab = arena.slabs; slab;)
+        {
+            Slab* next = slab->next;
+            AlignedFree(slab);
+            slab = next;
+        }
+    }
+}
+
+const VkAllocationCallbacks* VulkanHostAllocator::Callbacks() const
+{
+    return &m_callbacks;
+}
+
+void VulkanHostAllocator::NewFrame()
+{
+    for (Arena& arena : m_arenas)
+    {
+        Counters& c = arena.counters;
+        c.lastFrameAllocations.store(c.frameAllocations.exchange(0, std::memory_order_relaxed),
+                                     std::memory_order_relaxed);
+    }
+}
+
+VulkanHostAllocatorStatistics VulkanHostAllocator::Statistics(const VkSystemAllocationScope scope) const
+{
+    assert(scope < VK_HOST_ALLOCATOR_SCOPES);
+
+    const Counters& c = m_arenas[scope].counters;
+
+    VulkanHostAllocatorStatistics stats;
+    stats.liveBytes         = c.liveBytes.load(std::memory_order_relaxed);
+    stats.peakLiveBytes     = c.peakLiveBytes.load(std::memory_order_relaxed);
+    stats.liveAllocations   = c.liveAllocations.load(std::memory_order_relaxed);
+    stats.totalAllocations  = c.totalAllocations.load(std::memory_order_relaxed);
+    stats.frameAllocations  = c.lastFrameAllocations.load(std::memory_order_relaxed);
+    stats.pooledAllocations = c.pooledAllocations.load(std::memory_order_relaxed);
+    stats.reservedSlabBytes = c.reservedSlabBytes.load(std::memory_order_relaxed);
+    stats.internalBytes     = c.internalBytes.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void VulkanHostAllocator::PrintStatistics() const
+{
+    static string_t scopeNames[VK_HOST_ALLOCATOR_SCOPES] = { "Command", "Object", "Cache", "Device", "Instance" };
+
+    for (uint32_t s = 0; s < VK_HOST_ALLOCATOR_SCOPES; s++)
+    {
+        const VulkanHostAllocatorStatistics stats = Statistics(static_cast<VkSystemAllocationScope>(s));
+
+        PrintInfo("Host allocator: %-8s | live: %8llu B | peak: %8llu B | allocs: %8llu (%llu pooled) | "
+                  "slabs: %8llu B | internal: %8llu B",
+                  scopeNames[s],
+                  static_cast<unsigned long long>(stats.liveBytes),
+                  static_cast<unsigned long long>(stats.peakLiveBytes),
+                  static_cast<unsigned long long>(stats.totalAllocations),
+                  static_cast<unsigned long long>(stats.pooledAllocations),
+                  static_cast<unsigned long long>(stats.reservedSlabBytes),
+                  static_cast<unsigned long long>(stats.internalBytes));
+    }
+}
+
+void* VulkanHostAllocator::AllocateBlock(Arena& arena, const uint32_t sizeClass)
+{
+    std::lock_guard<std::mutex> lock(arena.mutex);
+
+    FreeBlock*& freeList = arena.freeLists[sizeClass];
+
+    if (!freeList)
+    {
+        // Carve a new slab into blocks. The slab header occupies the first block (or several).
+        const size_t blockSize  = static_cast<size_t>(VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE) << sizeClass;
+        const size_t headerSize = std::max(blockSize, sizeof(Slab));
+
+        Slab* slab = static_cast<Slab*>(AlignedAlloc(VK_HOST_ALLOCATOR_SLAB_SIZE, VK_HOST_ALLOCATOR_SLAB_SIZE));
+
+        if (!slab) return nullptr;
+
+        slab->next  = arena.slabs;
+        arena.slabs = slab;
+
+        arena.counters.reservedSlabBytes.fetch_add(VK_HOST_ALLOCATOR_SLAB_SIZE, std::memory_order_relaxed);
+
+        byte_t* first = reinterpret_cast<byte_t*>(slab) + headerSize;
+        byte_t* last  = reinterpret_cast<byte_t*>(slab) + VK_HOST_ALLOCATOR_SLAB_SIZE - blockSize;
+
+        // Link the blocks in the address order.
+        for (byte_t* block = last; block >= first; block -= blockSize)
+        {
+            FreeBlock* freeBlock = reinterpret_cast<FreeBlock*>(block);
+            freeBlock->next      = freeList;
+            freeList             = freeBlock;
+        }
+    }
+
+    FreeBlock* block = freeList;
+    freeList         = block->next;
+
+    return block;
+}
+
+void VulkanHostAllocator::ReleaseBlock(Arena& arena, const uint32_t sizeClass, void* block)
+{
+    std::lock_guard<std::mutex> lock(arena.mutex);
+
+    FreeBlock* freeBlock        = static_cast<FreeBlock*>(block);
+    freeBlock->next             = arena.freeLists[sizeClass];
+    arena.freeLists[sizeClass]  = freeBlock;
+}
+
+void* VulkanHostAllocator::Allocate(size_t size, size_t alignment, const VkSystemAllocationScope scope)
+{
+    assert(scope < VK_HOST_ALLOCATOR_SCOPES);
+
+    if (size == 0) return nullptr;
+
+    Arena& arena = m_arenas[scope];
+
+    // The header is placed right before the allocation; padding it to the alignment keeps the allocation aligned.
+    alignment = std::max(alignment, static_cast<size_t>(VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE));
+
+    const size_t offset    = alignment;
+    const size_t blockSize = offset + size;
+
+    byte_t* block;
+    uint8_t sizeClass;
+
+    // Blocks are naturally aligned to their size (which is a power of 2), and so is the offset.
+    if (blockSize <= VK_HOST_ALLOCATOR_MAX_BLOCK_SIZE)
+    {
+        sizeClass = static_cast<uint8_t>(GetSizeClass(blockSize));
+        block     = static_cast<byte_t*>(AllocateBlock(arena, sizeClass));
+
+        arena.counters.pooledAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        sizeClass = VK_HOST_ALLOCATOR_LARGE_CLASS;
+        block     = static_cast<byte_t*>(AlignedAlloc(blockSize, alignment));
+    }
+
+    if (!block) return nullptr;
+
+    void* memory = block + offset;
+
+    AllocationHeader* header = GetHeader(memory);
+    header->size      = size;
+    header->offset    = static_cast<uint32_t>(offset);
+    header->sizeClass = sizeClass;
+    header->scope     = static_cast<uint8_t>(scope);
+
+    Counters& c = arena.counters;
+
+    const uint64_t liveBytes = c.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+    c.liveAllocations.fetch_add(1,  std::memory_order_relaxed);
+    c.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    c.frameAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    // Update the peak.
+    uint64_t peak = c.peakLiveBytes.load(std::memory_order_relaxed);
+    while (peak < liveBytes && !c.peakLiveBytes.compare_exchange_weak(peak, liveBytes, std::memory_order_relaxed));
+
+    return memory;
+}
+
+void VulkanHostAllocator::Free(void* memory)
+{
+    if (!memory) return;
+
+    const AllocationHeader* header = GetHeader(memory);
+
+    const uint64_t size      = header->size;
+    const uint8_t  sizeClass = header->sizeClass;
+
+    Arena&  arena = m_arenas[header->scope];
+    byte_t* block = static_cast<byte_t*>(memory) - header->offset;
+
+    arena.counters.liveBytes.fetch_sub(size,    std::memory_order_relaxed);
+    arena.counters.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+
+    if (sizeClass == VK_HOST_ALLOCATOR_LARGE_CLASS)
+    {
+        AlignedFree(block);
+    }
+    else
+    {
+        ReleaseBlock(arena, sizeClass, block);
+    }
+}
+
+void* VulkanHostAllocator::Reallocate(void* original, size_t size, size_t alignment,
+                                      const VkSystemAllocationScope scope)
+{
+    if (!original)
+    {
+        return Allocate(size, alignment, scope);
+    }
+
+    if (size == 0)
+    {
+        Free(original);
+        return nullptr;
+    }
+
+    const AllocationHeader* header = GetHeader(original);
+
+    // Reuse the block if it is large enough, and the original allocation is sufficiently aligned.
+    if (header->sizeClass != VK_HOST_ALLOCATOR_LARGE_CLASS && header->scope == scope && alignment <= header->offset)
+    {
+        const size_t blockSize = static_cast<size_t>(VK_HOST_ALLOCATOR_MIN_BLOCK_SIZE) << header->sizeClass;
+
+        if (header->offset + size <= blockSize)
+        {
+            Counters& c = m_arenas[scope].counters;
+            c.liveBytes.fetch_add(size, std::memory_order_relaxed);
+            c.liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+            GetHeader(original)->size = size;
+            return original;
+        }
+    }
+
+    // If the allocation fails, the original allocation must remain valid.
+    void* memory = Allocate(size, alignment, scope);
+
+    if (memory)
+    {
+        memcpy(memory, original, std::min(static_cast<size_t>(header->size), size));
+        Free(original);
+    }
+
+    return memory;
+}
+
+void* VKAPI_PTR VulkanHostAllocator::AllocationCallback(void* userData, size_t size, size_t alignment,
+                                                        VkSystemAllocationScope scope)
+{
+    return static_cast<VulkanHostAllocator*>(userData)->Allocate(size, alignment, scope);
+}
+
+void* VKAPI_PTR VulkanHostAllocator::ReallocationCallback(void* userData, void* original, size_t size,
+                                                          size_t alignment, VkSystemAllocationScope scope)
+{
+    return static_cast<VulkanHostAllocator*>(userData)->Reallocate(original, size, alignment, scope);
+}
+
+void VKAPI_PTR VulkanHostAllocator::FreeCallback(void* userData, void* memory)
+{
+    static_cast<VulkanHostAllocator*>(userData)->Free(memory);
+}
+
+void VKAPI_PTR VulkanHostAllocator::InternalAllocationCallback(void* userData, size_t size, VkInternalAllocationType,
+                                                               VkSystemAllocationScope scope)
+{
+    auto allocator = static_cast<VulkanHostAllocator*>(userData);
+    allocator->m_arenas[scope].counters.internalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void VKAPI_PTR VulkanHostAllocator::InternalFreeCallback(void* userData, size_t size, VkInternalAllocationType,
+                                                         VkSystemAllocationScope scope)
+{
+    auto allocator = static_cast<VulkanHostAllocator*>(userData);
+    allocator->m_arenas[scope].counters.internalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <atomic>
+#include <mutex>
+#include <vulkan/vulkan.h>
+
+#define VK_HOST_ALLOCATOR_SIZE_CLASSES 9     // 16, 32, ..., 4096 bytes
+#define VK_HOST_ALLOCATOR_SCOPES       5     // See VkSystemAllocationScope
+#define VK_HOST_ALLOCATOR_SLAB_SIZE    65536 // Pooled blocks are carved out of slabs
+
+// Host memory statistics of a VkSystemAllocationScope.
+struct VulkanHostAllocatorStatistics
+{
+    uint64_t liveBytes;          // Requested by the driver, not yet freed
+    uint64_t peakLiveBytes;
+    uint64_t liveAllocations;
+    uint64_t totalAllocations;
+    uint64_t frameAllocations;   // During the previous frame (see NewFrame())
+    uint64_t pooledAllocations;  // Served from the pools rather than the system heap
+    uint64_t reservedSlabBytes;  // Owned by the pools
+    uint64_t internalBytes;      // Allocated by the driver itself (e.g. executable memory)
+};
+
+// VkAllocationCallbacks implementation.
+// Small allocations are pooled by size class; each VkSystemAllocationScope has a separate arena,
+// so that short-lived (command) allocations do not fragment long-lived (device, instance) ones.
+// Large allocations go to the system heap. All allocations honor the requested alignment.
+// Thread-safe, as required by the API.
+class VulkanHostAllocator
+{
+public:
+    VulkanHostAllocator();
+    ~VulkanHostAllocator();
+
+    VulkanHostAllocator(const VulkanHostAllocator&)            = delete;
+    VulkanHostAllocator& operator=(const VulkanHostAllocator&) = delete;
+
+    // Returns the callbacks to pass to vkCreate*() and vkDestroy*().
+    // The allocator must outlive all the objects created with them.
+    const VkAllocationCallbacks* Callbacks() const;
+
+    // Starts counting the allocations of a new frame.
+    void NewFrame();
+
+    // Returns the statistics of the allocation scope.
+    VulkanHostAllocatorStatistics Statistics(const VkSystemAllocationScope scope) const;
+
+    // Prints the statistics of all the allocation scopes.
+    void PrintStatistics() const;
+
+private:
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct Slab
+    {
+        Slab* next;
+    };
+
+    struct Counters
+    {
+        std::atomic<uint64_t> liveBytes;
+        std::atomic<uint64_t> peakLiveBytes;
+        std::atomic<uint64_t> liveAllocations;
+        std::atomic<uint64_t> totalAllocations;
+        std::atomic<uint64_t> frameAllocations;
+        std::atomic<uint64_t> lastFrameAllocations;
+        std::atomic<uint64_t> pooledAllocations;
+        std::atomic<uint64_t> reservedSlabBytes;
+        std::atomic<uint64_t> internalBytes;
+    };
+
+    struct Arena
+    {
+        std::mutex            mutex;
+        FreeBlock*            freeLists[VK_HOST_ALLOCATOR_SIZE_CLASSES];
+        Slab*                 slabs;
+        Counters              counters;
+    };
+
+    void* Allocate(size_t size, size_t alignment, const VkSystemAllocationScope scope);
+    void* Reallocate(void* original, size_t size, size_t alignment, const VkSystemAllocationScope scope);
+    void  Free(void* memory);
+
+    void* AllocateBlock(Arena& arena, const uint32_t sizeClass);
+    void  ReleaseBlock(Arena& arena, const uint32_t sizeClass, void* block);
+
+    static void* VKAPI_PTR AllocationCallback(void* userData, size_t size, size_t alignment,
+                                              VkSystemAllocationScope scope);
+    static void* VKAPI_PTR ReallocationCallback(void* userData, void* original, size_t size, size_t alignment,
+                                                VkSystemAllocationScope scope);
+    static void  VKAPI_PTR FreeCallback(void* userData, void* memory);
+    static void  VKAPI_PTR InternalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type,
+                                                      VkSystemAllocationScope scope);
+    static void  VKAPI_PTR InternalFreeCallback(void* userData, size_t size, VkInternalAllocationType type,
+                                                VkSystemAllocationScope scope);
+
+    VkAllocationCallbacks m_callbacks;
+    Arena                 m_arenas[VK_HOST_ALLOCATOR_SCOPES];
+};
@@ -0,0 +1,384 @@
+#include "jobsystem.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Number of unsuccessful attempts to find a job before an idle worker goes to sleep.
+#define JOB_SPIN_COUNT 64
+
+static_assert((JOB_QUEUE_CAPACITY & (JOB_QUEUE_CAPACITY - 1)) == 0, "The capacity must be a power of 2.");
+
+static thread_local uint32_t t_workerIndex = UINT32_MAX;
+
+// Thread names must outlive the trace. Large enough for any 32-bit index (GCC warns about truncation otherwise).
+static char g_workerNames[JOB_MAX_WORKERS][24];
+
+void JobSystem::Create(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    m_workerCount = std::min(threadCount, static_cast<uint32_t>(JOB_MAX_WORKERS));
+
+    // Background jobs are never executed by the main thread, so they need another thread.
+    m_threadCount = std::max(m_workerCount, 2u);
+    m_queues      = new JobQueue[m_threadCount];
+    m_threads     = new std::thread[m_threadCount];
+
+    m_isRunning.store(true, std::memory_order_relaxed);
+    m_queuedJobs.store(0, std::memory_order_relaxed);
+    m_sleepingWorkers.store(0, std::memory_order_relaxed);
+    m_backgroundJobCount.store(0, std::memory_order_relaxed);
+
+    for (uint32_t w = 0; w < m_threadCount; w++)
+    {
+        m_queues[w].top.store(0, std::memory_order_relaxed);
+        m_queues[w].bottom.store(0, std::memory_order_relaxed);
+    }
+
+    // The calling thread is worker 0.
+    t_workerIndex = 0;
+
+    for (uint32_t w = 1; w < m_threadCount; w++)
+    {
+        m_threads[w] = std::thread(&JobSystem::WorkerMain, this, w);
+    }
+
+    PrintInfo("Job system: %u worker threads.", m_workerCount);
+}
+
+void JobSystem::Destroy()
+{
+    assert(WorkerIndex() == 0);
+    assert(m_backgroundJobs.empty());
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isRunning.store(false, std::memory_order_seq_cst);
+    }
+
+    m_wakeUp.notify_all();
+
+    for (uint32_t w = 1; w < m_threadCount; w++)
+    {
+        m_threads[w].join();
+    }
+
+    delete[] m_threads;
+    delete[] m_queues;
+
+    m_threads     = nullptr;
+    m_queues      = nullptr;
+    m_workerCount = 0;
+    m_threadCount = 0;
+}
+
+uint32_t JobSystem::WorkerCount() const
+{
+    return m_workerCount;
+}
+
+uint32_t JobSystem::ThreadCount() const
+{
+    return m_threadCount;
+}
+
+uint32_t JobSystem::WorkerIndex()
+{
+    return t_workerIndex;
+}
+
+bool JobSystem::Push(JobQueue& queue, const Job& job)
+{
+    const int64_t b = queue.bottom.load(std::memory_order_relaxed);
+    const int64_t t = queue.top.load(std::memory_order_acquire);
+
+    if (b - t >= JOB_QUEUE_CAPACITY) return false;
+
+    queue.jobs[b & (JOB_QUEUE_CAPACITY - 1)] = job;
+
+    // Publish the job to the stealers.
+    queue.bottom.store(b + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool JobSystem::Pop(JobQueue& queue, Job* job)
+{
+    const int64_t b = queue.bottom.load(std::memory_order_relaxed) - 1;
+
+    queue.bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    int64_t t = queue.top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        // Empty.
+        queue.bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    *job = queue.jobs[b & (JOB_QUEUE_CAPACITY - 1)];
+
+    if (t == b)
+    {
+        // The last job: race against the stealers.
+        const bool isTaken = queue.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                                         std::memory_order_relaxed);
+        queue.bottom.store(b + 1, std::memory_order_relaxed);
+
+        return isTaken;
+    }
+
+    return true;
+}
+
+bool JobSystem::Steal(JobQueue& queue, Job* job)
+{
+    int64_t t = queue.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = queue.bottom.load(std::memory_order_acquire);
+
+    if (t >= b) return false;
+
+    *job = queue.jobs[t & (JOB_QUEUE_CAPACITY - 1)];
+
+    // Fails if the owner or another stealer took the job first.
+    return queue.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+bool JobSystem::PopBackground(Job* job)
+{
+    std::lock_guard<std::mutex> lock(m_backgroundMutex);
+
+    if (m_backgroundJobs.empty()) return false;
+
+    *job = m_backgroundJobs.front();
+    m_backgroundJobs.pop_front();
+
+    m_backgroundJobCount.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool JobSystem::FindJob(const uint32_t workerIndex, Job* job)
+{
+    // The background thread (if any) only executes background jobs.
+    const bool isWorker = (workerIndex < m_workerCount);
+
+    bool isFound = isWorker && Pop(m_queues[workerIndex], job);
+
+    // Start with a different victim every time, so that the workers do not contend for the same queue.
+    static thread_local uint32_t t_victim = workerIndex;
+
+    for (uint32_t i = 1; isWorker && !isFound && i < m_workerCount; i++)
+    {
+        t_victim = (t_victim + 1) % m_workerCount;
+
+        if (t_victim != workerIndex)
+        {
+            isFound = Steal(m_queues[t_victim], job);
+        }
+    }
+
+    // Regular jobs take priority. The main thread never takes background jobs.
+    if (!isFound && workerIndex != 0)
+    {
+        isFound = PopBackground(job);
+    }
+
+    if (isFound)
+    {
+        m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    return isFound;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+    job.function(job.data, job.begin, job.end);
+
+    if (job.counter)
+    {
+        // Publishes the results of the job to the joining thread.
+        job.counter->fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void JobSystem::Run(const Job* jobs, const uint32_t count)
+{
+    const uint32_t workerIndex = WorkerIndex();
+
+    ASSERT(workerIndex < m_workerCount, "Jobs may only be issued by the workers.");
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (jobs[i].counter)
+        {
+            jobs[i].counter->fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t queuedCount = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // Account for the job before it becomes visible, so that the count never underflows.
+        m_queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+        if (Push(m_queues[workerIndex], jobs[i]))
+        {
+            queuedCount++;
+        }
+        else
+        {
+            // The queue is full. Execute the job right away.
+            m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            Execute(jobs[i]);
+        }
+    }
+
+    // Pairs with the check of the sleeping workers (see WorkerMain()).
+    if (queuedCount > 0 && m_sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (queuedCount > 1)
+        {
+            m_wakeUp.notify_all();
+        }
+        else
+        {
+            m_wakeUp.notify_one();
+        }
+    }
+}
+
+void JobSystem::RunBackground(const Job& job)
+{
+    if (job.counter)
+    {
+        job.counter->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+    {
+        std::lock_guard<std::mutex> lock(m_backgroundMutex);
+        m_backgroundJobs.push_back(job);
+    }
+
+    m_backgroundJobCount.fetch_add(1, std::memory_order_seq_cst);
+
+    // Pairs with the check of the sleeping workers (see WorkerMain()).
+    if (m_sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wakeUp.notify_one();
+    }
+}
+
+void JobSystem::ParallelFor(const uint32_t count, const uint32_t batchSize, JobFunction function, void* data,
+                            JobCounter* counter)
+{
+    assert(batchSize > 0);
+
+    constexpr uint32_t maxJobCount = 64;
+
+    Job      jobs[maxJobCount];
+    uint32_t jobCount = 0;
+
+    for (uint32_t begin = 0; begin < count; begin += batchSize)
+    {
+        jobs[jobCount++] = { function, data, begin, std::min(begin + batchSize, count), counter };
+
+        if (jobCount == maxJobCount)
+        {
+            Run(jobs, jobCount);
+            jobCount = 0;
+        }
+    }
+
+    Run(jobs, jobCount);
+}
+
+void JobSystem::Wait(const JobCounter& counter)
+{
+    const uint32_t workerIndex = WorkerIndex();
+
+    ASSERT(workerIndex < m_workerCount, "Only the workers may wait for jobs.");
+
+    // Help out rather than block.
+    while (counter.load(std::memory_order_acquire) > 0)
+    {
+        Job job;
+
+        if (FindJob(workerIndex, &job))
+        {
+            Execute(job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::WorkerMain(const uint32_t workerIndex)
+{
+    t_workerIndex = workerIndex;
+
+    if (workerIndex < m_workerCount)
+    {
+        snprintf(g_workerNames[workerIndex], sizeof(g_workerNames[workerIndex]), "Worker %u", workerIndex);
+    }
+    else
+    {
+        snprintf(g_workerNames[workerIndex], sizeof(g_workerNames[workerIndex]), "Background");
+    }
+    TraceSetThreadName(g_workerNames[workerIndex]);
+
+    uint32_t spinCount = 0;
+
+    while (m_isRunning.load(std::memory_order_relaxed))
+    {
+        Job job;
+
+        if (FindJob(workerIndex, &job))
+        {
+            Execute(job);
+            spinCount = 0;
+        }
+        else if (++spinCount < JOB_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            // Pairs with the check in Run(): either the worker sees the job, or Run() sees the worker.
+            m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+
+            // The background thread only wakes up for background jobs.
+            const std::atomic<uint32_t>& jobCount = (workerIndex < m_workerCount) ? m_queuedJobs
+                                                                                  : m_backgroundJobCount;
+
+            m_wakeUp.wait(lock, [this, &jobCount]()
+            {
+                return !m_isRunning.load(std::memory_order_seq_cst) ||
+                       jobCount.load(std::memory_order_seq_cst) > 0;
+            });
+
+            m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+
+            spinCount = 0;
+        }
+    }
+}
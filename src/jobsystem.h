@@ -0,0 +1,102 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#define JOB_MAX_WORKERS        64   // Including the main thread
+#define JOB_QUEUE_CAPACITY     4096 // Per worker; must be a power of 2
+
+// Fork/join counter: the number of jobs which have not finished yet.
+using JobCounter = std::atomic<uint32_t>;
+
+// Executes the job. ['begin', 'end') is the range of items assigned to the job (see ParallelFor()).
+using JobFunction = void (*)(void* data, const uint32_t begin, const uint32_t end);
+
+struct Job
+{
+    JobFunction function;
+    void*       data;
+    uint32_t    begin;
+    uint32_t    end;
+    JobCounter* counter; // Decremented once the job finishes (optional)
+};
+
+// Work-stealing job system with a fixed pool of worker threads.
+// Each worker (the thread calling Create() included) has a double-ended queue of jobs.
+// The owner pushes and pops jobs at the bottom (LIFO, cache-friendly), while idle workers
+// steal jobs from the top (FIFO, the largest pieces of work). Idle workers sleep.
+// Jobs may only be issued by the workers, including from within other jobs.
+// Long-running background jobs (e.g. pipeline compilation) are never executed by the main thread:
+// with a single worker, a thread dedicated to them is started.
+class JobSystem
+{
+public:
+
+    // 'threadCount': the number of worker threads, the calling thread included.
+    // 0 uses one thread per hardware thread.
+    void Create(uint32_t threadCount = 0);
+    void Destroy();
+
+    // Returns the number of workers (the calling thread of Create() included).
+    uint32_t WorkerCount() const;
+
+    // Returns the number of threads which may execute jobs: the workers, and the background thread (if any).
+    // Per-thread state used by background jobs must be sized accordingly.
+    uint32_t ThreadCount() const;
+
+    // Returns the index of the calling worker in [0, WorkerCount()), or of the background thread
+    // in [WorkerCount(), ThreadCount()). The thread calling Create() is 0. Other threads: UINT32_MAX.
+    static uint32_t WorkerIndex();
+
+    // Issues the jobs. The counter (if any) is incremented by the number of jobs.
+    void Run(const Job* jobs, const uint32_t count);
+
+    // Splits [0, 'count') into batches of at most 'batchSize' items, and runs a job per batch.
+    void ParallelFor(const uint32_t count, const uint32_t batchSize, JobFunction function, void* data,
+                     JobCounter* counter);
+
+    // Issues a background job, executed (in FIFO order) by the worker threads once they run out of other jobs,
+    // or by the background thread if there is a single worker. May be called from any thread.
+    // The main thread (worker 0) does not execute background jobs, so that they cannot cause it to stall.
+    // The job must finish before the job system is destroyed.
+    void RunBackground(const Job& job);
+
+    // Executes jobs until the counter reaches 0.
+    void Wait(const JobCounter& counter);
+
+private:
+
+    // Chase-Lev deque (see "Correct and Efficient Work-Stealing for Weak Memory Models").
+    struct JobQueue
+    {
+        alignas(64) std::atomic<int64_t> top;    // Stealers
+        alignas(64) std::atomic<int64_t> bottom; // Owner
+        Job                              jobs[JOB_QUEUE_CAPACITY];
+    };
+
+    bool Push(JobQueue& queue, const Job& job);
+    bool Pop(JobQueue& queue, Job* job);
+    bool Steal(JobQueue& queue, Job* job);
+    bool PopBackground(Job* job);
+    bool FindJob(const uint32_t workerIndex, Job* job);
+    void Execute(const Job& job);
+    void WorkerMain(const uint32_t workerIndex);
+
+    uint32_t                m_workerCount;
+    uint32_t                m_threadCount;   // Workers, and the background thread (if any)
+    JobQueue*               m_queues;        // One per thread
+    std::thread*            m_threads;       // Threads [1, m_threadCount)
+    std::atomic<bool>       m_isRunning;
+    std::atomic<uint32_t>   m_queuedJobs;    // Pushed, and not taken yet
+    std::atomic<uint32_t>   m_sleepingWorkers;
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeUp;
+    std::deque<Job>         m_backgroundJobs;
+    std::mutex              m_backgroundMutex; // Guards m_backgroundJobs
+    std::atomic<uint32_t>   m_backgroundJobCount; // Queued, for the background thread to sleep on
+};
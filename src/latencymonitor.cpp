@@ -0,0 +1,164 @@
+#include "latencymonitor.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+// Frames which are not presented within the time-out (e.g. if the window is occluded) are not measured.
+#define VK_LATENCY_PRESENT_TIMEOUT 100000000ull // 100 ms
+
+void VulkanLatencyMonitor::Create(VkDevice device, const VulkanQueueScheduler* scheduler, const bool usePresentWait)
+{
+    m_device         = device;
+    m_scheduler      = scheduler;
+    m_waitForPresent = nullptr;
+    m_current        = {};
+    m_historyCount   = 0;
+    m_isRunning      = true;
+    m_isWaiting      = false;
+
+    if (usePresentWait)
+    {
+        m_waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+                           vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+
+        ASSERT(m_waitForPresent, "Failed to load the entry point of \'%s\'.", "vkWaitForPresentKHR");
+    }
+
+    m_thread = std::thread(&VulkanLatencyMonitor::ThreadMain, this);
+
+    if (!m_waitForPresent)
+    {
+        PrintWarning("VK_KHR_present_wait is not supported. Latency is measured up to the end of the GPU work.");
+    }
+}
+
+void VulkanLatencyMonitor::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isRunning = false;
+    }
+
+    // The pending frames are measured before the thread exits.
+    m_wakeUp.notify_one();
+    m_thread.join();
+
+    m_pendingFrames.clear();
+}
+
+bool VulkanLatencyMonitor::UsesPresentWait() const
+{
+    return m_waitForPresent != nullptr;
+}
+
+void VulkanLatencyMonitor::OnAcquired(const uint64_t frameSerial)
+{
+    m_current             = {};
+    m_current.frameSerial = frameSerial;
+    m_current.acquireTime = Clock::now();
+}
+
+void VulkanLatencyMonitor::OnSubmitted(const uint64_t frameSerial, const uint64_t timelineValue)
+{
+    assert(m_current.frameSerial == frameSerial);
+
+    m_current.submitTime    = Clock::now();
+    m_current.timelineValue = timelineValue;
+}
+
+void VulkanLatencyMonitor::OnPresented(const uint64_t frameSerial, VkSwapchainKHR swapChain,
+                                       const uint64_t presentId)
+{
+    assert(m_current.frameSerial == frameSerial);
+
+    m_current.swapChain = swapChain;
+    m_current.presentId = presentId;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingFrames.push_back(m_current);
+    }
+
+    m_wakeUp.notify_one();
+}
+
+void VulkanLatencyMonitor::Flush()
+{
+    TRACE_FUNCTION();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_idle.wait(lock, [this]() { return m_pendingFrames.empty() && !m_isWaiting; });
+}
+
+uint32_t VulkanLatencyMonitor::GetFrameLatencies(FrameLatency* latencies) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint64_t count = std::min<uint64_t>(m_historyCount, VK_LATENCY_HISTORY_SIZE);
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        latencies[i] = m_history[(m_historyCount - count + i) % VK_LATENCY_HISTORY_SIZE];
+    }
+
+    return static_cast<uint32_t>(count);
+}
+
+void VulkanLatencyMonitor::ThreadMain()
+{
+    TraceSetThreadName("Latency monitor");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_wakeUp.wait(lock, [this]() { return !m_isRunning || !m_pendingFrames.empty(); });
+
+        // Only exit once all the frames have been measured.
+        if (m_pendingFrames.empty()) break;
+
+        const PendingFrame frame = m_pendingFrames.front();
+        m_pendingFrames.pop_front();
+
+        m_isWaiting = true;
+
+        lock.unlock();
+
+        bool isPresented = true;
+
+        if (m_waitForPresent)
+        {
+            const VkResult result = m_waitForPresent(m_device, frame.swapChain, frame.presentId,
+                                                     VK_LATENCY_PRESENT_TIMEOUT);
+
+            isPresented = (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+        }
+        else
+        {
+            m_scheduler->WaitForCompletion(VK_QUEUE_TYPE_GRAPHICS, frame.timelineValue);
+        }
+
+        const Clock::time_point presentTime = Clock::now();
+
+        lock.lock();
+
+        if (isPresented)
+        {
+            FrameLatency& latency = m_history[m_historyCount++ % VK_LATENCY_HISTORY_SIZE];
+
+            latency.frameSerial      = frame.frameSerial;
+            latency.acquireToPresent = std::chrono::duration<float, std::milli>(presentTime - frame.acquireTime).count();
+            latency.submitToPresent  = std::chrono::duration<float, std::milli>(presentTime - frame.submitTime).count();
+        }
+
+        m_isWaiting = false;
+
+        if (m_pendingFrames.empty())
+        {
+            m_idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "queuescheduler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#define VK_LATENCY_HISTORY_SIZE 256 // Frames
+
+struct FrameLatency
+{
+    uint64_t frameSerial;
+    float    acquireToPresent; // In milliseconds: from the acquisition of the image to its presentation
+    float    submitToPresent;  // In milliseconds: from the submission of the frame to its presentation
+};
+
+// Measures the latency of the frames on a background thread.
+// If VK_KHR_present_wait is available, the thread waits for each frame to be presented (i.e. displayed).
+// Otherwise, it waits for the GPU to finish the frame, which is a lower bound of the time of presentation.
+// All the methods are called by the render thread.
+class VulkanLatencyMonitor
+{
+public:
+
+    void Create(VkDevice device, const VulkanQueueScheduler* scheduler, const bool usePresentWait);
+    void Destroy();
+
+    // Returns 'true' if the frames are timed by the presentation engine (rather than by the GPU).
+    bool UsesPresentWait() const;
+
+    // The image of the frame has been acquired.
+    void OnAcquired(const uint64_t frameSerial);
+
+    // The frame has been submitted: it signals 'timelineValue' on the graphics queue.
+    void OnSubmitted(const uint64_t frameSerial, const uint64_t timelineValue);
+
+    // The frame has been queued for presentation with the present ID 'presentId' (see VkPresentIdKHR).
+    void OnPresented(const uint64_t frameSerial, VkSwapchainKHR swapChain, const uint64_t presentId);
+
+    // Waits for the frames which are being measured. Must be called before the swap chain they were presented
+    // to is retired, since the background thread may be waiting on it.
+    void Flush();
+
+    // Returns the number of measured frames (at most VK_LATENCY_HISTORY_SIZE), oldest first.
+    uint32_t GetFrameLatencies(FrameLatency* latencies) const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingFrame
+    {
+        uint64_t          frameSerial;
+        Clock::time_point acquireTime;
+        Clock::time_point submitTime;
+        uint64_t          timelineValue;
+        VkSwapchainKHR    swapChain;
+        uint64_t          presentId;
+    };
+
+    void ThreadMain();
+
+    VkDevice                    m_device;
+    const VulkanQueueScheduler* m_scheduler;
+    PFN_vkWaitForPresentKHR     m_waitForPresent; // Null if VK_KHR_present_wait is not used
+    PendingFrame                m_current;      // Being recorded
+    std::deque<PendingFrame>    m_pendingFrames;
+    FrameLatency                m_history[VK_LATENCY_HISTORY_SIZE];
+    uint64_t                    m_historyCount;
+    bool                        m_isRunning;
+    bool                        m_isWaiting;    // The thread is measuring a frame
+    mutable std::mutex          m_mutex;        // Guards all of the above (except for m_current)
+    std::condition_variable     m_wakeUp;
+    std::condition_variable     m_idle;
+    std::thread                 m_thread;
+};
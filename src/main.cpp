@@ -1,42 +1,608 @@
+#include "assetarchive.h"
+#include "benchmarkworkloads.h"
+#include "cullingkernels.h"
+#include "drawqueue.h"
 #include "renderbackend.h"
+#include "scene.h"
+#include "tracer.h"
 #include "utility.h"
-#include "window.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+    #include "window.h"
+#endif
 
 class Renderer
 {
 public:
     RenderBackEnd* renderBackEnd;
+    JobSystem      jobSystem;
+    Scene          scene;
 };
 
 Renderer renderer;
 
 int main(const int argc, string_t argv[])
 {
-    ASSERT(argc == 3, "Missing command line arguments: resolution. E.g.: 1920 1080.");
+    using Clock = std::chrono::steady_clock;
+
+    const Clock::time_point startupBegin = Clock::now();
+
+    ASSERT(argc >= 3, "Missing command line arguments: resolution. E.g.: 1920 1080"
+                      " [--headless]"
+                      " [--frames N]"
+                      " [--trace trace.json]"
+                      " [--async-compute-bench MiB]"
+                      " [--workers N]"
+                      " [--record-bench draws]"
+                      " [--cull-bench instances]"
+                      " [--cull-bench-draws count|multi|single]"
+                      " [--cull-cpu-bench objects]"
+                      " [--scene-bench nodes]"
+                      " [--draw-sort-bench draws]"
+                      " [--asset-bench MiB]"
+                      " [--memory-bench N]"
+                      " [--cold-start]"
+                      " [--device index|UUID]"
+                      " [--present throughput|low-latency|vsync|immediate]"
+                      " [--fps-limit N]"
+                      " [--latency]"
+                      " [--frames-in-flight N].");
 
     uint16_t windowWidth  = static_cast<uint16_t>(atoi(argv[1]));
     uint16_t windowHeight = static_cast<uint16_t>(atoi(argv[2]));
 
-    // Create the OS window used for drawing. Needed to create the RBE display surface. 
-    Window window = Window(windowWidth, windowHeight);
+#ifdef WIN32
+    bool headless = false;
+#else
+    // There is no windowing system support on this platform.
+    bool headless = true;
+#endif
+
+    // Headless rendering has no way to quit, so it runs for a fixed number of frames.
+    uint32_t maxFrameCount = UINT32_MAX;
+
+    // Chrome trace event file (also supported by Perfetto).
+    string_t tracePath = nullptr;
+
+    // Size of the synthetic workload used to compare async compute with the graphics queue only.
+    uint32_t asyncComputeBenchSize = 0;
+
+    // The number of threads of the job system (0: one per hardware thread).
+    uint32_t workerCount = 0;
+
+    // The number of draws of the synthetic workload used to measure the scaling of command recording.
+    uint32_t recordBenchDrawCount = 0;
+
+    // The number of instances of the synthetic workload culled on the GPU.
+    uint32_t cullBenchInstanceCount = 0;
+
+    // The first path used to draw them, to measure the fallbacks on GPUs which support the faster paths.
+    VulkanCullingDrawPath cullBenchDrawPath = VK_CULLING_DRAW_PATH_COUNT;
+
+    static string_t cullBenchDrawPathNames[] = { "count", "multi", "single" };
+
+    // The number of objects used to compare the SIMD culling kernels with the scalar ones.
+    uint32_t cullCpuBenchObjectCount = 0;
+
+    // The number of nodes of the scene used to measure the update of the transforms.
+    uint32_t sceneBenchNodeCount = 0;
+
+    // The number of draws used to measure the sorting and merging of the draw queue.
+    uint32_t drawSortBenchDrawCount = 0;
+
+    // The size of the synthetic asset archive used to measure the loading of the assets.
+    uint32_t assetBenchSizeMiB = 0;
+
+    // The number of random allocations and frees used to measure the device memory allocator.
+    uint32_t memoryBenchOperationCount = 0;
+
+    // Discard the pipeline cache from the previous run, to measure the start-up time without it.
+    bool coldStart = false;
+
+    // Overrides the automatic selection of the graphics device.
+    string_t deviceSelector = nullptr;
+
+    PresentPolicy presentPolicy = PRESENT_POLICY_THROUGHPUT;
+
+    static string_t presentPolicyNames[] = { "throughput", "low-latency", "vsync", "immediate" };
+
+    // Caps the frame rate (0: no cap).
+    float frameRateLimit = 0.0f;
+
+    // Reports the latency of the frames, to tune the number of frames in flight against it.
+    bool measureLatency = false;
+
+    uint32_t framesInFlight = 2;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            maxFrameCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+
+        #ifndef MAGMA_TRACING
+            PrintWarning("Tracing is compiled out. Define MAGMA_TRACING to enable it.");
+            tracePath = nullptr;
+        #endif
+        }
+        else if (strcmp(argv[i], "--async-compute-bench") == 0 && i + 1 < argc)
+        {
+            asyncComputeBenchSize = static_cast<uint32_t>(atoi(argv[++i])) << 20;
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            workerCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--record-bench") == 0 && i + 1 < argc)
+        {
+            recordBenchDrawCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--cull-bench") == 0 && i + 1 < argc)
+        {
+            cullBenchInstanceCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--cull-bench-draws") == 0 && i + 1 < argc)
+        {
+            string_t path    = argv[++i];
+            bool     isKnown = false;
+
+            for (uint32_t p = 0; p < sizeof(cullBenchDrawPathNames) / sizeof(cullBenchDrawPathNames[0]); p++)
+            {
+                if (strcmp(path, cullBenchDrawPathNames[p]) == 0)
+                {
+                    cullBenchDrawPath = static_cast<VulkanCullingDrawPath>(p);
+                    isKnown           = true;
+                }
+            }
 
-    renderer.renderBackEnd = new VulkanRenderBackEnd();
+            if (!isKnown)
+            {
+                PrintWarning("Unknown culling draw path \'%s\'.", path);
+            }
+        }
+        else if (strcmp(argv[i], "--cull-cpu-bench") == 0 && i + 1 < argc)
+        {
+            cullCpuBenchObjectCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--scene-bench") == 0 && i + 1 < argc)
+        {
+            sceneBenchNodeCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--draw-sort-bench") == 0 && i + 1 < argc)
+        {
+            drawSortBenchDrawCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--asset-bench") == 0 && i + 1 < argc)
+        {
+            assetBenchSizeMiB = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--memory-bench") == 0 && i + 1 < argc)
+        {
+            memoryBenchOperationCount = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--cold-start") == 0)
+        {
+            coldStart = true;
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            deviceSelector = argv[++i];
+        }
+        else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+        {
+            string_t policy = argv[++i];
+            bool     isKnown = false;
+
+            for (uint32_t p = 0; p < sizeof(presentPolicyNames) / sizeof(presentPolicyNames[0]); p++)
+            {
+                if (strcmp(policy, presentPolicyNames[p]) == 0)
+                {
+                    presentPolicy = static_cast<PresentPolicy>(p);
+                    isKnown       = true;
+                }
+            }
+
+            if (!isKnown)
+            {
+                PrintWarning("Unknown presentation policy \'%s\'.", policy);
+            }
+        }
+        else if (strcmp(argv[i], "--fps-limit") == 0 && i + 1 < argc)
+        {
+            frameRateLimit = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--latency") == 0)
+        {
+            measureLatency = true;
+        }
+        else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            framesInFlight = static_cast<uint32_t>(atoi(argv[++i]));
+        }
+    }
+
+    if (headless && maxFrameCount == UINT32_MAX)
+    {
+        maxFrameCount = 1000;
+    }
+
+    // The benchmark renders the first half of the frames using the graphics queue only,
+    // and the second half with async compute. The first frames of each half are not measured.
+    const uint32_t benchHalfFrameCount = maxFrameCount / 2;
+    const uint32_t benchWarmUpCount    = benchHalfFrameCount / 10;
+
+    if (asyncComputeBenchSize > 0)
+    {
+        ASSERT(maxFrameCount != UINT32_MAX, "The benchmark requires a fixed number of frames (--frames N).");
+    }
+
+    // Does not involve the GPU, so it runs before the back-end is created.
+    if (cullCpuBenchObjectCount > 0)
+    {
+        BenchmarkCullingKernels(cullCpuBenchObjectCount);
+    }
+
+    if (drawSortBenchDrawCount > 0)
+    {
+        BenchmarkDrawQueue(drawSortBenchDrawCount);
+    }
+
+    if (assetBenchSizeMiB > 0)
+    {
+        BenchmarkAssetArchive(assetBenchSizeMiB);
+    }
+
+    if (tracePath)
+    {
+        TraceSetThreadName("Main");
+        TraceEnable(true);
+    }
+
+    if (coldStart)
+    {
+        remove(VK_PIPELINE_CACHE_PATH);
+    }
+
+    // The main thread is worker 0.
+    renderer.jobSystem.Create(workerCount);
+
+    if (sceneBenchNodeCount > 0)
+    {
+        BenchmarkScene(&renderer.jobSystem, sceneBenchNodeCount);
+    }
+
+    renderer.scene.Create(&renderer.jobSystem);
+
+    VulkanRenderBackEnd* vulkanBackEnd = new VulkanRenderBackEnd(&renderer.jobSystem, framesInFlight);
+
+    renderer.renderBackEnd = vulkanBackEnd;
 
     renderer.renderBackEnd->CreateApiInstance();
-    renderer.renderBackEnd->CreateDisplaySurface(window);
+
+#ifdef WIN32
+    // Create the OS window used for drawing. Needed to create the RBE display surface.
+    Window* window = nullptr;
+
+    if (!headless)
+    {
+        window = new Window(windowWidth, windowHeight);
+        renderer.renderBackEnd->CreateDisplaySurface(*window);
+    }
+#endif
+
+    if (headless)
+    {
+        // Render off-screen. No window, no display, no V-Sync.
+        renderer.renderBackEnd->CreateHeadlessSurface(windowWidth, windowHeight);
+    }
+
+    if (deviceSelector)
+    {
+        renderer.renderBackEnd->SetDeviceSelector(deviceSelector);
+    }
+
+    renderer.renderBackEnd->SetPresentPolicy(presentPolicy);
+    renderer.renderBackEnd->SetFrameRateLimit(frameRateLimit);
+
     renderer.renderBackEnd->CreateGraphicsDevice();
-    renderer.renderBackEnd->CreateSyncPrimitives();
     renderer.renderBackEnd->CreateSwapChain();
+    renderer.renderBackEnd->CreateSyncPrimitives();
+
+    renderer.renderBackEnd->SetLatencyMeasurement(measureLatency);
+
+    if (memoryBenchOperationCount > 0)
+    {
+        // Before the first frame, so that only the resources of the back-end share the blocks.
+        BenchmarkMemoryAllocator(vulkanBackEnd->MemoryAllocator(), memoryBenchOperationCount);
+    }
+
+    // Latencies of all the frames of the run (acquisition to presentation, submission to presentation).
+    std::vector<float> acquireLatencies, submitLatencies;
+    uint64_t           lastMeasuredFrame = 0;
+    FrameLatency       frameLatencies[VK_LATENCY_HISTORY_SIZE];
+
+    // Recorded at the beginning of every frame.
+    VulkanBenchmarkWorkloads benchWorkloads;
+    benchWorkloads.Create(vulkanBackEnd);
+
+    if (asyncComputeBenchSize > 0)
+    {
+        benchWorkloads.SetComputeWorkload(asyncComputeBenchSize);
+        renderer.renderBackEnd->SetAsyncCompute(false);
+    }
+
+    benchWorkloads.SetRecordingWorkload(recordBenchDrawCount);
+    benchWorkloads.SetCullingWorkload(cullBenchInstanceCount, cullBenchDrawPath);
+
+    // [0]: graphics queue only, [1]: async compute.
+    double   benchCpuTimes[2]     = {};
+    double   benchGpuTimes[2]     = {};
+    double   benchComputeTimes[2] = {};
+    uint32_t benchFrameCounts[2]  = {};
+
+#ifdef WIN32
+    if (window)
+    {
+        window->Show();
+    }
+#endif
+
+    Clock::time_point frameStart  = Clock::now();
+    Clock::time_point reportStart = frameStart;
+
+    // Main loop.
+    for (uint32_t frame = 0; frame < maxFrameCount; frame++)
+    {
+        TRACE_SCOPE("Frame");
+
+        // Sample the input as late as possible.
+        renderer.renderBackEnd->WaitForNextFrame();
+
+    #ifdef WIN32
+        if (window && !window->ProcessMessages())
+        {
+            break;
+        }
+
+        if (window)
+        {
+            // There is nothing to render into while the window is minimized.
+            if (window->Width() == 0 || window->Height() == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            // Does nothing unless the window has been resized.
+            renderer.renderBackEnd->ResizeSwapChain(window->Width(), window->Height());
+        }
+    #endif
+
+        if (asyncComputeBenchSize > 0 && frame == benchHalfFrameCount)
+        {
+            renderer.renderBackEnd->SetAsyncCompute(true);
+        }
+
+        // Costs nothing while the scene is static.
+        renderer.scene.UpdateTransforms();
+
+        renderer.renderBackEnd->BeginFrame();
+        renderer.renderBackEnd->EndFrame();
+
+        const Clock::time_point frameEnd = Clock::now();
+
+        const float cpuFrameTime = std::chrono::duration<float, std::milli>(frameEnd - frameStart).count();
+        const float gpuFrameTime = renderer.renderBackEnd->GetGpuFrameTime();
+
+        frameStart = frameEnd;
+
+        // Collect the frames measured since the previous one. Measurements are one or more frames late.
+        if (measureLatency)
+        {
+            const uint32_t latencyCount = renderer.renderBackEnd->GetFrameLatencies(frameLatencies);
+
+            for (uint32_t i = 0; i < latencyCount; i++)
+            {
+                // Serial numbers start at 0.
+                if (frameLatencies[i].frameSerial + 1 > lastMeasuredFrame)
+                {
+                    acquireLatencies.push_back(frameLatencies[i].acquireToPresent);
+                    submitLatencies.push_back(frameLatencies[i].submitToPresent);
+
+                    lastMeasuredFrame = frameLatencies[i].frameSerial + 1;
+                }
+            }
+        }
+
+        if (frame == 0)
+        {
+            // Includes the creation of the device, which loads the pipeline cache.
+            PrintInfo("Start-up time: %.2f ms.",
+                      std::chrono::duration<double, std::milli>(frameEnd - startupBegin).count());
+        }
+
+        // GPU timings lag behind by the number of frames in flight, which the warm-up covers.
+        if (asyncComputeBenchSize > 0 && frame < 2 * benchHalfFrameCount &&
+            frame % benchHalfFrameCount >= benchWarmUpCount)
+        {
+            const uint32_t b = frame / benchHalfFrameCount;
+
+            benchCpuTimes[b]     += cpuFrameTime;
+            benchGpuTimes[b]     += gpuFrameTime;
+            benchComputeTimes[b] += renderer.renderBackEnd->GetGpuComputeTime();
+            benchFrameCounts[b]++;
+        }
+
+    #ifdef WIN32
+        if (window)
+        {
+            window->UpdateTitle(cpuFrameTime, gpuFrameTime);
+        }
+    #endif
+
+        // Without a title bar, report the timings once per second.
+        if (headless && (frameEnd - reportStart) >= std::chrono::seconds(1))
+        {
+            reportStart = frameEnd;
+
+            PrintInfo("CPU: %5.2f ms | GPU: %5.2f ms | GPU compute: %5.2f ms", cpuFrameTime, gpuFrameTime,
+                      renderer.renderBackEnd->GetGpuComputeTime());
+
+            if (!acquireLatencies.empty())
+            {
+                PrintInfo("Latency: acquire-to-present %5.2f ms | submit-to-present %5.2f ms",
+                          acquireLatencies.back(), submitLatencies.back());
+            }
+
+            const GpuScopeTiming* timings;
+            const uint32_t        timingCount = renderer.renderBackEnd->GetGpuTimings(&timings);
+
+            // Skip the frame itself.
+            for (uint32_t i = 1; i < timingCount; i++)
+            {
+                PrintInfo("%*s%s: %5.3f ms", static_cast<int>(2 * timings[i].depth), "",
+                          timings[i].name, timings[i].milliseconds);
+            }
+        }
+    }
+
+    if (asyncComputeBenchSize > 0 && benchFrameCounts[0] > 0 && benchFrameCounts[1] > 0)
+    {
+        for (uint32_t b = 0; b < 2; b++)
+        {
+            benchCpuTimes[b]     /= benchFrameCounts[b];
+            benchGpuTimes[b]     /= benchFrameCounts[b];
+            benchComputeTimes[b] /= benchFrameCounts[b];
+        }
+
+        // When GPU-bound, the CPU frame time is the frame time of the GPU as a whole (all queues).
+        // The work which overlaps is the work of both queues minus the time the GPU was busy.
+        const double overlap = std::max(0.0, benchGpuTimes[1] + benchComputeTimes[1] - benchCpuTimes[1]);
+
+        PrintInfo("Async compute benchmark (%u MiB per queue, %u frames per mode):",
+                  asyncComputeBenchSize >> 20, benchFrameCounts[0]);
+        PrintInfo("  Graphics queue only: %6.3f ms per frame (GPU: %6.3f ms)",
+                  benchCpuTimes[0], benchGpuTimes[0]);
+        PrintInfo("  Async compute:       %6.3f ms per frame (GPU: %6.3f ms, GPU compute: %6.3f ms, overlap: %6.3f ms)",
+                  benchCpuTimes[1], benchGpuTimes[1], benchComputeTimes[1], overlap);
+        PrintInfo("  Speed-up:            %6.2f%%", 100.0 * (benchCpuTimes[0] / benchCpuTimes[1] - 1.0));
+    }
+
+    // The results of the GPU are compared with the reference computed on the CPU. The GPU may round differently,
+    // so the instances on the boundaries of the tests (see CountVisibleInstances()) may be classified differently.
+    uint32_t visibleCounts[VK_GPU_CULLING_PHASE_COUNT], expectedCounts[VK_GPU_CULLING_PHASE_COUNT];
+    uint32_t frustumCount, boundaryCount, drawnCount;
+
+    if (cullBenchInstanceCount > 0 &&
+        benchWorkloads.GetCullingResult(visibleCounts, expectedCounts, &frustumCount, &boundaryCount, &drawnCount))
+    {
+        uint32_t disagreementCount = 0;
+
+        for (uint32_t p = 0; p < VK_GPU_CULLING_PHASE_COUNT; p++)
+        {
+            disagreementCount += (visibleCounts[p] > expectedCounts[p]) ? visibleCounts[p] - expectedCounts[p]
+                                                                        : expectedCounts[p] - visibleCounts[p];
+        }
+
+        // An instance which moves from a phase to another counts twice.
+        const bool isMatch = (disagreementCount == 0);
+        const bool isValid = (disagreementCount <= 2 * boundaryCount);
+
+        PrintInfo("GPU culling benchmark (%u instances, %u in the frustum): %u + %u visible (expected %u + %u): %s.",
+                  cullBenchInstanceCount, frustumCount, visibleCounts[VK_GPU_CULLING_EARLY],
+                  visibleCounts[VK_GPU_CULLING_LATE], expectedCounts[VK_GPU_CULLING_EARLY],
+                  expectedCounts[VK_GPU_CULLING_LATE],
+                  isMatch ? "match" : (isValid ? "match within the tolerance" : "MISMATCH"));
+
+        if (!isMatch)
+        {
+            PrintInfo("  The counts differ by %u in total; %u instances lie on the boundaries of the tests.",
+                      disagreementCount, boundaryCount);
+        }
+
+        // Every visible instance must be drawn once, whatever the draw path.
+        if (drawnCount != VK_GPU_CULLING_NO_RESULT)
+        {
+            const uint32_t visibleCount = visibleCounts[VK_GPU_CULLING_EARLY] + visibleCounts[VK_GPU_CULLING_LATE];
+
+            PrintInfo("  Drawn %u instances (%s draw path requested): %s.", drawnCount,
+                      cullBenchDrawPathNames[cullBenchDrawPath], (drawnCount == visibleCount) ? "match" : "MISMATCH");
+        }
+
+        PrintInfo("  Occlusion culled %u instances (%.1f%% of the frustum).",
+                  frustumCount - visibleCounts[VK_GPU_CULLING_EARLY] - visibleCounts[VK_GPU_CULLING_LATE],
+                  100.0 * (frustumCount - visibleCounts[VK_GPU_CULLING_EARLY] - visibleCounts[VK_GPU_CULLING_LATE]) /
+                  std::max(frustumCount, 1u));
+    }
+    else if (cullBenchInstanceCount > 0)
+    {
+        PrintWarning("GPU culling benchmark: no frame has culled the instances.");
+    }
+
+    if (!acquireLatencies.empty())
+    {
+        const size_t count = acquireLatencies.size();
+
+        PrintInfo("Latency (%zu frames, %s):", count, presentPolicyNames[presentPolicy]);
+
+        for (std::vector<float>* latencies : { &acquireLatencies, &submitLatencies })
+        {
+            double sum = 0.0;
+
+            for (const float latency : *latencies)
+            {
+                sum += latency;
+            }
+
+            std::sort(latencies->begin(), latencies->end());
+
+            PrintInfo("  %s: avg %6.2f ms | p50 %6.2f ms | p99 %6.2f ms",
+                      (latencies == &acquireLatencies) ? "Acquire-to-present" : "Submit-to-present ",
+                      sum / count, (*latencies)[count / 2], (*latencies)[std::min(count - 1, count * 99 / 100)]);
+        }
+    }
 
     // Clean up.
     // API note: you only have to vkDestroy() objects you vkCreate().
-    renderer.renderBackEnd->DestroySwapChain();
+    benchWorkloads.Destroy();
+
     renderer.renderBackEnd->DestroySyncPrimitives();
+    renderer.renderBackEnd->DestroySwapChain();
     renderer.renderBackEnd->DestroyGraphicsDevice();
     renderer.renderBackEnd->DestroyDisplaySurface();
     renderer.renderBackEnd->DestroyApiInstance();
 
     delete renderer.renderBackEnd;
 
+    renderer.scene.Destroy();
+    renderer.jobSystem.Destroy();
+
+#ifdef WIN32
+    delete window;
+#endif
+
+    if (tracePath)
+    {
+        TraceEnable(false);
+
+        if (TraceWriteChromeJson(tracePath))
+        {
+            PrintInfo("Saved the trace to \'%s\'.", tracePath);
+        }
+    }
+
     return EXIT_SUCCESS;
 }
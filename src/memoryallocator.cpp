@@ -0,0 +1,1107 @@
+#include "memoryallocator.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+#define VK_TLSF_NULL_NODE UINT32_MAX
+
+// Returns the index of the least significant set bit. 'bits' must not be 0.
+static inline uint32_t FindFirstSet(const uint64_t bits)
+{
+    assert(bits != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+}
+
+// Returns the index of the most significant set bit. 'bits' must not be 0.
+static inline uint32_t FindLastSet(const uint64_t bits)
+{
+    assert(bits != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(63 - __builtin_clzll(bits));
+#endif
+}
+
+static inline VkDeviceSize AlignUp(const VkDeviceSize value, const VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static inline VkDeviceSize AlignDown(const VkDeviceSize value, const VkDeviceSize alignment)
+{
+    return value / alignment * alignment;
+}
+
+void VulkanMemoryAllocator::Create(VkPhysicalDevice physicalDevice, VkDevice device,
+                                   const VkAllocationCallbacks* allocator)
+{
+    m_physicalDevice = physicalDevice;
+    m_device         = device;
+    m_allocator      = allocator;
+
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+
+    m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+    m_nonCoherentAtomSize    = std::max(properties.limits.nonCoherentAtomSize, VkDeviceSize{ 1 });
+    m_maxAllocationCount     = properties.limits.maxMemoryAllocationCount;
+    m_allocationCount        = 0;
+
+    for (uint32_t t = 0; t < m_memoryProperties.memoryTypeCount; t++)
+    {
+        const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[t].heapIndex].size;
+
+        // Small heaps (e.g. the 256 MiB BAR) should not be exhausted by a few blocks.
+        // The block size is a power of 2, so that it is a multiple of nonCoherentAtomSize.
+        const VkDeviceSize maxBlockSize = std::max(heapSize / 8, VkDeviceSize{ 1 });
+
+        m_blockSizes[t]      = std::min(static_cast<VkDeviceSize>(VK_MEMORY_BLOCK_SIZE),
+                                        VkDeviceSize{ 1 } << FindLastSet(maxBlockSize));
+        m_dedicatedCounts[t] = 0;
+        m_dedicatedBytes[t]  = 0;
+    }
+
+    m_pools.clear();
+    m_pools.resize(2 * m_memoryProperties.memoryTypeCount);
+}
+
+void VulkanMemoryAllocator::Destroy()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (Pool& pool : m_pools)
+    {
+        for (Block* block : pool.blocks)
+        {
+            if (!block) continue;
+
+            if (block->allocationCount > 0)
+            {
+                PrintWarning("Device memory: %u allocations leaked.", block->allocationCount);
+            }
+
+            DestroyBlock(block);
+        }
+    }
+
+    m_pools.clear();
+
+    for (uint32_t t = 0; t < m_memoryProperties.memoryTypeCount; t++)
+    {
+        if (m_dedicatedCounts[t] > 0)
+        {
+            PrintWarning("Device memory: %llu dedicated allocations leaked.",
+                         static_cast<unsigned long long>(m_dedicatedCounts[t]));
+        }
+    }
+}
+
+uint32_t VulkanMemoryAllocator::FindMemoryType(const uint32_t typeBits, const VulkanMemoryUsage usage) const
+{
+    // Memory property flags which are required, preferred and preferably avoided.
+    static const VkMemoryPropertyFlags requiredFlags[VK_MEMORY_USAGE_COUNT] = {
+        0,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+    };
+    static const VkMemoryPropertyFlags preferredFlags[VK_MEMORY_USAGE_COUNT] = {
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        0,
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+    };
+    static const VkMemoryPropertyFlags avoidedFlags[VK_MEMORY_USAGE_COUNT] = {
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        0
+    };
+
+    uint32_t bestType  = UINT32_MAX;
+    uint32_t bestScore = UINT32_MAX;
+
+    for (uint32_t t = 0; t < m_memoryProperties.memoryTypeCount; t++)
+    {
+        if ((typeBits & (1u << t)) == 0) continue;
+
+        const VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[t].propertyFlags;
+
+        if ((flags & requiredFlags[usage]) != requiredFlags[usage]) continue;
+
+        // Count the mismatching flags.
+        uint32_t score = 0;
+
+        for (VkMemoryPropertyFlags f = (preferredFlags[usage] & ~flags) | (avoidedFlags[usage] & flags); f; f &= f - 1)
+        {
+            score++;
+        }
+
+        if (score < bestScore)
+        {
+            bestType  = t;
+            bestScore = score;
+        }
+    }
+
+    return bestType;
+}
+
+VkResult VulkanMemoryAllocator::AllocateDeviceMemory(const VkDeviceSize size, const uint32_t memoryType,
+                                                     const VkMemoryDedicatedAllocateInfo* dedicatedInfo,
+                                                     VkDeviceMemory* memory, byte_t** mapped)
+{
+    if (m_allocationCount >= m_maxAllocationCount)
+    {
+        PrintWarning("Device memory: maxMemoryAllocationCount (%u) reached.", m_maxAllocationCount);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext                = dedicatedInfo;
+    allocateInfo.allocationSize       = size;
+    allocateInfo.memoryTypeIndex      = memoryType;
+
+    const VkResult result = vkAllocateMemory(m_device, &allocateInfo, m_allocator, memory);
+
+    if (result != VK_SUCCESS) return result;
+
+    m_allocationCount++;
+
+    *mapped = nullptr;
+
+    if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        CHECK_INT(vkMapMemory(m_device, *memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(mapped)),
+                  "Failed to map device memory.");
+    }
+
+    return VK_SUCCESS;
+}
+
+void VulkanMemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory)
+{
+    // Implicitly unmaps the memory.
+    vkFreeMemory(m_device, memory, m_allocator);
+
+    m_allocationCount--;
+}
+
+VulkanMemoryAllocator::Block* VulkanMemoryAllocator::CreateBlock(const uint32_t memoryType)
+{
+    VkDeviceMemory memory;
+    byte_t*        mapped;
+
+    if (AllocateDeviceMemory(m_blockSizes[memoryType], memoryType, nullptr, &memory, &mapped) != VK_SUCCESS)
+    {
+        return nullptr;
+    }
+
+    Block* block = new Block;
+    block->memory           = memory;
+    block->size             = m_blockSizes[memoryType];
+    block->allocatedBytes   = 0;
+    block->allocationCount  = 0;
+    block->mapped           = mapped;
+    block->firstLevelBitmap = 0;
+
+    std::fill_n(block->secondLevelBitmaps, VK_TLSF_FIRST_LEVEL_COUNT, 0u);
+    std::fill_n(&block->freeLists[0][0], VK_TLSF_FIRST_LEVEL_COUNT * VK_TLSF_SECOND_LEVEL_COUNT, VK_TLSF_NULL_NODE);
+
+    // A single free node spans the entire block.
+    const uint32_t n = NewNode(*block);
+
+    Node& node        = block->nodes[n];
+    node.offset       = 0;
+    node.size         = block->size;
+    node.alignment    = 1;
+    node.prevPhysical = VK_TLSF_NULL_NODE;
+    node.nextPhysical = VK_TLSF_NULL_NODE;
+    node.userData     = nullptr;
+
+    InsertFreeNode(*block, n);
+
+    return block;
+}
+
+void VulkanMemoryAllocator::DestroyBlock(Block* block)
+{
+    FreeDeviceMemory(block->memory);
+    delete block;
+}
+
+void VulkanMemoryAllocator::MapSize(const VkDeviceSize size, uint32_t* firstLevel, uint32_t* secondLevel)
+{
+    if (size < VK_TLSF_SECOND_LEVEL_COUNT)
+    {
+        // Small sizes are mapped linearly.
+        *firstLevel  = 0;
+        *secondLevel = static_cast<uint32_t>(size);
+    }
+    else
+    {
+        const uint32_t log2Size = FindLastSet(size);
+
+        *firstLevel  = log2Size - VK_TLSF_SECOND_LEVEL_BITS + 1;
+        *secondLevel = static_cast<uint32_t>(size >> (log2Size - VK_TLSF_SECOND_LEVEL_BITS)) - VK_TLSF_SECOND_LEVEL_COUNT;
+    }
+}
+
+uint32_t VulkanMemoryAllocator::NewNode(Block& block)
+{
+    if (!block.unusedNodes.empty())
+    {
+        const uint32_t n = block.unusedNodes.back();
+        block.unusedNodes.pop_back();
+        return n;
+    }
+
+    block.nodes.emplace_back();
+    return static_cast<uint32_t>(block.nodes.size() - 1);
+}
+
+void VulkanMemoryAllocator::InsertFreeNode(Block& block, const uint32_t n)
+{
+    Node& node = block.nodes[n];
+
+    uint32_t fl, sl;
+    MapSize(node.size, &fl, &sl);
+
+    const uint32_t head = block.freeLists[fl][sl];
+
+    node.isFree   = true;
+    node.prevFree = VK_TLSF_NULL_NODE;
+    node.nextFree = head;
+
+    if (head != VK_TLSF_NULL_NODE)
+    {
+        block.nodes[head].prevFree = n;
+    }
+
+    block.freeLists[fl][sl]       = n;
+    block.secondLevelBitmaps[fl] |= 1u << sl;
+    block.firstLevelBitmap       |= 1ull << fl;
+}
+
+void VulkanMemoryAllocator::RemoveFreeNode(Block& block, const uint32_t n)
+{
+    Node& node = block.nodes[n];
+
+    assert(node.isFree);
+
+    if (node.prevFree != VK_TLSF_NULL_NODE) block.nodes[node.prevFree].nextFree = node.nextFree;
+    if (node.nextFree != VK_TLSF_NULL_NODE) block.nodes[node.nextFree].prevFree = node.prevFree;
+
+    uint32_t fl, sl;
+    MapSize(node.size, &fl, &sl);
+
+    if (block.freeLists[fl][sl] == n)
+    {
+        block.freeLists[fl][sl] = node.nextFree;
+
+        if (node.nextFree == VK_TLSF_NULL_NODE)
+        {
+            block.secondLevelBitmaps[fl] &= ~(1u << sl);
+
+            if (block.secondLevelBitmaps[fl] == 0)
+            {
+                block.firstLevelBitmap &= ~(1ull << fl);
+            }
+        }
+    }
+
+    node.isFree = false;
+}
+
+uint32_t VulkanMemoryAllocator::FindFreeNode(const Block& block, VkDeviceSize size)
+{
+    // Round the size up to the next free list, so that any node of the list fits.
+    if (size >= VK_TLSF_SECOND_LEVEL_COUNT)
+    {
+        size += (VkDeviceSize{ 1 } << (FindLastSet(size) - VK_TLSF_SECOND_LEVEL_BITS)) - 1;
+    }
+
+    uint32_t fl, sl;
+    MapSize(size, &fl, &sl);
+
+    uint32_t secondLevelBitmap = block.secondLevelBitmaps[fl] & (~0u << sl);
+
+    if (secondLevelBitmap == 0)
+    {
+        // Use the smallest larger size range.
+        const uint64_t firstLevelBitmap = (fl + 1 < 64) ? (block.firstLevelBitmap & (~0ull << (fl + 1))) : 0;
+
+        if (firstLevelBitmap == 0) return VK_TLSF_NULL_NODE;
+
+        fl                = FindFirstSet(firstLevelBitmap);
+        secondLevelBitmap = block.secondLevelBitmaps[fl];
+    }
+
+    sl = FindFirstSet(secondLevelBitmap);
+
+    return block.freeLists[fl][sl];
+}
+
+uint32_t VulkanMemoryAllocator::AllocateFromBlock(Block& block, const VkDeviceSize size,
+                                                  const VkDeviceSize alignment, void* userData)
+{
+    uint32_t n = FindFreeNode(block, size);
+
+    if (n == VK_TLSF_NULL_NODE) return VK_TLSF_NULL_NODE;
+
+    // The node is large enough, but may not be once aligned. Then search for the worst case.
+    const Node& candidate = block.nodes[n];
+
+    if (AlignUp(candidate.offset, alignment) + size > candidate.offset + candidate.size)
+    {
+        n = FindFreeNode(block, size + alignment - 1);
+
+        if (n == VK_TLSF_NULL_NODE) return VK_TLSF_NULL_NODE;
+    }
+
+    RemoveFreeNode(block, n);
+
+    const VkDeviceSize offset  = block.nodes[n].offset;
+    const VkDeviceSize padding = AlignUp(offset, alignment) - offset;
+
+    // Split the alignment padding off the front; it remains free.
+    // Its neighbor is allocated (free nodes are always merged), so the padding cannot be merged.
+    if (padding > 0)
+    {
+        const uint32_t a = NewNode(block); // Invalidates references
+
+        Node& front = block.nodes[n];
+        Node& node  = block.nodes[a];
+
+        node.offset       = front.offset + padding;
+        node.size         = front.size   - padding;
+        node.prevPhysical = n;
+        node.nextPhysical = front.nextPhysical;
+
+        if (front.nextPhysical != VK_TLSF_NULL_NODE)
+        {
+            block.nodes[front.nextPhysical].prevPhysical = a;
+        }
+
+        front.size         = padding;
+        front.nextPhysical = a;
+
+        InsertFreeNode(block, n);
+
+        n = a;
+    }
+
+    // Split the remainder off the back.
+    if (block.nodes[n].size > size)
+    {
+        const uint32_t b = NewNode(block); // Invalidates references
+
+        Node& node = block.nodes[n];
+        Node& back = block.nodes[b];
+
+        back.offset       = node.offset + size;
+        back.size         = node.size   - size;
+        back.alignment    = 1;
+        back.prevPhysical = n;
+        back.nextPhysical = node.nextPhysical;
+        back.userData     = nullptr;
+
+        if (node.nextPhysical != VK_TLSF_NULL_NODE)
+        {
+            block.nodes[node.nextPhysical].prevPhysical = b;
+        }
+
+        node.size         = size;
+        node.nextPhysical = b;
+
+        InsertFreeNode(block, b);
+    }
+
+    Node& node     = block.nodes[n];
+    node.isFree    = false;
+    node.alignment = alignment;
+    node.userData  = userData;
+
+    block.allocatedBytes  += size;
+    block.allocationCount += 1;
+
+    return n;
+}
+
+void VulkanMemoryAllocator::FreeFromBlock(Block& block, uint32_t n)
+{
+    assert(!block.nodes[n].isFree && "Double free.");
+
+    block.allocatedBytes  -= block.nodes[n].size;
+    block.allocationCount -= 1;
+
+    // Merge with the previous node. The node at offset 0 is never merged into the next one.
+    const uint32_t prev = block.nodes[n].prevPhysical;
+
+    if (prev != VK_TLSF_NULL_NODE && block.nodes[prev].isFree)
+    {
+        RemoveFreeNode(block, prev);
+
+        block.nodes[prev].size        += block.nodes[n].size;
+        block.nodes[prev].nextPhysical = block.nodes[n].nextPhysical;
+
+        if (block.nodes[n].nextPhysical != VK_TLSF_NULL_NODE)
+        {
+            block.nodes[block.nodes[n].nextPhysical].prevPhysical = prev;
+        }
+
+        block.unusedNodes.push_back(n);
+
+        n = prev;
+    }
+
+    // Merge with the next node.
+    const uint32_t next = block.nodes[n].nextPhysical;
+
+    if (next != VK_TLSF_NULL_NODE && block.nodes[next].isFree)
+    {
+        RemoveFreeNode(block, next);
+
+        block.nodes[n].size        += block.nodes[next].size;
+        block.nodes[n].nextPhysical = block.nodes[next].nextPhysical;
+
+        if (block.nodes[next].nextPhysical != VK_TLSF_NULL_NODE)
+        {
+            block.nodes[block.nodes[next].nextPhysical].prevPhysical = n;
+        }
+
+        block.unusedNodes.push_back(next);
+    }
+
+    block.nodes[n].userData = nullptr;
+
+    InsertFreeNode(block, n);
+}
+
+bool VulkanMemoryAllocator::AllocateFromPool(const uint32_t poolIndex, const VkDeviceSize size,
+                                             const VkDeviceSize alignment, const uint32_t excludedBlock,
+                                             void* userData, VulkanAllocation* allocation)
+{
+    Pool& pool = m_pools[poolIndex];
+
+    // First fit over the blocks: keeps the older blocks full, and the newer ones empty (and releasable).
+    for (uint32_t b = 0; b < static_cast<uint32_t>(pool.blocks.size()); b++)
+    {
+        Block* block = pool.blocks[b];
+
+        if (!block || b == excludedBlock || block->size - block->allocatedBytes < size) continue;
+
+        const uint32_t n = AllocateFromBlock(*block, size, alignment, userData);
+
+        if (n != VK_TLSF_NULL_NODE)
+        {
+            const VkDeviceSize offset = block->nodes[n].offset;
+
+            allocation->memory     = block->memory;
+            allocation->offset     = offset;
+            allocation->size       = size;
+            allocation->mapped     = block->mapped ? (block->mapped + offset) : nullptr;
+            allocation->memoryType = poolIndex / 2;
+            allocation->pool       = poolIndex;
+            allocation->block      = b;
+            allocation->node       = n;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+VkResult VulkanMemoryAllocator::AllocateFromMemoryType(const VkMemoryRequirements& requirements,
+                                                       const uint32_t memoryType, const bool optimalImage,
+                                                       const bool dedicated, void* userData,
+                                                       const VkMemoryDedicatedAllocateInfo* dedicatedInfo,
+                                                       VulkanAllocation* allocation)
+{
+    // Sub-allocating large resources wastes too much of a block.
+    if (!dedicated && requirements.size <= m_blockSizes[memoryType] / 2)
+    {
+        // Linear and optimal resources may only share blocks if the granularity does not matter.
+        const uint32_t kind      = (optimalImage && m_bufferImageGranularity > 1) ? 1 : 0;
+        const uint32_t poolIndex = 2 * memoryType + kind;
+
+        if (AllocateFromPool(poolIndex, requirements.size, requirements.alignment, UINT32_MAX,
+                             userData, allocation))
+        {
+            return VK_SUCCESS;
+        }
+
+        if (Block* block = CreateBlock(memoryType))
+        {
+            std::vector<Block*>& blocks = m_pools[poolIndex].blocks;
+
+            const auto slot = std::find(blocks.begin(), blocks.end(), nullptr);
+
+            if (slot != blocks.end())
+            {
+                *slot = block;
+            }
+            else
+            {
+                blocks.push_back(block);
+            }
+
+            // Only the new block has sufficient space.
+            const bool success = AllocateFromPool(poolIndex, requirements.size, requirements.alignment,
+                                                  UINT32_MAX, userData, allocation);
+            assert(success);
+            (void)success;
+
+            return VK_SUCCESS;
+        }
+
+        // Out of memory for a new block; a smaller dedicated allocation may still succeed.
+    }
+
+    byte_t* mapped;
+
+    const VkResult result = AllocateDeviceMemory(requirements.size, memoryType, dedicatedInfo,
+                                                 &allocation->memory, &mapped);
+
+    if (result != VK_SUCCESS) return result;
+
+    allocation->offset     = 0;
+    allocation->size       = requirements.size;
+    allocation->mapped     = mapped;
+    allocation->memoryType = memoryType;
+    allocation->pool       = UINT32_MAX;
+    allocation->block      = UINT32_MAX;
+    allocation->node       = UINT32_MAX;
+
+    m_dedicatedCounts[memoryType]++;
+    m_dedicatedBytes[memoryType] += requirements.size;
+
+    return VK_SUCCESS;
+}
+
+VkResult VulkanMemoryAllocator::AllocateInternal(const VkMemoryRequirements& requirements,
+                                                 const VulkanMemoryUsage usage, const bool optimalImage,
+                                                 const bool dedicated, void* userData,
+                                                 const VkMemoryDedicatedAllocateInfo* dedicatedInfo,
+                                                 VulkanAllocation* allocation)
+{
+    assert(requirements.size > 0);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t typeBits = requirements.memoryTypeBits;
+
+    // Fall back to the next best memory type if the heap is exhausted.
+    for (;;)
+    {
+        const uint32_t memoryType = FindMemoryType(typeBits, usage);
+
+        if (memoryType == UINT32_MAX) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+        const VkResult result = AllocateFromMemoryType(requirements, memoryType, optimalImage, dedicated,
+                                                       userData, dedicatedInfo, allocation);
+
+        if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY) return result;
+
+        typeBits &= ~(1u << memoryType);
+    }
+}
+
+VkResult VulkanMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, const VulkanMemoryUsage usage,
+                                         const bool optimalImage, const bool dedicated, void* userData,
+                                         VulkanAllocation* allocation)
+{
+    return AllocateInternal(requirements, usage, optimalImage, dedicated, userData, nullptr, allocation);
+}
+
+void VulkanMemoryAllocator::FreeInternal(const VulkanAllocation& allocation)
+{
+    if (allocation.pool == UINT32_MAX)
+    {
+        FreeDeviceMemory(allocation.memory);
+
+        m_dedicatedCounts[allocation.memoryType]--;
+        m_dedicatedBytes[allocation.memoryType] -= allocation.size;
+        return;
+    }
+
+    std::vector<Block*>& blocks = m_pools[allocation.pool].blocks;
+
+    Block* block = blocks[allocation.block];
+
+    FreeFromBlock(*block, allocation.node);
+
+    if (block->allocationCount == 0)
+    {
+        // Keep a single empty block per pool to avoid thrashing.
+        for (uint32_t b = 0; b < static_cast<uint32_t>(blocks.size()); b++)
+        {
+            if (b != allocation.block && blocks[b] && blocks[b]->allocationCount == 0)
+            {
+                DestroyBlock(block);
+                blocks[allocation.block] = nullptr;
+                break;
+            }
+        }
+    }
+}
+
+void VulkanMemoryAllocator::Free(const VulkanAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    FreeInternal(allocation);
+}
+
+VkResult VulkanMemoryAllocator::CreateBuffer(const VkBufferCreateInfo& bufferInfo, const VulkanMemoryUsage usage,
+                                             void* userData, VkBuffer* buffer, VulkanAllocation* allocation)
+{
+    VkResult result = vkCreateBuffer(m_device, &bufferInfo, m_allocator, buffer);
+
+    if (result != VK_SUCCESS) return result;
+
+    VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+    requirementsInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.buffer = *buffer;
+
+    VkMemoryDedicatedRequirements dedicatedRequirements = {};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+
+    vkGetBufferMemoryRequirements2(m_device, &requirementsInfo, &requirements);
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+    dedicatedInfo.sType  = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = *buffer;
+
+    const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation ||
+                           dedicatedRequirements.requiresDedicatedAllocation;
+
+    result = AllocateInternal(requirements.memoryRequirements, usage, false, dedicated, userData,
+                              &dedicatedInfo, allocation);
+
+    if (result != VK_SUCCESS)
+    {
+        vkDestroyBuffer(m_device, *buffer, m_allocator);
+        *buffer = VK_NULL_HANDLE;
+        return result;
+    }
+
+    CHECK_INT(vkBindBufferMemory(m_device, *buffer, allocation->memory, allocation->offset),
+              "Failed to bind buffer memory.");
+
+    return VK_SUCCESS;
+}
+
+VkResult VulkanMemoryAllocator::CreateImage(const VkImageCreateInfo& imageInfo, const VulkanMemoryUsage usage,
+                                            void* userData, VkImage* image, VulkanAllocation* allocation)
+{
+    VkResult result = vkCreateImage(m_device, &imageInfo, m_allocator, image);
+
+    if (result != VK_SUCCESS) return result;
+
+    VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.image = *image;
+
+    VkMemoryDedicatedRequirements dedicatedRequirements = {};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+
+    vkGetImageMemoryRequirements2(m_device, &requirementsInfo, &requirements);
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.image = *image;
+
+    const bool dedicated    = dedicatedRequirements.prefersDedicatedAllocation ||
+                              dedicatedRequirements.requiresDedicatedAllocation;
+    const bool optimalImage = (imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL);
+
+    result = AllocateInternal(requirements.memoryRequirements, usage, optimalImage, dedicated, userData,
+                              &dedicatedInfo, allocation);
+
+    if (result != VK_SUCCESS)
+    {
+        vkDestroyImage(m_device, *image, m_allocator);
+        *image = VK_NULL_HANDLE;
+        return result;
+    }
+
+    CHECK_INT(vkBindImageMemory(m_device, *image, allocation->memory, allocation->offset),
+              "Failed to bind image memory.");
+
+    return VK_SUCCESS;
+}
+
+void VulkanMemoryAllocator::DestroyBuffer(VkBuffer buffer, const VulkanAllocation& allocation)
+{
+    vkDestroyBuffer(m_device, buffer, m_allocator);
+    Free(allocation);
+}
+
+void VulkanMemoryAllocator::DestroyImage(VkImage image, const VulkanAllocation& allocation)
+{
+    vkDestroyImage(m_device, image, m_allocator);
+    Free(allocation);
+}
+
+void VulkanMemoryAllocator::Flush(const VulkanAllocation& allocation, const VkDeviceSize offset,
+                                  const VkDeviceSize size) const
+{
+    const VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[allocation.memoryType].propertyFlags;
+
+    if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) return;
+
+    // The range must be aligned to nonCoherentAtomSize, or end at the end of the memory object.
+    const VkDeviceSize memorySize = (allocation.pool == UINT32_MAX) ? allocation.size
+                                                                    : m_blockSizes[allocation.memoryType];
+    const VkDeviceSize end        = (size == VK_WHOLE_SIZE) ? allocation.size : (offset + size);
+
+    VkMappedMemoryRange range = {};
+    range.sType               = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory              = allocation.memory;
+    range.offset              = AlignDown(allocation.offset + offset, m_nonCoherentAtomSize);
+    range.size                = std::min(AlignUp(allocation.offset + end, m_nonCoherentAtomSize), memorySize)
+                              - range.offset;
+
+    CHECK_INT(vkFlushMappedMemoryRanges(m_device, 1, &range), "Failed to flush mapped memory.");
+}
+
+void VulkanMemoryAllocator::Invalidate(const VulkanAllocation& allocation, const VkDeviceSize offset,
+                                       const VkDeviceSize size) const
+{
+    const VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[allocation.memoryType].propertyFlags;
+
+    if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) return;
+
+    const VkDeviceSize memorySize = (allocation.pool == UINT32_MAX) ? allocation.size
+                                                                    : m_blockSizes[allocation.memoryType];
+    const VkDeviceSize end        = (size == VK_WHOLE_SIZE) ? allocation.size : (offset + size);
+
+    VkMappedMemoryRange range = {};
+    range.sType               = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory              = allocation.memory;
+    range.offset              = AlignDown(allocation.offset + offset, m_nonCoherentAtomSize);
+    range.size                = std::min(AlignUp(allocation.offset + end, m_nonCoherentAtomSize), memorySize)
+                              - range.offset;
+
+    CHECK_INT(vkInvalidateMappedMemoryRanges(m_device, 1, &range), "Failed to invalidate mapped memory.");
+}
+
+uint32_t VulkanMemoryAllocator::Defragment(VulkanMoveAllocationFunction move, const VkDeviceSize maxBytes)
+{
+    struct Candidate
+    {
+        uint32_t     node;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        void*        userData;
+    };
+
+    std::vector<Candidate> candidates;
+
+    uint32_t     moveCount  = 0;
+    VkDeviceSize movedBytes = 0;
+
+    for (uint32_t p = 0; p < static_cast<uint32_t>(m_pools.size()) && movedBytes < maxBytes; p++)
+    {
+        uint32_t source = UINT32_MAX;
+
+        candidates.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            const std::vector<Block*>& blocks = m_pools[p].blocks;
+
+            // Select the least occupied block, provided the other blocks can absorb its allocations.
+            VkDeviceSize minAllocatedBytes = UINT64_MAX;
+            VkDeviceSize otherFreeBytes    = 0;
+
+            for (uint32_t b = 0; b < static_cast<uint32_t>(blocks.size()); b++)
+            {
+                if (!blocks[b]) continue;
+
+                otherFreeBytes += blocks[b]->size - blocks[b]->allocatedBytes;
+
+                if (blocks[b]->allocationCount > 0 && blocks[b]->allocatedBytes < minAllocatedBytes)
+                {
+                    source            = b;
+                    minAllocatedBytes = blocks[b]->allocatedBytes;
+                }
+            }
+
+            if (source == UINT32_MAX) continue;
+
+            const Block& block = *blocks[source];
+
+            otherFreeBytes -= block.size - block.allocatedBytes;
+
+            if (otherFreeBytes < block.allocatedBytes) continue;
+
+            for (uint32_t n = 0; n != VK_TLSF_NULL_NODE; n = block.nodes[n].nextPhysical)
+            {
+                const Node& node = block.nodes[n];
+
+                if (!node.isFree)
+                {
+                    candidates.push_back({ n, node.offset, node.size, node.alignment, node.userData });
+                }
+            }
+        }
+
+        for (const Candidate& candidate : candidates)
+        {
+            if (movedBytes + candidate.size > maxBytes) break;
+
+            VulkanAllocation src, dst;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                const Block* block = m_pools[p].blocks[source];
+
+                // Stop if the block has changed in the meantime.
+                if (!block || candidate.node >= block->nodes.size()) break;
+
+                const Node& node = block->nodes[candidate.node];
+
+                if (node.isFree || node.offset != candidate.offset || node.userData != candidate.userData) break;
+
+                if (!AllocateFromPool(p, candidate.size, candidate.alignment, source, candidate.userData, &dst))
+                {
+                    break;
+                }
+
+                src.memory     = block->memory;
+                src.offset     = candidate.offset;
+                src.size       = candidate.size;
+                src.mapped     = block->mapped ? (block->mapped + candidate.offset) : nullptr;
+                src.memoryType = p / 2;
+                src.pool       = p;
+                src.block      = source;
+                src.node       = candidate.node;
+            }
+
+            // The callback may free allocations, so the lock must not be held.
+            if (move(candidate.userData, src, dst))
+            {
+                moveCount++;
+                movedBytes += candidate.size;
+            }
+            else
+            {
+                Free(dst);
+            }
+        }
+    }
+
+    return moveCount;
+}
+
+VulkanMemoryStatistics VulkanMemoryAllocator::Statistics(const uint32_t memoryType) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VulkanMemoryStatistics stats = {};
+
+    VkDeviceSize freeBytes          = 0;
+    VkDeviceSize largestFreeRegions = 0; // Sum over the blocks
+
+    for (uint32_t p = 0; p < static_cast<uint32_t>(m_pools.size()); p++)
+    {
+        if (memoryType != UINT32_MAX && p / 2 != memoryType) continue;
+
+        for (const Block* block : m_pools[p].blocks)
+        {
+            if (!block) continue;
+
+            stats.blockCount++;
+            stats.blockBytes      += block->size;
+            stats.allocationCount += block->allocationCount;
+            stats.allocatedBytes  += block->allocatedBytes;
+
+            VkDeviceSize largestFreeRegion = 0;
+
+            for (uint32_t n = 0; n != VK_TLSF_NULL_NODE; n = block->nodes[n].nextPhysical)
+            {
+                const Node& node = block->nodes[n];
+
+                if (node.isFree)
+                {
+                    stats.freeRegionCount++;
+                    largestFreeRegion = std::max(largestFreeRegion, node.size);
+                }
+            }
+
+            freeBytes               += block->size - block->allocatedBytes;
+            largestFreeRegions      += largestFreeRegion;
+            stats.largestFreeRegion  = std::max(stats.largestFreeRegion, largestFreeRegion);
+        }
+    }
+
+    for (uint32_t t = 0; t < m_memoryProperties.memoryTypeCount; t++)
+    {
+        if (memoryType != UINT32_MAX && t != memoryType) continue;
+
+        stats.allocationCount += m_dedicatedCounts[t];
+        stats.allocatedBytes  += m_dedicatedBytes[t];
+        stats.dedicatedCount  += m_dedicatedCounts[t];
+    }
+
+    stats.fragmentation = (freeBytes > 0) ? (1.0f - static_cast<float>(largestFreeRegions) /
+                                                    static_cast<float>(freeBytes)) : 0.0f;
+
+    return stats;
+}
+
+void VulkanMemoryAllocator::PrintStatistics() const
+{
+    constexpr double MiB = 1.0 / (1 << 20);
+
+    for (uint32_t t = 0; t < m_memoryProperties.memoryTypeCount; t++)
+    {
+        const VulkanMemoryStatistics stats = Statistics(t);
+
+        if (stats.blockCount == 0 && stats.dedicatedCount == 0) continue;
+
+        PrintInfo("Device memory: type %2u | blocks: %3llu (%8.1f MiB) | allocations: %6llu (%llu dedicated) | "
+                  "allocated: %8.1f MiB | fragmentation: %.2f",
+                  t,
+                  static_cast<unsigned long long>(stats.blockCount), MiB * static_cast<double>(stats.blockBytes),
+                  static_cast<unsigned long long>(stats.allocationCount),
+                  static_cast<unsigned long long>(stats.dedicatedCount),
+                  MiB * static_cast<double>(stats.allocatedBytes), stats.fragmentation);
+    }
+}
+
+void BenchmarkMemoryAllocator(VulkanMemoryAllocator* allocator, const uint32_t operationCount)
+{
+    using Clock = std::chrono::steady_clock;
+
+    ASSERT(operationCount > 0, "The benchmark requires operations.");
+
+    // Bounds the memory in use, so that the benchmark runs on small heaps (e.g. of software rasterizers).
+    const uint32_t     maxLiveCount = 4096;
+    const VkDeviceSize maxLiveBytes = 256ull << 20;
+
+    // Deterministic, so that the runs are comparable.
+    uint32_t seed = 1;
+
+    const auto random = [&seed]()
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+        return seed >> 8;
+    };
+
+    struct LiveAllocation
+    {
+        VulkanAllocation allocation;
+        VkDeviceSize     size;
+    };
+
+    std::vector<LiveAllocation> live;
+    live.reserve(maxLiveCount);
+
+    VkDeviceSize liveBytes        = 0;
+    uint32_t     allocationCount  = 0;
+    uint32_t     failureCount     = 0;
+    float        maxFragmentation = 0.0f;
+
+    const Clock::time_point start = Clock::now();
+
+    for (uint32_t i = 0; i < operationCount; i++)
+    {
+        // Sizes from 256 B to 4 MiB, uniformly distributed on a log scale, like a mix of buffers and textures.
+        // 4 MiB is far below the threshold of dedicated allocations, so every request goes through TLSF.
+        const VkDeviceSize size      = VkDeviceSize{ 256 } << (random() % 15);
+        const VkDeviceSize alignment = VkDeviceSize{ 256 } << (4 * (random() % 3));
+
+        const bool isAllocation = live.empty() ||
+                                  (random() % 2 == 0 && live.size() < maxLiveCount && liveBytes + size <= maxLiveBytes);
+
+        if (isAllocation)
+        {
+            const VkMemoryRequirements requirements = { size, alignment, UINT32_MAX };
+
+            LiveAllocation entry = { {}, size };
+
+            if (allocator->Allocate(requirements, VK_MEMORY_USAGE_GPU_ONLY, random() % 2 == 0, false, nullptr,
+                                    &entry.allocation) == VK_SUCCESS)
+            {
+                live.push_back(entry);
+                liveBytes += size;
+                allocationCount++;
+            }
+            else
+            {
+                failureCount++;
+            }
+        }
+        else
+        {
+            const uint32_t index = random() % static_cast<uint32_t>(live.size());
+
+            allocator->Free(live[index].allocation);
+            liveBytes -= live[index].size;
+
+            live[index] = live.back();
+            live.pop_back();
+        }
+
+        // Sampling the statistics walks all the blocks, so it is done rarely, and not timed.
+        if (i % 65536 == 65535)
+        {
+            maxFragmentation = std::max(maxFragmentation, allocator->Statistics().fragmentation);
+        }
+    }
+
+    const std::chrono::duration<double> duration = Clock::now() - start;
+
+    const VulkanMemoryStatistics stats = allocator->Statistics();
+
+    maxFragmentation = std::max(maxFragmentation, stats.fragmentation);
+
+    constexpr double MiB = 1.0 / (1 << 20);
+
+    PrintInfo("Memory allocator benchmark (%u operations, %u allocations, %u failed):",
+              operationCount, allocationCount, failureCount);
+    PrintInfo("  %.2f M operations/s (%.1f ns per operation, including the creation of the blocks)",
+              operationCount / duration.count() * 1e-6, duration.count() * 1e9 / operationCount);
+    PrintInfo("  Live: %zu allocations, %.1f MiB | blocks: %llu (%.1f MiB) | free regions: %llu",
+              live.size(), MiB * static_cast<double>(liveBytes),
+              static_cast<unsigned long long>(stats.blockCount), MiB * static_cast<double>(stats.blockBytes),
+              static_cast<unsigned long long>(stats.freeRegionCount));
+    PrintInfo("  Fragmentation: %.3f at the end, %.3f at most (sampled)", stats.fragmentation, maxFragmentation);
+
+    for (const LiveAllocation& entry : live)
+    {
+        allocator->Free(entry.allocation);
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#define VK_MEMORY_BLOCK_SIZE        (64ull << 20) // Preferred size of a device memory block
+#define VK_TLSF_SECOND_LEVEL_BITS   4             // Each power-of-2 size range is split into 16 free lists
+#define VK_TLSF_SECOND_LEVEL_COUNT  (1u << VK_TLSF_SECOND_LEVEL_BITS)
+#define VK_TLSF_FIRST_LEVEL_COUNT   (64 - VK_TLSF_SECOND_LEVEL_BITS + 1)
+
+// Intended access pattern of the memory; determines the memory type.
+enum VulkanMemoryUsage : uint32_t
+{
+    VK_MEMORY_USAGE_GPU_ONLY,   // Device-local
+    VK_MEMORY_USAGE_CPU_TO_GPU, // Host-visible, coherent, persistently mapped (uploads)
+    VK_MEMORY_USAGE_GPU_TO_CPU, // Host-visible, preferably cached, persistently mapped (read-backs)
+    VK_MEMORY_USAGE_COUNT
+};
+
+// Sub-allocation of a block of device memory, or a dedicated allocation.
+struct VulkanAllocation
+{
+    VkDeviceMemory memory;
+    VkDeviceSize   offset;     // Within 'memory'
+    VkDeviceSize   size;
+    byte_t*        mapped;     // Pointer to 'offset'; nullptr unless host-visible
+    uint32_t       memoryType;
+    uint32_t       pool;       // UINT32_MAX for dedicated allocations
+    uint32_t       block;
+    uint32_t       node;
+};
+
+// Called by VulkanMemoryAllocator::Defragment() for each allocation it relocates.
+// The callee must copy the contents of 'src' to 'dst', rebind the resource which owns 'src'
+// (identified by 'userData'), and free 'src' once the GPU no longer uses it.
+// If it returns 'false', 'dst' is freed and 'src' remains in use.
+typedef bool (*VulkanMoveAllocationFunction)(void* userData, const VulkanAllocation& src,
+                                             const VulkanAllocation& dst);
+
+struct VulkanMemoryStatistics
+{
+    uint64_t blockCount;
+    uint64_t blockBytes;           // Reserved by the blocks
+    uint64_t allocationCount;      // Including dedicated ones
+    uint64_t allocatedBytes;       // Including dedicated ones
+    uint64_t dedicatedCount;
+    uint64_t freeRegionCount;
+    uint64_t largestFreeRegion;
+    float    fragmentation;        // 1 - (sum of the largest free region of each block) / free bytes
+};
+
+// Device memory sub-allocator.
+// Memory is reserved in large blocks per memory type, and sub-allocated with TLSF
+// (two-level segregated fit: O(1) allocation and deallocation with low fragmentation).
+// Large resources and the ones which require or prefer it get dedicated allocations.
+// If bufferImageGranularity > 1, linear and optimal resources are placed into separate blocks,
+// so that they never share a page. Host-visible blocks are persistently mapped.
+// Thread-safe.
+class VulkanMemoryAllocator
+{
+public:
+
+    void Create(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* allocator);
+    void Destroy();
+
+    // Allocates memory for the resource. 'optimalImage' must be set for images with VK_IMAGE_TILING_OPTIMAL.
+    // 'userData' identifies the owner of the allocation (see Defragment()).
+    // Returns VK_ERROR_OUT_OF_DEVICE_MEMORY or VK_ERROR_TOO_MANY_OBJECTS on failure.
+    VkResult Allocate(const VkMemoryRequirements& requirements, const VulkanMemoryUsage usage,
+                      const bool optimalImage, const bool dedicated, void* userData,
+                      VulkanAllocation* allocation);
+    void     Free(const VulkanAllocation& allocation);
+
+    // Create the resource, and allocate and bind its memory.
+    VkResult CreateBuffer(const VkBufferCreateInfo& bufferInfo, const VulkanMemoryUsage usage, void* userData,
+                          VkBuffer* buffer, VulkanAllocation* allocation);
+    VkResult CreateImage(const VkImageCreateInfo& imageInfo, const VulkanMemoryUsage usage, void* userData,
+                         VkImage* image, VulkanAllocation* allocation);
+    void     DestroyBuffer(VkBuffer buffer, const VulkanAllocation& allocation);
+    void     DestroyImage(VkImage image, const VulkanAllocation& allocation);
+
+    // Make host writes visible to the device, and device writes visible to the host.
+    // No-ops for host-coherent memory. The range is relative to the allocation.
+    void Flush(const VulkanAllocation& allocation, const VkDeviceSize offset, const VkDeviceSize size) const;
+    void Invalidate(const VulkanAllocation& allocation, const VkDeviceSize offset, const VkDeviceSize size) const;
+
+    // Defragmentation hook. Relocates allocations out of the least occupied block of each pool
+    // into the free space of its other blocks, so that the emptied block can be released.
+    // Moves at most 'maxBytes' bytes in total. Returns the number of relocated allocations.
+    uint32_t Defragment(VulkanMoveAllocationFunction move, const VkDeviceSize maxBytes);
+
+    // Returns the statistics of all memory types combined if 'memoryType' is UINT32_MAX.
+    VulkanMemoryStatistics Statistics(const uint32_t memoryType = UINT32_MAX) const;
+
+    // Prints the statistics of all memory types in use.
+    void PrintStatistics() const;
+
+private:
+
+    // Physically contiguous range of a block. Free nodes are also linked into a free list.
+    // Node 0 always begins at offset 0.
+    struct Node
+    {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        VkDeviceSize alignment;    // Requested by the allocation
+        uint32_t     prevPhysical;
+        uint32_t     nextPhysical;
+        uint32_t     prevFree;
+        uint32_t     nextFree;
+        bool         isFree;
+        void*        userData;
+    };
+
+    struct Block
+    {
+        VkDeviceMemory        memory;
+        VkDeviceSize          size;
+        VkDeviceSize          allocatedBytes;
+        uint32_t              allocationCount;
+        byte_t*               mapped;
+        uint64_t              firstLevelBitmap;
+        uint32_t              secondLevelBitmaps[VK_TLSF_FIRST_LEVEL_COUNT];
+        uint32_t              freeLists[VK_TLSF_FIRST_LEVEL_COUNT][VK_TLSF_SECOND_LEVEL_COUNT];
+        std::vector<Node>     nodes;
+        std::vector<uint32_t> unusedNodes;
+    };
+
+    // Blocks of a memory type with resources of one kind (linear or optimal).
+    struct Pool
+    {
+        std::vector<Block*> blocks; // May contain nullptr slots, so that the indices remain stable
+    };
+
+    uint32_t FindMemoryType(const uint32_t typeBits, const VulkanMemoryUsage usage) const;
+    VkResult AllocateDeviceMemory(const VkDeviceSize size, const uint32_t memoryType,
+                                  const VkMemoryDedicatedAllocateInfo* dedicatedInfo,
+                                  VkDeviceMemory* memory, byte_t** mapped);
+    void     FreeDeviceMemory(VkDeviceMemory memory);
+
+    VkResult AllocateInternal(const VkMemoryRequirements& requirements, const VulkanMemoryUsage usage,
+                              const bool optimalImage, const bool dedicated, void* userData,
+                              const VkMemoryDedicatedAllocateInfo* dedicatedInfo, VulkanAllocation* allocation);
+    VkResult AllocateFromMemoryType(const VkMemoryRequirements& requirements, const uint32_t memoryType,
+                                    const bool optimalImage, const bool dedicated, void* userData,
+                                    const VkMemoryDedicatedAllocateInfo* dedicatedInfo,
+                                    VulkanAllocation* allocation);
+    bool     AllocateFromPool(const uint32_t poolIndex, const VkDeviceSize size, const VkDeviceSize alignment,
+                              const uint32_t excludedBlock, void* userData, VulkanAllocation* allocation);
+    void     FreeInternal(const VulkanAllocation& allocation);
+
+    Block*   CreateBlock(const uint32_t memoryType);
+    void     DestroyBlock(Block* block);
+
+    // TLSF.
+    static void     MapSize(const VkDeviceSize size, uint32_t* firstLevel, uint32_t* secondLevel);
+    static uint32_t NewNode(Block& block);
+    static void     InsertFreeNode(Block& block, const uint32_t n);
+    static void     RemoveFreeNode(Block& block, const uint32_t n);
+    static uint32_t FindFreeNode(const Block& block, VkDeviceSize size);
+    static uint32_t AllocateFromBlock(Block& block, const VkDeviceSize size, const VkDeviceSize alignment,
+                                      void* userData);
+    static void     FreeFromBlock(Block& block, uint32_t n);
+
+    VkPhysicalDevice                 m_physicalDevice;
+    VkDevice                         m_device;
+    const VkAllocationCallbacks*     m_allocator;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    VkDeviceSize                     m_bufferImageGranularity;
+    VkDeviceSize                     m_nonCoherentAtomSize;
+    uint32_t                         m_maxAllocationCount;
+    uint32_t                         m_allocationCount;        // Of VkDeviceMemory objects
+    VkDeviceSize                     m_blockSizes[VK_MAX_MEMORY_TYPES];
+    std::vector<Pool>                m_pools;                  // 2 per memory type: linear, optimal
+    uint64_t                         m_dedicatedCounts[VK_MAX_MEMORY_TYPES];
+    VkDeviceSize                     m_dedicatedBytes[VK_MAX_MEMORY_TYPES];
+    mutable std::mutex               m_mutex;
+};
+
+// Measures the throughput of 'operationCount' random allocations and deallocations of device-local memory
+// (with at most a few thousand allocations alive at a time), and the resulting fragmentation. Prints a report.
+void BenchmarkMemoryAllocator(VulkanMemoryAllocator* allocator, const uint32_t operationCount);
@@ -0,0 +1,173 @@
+#include "parallelrecorder.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <cassert>
+
+void VulkanParallelRecorder::Create(VkDevice device, const VkAllocationCallbacks* allocator, JobSystem* jobSystem,
+                                    const uint32_t queueFamilyIndex, const uint32_t frameCount)
+{
+    assert(frameCount <= VK_MAX_PARALLEL_RECORDER_FRAMES);
+
+    m_device       = device;
+    m_allocator    = allocator;
+    m_jobSystem    = jobSystem;
+    m_workerCount  = jobSystem->WorkerCount();
+    m_frameCount   = frameCount;
+    m_frameIndex   = 0;
+    m_pools        = new ThreadPool[m_frameCount * m_workerCount];
+    m_globalLayout = VK_NULL_HANDLE;
+    m_globalSet    = VK_NULL_HANDLE;
+
+    // The pools are reset in bulk once per frame, and their command buffers are short-lived.
+    VkCommandPoolCreateInfo commandPoolInfo = {};
+    commandPoolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+
+    for (uint32_t i = 0; i < m_frameCount * m_workerCount; i++)
+    {
+        CHECK_INT(vkCreateCommandPool(m_device, &commandPoolInfo, m_allocator, &m_pools[i].commandPool),
+                  "Failed to create a command pool.");
+
+        m_pools[i].usedCount = 0;
+    }
+}
+
+void VulkanParallelRecorder::Destroy()
+{
+    for (uint32_t i = 0; i < m_frameCount * m_workerCount; i++)
+    {
+        // Destroying the pool also frees its command buffers.
+        vkDestroyCommandPool(m_device, m_pools[i].commandPool, m_allocator);
+    }
+
+    delete[] m_pools;
+    m_pools = nullptr;
+
+    m_batchCommandBuffers.clear();
+}
+
+void VulkanParallelRecorder::BeginFrame(const uint32_t frameIndex)
+{
+    assert(frameIndex < m_frameCount);
+
+    m_frameIndex = frameIndex;
+
+    ThreadPool* pools = &m_pools[m_frameIndex * m_workerCount];
+
+    for (uint32_t w = 0; w < m_workerCount; w++)
+    {
+        // Only reset the pools which have been used.
+        if (pools[w].usedCount > 0)
+        {
+            CHECK_INT(vkResetCommandPool(m_device, pools[w].commandPool, 0),
+                      "Failed to reset a command pool.");
+
+            pools[w].usedCount = 0;
+        }
+    }
+}
+
+void VulkanParallelRecorder::SetGlobalDescriptorSet(VkPipelineLayout layout, VkDescriptorSet set)
+{
+    m_globalLayout = layout;
+    m_globalSet    = set;
+}
+
+VkCommandBuffer VulkanParallelRecorder::AcquireCommandBuffer(const uint32_t workerIndex)
+{
+    ThreadPool& pool = m_pools[m_frameIndex * m_workerCount + workerIndex];
+
+    if (pool.usedCount == pool.commandBuffers.size())
+    {
+        VkCommandBufferAllocateInfo commandBufferInfo = {};
+        commandBufferInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool        = pool.commandPool;
+        commandBufferInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        commandBufferInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+
+        CHECK_INT(vkAllocateCommandBuffers(m_device, &commandBufferInfo, &commandBuffer),
+                  "Failed to allocate a command buffer.");
+
+        pool.commandBuffers.push_back(commandBuffer);
+    }
+
+    return pool.commandBuffers[pool.usedCount++];
+}
+
+void VulkanParallelRecorder::RecordBatch(void* data, const uint32_t begin, const uint32_t end)
+{
+    TRACE_SCOPE("RecordBatch");
+
+    const RecordJob&        job      = *static_cast<const RecordJob*>(data);
+    VulkanParallelRecorder* recorder = job.recorder;
+
+    // The pool of the worker is not accessed by any other thread.
+    VkCommandBuffer commandBuffer = recorder->AcquireCommandBuffer(JobSystem::WorkerIndex());
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = job.inheritanceInfo;
+
+    if (job.inheritanceInfo->renderPass)
+    {
+        beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    }
+
+    CHECK_INT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+              "Failed to begin recording a command buffer.");
+
+    if (recorder->m_globalSet)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recorder->m_globalLayout,
+                                0, 1, &recorder->m_globalSet, 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,  recorder->m_globalLayout,
+                                0, 1, &recorder->m_globalSet, 0, nullptr);
+    }
+
+    job.record(commandBuffer, begin, end, job.userData);
+
+    CHECK_INT(vkEndCommandBuffer(commandBuffer),
+              "Failed to end recording a command buffer.");
+
+    job.commandBuffers[begin / job.batchSize] = commandBuffer;
+}
+
+void VulkanParallelRecorder::Record(VkCommandBuffer primaryCommandBuffer, const uint32_t count,
+                                    const uint32_t batchSize, VulkanRecordFunction record, void* userData,
+                                    const VkCommandBufferInheritanceInfo* inheritanceInfo)
+{
+    TRACE_FUNCTION();
+
+    assert(batchSize > 0);
+
+    if (count == 0) return;
+
+    // Outside of a render pass, there is nothing to inherit.
+    VkCommandBufferInheritanceInfo defaultInheritanceInfo = {};
+    defaultInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+
+    const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+
+    m_batchCommandBuffers.resize(batchCount);
+
+    RecordJob job = {};
+    job.recorder        = this;
+    job.record          = record;
+    job.userData        = userData;
+    job.batchSize       = batchSize;
+    job.inheritanceInfo = inheritanceInfo ? inheritanceInfo : &defaultInheritanceInfo;
+    job.commandBuffers  = m_batchCommandBuffers.data();
+
+    JobCounter counter{ 0 };
+
+    m_jobSystem->ParallelFor(count, batchSize, RecordBatch, &job, &counter);
+    m_jobSystem->Wait(counter);
+
+    // Preserve the order of the items.
+    vkCmdExecuteCommands(primaryCommandBuffer, batchCount, m_batchCommandBuffers.data());
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "jobsystem.h"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#define VK_MAX_PARALLEL_RECORDER_FRAMES 4
+
+// Records the items (e.g. draws) ['begin', 'end') into the command buffer.
+using VulkanRecordFunction = void (*)(VkCommandBuffer commandBuffer, const uint32_t begin, const uint32_t end,
+                                      void* userData);
+
+// Records commands on all the workers of the job system.
+// Each worker has a command pool per frame in flight (command pools are externally synchronized,
+// so they cannot be shared across threads), from which it allocates secondary command buffers.
+// The secondary command buffers are executed, in order, by a primary one on the calling thread.
+// The pools of a frame are reset in bulk once the frame retires; the command buffers are recycled.
+class VulkanParallelRecorder
+{
+public:
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, JobSystem* jobSystem,
+                const uint32_t queueFamilyIndex, const uint32_t frameCount);
+    void Destroy();
+
+    // Must be called when recording of the frame in the slot 'frameIndex' begins.
+    // The GPU must have finished executing the frame which previously used the slot.
+    void BeginFrame(const uint32_t frameIndex);
+
+    // The descriptor set is bound (as set 0, to the graphics and compute bind points) at the beginning
+    // of every secondary command buffer, which does not inherit the bindings of the primary one.
+    void SetGlobalDescriptorSet(VkPipelineLayout layout, VkDescriptorSet set);
+
+    // Records [0, 'count') in batches of (at most) 'batchSize' items, a secondary command buffer per batch,
+    // and executes them from the primary command buffer. Returns once the recording is complete.
+    // 'inheritanceInfo' is required inside a render pass; it may be null otherwise.
+    // Must not be called by several threads at the same time.
+    void Record(VkCommandBuffer primaryCommandBuffer, const uint32_t count, const uint32_t batchSize,
+                VulkanRecordFunction record, void* userData,
+                const VkCommandBufferInheritanceInfo* inheritanceInfo = nullptr);
+
+private:
+
+    // Owned by a single worker, for a single frame.
+    struct alignas(64) ThreadPool
+    {
+        VkCommandPool                commandPool;
+        std::vector<VkCommandBuffer> commandBuffers; // Allocated on demand, and reused
+        uint32_t                     usedCount;
+    };
+
+    struct RecordJob
+    {
+        VulkanParallelRecorder*               recorder;
+        VulkanRecordFunction                  record;
+        void*                                 userData;
+        uint32_t                              batchSize;
+        const VkCommandBufferInheritanceInfo* inheritanceInfo;
+        VkCommandBuffer*                      commandBuffers; // One per batch
+    };
+
+    static void RecordBatch(void* data, const uint32_t begin, const uint32_t end);
+
+    VkCommandBuffer AcquireCommandBuffer(const uint32_t workerIndex);
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    JobSystem*                   m_jobSystem;
+    uint32_t                     m_workerCount;
+    uint32_t                     m_frameCount;
+    uint32_t                     m_frameIndex;
+    ThreadPool*                  m_pools;          // [frame][worker]
+    VkPipelineLayout             m_globalLayout;   // Optional
+    VkDescriptorSet              m_globalSet;
+    std::vector<VkCommandBuffer> m_batchCommandBuffers;
+};
@@ -0,0 +1,230 @@
+#include "pipelinecache.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#define VK_PIPELINE_CACHE_FILE_MAGIC    0x4350474D // 'MGPC'
+#define VK_PIPELINE_CACHE_FILE_VERSION  1
+#define VK_PIPELINE_CACHE_MAX_DATA_SIZE (1ull << 30)
+
+// Precedes the data returned by vkGetPipelineCacheData().
+// The header of the data itself does not contain the driver version.
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t version;       // Of the file format
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;      // See HashBytes()
+};
+
+void VulkanPipelineCache::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                 const VkPhysicalDeviceProperties& physicalDeviceProperties,
+                                 const uint32_t workerCount, string_t path)
+{
+    TRACE_FUNCTION();
+
+    ASSERT(workerCount <= JOB_MAX_WORKERS, "Too many workers.");
+
+    m_device                   = device;
+    m_allocator                = allocator;
+    m_physicalDeviceProperties = physicalDeviceProperties;
+    m_path                     = path;
+    m_workerCount              = workerCount;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    void*  data = nullptr;
+    size_t size = 0;
+
+    m_isWarm = Load(&data, &size);
+
+    // Each worker starts with the entire contents of the file.
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = size;
+    cacheInfo.pInitialData    = data;
+
+    for (uint32_t w = 0; w < m_workerCount; w++)
+    {
+        CHECK_INT(vkCreatePipelineCache(m_device, &cacheInfo, m_allocator, &m_caches[w]),
+                  "Failed to create a pipeline cache.");
+    }
+
+    delete[] static_cast<byte_t*>(data);
+
+    const float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (m_isWarm)
+    {
+        PrintInfo("Pipeline cache: loaded %.1f KiB from \'%s\' in %.2f ms (warm start).",
+                  static_cast<double>(size) / 1024.0, m_path, milliseconds);
+    }
+    else
+    {
+        PrintInfo("Pipeline cache: no compatible cache in \'%s\' (cold start).", m_path);
+    }
+}
+
+void VulkanPipelineCache::Destroy()
+{
+    Save();
+
+    for (uint32_t w = 0; w < m_workerCount; w++)
+    {
+        vkDestroyPipelineCache(m_device, m_caches[w], m_allocator);
+        m_caches[w] = VK_NULL_HANDLE;
+    }
+}
+
+VkPipelineCache VulkanPipelineCache::Cache() const
+{
+    const uint32_t workerIndex = JobSystem::WorkerIndex();
+
+    ASSERT(workerIndex < m_workerCount, "Pipelines may only be created by the threads of the job system.");
+
+    return m_caches[workerIndex];
+}
+
+bool VulkanPipelineCache::IsWarm() const
+{
+    return m_isWarm;
+}
+
+bool VulkanPipelineCache::Load(void** data, size_t* size) const
+{
+    FILE* file = OpenFile(m_path, "rb");
+
+    if (!file) return false;
+
+    const VkPhysicalDeviceProperties& properties = m_physicalDeviceProperties;
+
+    PipelineCacheFileHeader header = {};
+
+    bool isValid = (fread(&header, sizeof(header), 1, file) == 1)           &&
+                   (header.magic    == VK_PIPELINE_CACHE_FILE_MAGIC)          &&
+                   (header.version  == VK_PIPELINE_CACHE_FILE_VERSION)        &&
+                   (header.dataSize >= sizeof(VkPipelineCacheHeaderVersionOne)) &&
+                   (header.dataSize <= VK_PIPELINE_CACHE_MAX_DATA_SIZE);
+
+    if (isValid &&
+        (header.vendorID      != properties.vendorID      ||
+         header.deviceID      != properties.deviceID      ||
+         header.driverVersion != properties.driverVersion ||
+         memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0))
+    {
+        PrintInfo("Pipeline cache: \'%s\' was created by a different device or driver.", m_path);
+        fclose(file);
+        return false;
+    }
+
+    byte_t* bytes = nullptr;
+
+    if (isValid)
+    {
+        bytes   = new byte_t[header.dataSize];
+        isValid = (fread(bytes, header.dataSize, 1, file) == 1) &&
+                  (HashBytes(bytes, header.dataSize) == header.dataHash);
+    }
+
+    fclose(file);
+
+    if (isValid)
+    {
+        // Drivers are not required to validate the data, so check its own header too.
+        VkPipelineCacheHeaderVersionOne dataHeader;
+        memcpy(&dataHeader, bytes, sizeof(dataHeader));
+
+        isValid = (dataHeader.headerSize    >= sizeof(dataHeader))                  &&
+                  (dataHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+                  (dataHeader.vendorID      == properties.vendorID)                 &&
+                  (dataHeader.deviceID      == properties.deviceID)                 &&
+                  (memcmp(dataHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+    }
+
+    if (!isValid)
+    {
+        PrintWarning("Pipeline cache: \'%s\' is corrupted. Ignoring it.", m_path);
+        delete[] bytes;
+        return false;
+    }
+
+    *data = bytes;
+    *size = static_cast<size_t>(header.dataSize);
+
+    return true;
+}
+
+void VulkanPipelineCache::Save()
+{
+    TRACE_FUNCTION();
+
+    // Pipelines created by any of the workers end up in the file.
+    if (m_workerCount > 1)
+    {
+        CHECK_INT(vkMergePipelineCaches(m_device, m_caches[0], m_workerCount - 1, &m_caches[1]),
+                  "Failed to merge pipeline caches.");
+    }
+
+    size_t size = 0;
+
+    CHECK_INT(vkGetPipelineCacheData(m_device, m_caches[0], &size, nullptr),
+              "Failed to query the size of the pipeline cache data.");
+
+    byte_t* data = new byte_t[size];
+
+    CHECK_INT(vkGetPipelineCacheData(m_device, m_caches[0], &size, data),
+              "Failed to retrieve the pipeline cache data.");
+
+    const VkPhysicalDeviceProperties& properties = m_physicalDeviceProperties;
+
+    PipelineCacheFileHeader header = {};
+    header.magic         = VK_PIPELINE_CACHE_FILE_MAGIC;
+    header.version       = VK_PIPELINE_CACHE_FILE_VERSION;
+    header.vendorID      = properties.vendorID;
+    header.deviceID      = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    header.dataSize      = size;
+    header.dataHash      = HashBytes(data, size);
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    // Write to a temporary file, and replace the old file once the new one is complete.
+    const std::string tempPath = std::string(m_path) + ".tmp";
+
+    FILE* file = OpenFile(tempPath.c_str(), "wb");
+
+    bool isWritten = false;
+
+    if (file)
+    {
+        isWritten = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+                    (size == 0 || fwrite(data, size, 1, file) == 1) &&
+                    (fflush(file) == 0);
+        isWritten = (fclose(file) == 0) && isWritten;
+    }
+
+    delete[] data;
+
+    std::error_code error;
+
+    if (isWritten)
+    {
+        // Replaces the destination atomically.
+        std::filesystem::rename(tempPath, m_path, error);
+    }
+
+    if (!isWritten || error)
+    {
+        PrintWarning("Pipeline cache: failed to save \'%s\'.", m_path);
+        std::filesystem::remove(tempPath, error);
+        return;
+    }
+
+    PrintInfo("Pipeline cache: saved %.1f KiB to \'%s\'.", static_cast<double>(size) / 1024.0, m_path);
+}
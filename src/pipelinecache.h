@@ -0,0 +1,45 @@
+#pragma once
+
+#include "jobsystem.h"
+
+#include <vulkan/vulkan.h>
+
+#define VK_PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
+// Pipeline cache persisted on disk across runs.
+// The file is only used if it was produced by the same device and driver: the vendor, the device,
+// the driver version and the pipeline cache UUID must match, and the data must be intact.
+// Pipelines are created concurrently by the workers of the job system, so each worker has its own cache
+// (to avoid lock contention inside the driver). They are merged into a single cache when saving.
+// The file is replaced atomically, so a crash never leaves a partially written cache behind.
+class VulkanPipelineCache
+{
+public:
+
+    // Loads the cache from the file (if there is a compatible one). 'workerCount': see JobSystem::ThreadCount().
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                const VkPhysicalDeviceProperties& physicalDeviceProperties, const uint32_t workerCount,
+                string_t path = VK_PIPELINE_CACHE_PATH);
+
+    // Saves the cache to the file.
+    void Destroy();
+
+    // Returns the cache of the calling thread of the job system (see JobSystem::WorkerIndex()).
+    VkPipelineCache Cache() const;
+
+    // Returns 'true' if the cache was loaded from the file.
+    bool IsWarm() const;
+
+private:
+
+    bool Load(void** data, size_t* size) const;
+    void Save();
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VkPhysicalDeviceProperties   m_physicalDeviceProperties;
+    string_t                     m_path;
+    uint32_t                     m_workerCount;
+    VkPipelineCache              m_caches[JOB_MAX_WORKERS];
+    bool                         m_isWarm;
+};
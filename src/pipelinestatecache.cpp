@@ -0,0 +1,278 @@
+#include "pipelinestatecache.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <chrono>
+#include <cstring>
+
+// Vulkan structures consist of 32-bit members only, so they can be hashed as raw memory.
+template <typename T>
+static uint64_t HashValues(const T* values, const uint32_t count, const uint64_t seed)
+{
+    return HashBytes(values, count * sizeof(T), seed);
+}
+
+uint64_t HashPipelineDescription(const VulkanPipelineDescription& d)
+{
+    // The layout handle is stable for the lifetime of the layout.
+    uint64_t hash = HashBytes(&d.layout, sizeof(d.layout));
+
+    hash = HashValues(&d.stageCount, 1, hash);
+
+    for (uint32_t i = 0; i < d.stageCount; i++)
+    {
+        const VulkanShaderStage& stage = d.stages[i];
+
+        hash = HashValues(&stage.stage,    1, hash);
+        hash = HashValues(&stage.codeHash, 1, hash);
+        hash = HashBytes(stage.entryPoint, strlen(stage.entryPoint), hash);
+    }
+
+    hash = HashValues(&d.vertexBindingCount,   1,                      hash);
+    hash = HashValues(d.vertexBindings,        d.vertexBindingCount,   hash);
+    hash = HashValues(&d.vertexAttributeCount, 1,                      hash);
+    hash = HashValues(d.vertexAttributes,      d.vertexAttributeCount, hash);
+    hash = HashValues(&d.topology,             1,                      hash);
+
+    hash = HashValues(&d.polygonMode,          1,                      hash);
+    hash = HashValues(&d.cullMode,             1,                      hash);
+    hash = HashValues(&d.frontFace,            1,                      hash);
+
+    hash = HashValues(&d.depthTestEnable,      1,                      hash);
+    hash = HashValues(&d.depthWriteEnable,     1,                      hash);
+    hash = HashValues(&d.depthCompareOp,       1,                      hash);
+
+    // Render pass compatibility, rather than the render pass itself.
+    hash = HashValues(&d.subpass,              1,                      hash);
+    hash = HashValues(&d.colorAttachmentCount, 1,                      hash);
+    hash = HashValues(d.colorFormats,          d.colorAttachmentCount, hash);
+    hash = HashValues(d.blendStates,           d.colorAttachmentCount, hash);
+    hash = HashValues(&d.depthStencilFormat,   1,                      hash);
+    hash = HashValues(&d.sampleCount,          1,                      hash);
+
+    return hash;
+}
+
+void VulkanPipelineStateCache::Create(VkDevice device, const VkAllocationCallbacks* allocator, JobSystem* jobSystem,
+                                      const VulkanPipelineCache* pipelineCache)
+{
+    m_device        = device;
+    m_allocator     = allocator;
+    m_jobSystem     = jobSystem;
+    m_pipelineCache = pipelineCache;
+
+    m_compilingCount.store(0, std::memory_order_relaxed);
+    m_compileTime.store(0, std::memory_order_relaxed);
+    m_compiledCount.store(0, std::memory_order_relaxed);
+    m_fallbackCount.store(0, std::memory_order_relaxed);
+}
+
+void VulkanPipelineStateCache::Destroy()
+{
+    m_jobSystem->Wait(m_compilingCount);
+
+    const uint32_t compiledCount = m_compiledCount.load(std::memory_order_relaxed);
+
+    if (compiledCount > 0)
+    {
+        PrintInfo("Pipeline state cache: %u pipelines compiled (%.2f ms on average), "
+                  "%u requests served by a fallback pipeline.", compiledCount,
+                  m_compileTime.load(std::memory_order_relaxed) / (1000.0 * compiledCount),
+                  m_fallbackCount.load(std::memory_order_relaxed));
+    }
+
+    for (auto& keyEntry : m_entries)
+    {
+        Entry* entry = keyEntry.second;
+
+        if (entry->state.load(std::memory_order_relaxed) == ENTRY_READY)
+        {
+            vkDestroyPipeline(m_device, entry->pipeline, m_allocator);
+        }
+
+        delete entry;
+    }
+
+    m_entries.clear();
+}
+
+VkPipeline VulkanPipelineStateCache::Request(const VulkanPipelineDescription& description, VkPipeline fallback)
+{
+    return Request(HashPipelineDescription(description), description, fallback);
+}
+
+VkPipeline VulkanPipelineStateCache::Request(const uint64_t key, const VulkanPipelineDescription& description,
+                                             VkPipeline fallback)
+{
+    Entry* entry = nullptr;
+
+    {
+        // Fast path: the pipeline has been requested before.
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+        auto it = m_entries.find(key);
+
+        if (it != m_entries.end())
+        {
+            entry = it->second;
+        }
+    }
+
+    if (!entry)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+        // Another thread may have requested the same pipeline in the meantime.
+        Entry*& newEntry = m_entries[key];
+
+        if (!newEntry)
+        {
+            newEntry = new Entry;
+            newEntry->cache       = this;
+            newEntry->pipeline    = VK_NULL_HANDLE;
+            newEntry->description = description;
+            newEntry->state.store(ENTRY_COMPILING, std::memory_order_relaxed);
+
+            // Never on the calling thread (even with a single worker), which may be the render thread,
+            // or may not belong to the job system.
+            const Job job = { CompileJob, newEntry, 0, 1, &m_compilingCount };
+
+            m_jobSystem->RunBackground(job);
+        }
+
+        entry = newEntry;
+    }
+
+    // Pairs with the release in Compile(): the pipeline handle is visible once the state is.
+    if (entry->state.load(std::memory_order_acquire) == ENTRY_READY)
+    {
+        return entry->pipeline;
+    }
+
+    m_fallbackCount.fetch_add(1, std::memory_order_relaxed);
+
+    return fallback;
+}
+
+bool VulkanPipelineStateCache::IsReady(const uint64_t key) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    auto it = m_entries.find(key);
+
+    return it != m_entries.end() && it->second->state.load(std::memory_order_acquire) != ENTRY_COMPILING;
+}
+
+void VulkanPipelineStateCache::CompileJob(void* data, const uint32_t, const uint32_t)
+{
+    Entry* entry = static_cast<Entry*>(data);
+
+    entry->cache->Compile(*entry);
+}
+
+void VulkanPipelineStateCache::Compile(Entry& entry)
+{
+    TRACE_SCOPE("CompilePipeline");
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const VulkanPipelineDescription& d = entry.description;
+
+    ASSERT(d.stageCount           <= VK_MAX_PIPELINE_SHADER_STAGES     &&
+           d.vertexBindingCount   <= VK_MAX_PIPELINE_VERTEX_BINDINGS   &&
+           d.vertexAttributeCount <= VK_MAX_PIPELINE_VERTEX_ATTRIBUTES &&
+           d.colorAttachmentCount <= VK_MAX_PIPELINE_COLOR_ATTACHMENTS, "Invalid pipeline description.");
+
+    VkPipelineShaderStageCreateInfo stages[VK_MAX_PIPELINE_SHADER_STAGES] = {};
+
+    for (uint32_t i = 0; i < d.stageCount; i++)
+    {
+        stages[i].sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[i].stage  = d.stages[i].stage;
+        stages[i].module = d.stages[i].module;
+        stages[i].pName  = d.stages[i].entryPoint;
+    }
+
+    VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+    vertexInputState.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputState.vertexBindingDescriptionCount   = d.vertexBindingCount;
+    vertexInputState.pVertexBindingDescriptions      = d.vertexBindings;
+    vertexInputState.vertexAttributeDescriptionCount = d.vertexAttributeCount;
+    vertexInputState.pVertexAttributeDescriptions    = d.vertexAttributes;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+    inputAssemblyState.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyState.topology = d.topology;
+
+    // Set dynamically.
+    VkPipelineViewportStateCreateInfo viewportState = {};
+    viewportState.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount  = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+    rasterizationState.sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationState.polygonMode = d.polygonMode;
+    rasterizationState.cullMode    = d.cullMode;
+    rasterizationState.frontFace   = d.frontFace;
+    rasterizationState.lineWidth   = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleState = {};
+    multisampleState.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleState.rasterizationSamples = d.sampleCount;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+    depthStencilState.sType            = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilState.depthTestEnable  = d.depthTestEnable;
+    depthStencilState.depthWriteEnable = d.depthWriteEnable;
+    depthStencilState.depthCompareOp   = d.depthCompareOp;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+    colorBlendState.sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendState.attachmentCount = d.colorAttachmentCount;
+    colorBlendState.pAttachments    = d.blendStates;
+
+    const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(sizeof(dynamicStates) / sizeof(dynamicStates[0]));
+    dynamicState.pDynamicStates    = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount          = d.stageCount;
+    pipelineInfo.pStages             = stages;
+    pipelineInfo.pVertexInputState   = &vertexInputState;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyState;
+    pipelineInfo.pViewportState      = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizationState;
+    pipelineInfo.pMultisampleState   = &multisampleState;
+    pipelineInfo.pDepthStencilState  = &depthStencilState;
+    pipelineInfo.pColorBlendState    = &colorBlendState;
+    pipelineInfo.pDynamicState       = &dynamicState;
+    pipelineInfo.layout              = d.layout;
+    pipelineInfo.renderPass          = d.renderPass;
+    pipelineInfo.subpass             = d.subpass;
+    pipelineInfo.basePipelineIndex   = -1;
+
+    // Each worker has its own pipeline cache, so the workers do not contend for it.
+    const VkResult result = vkCreateGraphicsPipelines(m_device, m_pipelineCache->Cache(), 1, &pipelineInfo,
+                                                      m_allocator, &entry.pipeline);
+
+    if (result != VK_SUCCESS)
+    {
+        // Keep using the fallback pipeline rather than aborting.
+        PrintWarning("Failed to compile a graphics pipeline (error %i).", static_cast<int>(result));
+        entry.state.store(ENTRY_FAILED, std::memory_order_release);
+        return;
+    }
+
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - start).count();
+
+    m_compileTime.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+    m_compiledCount.fetch_add(1, std::memory_order_relaxed);
+
+    entry.state.store(ENTRY_READY, std::memory_order_release);
+}
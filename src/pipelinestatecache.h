@@ -0,0 +1,120 @@
+#pragma once
+
+#include "jobsystem.h"
+#include "pipelinecache.h"
+
+#include <vulkan/vulkan.h>
+
+#include <shared_mutex>
+#include <unordered_map>
+
+#define VK_MAX_PIPELINE_SHADER_STAGES      5 // Vertex, tessellation (2), geometry, fragment
+#define VK_MAX_PIPELINE_VERTEX_BINDINGS    8
+#define VK_MAX_PIPELINE_VERTEX_ATTRIBUTES  16
+#define VK_MAX_PIPELINE_COLOR_ATTACHMENTS  8
+
+struct VulkanShaderStage
+{
+    VkShaderStageFlagBits stage;
+    VkShaderModule        module;
+    uint64_t              codeHash;   // HashBytes() of the SPIR-V code. Identifies the module across runs.
+    string_t              entryPoint; // Must outlive the compilation (e.g. a string literal)
+};
+
+// Full description of a graphics pipeline. Viewports and scissors are always dynamic.
+// Unused state (e.g. the blend factors if blending is disabled) should be zeroed, so that it does not affect the key.
+// The render pass is only used to compile the pipeline: any compatible render pass (same subpass,
+// attachment formats and sample count) yields the same pipeline.
+struct VulkanPipelineDescription
+{
+    VkPipelineLayout                    layout;
+
+    uint32_t                            stageCount;
+    VulkanShaderStage                   stages[VK_MAX_PIPELINE_SHADER_STAGES];
+
+    uint32_t                            vertexBindingCount;
+    VkVertexInputBindingDescription     vertexBindings[VK_MAX_PIPELINE_VERTEX_BINDINGS];
+    uint32_t                            vertexAttributeCount;
+    VkVertexInputAttributeDescription   vertexAttributes[VK_MAX_PIPELINE_VERTEX_ATTRIBUTES];
+    VkPrimitiveTopology                 topology;
+
+    VkPolygonMode                       polygonMode;
+    VkCullModeFlags                     cullMode;
+    VkFrontFace                         frontFace;
+
+    VkBool32                            depthTestEnable;
+    VkBool32                            depthWriteEnable;
+    VkCompareOp                         depthCompareOp;
+
+    VkRenderPass                        renderPass;
+    uint32_t                            subpass;
+    uint32_t                            colorAttachmentCount;
+    VkFormat                            colorFormats[VK_MAX_PIPELINE_COLOR_ATTACHMENTS];
+    VkPipelineColorBlendAttachmentState blendStates[VK_MAX_PIPELINE_COLOR_ATTACHMENTS];
+    VkFormat                            depthStencilFormat;
+    VkSampleCountFlagBits               sampleCount;
+};
+
+// Returns the key of the pipeline. Only takes into account the state which affects the pipeline:
+// shaders are identified by their code (rather than by their handles), and render passes by compatibility.
+uint64_t HashPipelineDescription(const VulkanPipelineDescription& description);
+
+// Cache of graphics pipelines, keyed by the hash of their description.
+// Missing pipelines are compiled by background jobs of the job system (see JobSystem::RunBackground()),
+// so requesting a new pipeline never stalls the calling thread, even with a single worker. Until the pipeline is ready,
+// a fallback pipeline (if any) is returned instead, and the draws using the pipeline may be skipped otherwise.
+// Compiled pipelines are added to the persistent pipeline cache.
+// Pipelines may be requested from any thread, including threads which do not belong to the job system.
+class VulkanPipelineStateCache
+{
+public:
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, JobSystem* jobSystem,
+                const VulkanPipelineCache* pipelineCache);
+
+    // Waits for the pipelines being compiled, and destroys all the pipelines.
+    void Destroy();
+
+    // Returns the pipeline, or 'fallback' while the pipeline is being compiled (or if it failed to compile).
+    // Shader modules and the render pass must stay alive until the pipeline is ready.
+    VkPipeline Request(const VulkanPipelineDescription& description, VkPipeline fallback = VK_NULL_HANDLE);
+
+    // Same as above, with the key computed by HashPipelineDescription(). Avoids hashing the description every time.
+    VkPipeline Request(const uint64_t key, const VulkanPipelineDescription& description,
+                       VkPipeline fallback = VK_NULL_HANDLE);
+
+    // Returns 'true' once the pipeline is ready (or failed to compile).
+    bool IsReady(const uint64_t key) const;
+
+private:
+
+    enum EntryState : uint32_t
+    {
+        ENTRY_COMPILING,
+        ENTRY_READY,
+        ENTRY_FAILED
+    };
+
+    struct Entry
+    {
+        VulkanPipelineStateCache* cache;
+        std::atomic<EntryState>   state;
+        VkPipeline                pipeline;    // Valid once ready
+        VulkanPipelineDescription description; // Copied, so that the caller does not have to keep it around
+    };
+
+    static void CompileJob(void* data, const uint32_t begin, const uint32_t end);
+
+    void Compile(Entry& entry);
+
+    VkDevice                             m_device;
+    const VkAllocationCallbacks*         m_allocator;
+    JobSystem*                           m_jobSystem;
+    const VulkanPipelineCache*           m_pipelineCache;
+    std::unordered_map<uint64_t, Entry*> m_entries;
+    mutable std::shared_mutex            m_mutex;         // Guards m_entries
+    JobCounter                           m_compilingCount;
+    std::atomic<uint64_t>                m_compileTime;   // In microseconds, across all the pipelines
+    std::atomic<uint32_t>                m_compiledCount;
+    std::atomic<uint32_t>                m_fallbackCount; // Requests served by the fallback pipeline
+};
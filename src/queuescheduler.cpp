@@ -0,0 +1,198 @@
+#include "queuescheduler.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+
+#define VK_MAX_SUBMISSION_WAITS (VK_QUEUE_TYPE_COUNT + 1)
+
+void VulkanQueueScheduler::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                  const VkQueue queues[VK_QUEUE_TYPE_COUNT])
+{
+    m_device    = device;
+    m_allocator = allocator;
+
+    memset(m_lastSubmittedValues, 0, sizeof(m_lastSubmittedValues));
+    memset(m_knownWaitValues,     0, sizeof(m_knownWaitValues));
+    memset(m_knownWaitStages,     0, sizeof(m_knownWaitStages));
+
+    VkSemaphoreTypeCreateInfo typeInfo = {};
+    typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue  = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    for (uint32_t q = 0; q < VK_QUEUE_TYPE_COUNT; q++)
+    {
+        m_queues[q] = queues[q];
+
+        CHECK_INT(vkCreateSemaphore(m_device, &semaphoreInfo, m_allocator, &m_timelines[q]),
+                  "Failed to create a timeline semaphore.");
+    }
+}
+
+void VulkanQueueScheduler::Destroy()
+{
+    WaitIdle();
+
+    for (uint32_t q = 0; q < VK_QUEUE_TYPE_COUNT; q++)
+    {
+        vkDestroySemaphore(m_device, m_timelines[q], m_allocator);
+        m_timelines[q] = VK_NULL_HANDLE;
+    }
+}
+
+uint64_t VulkanQueueScheduler::Submit(const VulkanQueueType queue, const VulkanSubmission& submission)
+{
+    assert(queue < VK_QUEUE_TYPE_COUNT);
+
+    // Timeline and binary semaphores can be mixed. The values of the binary ones are ignored.
+    uint32_t             waitCount = 0;
+    VkSemaphore          waitSemaphores[VK_MAX_SUBMISSION_WAITS];
+    VkPipelineStageFlags waitStages[VK_MAX_SUBMISSION_WAITS];
+    uint64_t             waitValues[VK_MAX_SUBMISSION_WAITS];
+
+    // Merge the dependencies on the same queue. Later points of a timeline imply the earlier ones.
+    uint64_t             mergedValues[VK_QUEUE_TYPE_COUNT] = {};
+    VkPipelineStageFlags mergedStages[VK_QUEUE_TYPE_COUNT] = {};
+
+    for (uint32_t i = 0; i < submission.waitCount; i++)
+    {
+        const VulkanTimelineWait& wait = submission.waits[i];
+
+        ASSERT(wait.value <= m_lastSubmittedValues[wait.queue],
+               "Dependency on a timeline value (%llu) which has not been submitted yet.",
+               static_cast<unsigned long long>(wait.value));
+
+        mergedValues[wait.queue]  = std::max(mergedValues[wait.queue], wait.value);
+        mergedStages[wait.queue] |= wait.stage;
+    }
+
+    for (uint32_t src = 0; src < VK_QUEUE_TYPE_COUNT; src++)
+    {
+        uint64_t&             knownValue  = m_knownWaitValues[queue][src];
+        VkPipelineStageFlags& knownStages = m_knownWaitStages[queue][src];
+
+        // A semaphore wait also covers all subsequent submissions to the same queue (for the same stages).
+        // Therefore, skip the dependencies which have already been satisfied by an earlier submission.
+        const bool isSatisfied = (mergedValues[src] <= knownValue) &&
+                                 (mergedStages[src] & ~knownStages) == 0;
+
+        if (mergedValues[src] > 0 && !isSatisfied)
+        {
+            // Waiting for a later point is free, and it lets us merge the known stages.
+            knownStages = (mergedValues[src] > knownValue) ? mergedStages[src] : (knownStages | mergedStages[src]);
+            knownValue  = std::max(knownValue, mergedValues[src]);
+
+            waitSemaphores[waitCount] = m_timelines[src];
+            waitStages[waitCount]     = knownStages;
+            waitValues[waitCount]     = knownValue;
+            waitCount++;
+        }
+    }
+
+    if (submission.binaryWaitSemaphore)
+    {
+        waitSemaphores[waitCount] = submission.binaryWaitSemaphore;
+        waitStages[waitCount]     = submission.binaryWaitStage;
+        waitValues[waitCount]     = 0;
+        waitCount++;
+    }
+
+    const uint64_t signalValue = ++m_lastSubmittedValues[queue];
+
+    uint32_t    signalCount = 0;
+    VkSemaphore signalSemaphores[2];
+    uint64_t    signalValues[2];
+
+    signalSemaphores[signalCount] = m_timelines[queue];
+    signalValues[signalCount]     = signalValue;
+    signalCount++;
+
+    if (submission.binarySignalSemaphore)
+    {
+        signalSemaphores[signalCount] = submission.binarySignalSemaphore;
+        signalValues[signalCount]     = 0;
+        signalCount++;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount   = waitCount;
+    timelineInfo.pWaitSemaphoreValues      = waitValues;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues    = signalValues;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.waitSemaphoreCount   = waitCount;
+    submitInfo.pWaitSemaphores      = waitSemaphores;
+    submitInfo.pWaitDstStageMask    = waitStages;
+    submitInfo.commandBufferCount   = submission.commandBufferCount;
+    submitInfo.pCommandBuffers      = submission.commandBuffers;
+    submitInfo.signalSemaphoreCount = signalCount;
+    submitInfo.pSignalSemaphores    = signalSemaphores;
+
+    CHECK_INT(vkQueueSubmit(m_queues[queue], 1, &submitInfo, submission.fence),
+              "Failed to submit a command buffer.");
+
+    return signalValue;
+}
+
+uint64_t VulkanQueueScheduler::LastSubmittedValue(const VulkanQueueType queue) const
+{
+    assert(queue < VK_QUEUE_TYPE_COUNT);
+    return m_lastSubmittedValues[queue];
+}
+
+uint64_t VulkanQueueScheduler::CompletedValue(const VulkanQueueType queue) const
+{
+    assert(queue < VK_QUEUE_TYPE_COUNT);
+
+    uint64_t value;
+    CHECK_INT(vkGetSemaphoreCounterValue(m_device, m_timelines[queue], &value),
+              "Failed to query the value of a timeline semaphore.");
+
+    return value;
+}
+
+bool VulkanQueueScheduler::IsComplete(const VulkanQueueType queue, const uint64_t value) const
+{
+    return CompletedValue(queue) >= value;
+}
+
+void VulkanQueueScheduler::WaitForCompletion(const VulkanQueueType queue, const uint64_t value) const
+{
+    assert(queue < VK_QUEUE_TYPE_COUNT);
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &m_timelines[queue];
+    waitInfo.pValues        = &value;
+
+    CHECK_INT(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX),
+              "Failed to wait for a timeline semaphore.");
+}
+
+void VulkanQueueScheduler::WaitIdle() const
+{
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = VK_QUEUE_TYPE_COUNT;
+    waitInfo.pSemaphores    = m_timelines;
+    waitInfo.pValues        = m_lastSubmittedValues;
+
+    CHECK_INT(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX),
+              "Failed to wait for a timeline semaphore.");
+}
+
+VkSemaphore VulkanQueueScheduler::TimelineSemaphore(const VulkanQueueType queue) const
+{
+    assert(queue < VK_QUEUE_TYPE_COUNT);
+    return m_timelines[queue];
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <vulkan/vulkan.h>
+
+// Queues which can be scheduled. Several of them may map to the same hardware queue.
+enum VulkanQueueType : uint32_t
+{
+    VK_QUEUE_TYPE_GRAPHICS,
+    VK_QUEUE_TYPE_COMPUTE,
+    VK_QUEUE_TYPE_TRANSFER,
+    VK_QUEUE_TYPE_COUNT
+};
+
+// Dependency on a point of the timeline of a queue.
+struct VulkanTimelineWait
+{
+    VulkanQueueType          queue;
+    uint64_t                 value; // Returned by VulkanQueueScheduler::Submit()
+    VkPipelineStageFlags     stage; // Stage of the dependent submission which has to wait
+};
+
+// Describes a single batch of work submitted to a queue.
+struct VulkanSubmission
+{
+    uint32_t                  commandBufferCount;
+    const VkCommandBuffer*    commandBuffers;
+
+    uint32_t                  waitCount;
+    const VulkanTimelineWait* waits;
+
+    // Optional binary semaphores and fence. Required to interact with the swap chain.
+    VkSemaphore               binaryWaitSemaphore;
+    VkPipelineStageFlags      binaryWaitStage;
+    VkSemaphore               binarySignalSemaphore;
+    VkFence                   fence;
+};
+
+// Schedules work across the graphics, compute and transfer queues.
+// Each queue has a timeline semaphore whose value is incremented by every submission.
+// Submissions declare dependencies on points of the timelines of other queues, so the queues
+// can overlap their work whenever the dependencies allow it.
+class VulkanQueueScheduler
+{
+public:
+
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                const VkQueue queues[VK_QUEUE_TYPE_COUNT]);
+    void Destroy();
+
+    // Submits the work to the queue, and returns the timeline value it signals upon completion.
+    // Dependencies the queue is already known to satisfy are not submitted again.
+    uint64_t Submit(const VulkanQueueType queue, const VulkanSubmission& submission);
+
+    // Returns the value which will be signaled by the most recent submission to the queue.
+    uint64_t LastSubmittedValue(const VulkanQueueType queue) const;
+
+    // Returns the value of the timeline of the queue (on the GPU). Does not block.
+    uint64_t CompletedValue(const VulkanQueueType queue) const;
+
+    // Returns 'true' if the GPU has reached the point on the timeline of the queue. Does not block.
+    bool IsComplete(const VulkanQueueType queue, const uint64_t value) const;
+
+    // Blocks the CPU until the GPU reaches the point on the timeline of the queue.
+    void WaitForCompletion(const VulkanQueueType queue, const uint64_t value) const;
+
+    // Blocks the CPU until the GPU completes all submitted work.
+    void WaitIdle() const;
+
+    // Returns the timeline semaphore of the queue.
+    VkSemaphore TimelineSemaphore(const VulkanQueueType queue) const;
+
+private:
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VkQueue                      m_queues[VK_QUEUE_TYPE_COUNT];
+    VkSemaphore                  m_timelines[VK_QUEUE_TYPE_COUNT];
+    uint64_t                     m_lastSubmittedValues[VK_QUEUE_TYPE_COUNT];
+    // [dst][src]: the most recent point on the timeline of 'src' that 'dst' has waited on, and for which stages.
+    uint64_t                     m_knownWaitValues[VK_QUEUE_TYPE_COUNT][VK_QUEUE_TYPE_COUNT];
+    VkPipelineStageFlags         m_knownWaitStages[VK_QUEUE_TYPE_COUNT][VK_QUEUE_TYPE_COUNT];
+};
@@ -1,13 +1,19 @@
 #include "renderbackend.h"
+#include "deviceselection.h"
+#include "tracer.h"
 #include "utility.h"
-#include "window.h"
+
+#ifdef WIN32
+    #include "window.h"
+#endif
 
 #include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <memory>
 
-#define VK_API_VERSION             VK_API_VERSION_1_1
+// 1.2 is required for timeline semaphores.
+#define VK_API_VERSION             VK_API_VERSION_1_2
 
 #define VK_MAX_DEVICES             8
 #define VK_MAX_LAYERS              8
@@ -17,12 +23,28 @@
 #define VK_OPT_INSTANCE_EXTENSIONS 1
 
 #define VK_REQ_DEVICE_EXTENSIONS   1
-#define VK_OPT_DEVICE_EXTENSIONS   1
+#define VK_OPT_DEVICE_EXTENSIONS   2
 
 #define VK_QUEUE_PRESENT_BIT       0x01000000
 
+// Re-creations of the swap chain while acquiring an image, before giving up on presenting the frame.
+#define VK_MAX_ACQUIRE_ATTEMPTS    3
+
+// Stages of the first accesses to the swap chain image which wait for its acquisition.
+#define VK_SWAP_CHAIN_WAIT_STAGES  (VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+
+static_assert(VK_MAX_GPU_PROFILER_FRAMES >= VK_MAX_FRAMES_IN_FLIGHT, "Insufficient number of GPU profiler frames.");
+static_assert(VK_MAX_ASYNC_COMPUTE_FRAMES >= VK_MAX_FRAMES_IN_FLIGHT, "Insufficient number of async compute frames.");
+static_assert(VK_MAX_PARALLEL_RECORDER_FRAMES >= VK_MAX_FRAMES_IN_FLIGHT, "Insufficient number of recorder frames.");
+static_assert(VK_MAX_DESCRIPTOR_ALLOCATOR_FRAMES >= VK_MAX_FRAMES_IN_FLIGHT, "Insufficient number of descriptor frames.");
+
 #ifdef WIN32
     #define VK_PLATFORM_SURFACE_EXTENSION_NAME VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+    #define VK_HEADLESS_SURFACE_EXTENSION_NAME VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME
+#else
+    // Without a supported windowing system, headless rendering is the only option.
+    #define VK_PLATFORM_SURFACE_EXTENSION_NAME VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME
+    #define VK_HEADLESS_SURFACE_EXTENSION_NAME nullptr
 #endif
 
 bool ContainsVulkanExtension(string_t name, const VkExtensionProperties list[], size_t count)
@@ -44,19 +66,27 @@ bool ContainsVulkanExtension(string_t name, const VkExtensionProperties list[],
     return result;
 }
 
-VulkanRenderBackEnd::VulkanRenderBackEnd()
+VulkanRenderBackEnd::VulkanRenderBackEnd(JobSystem* jobSystem, const uint32_t framesInFlight)
 {
     // Careful with memset() and VTable.
     byte_t* start = reinterpret_cast<byte_t*>(&allocator);
     byte_t* end   = reinterpret_cast<byte_t*>(this + 1);
     memset(start, 0, static_cast<size_t>(end - start));
+
+    frameCount = std::max(1u, std::min(framesInFlight, static_cast<uint32_t>(VK_MAX_FRAMES_IN_FLIGHT)));
+
+    isAsyncComputeEnabled = true;
+
+    this->jobSystem = jobSystem;
 }
 
 VulkanInstanceProperties VulkanRenderBackEnd::GetInstanceProperties() const
 {
+    TRACE_FUNCTION();
+
     // Warning: these must be static so that we can take (and store) pointers to these strings.
     static string_t requiredExtensions[VK_REQ_INSTANCE_EXTENSIONS] = { VK_KHR_SURFACE_EXTENSION_NAME, VK_PLATFORM_SURFACE_EXTENSION_NAME };
-    static string_t optionalExtensions[VK_OPT_INSTANCE_EXTENSIONS] = { nullptr };
+    static string_t optionalExtensions[VK_OPT_INSTANCE_EXTENSIONS] = { VK_HEADLESS_SURFACE_EXTENSION_NAME };
 
     VulkanInstanceProperties ip = {};
 
@@ -103,6 +133,8 @@ VulkanInstanceProperties VulkanRenderBackEnd::GetInstanceProperties() const
 
 void VulkanRenderBackEnd::CreateApiInstance()
 {
+    TRACE_FUNCTION();
+
     this->instanceProperties = GetInstanceProperties();
 
     VkApplicationInfo appInfo  = {};
@@ -113,6 +145,10 @@ void VulkanRenderBackEnd::CreateApiInstance()
     appInfo.applicationVersion = appInfo.engineVersion;
     appInfo.apiVersion         = VK_API_VERSION;
 
+    // All host allocations of the driver go through our allocator.
+    hostAllocator = new VulkanHostAllocator;
+    allocator     = hostAllocator->Callbacks();
+
     VkInstanceCreateInfo instanceInfo    = {};
     instanceInfo.sType                   = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     instanceInfo.pApplicationInfo        = &appInfo;
@@ -129,29 +165,63 @@ void VulkanRenderBackEnd::DestroyApiInstance()
 {
     // TODO: clean up VulkanInstanceProperties.
     vkDestroyInstance(instance, allocator);
+
+    hostAllocator->PrintStatistics();
+
+    delete hostAllocator;
+    hostAllocator = nullptr;
+    allocator     = nullptr;
 }
 
+#ifdef WIN32
 VkResult vkCreateSurfaceKHR(VkInstance instance, const void* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkSurfaceKHR* pSurface)
 {
-#ifdef WIN32
     return vkCreateWin32SurfaceKHR(instance, static_cast<const VkWin32SurfaceCreateInfoKHR*>(pCreateInfo), pAllocator, pSurface);  
-#endif
 }
+#endif
 
 void VulkanRenderBackEnd::CreateDisplaySurface(const Window& window)
 {
+#ifdef WIN32
     surfaceDimensions.width  = window.Width();
     surfaceDimensions.height = window.Height();
+    headlessSurface          = false;
 
-#ifdef WIN32
     VkWin32SurfaceCreateInfoKHR surfaceInfo = {};
     surfaceInfo.sType     = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
     surfaceInfo.hinstance = window.Instance();
     surfaceInfo.hwnd      = window.Handle();
-#endif
 
     CHECK_INT(vkCreateSurfaceKHR(instance, &surfaceInfo, allocator, &surface),
               "Failed to create a display surface.");
+#else
+    (void)window;
+    PrintError("Display surfaces are not supported on this platform. Use a headless surface instead.");
+    TERMINATE();
+#endif
+}
+
+void VulkanRenderBackEnd::CreateHeadlessSurface(const uint16_t width, const uint16_t height)
+{
+    surfaceDimensions.width  = width;
+    surfaceDimensions.height = height;
+    headlessSurface          = true;
+
+    ASSERT(ContainsVulkanExtension(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME, instanceProperties.supportedExtensions,
+                                                                           instanceProperties.supportedExtensionCount),
+           "The extension \'%s\' is not supported by the graphics API.", VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+
+    // The loader does not necessarily export extension entry points, so query it explicitly.
+    auto createHeadlessSurface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+                                 vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+
+    ASSERT(createHeadlessSurface, "Failed to load the entry point of \'%s\'.", "vkCreateHeadlessSurfaceEXT");
+
+    VkHeadlessSurfaceCreateInfoEXT surfaceInfo = {};
+    surfaceInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+    CHECK_INT(createHeadlessSurface(instance, &surfaceInfo, allocator, &surface),
+              "Failed to create a headless surface.");
 }
 
 void VulkanRenderBackEnd::DestroyDisplaySurface()
@@ -159,143 +229,289 @@ void VulkanRenderBackEnd::DestroyDisplaySurface()
     vkDestroySurfaceKHR(instance, surface, allocator);
 }
 
-VulkanDeviceProperties VulkanRenderBackEnd::GetDeviceProperties() const
+static void ReleaseDeviceProperties(VulkanDeviceProperties& dp)
+{
+    delete[] dp.supportedExtensions;
+    delete[] dp.activeExtensions;
+    delete[] dp.queueFamilies;
+
+    dp = {};
+}
+
+bool VulkanRenderBackEnd::QueryDeviceProperties(VkPhysicalDevice physicalDevice, VulkanDeviceProperties* dp) const
 {
     // Warning: these must be static so that we can take (and store) pointers to these strings.
     static string_t requiredExtensions[VK_REQ_DEVICE_EXTENSIONS] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-    static string_t optionalExtensions[VK_OPT_DEVICE_EXTENSIONS] = { nullptr };
+    static string_t optionalExtensions[VK_OPT_DEVICE_EXTENSIONS] = { VK_KHR_PRESENT_ID_EXTENSION_NAME,
+                                                                     VK_KHR_PRESENT_WAIT_EXTENSION_NAME };
 
-    VulkanDeviceProperties dp = {};
+    uint32_t supportedExtensionCount;
+    CHECK_INT(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &supportedExtensionCount, nullptr),
+              "Failed to enumerate extensions supported by the graphics device.");
 
-    // Only store the selected device. None of the others are needed outside of this function.
-    uint32_t physicalDeviceCount;
-    CHECK_INT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr),
-              "Failed to enumerate physical graphics devices.");
+    auto supportedExtensions = std::make_unique<VkExtensionProperties[]>(supportedExtensionCount);
+    CHECK_INT(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &supportedExtensionCount, supportedExtensions.get()),
+              "Failed to enumerate extensions supported by the graphics device.");
 
-    VkPhysicalDevice physicalDevices[VK_MAX_DEVICES];
-    CHECK_INT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices),
-              "Failed to enumerate physical graphics devices.");
+    bool supportsRequiredExtensions = true;
 
-    // Select a physical device and query its properties.
-    for (uint32_t i = 0; i < physicalDeviceCount; i++)
+    // Check whether all the required extensions are supported.
+    for (string_t extName : requiredExtensions)
     {
-        VkPhysicalDevice physicalDevice = physicalDevices[i];
-        
-        uint32_t supportedExtensionCount;
-        CHECK_INT(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &supportedExtensionCount, nullptr),
-                  "Failed to enumerate extensions supported by the graphics device.");
+        supportsRequiredExtensions &= ContainsVulkanExtension(extName, supportedExtensions.get(), supportedExtensionCount);
+    }
+
+    uint32_t queueFamilyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
 
-        auto supportedExtensions = std::make_unique<VkExtensionProperties[]>(supportedExtensionCount);
-        CHECK_INT(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &supportedExtensionCount, supportedExtensions.get()),
-                  "Failed to enumerate extensions supported by the graphics device.");
+    auto queueFamilies = std::make_unique<VkQueueFamilyProperties[]>(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.get());
 
-        bool supportsRequiredExtensions = true;
+    bool supportsGraphics     = false;
+    bool supportsCompute      = false;
+    bool supportsPresentation = false;
+
+    // Determine whether the available queues cover our needs.
+    for (uint32_t f = 0; f < queueFamilyCount; f++)
+    {
+        VkBool32 queueCanPresent;
+        CHECK_INT(vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, f, surface, &queueCanPresent),
+                  "Failed to query the graphics device surface support.");
 
-        // Check whether all the required extensions are supported.
-        for (string_t extName : requiredExtensions)
+        if (queueCanPresent)
         {
-            supportsRequiredExtensions &= ContainsVulkanExtension(extName, supportedExtensions.get(), supportedExtensionCount);
+            queueFamilies[f].queueFlags |= VK_QUEUE_PRESENT_BIT;
         }
 
-        uint32_t queueFamilyCount;
-        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        VkQueueFlags queueFlags = queueFamilies[f].queueFlags;
 
-        auto queueFamilies = std::make_unique<VkQueueFamilyProperties[]>(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.get());
+        supportsPresentation |= static_cast<bool>(queueCanPresent);
+        supportsGraphics     |= static_cast<bool>(queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        supportsCompute      |= static_cast<bool>(queueFlags & VK_QUEUE_COMPUTE_BIT);
+    }
 
-        bool supportsGraphics     = false;
-        bool supportsCompute      = false;
-        bool supportsPresentation = false;
+    VkPhysicalDeviceProperties         physicalDeviceProperties;
+    VkPhysicalDeviceFeatures           physicalDeviceFeatures;
+    VkPhysicalDeviceVulkan12Features   physicalDeviceFeatures12   = {};
+    VkPhysicalDeviceVulkan12Properties physicalDeviceProperties12 = {};
 
-        // Determine whether the available queues cover our needs.
-        for (uint32_t f = 0; f < queueFamilyCount; f++)
-        {
-            VkBool32 queueCanPresent;
-            CHECK_INT(vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, f, surface, &queueCanPresent),
-                      "Failed to query the graphics device surface support.");
+    VkPhysicalDevicePresentIdFeaturesKHR   presentIdFeatures   = {};
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
 
-            if (queueCanPresent)
-            {
-                queueFamilies[f].queueFlags |= VK_QUEUE_PRESENT_BIT;
-            }
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+    vkGetPhysicalDeviceFeatures(  physicalDevice, &physicalDeviceFeatures);
+
+    // Only query the features of the core version the device actually supports.
+    if (physicalDeviceProperties.apiVersion >= VK_API_VERSION)
+    {
+        physicalDeviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 
-            VkQueueFlags queueFlags = queueFamilies[f].queueFlags;
+        // Presentation timing is only used if both extensions are supported.
+        if (ContainsVulkanExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME, supportedExtensions.get(), supportedExtensionCount) &&
+            ContainsVulkanExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME, supportedExtensions.get(), supportedExtensionCount))
+        {
+            presentIdFeatures.sType   = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+            presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
 
-            supportsPresentation |= static_cast<bool>(queueCanPresent);
-            supportsGraphics     |= static_cast<bool>(queueFlags & VK_QUEUE_GRAPHICS_BIT);
-            supportsCompute      |= static_cast<bool>(queueFlags & VK_QUEUE_COMPUTE_BIT);
+            physicalDeviceFeatures12.pNext = &presentIdFeatures;
+            presentIdFeatures.pNext        = &presentWaitFeatures;
         }
 
-        VkPhysicalDeviceProperties physicalDeviceProperties;
-        VkPhysicalDeviceFeatures   physicalDeviceFeatures;
+        VkPhysicalDeviceFeatures2 physicalDeviceFeatures2 = {};
+        physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        physicalDeviceFeatures2.pNext = &physicalDeviceFeatures12;
+
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &physicalDeviceFeatures2);
+
+        // Descriptor indexing is core in 1.2; its limits are part of the 1.2 properties.
+        physicalDeviceProperties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 physicalDeviceProperties2 = {};
+        physicalDeviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        physicalDeviceProperties2.pNext = &physicalDeviceProperties12;
 
-        vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
-        vkGetPhysicalDeviceFeatures(  physicalDevice, &physicalDeviceFeatures);
+        vkGetPhysicalDeviceProperties2(physicalDevice, &physicalDeviceProperties2);
 
-        // Determine whether the GPU is compatible.
-        if (physicalDeviceProperties.apiVersion >= VK_API_VERSION &&
-            supportsRequiredExtensions &&
-            supportsGraphics &&    
-            supportsCompute &&     
-            supportsPresentation) 
+        // The structures are copied, so do not keep pointers to local variables.
+        physicalDeviceFeatures12.pNext   = nullptr;
+        physicalDeviceProperties12.pNext = nullptr;
+        presentIdFeatures.pNext          = nullptr;
+    }
+
+    // Determine whether the GPU is compatible.
+    if (!(physicalDeviceProperties.apiVersion >= VK_API_VERSION &&
+          physicalDeviceFeatures12.timelineSemaphore &&
+          supportsRequiredExtensions &&
+          supportsGraphics &&
+          supportsCompute &&
+          supportsPresentation))
+    {
+        return false;
+    }
+
+    dp->physicalDevice             = physicalDevice;
+    dp->physicalDeviceProperties   = physicalDeviceProperties;
+    dp->physicalDeviceFeatures     = physicalDeviceFeatures;
+    dp->physicalDeviceFeatures12   = physicalDeviceFeatures12;
+    dp->physicalDeviceProperties12 = physicalDeviceProperties12;
+    dp->presentIdFeatures          = presentIdFeatures;
+    dp->presentWaitFeatures        = presentWaitFeatures;
+
+    dp->supportedExtensionCount  = supportedExtensionCount;
+    dp->supportedExtensions      = supportedExtensions.release();
+
+    dp->activeExtensionCount     = 0;
+    dp->activeExtensions         = new string_t[VK_REQ_DEVICE_EXTENSIONS + VK_OPT_DEVICE_EXTENSIONS];
+
+    // Copy all of the required extensions. At this point, we know that all of them are supported.
+    for (string_t extName : requiredExtensions)
+    {
+        dp->activeExtensions[dp->activeExtensionCount++] = extName;
+    }
+
+    // Check whether any of the optional extensions are supported.
+    for (string_t extName : optionalExtensions)
+    {
+        if (ContainsVulkanExtension(extName, dp->supportedExtensions, dp->supportedExtensionCount))
         {
-            // Prevent memory leaks in case we enter this block several times.
-            delete[] dp.supportedExtensions;
-            delete[] dp.activeExtensions;
-            delete[] dp.queueFamilies;
+            dp->activeExtensions[dp->activeExtensionCount++] = extName;
+        }
+    }
+
+    dp->queueFamilyCount = queueFamilyCount;
+    dp->queueFamilies    = queueFamilies.release();
+
+    return true;
+}
 
-            dp.physicalDevice           = physicalDevice;
-            dp.physicalDeviceProperties = physicalDeviceProperties;
-            dp.physicalDeviceFeatures   = physicalDeviceFeatures;
+VulkanDeviceProperties VulkanRenderBackEnd::GetDeviceProperties() const
+{
+    TRACE_FUNCTION();
 
-            dp.supportedExtensionCount  = supportedExtensionCount;
-            dp.supportedExtensions      = supportedExtensions.release();
+    VulkanDeviceProperties dp = {};
 
-            dp.activeExtensionCount     = 0;
-            dp.activeExtensions         = new string_t[VK_REQ_DEVICE_EXTENSIONS + VK_OPT_DEVICE_EXTENSIONS];
+    // Only store the selected device. None of the others are needed outside of this function.
+    uint32_t physicalDeviceCount;
+    CHECK_INT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr),
+              "Failed to enumerate physical graphics devices.");
+
+    physicalDeviceCount = std::min(physicalDeviceCount, static_cast<uint32_t>(VK_MAX_DEVICES));
+
+    VkPhysicalDevice physicalDevices[VK_MAX_DEVICES];
+    VkResult result = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices);
 
-            // Copy all of the required extensions. At this point, we know that all of them are supported.
-            for (string_t extName : requiredExtensions)
+    ASSERT(result == VK_SUCCESS || result == VK_INCOMPLETE, "Failed to enumerate physical graphics devices.");
+
+    // Cheap, unlike the enumeration of the extensions and the queue families.
+    VulkanPhysicalDeviceId physicalDeviceIds[VK_MAX_DEVICES];
+
+    for (uint32_t i = 0; i < physicalDeviceCount; i++)
+    {
+        physicalDeviceIds[i] = GetPhysicalDeviceId(physicalDevices[i]);
+    }
+
+    const uint64_t devicesHash = HashPhysicalDeviceIds(physicalDeviceIds, physicalDeviceCount);
+
+    uint32_t selectedIndex = UINT32_MAX;
+
+    if (deviceSelector)
+    {
+        // The user knows best.
+        for (uint32_t i = 0; i < physicalDeviceCount && selectedIndex == UINT32_MAX; i++)
+        {
+            if (MatchesPhysicalDevice(deviceSelector, i, physicalDeviceIds[i]))
             {
-                dp.activeExtensions[dp.activeExtensionCount++] = extName;
+                ASSERT(QueryDeviceProperties(physicalDevices[i], &dp),
+                       "The selected graphics device (%s) is not compatible.", deviceSelector);
+
+                selectedIndex = i;
             }
+        }
+
+        ASSERT(dp.physicalDevice, "No graphics device matches \'%s\'.", deviceSelector);
+    }
+    else
+    {
+        VulkanPhysicalDeviceId cachedId;
 
-            // Check whether any of the optional extensions are supported.
-            for (string_t extName : optionalExtensions)
+        // Reuse the previous decision if the devices and the drivers have not changed.
+        if (LoadDeviceSelection(VK_DEVICE_SELECTION_CACHE_PATH, devicesHash, &cachedId))
+        {
+            for (uint32_t i = 0; i < physicalDeviceCount && selectedIndex == UINT32_MAX; i++)
             {
-                if (ContainsVulkanExtension(extName, dp.supportedExtensions, dp.supportedExtensionCount))
+                if (memcmp(&physicalDeviceIds[i], &cachedId, sizeof(cachedId)) == 0 &&
+                    QueryDeviceProperties(physicalDevices[i], &dp))
                 {
-                    dp.activeExtensions[dp.activeExtensionCount++] = extName;
+                    selectedIndex = i;
                 }
             }
+        }
 
-            dp.queueFamilyCount = queueFamilyCount;
-            dp.queueFamilies    = queueFamilies.release();
+        // Otherwise, rank all the compatible devices.
+        if (selectedIndex == UINT32_MAX)
+        {
+            uint64_t bestScore = 0;
 
-            // We found a compatible GPU, but is it the best one?
-            if (physicalDeviceProperties.deviceType == VkPhysicalDeviceType::VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+            for (uint32_t i = 0; i < physicalDeviceCount; i++)
             {
-                // Terminate the loop over devices.
-                break;
+                VulkanDeviceProperties candidate = {};
+
+                if (!QueryDeviceProperties(physicalDevices[i], &candidate)) continue;
+
+                const uint64_t score = ScorePhysicalDevice(physicalDevices[i], candidate.physicalDeviceProperties,
+                                                           candidate.queueFamilies, candidate.queueFamilyCount);
+
+                PrintInfo("Graphics device %u (%s): score %llu.", i, candidate.physicalDeviceProperties.deviceName,
+                          static_cast<unsigned long long>(score));
+
+                if (selectedIndex == UINT32_MAX || score > bestScore)
+                {
+                    ReleaseDeviceProperties(dp);
+
+                    dp            = candidate;
+                    bestScore     = score;
+                    selectedIndex = i;
+                }
+                else
+                {
+                    ReleaseDeviceProperties(candidate);
+                }
             }
+
+            ASSERT(dp.physicalDevice, "Failed to find a compatible physical graphics device.");
+
+            SaveDeviceSelection(VK_DEVICE_SELECTION_CACHE_PATH, devicesHash, physicalDeviceIds[selectedIndex]);
         }
     }
 
-    ASSERT(dp.physicalDevice, "Failed to find a compatible physical graphics device.");
+    char uuid[2 * VK_UUID_SIZE + 1];
+    FormatDeviceUuid(physicalDeviceIds[selectedIndex].deviceUUID, uuid);
+
+    PrintInfo("Selected graphics device %u (%s, UUID %s).", selectedIndex,
+              dp.physicalDeviceProperties.deviceName, uuid);
 
     return dp;
 }
 
+void VulkanRenderBackEnd::SetDeviceSelector(string_t selector)
+{
+    deviceSelector = selector;
+}
+
 void VulkanRenderBackEnd::CreateGraphicsDevice()
 {
+    TRACE_FUNCTION();
+
     this->deviceProperties = GetDeviceProperties();
 
     // The queue family index is overwritten only if a dedicated queue is available
     // (except for the present queue which is always assigned).
-    uint32_t graphicsQueueIndex = 0, graphicsQueueFamilyIndex = UINT32_MAX,
-             computeQueueIndex  = 0, computeQueueFamilyIndex  = UINT32_MAX,
-             transferQueueIndex = 0, transferQueueFamilyIndex = UINT32_MAX,
-             presentQueueIndex  = 0, presentQueueFamilyIndex  = UINT32_MAX;
+    uint32_t graphicsQueueIndex = 0, computeQueueIndex = 0, transferQueueIndex = 0, presentQueueIndex = 0;
+
+    graphicsQueueFamilyIndex = UINT32_MAX;
+    computeQueueFamilyIndex  = UINT32_MAX;
+    transferQueueFamilyIndex = UINT32_MAX;
+    presentQueueFamilyIndex  = UINT32_MAX;
 
     for (uint32_t f = 0; f < deviceProperties.queueFamilyCount; f++)
     {
@@ -431,16 +647,37 @@ void VulkanRenderBackEnd::CreateGraphicsDevice()
         queueInfoCount++;
     }
 
-    // Create a virtual device. Enable all supported features.
+    // Enable all supported features.
+    VkPhysicalDeviceVulkan12Features enabledFeatures12 = deviceProperties.physicalDeviceFeatures12;
+
+    VkPhysicalDeviceFeatures2 enabledFeatures = {};
+    enabledFeatures.sType    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    enabledFeatures.pNext    = &enabledFeatures12;
+    enabledFeatures.features = deviceProperties.physicalDeviceFeatures;
+
+    VkPhysicalDevicePresentIdFeaturesKHR   enabledPresentIdFeatures   = deviceProperties.presentIdFeatures;
+    VkPhysicalDevicePresentWaitFeaturesKHR enabledPresentWaitFeatures = deviceProperties.presentWaitFeatures;
+
+    // Allows the latency monitor to wait for the presentation of specific frames.
+    isPresentWaitSupported = enabledPresentIdFeatures.presentId && enabledPresentWaitFeatures.presentWait;
+
+    if (isPresentWaitSupported)
+    {
+        enabledFeatures12.pNext        = &enabledPresentIdFeatures;
+        enabledPresentIdFeatures.pNext = &enabledPresentWaitFeatures;
+    }
+
+    // Create a virtual device.
     VkDeviceCreateInfo deviceInfo      = {};
     deviceInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.pNext                   = &enabledFeatures;
     deviceInfo.queueCreateInfoCount    = queueInfoCount;
     deviceInfo.pQueueCreateInfos       = queueInfos;
     deviceInfo.enabledLayerCount       = instanceProperties.enabledLayerCount;
     deviceInfo.ppEnabledLayerNames     = instanceProperties.enabledLayers;
     deviceInfo.enabledExtensionCount   = deviceProperties.activeExtensionCount;
     deviceInfo.ppEnabledExtensionNames = deviceProperties.activeExtensions;
-    deviceInfo.pEnabledFeatures        = &deviceProperties.physicalDeviceFeatures;
+    deviceInfo.pEnabledFeatures        = nullptr; // Specified by 'enabledFeatures'
 
     CHECK_INT(vkCreateDevice(deviceProperties.physicalDevice, &deviceInfo, allocator, &device),
               "Failed to create a virtual graphics device.");
@@ -456,38 +693,234 @@ void VulkanRenderBackEnd::CreateGraphicsDevice()
     {
         // No async transfers, fall back to the graphics queue.
         transferQueueFamilyIndex = graphicsQueueFamilyIndex;
-        transferQueueFamilyIndex = graphicsQueueIndex;
+        transferQueueIndex       = graphicsQueueIndex;
     }
 
     vkGetDeviceQueue(device, graphicsQueueFamilyIndex, graphicsQueueIndex, &graphicsQueue);
     vkGetDeviceQueue(device, computeQueueFamilyIndex,  computeQueueIndex,  &computeQueue);
     vkGetDeviceQueue(device, transferQueueFamilyIndex, transferQueueIndex, &transferQueue);
     vkGetDeviceQueue(device, presentQueueFamilyIndex,  presentQueueIndex,  &presentQueue);
+
+    const VkQueue scheduledQueues[VK_QUEUE_TYPE_COUNT] = { graphicsQueue, computeQueue, transferQueue };
+
+    scheduler.Create(device, allocator, scheduledQueues);
+
+    memoryAllocator = new VulkanMemoryAllocator;
+    memoryAllocator->Create(deviceProperties.physicalDevice, device, allocator);
+
+    uploader = new VulkanAsyncUploader;
+    uploader->Create(device, allocator, memoryAllocator, &scheduler, deviceProperties.physicalDeviceProperties.limits,
+                     transferQueueFamilyIndex, graphicsQueueFamilyIndex);
+
+    pipelineCache.Create(device, allocator, deviceProperties.physicalDeviceProperties, jobSystem->ThreadCount());
+
+    pipelineStateCache = new VulkanPipelineStateCache;
+    pipelineStateCache->Create(device, allocator, jobSystem, &pipelineCache);
+
+    // The features are enabled along with all the other supported 1.2 features.
+    if (VulkanBindlessHeap::IsSupported(deviceProperties.physicalDeviceFeatures12))
+    {
+        bindlessHeap = new VulkanBindlessHeap;
+        bindlessHeap->Create(device, allocator, deviceProperties.physicalDeviceProperties12);
+    }
+    else
+    {
+        PrintWarning("Descriptor indexing is not supported. Bindless descriptors are disabled.");
+    }
+
+    destructionQueue = new VulkanDestructionQueue;
+    destructionQueue->Create(device, allocator, memoryAllocator);
 }
 
 void VulkanRenderBackEnd::DestroyGraphicsDevice()
 {
+    destructionQueue->Destroy();
+
+    delete destructionQueue;
+    destructionQueue = nullptr;
+
+    if (bindlessHeap)
+    {
+        bindlessHeap->Destroy();
+
+        delete bindlessHeap;
+        bindlessHeap = nullptr;
+    }
+
+    pipelineStateCache->Destroy();
+
+    delete pipelineStateCache;
+    pipelineStateCache = nullptr;
+
+    // Saves the pipelines compiled during the run.
+    pipelineCache.Destroy();
+
+    uploader->Destroy();
+
+    delete uploader;
+    uploader = nullptr;
+
+    memoryAllocator->PrintStatistics();
+    memoryAllocator->Destroy();
+
+    delete memoryAllocator;
+    memoryAllocator = nullptr;
+
+    scheduler.Destroy();
+
     // TODO: clean up VulkanDeviceProperties.
     vkDestroyDevice(device, allocator);
 }
 
 void VulkanRenderBackEnd::CreateSyncPrimitives()
 {
+    TRACE_FUNCTION();
+
+    ASSERT(bufferCount > 0, "The swap chain must be created before the sync primitives.");
+
+    // It is pointless to have more frames in flight than there are swap chain buffers:
+    // the CPU would just end up blocked on image acquisition instead.
+    frameCount = std::min(frameCount, bufferCount);
+    frameIndex = 0;
+
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    CHECK_INT(vkCreateSemaphore(device, &semaphoreInfo, allocator, &semaphore),
-              "Failed to create a semaphore.");
+    // Create the fences in the signaled state, so that the first wait does not block.
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    // The pool is reset in bulk once per frame, and its command buffers are short-lived.
+    VkCommandPoolCreateInfo commandPoolInfo = {};
+    commandPoolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        VulkanFrame& frame = frames[i];
+
+        CHECK_INT(vkCreateFence(device, &fenceInfo, allocator, &frame.fence),
+                  "Failed to create a fence.");
+        CHECK_INT(vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.imageAcquired),
+                  "Failed to create a semaphore.");
+        CHECK_INT(vkCreateCommandPool(device, &commandPoolInfo, allocator, &frame.commandPool),
+                  "Failed to create a command pool.");
+
+        VkCommandBufferAllocateInfo commandBufferInfo = {};
+        commandBufferInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool        = frame.commandPool;
+        commandBufferInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferInfo.commandBufferCount = 1;
+
+        CHECK_INT(vkAllocateCommandBuffers(device, &commandBufferInfo, &frame.commandBuffer),
+                  "Failed to allocate a command buffer.");
+    }
+
+    // Timestamps are written by the graphics queue.
+    gpuProfiler.Create(device, allocator, frameCount,
+                       deviceProperties.physicalDeviceProperties.limits.timestampPeriod,
+                       deviceProperties.queueFamilies[graphicsQueueFamilyIndex].timestampValidBits);
+
+    uploadRing = new VulkanUploadRing;
+    uploadRing->Create(memoryAllocator, deviceProperties.physicalDeviceProperties.limits, frameCount);
+
+    // Compute passes fall back to the graphics queue if there is no separate compute queue.
+    asyncCompute.Create(device, allocator, &scheduler, &gpuProfiler, computeQueueFamilyIndex,
+                        graphicsQueueFamilyIndex, computeQueue != graphicsQueue, frameCount,
+                        deviceProperties.physicalDeviceProperties.limits.timestampPeriod,
+                        deviceProperties.queueFamilies[computeQueueFamilyIndex].timestampValidBits);
+    asyncCompute.Enable(isAsyncComputeEnabled);
+
+    // Secondary command buffers are executed by the graphics command buffer of the frame.
+    recorder = new VulkanParallelRecorder;
+    recorder->Create(device, allocator, jobSystem, graphicsQueueFamilyIndex, frameCount);
+
+    // Sets may be allocated by the workers recording in parallel.
+    descriptorAllocator = new VulkanDescriptorAllocator;
+    descriptorAllocator->Create(device, allocator, jobSystem, frameCount);
+
+    if (bindlessHeap)
+    {
+        recorder->SetGlobalDescriptorSet(bindlessHeap->PipelineLayout(), bindlessHeap->Set());
+        asyncCompute.SetGlobalDescriptorSet(bindlessHeap->PipelineLayout(), bindlessHeap->Set());
+    }
+
+    // Its transient resources are shared by the frames in flight.
+    renderGraphDevice.Create(device, allocator, memoryAllocator, destructionQueue, &gpuProfiler);
+
+    renderGraph = new VulkanRenderGraph;
+    renderGraph->Create(&renderGraphDevice, deviceProperties.physicalDeviceProperties.limits.bufferImageGranularity);
 }
 
 void VulkanRenderBackEnd::DestroySyncPrimitives()
 {
-    vkDeviceWaitIdle(device);
-    vkDestroySemaphore(device, semaphore, allocator);
+    VkFence fences[VK_MAX_FRAMES_IN_FLIGHT];
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        fences[i] = frames[i].fence;
+    }
+
+    // Wait for the frames in flight to retire. Presentation is not fenced, so drain the queue too.
+    CHECK_INT(vkWaitForFences(device, frameCount, fences, VK_TRUE, UINT64_MAX),
+              "Failed to wait for a fence.");
+    CHECK_INT(vkQueueWaitIdle(presentQueue),
+              "Failed to wait for the presentation queue to become idle.");
+
+    // Nothing is in flight anymore.
+    destructionQueue->Collect(UINT64_MAX);
+
+    // Measures the frames presented so far before it stops.
+    SetLatencyMeasurement(false);
+
+    // Retires its transient resources to the (already drained) destruction queue.
+    renderGraph->Destroy();
+
+    delete renderGraph;
+    renderGraph = nullptr;
+
+    descriptorAllocator->Destroy();
+
+    delete descriptorAllocator;
+    descriptorAllocator = nullptr;
+
+    recorder->Destroy();
+
+    delete recorder;
+    recorder = nullptr;
+
+    asyncCompute.Destroy();
+
+    uploadRing->Destroy();
+
+    delete uploadRing;
+    uploadRing = nullptr;
+
+    gpuProfiler.Destroy();
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        VulkanFrame& frame = frames[i];
+
+        // Destroying the pool also frees its command buffers.
+        vkDestroyCommandPool(device, frame.commandPool,   allocator);
+        vkDestroySemaphore(device,   frame.imageAcquired, allocator);
+        vkDestroyFence(device,       frame.fence,         allocator);
+
+        frame = {};
+    }
+
+    memset(swapChainImageFences, 0, sizeof(swapChainImageFences));
+
+    isNextFrameReady = false;
 }
 
 VulkanSwapChainProperties VulkanRenderBackEnd::GetSwapChainProperties() const
 {
+    TRACE_FUNCTION();
+
     VulkanSwapChainProperties sp = {};
 
     CHECK_INT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(deviceProperties.physicalDevice, surface, &sp.surfaceCapabilities),
@@ -526,16 +959,44 @@ VulkanSwapChainProperties VulkanRenderBackEnd::GetSwapChainProperties() const
     // TODO: rotation and scaling.
     sp.activeSurfaceTransforms  = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
 
-    // Select the presentation mode.
+    // Select the presentation mode: the first supported mode in the order of preference of the policy.
     // VK_PRESENT_MODE_FIFO_KHR is always available, but VK_PRESENT_MODE_MAILBOX_KHR results in lower latency.
-    // Neither mode allows tearing.
+    // Neither mode allows tearing, unlike VK_PRESENT_MODE_IMMEDIATE_KHR.
+    VkPresentModeKHR preferredModes[3];
+    uint32_t         preferredModeCount = 0;
+
+    switch (presentPolicy)
+    {
+        case PRESENT_POLICY_THROUGHPUT:
+            preferredModes[preferredModeCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+            // Nobody can observe tearing without a display, so do not let V-Sync throttle headless rendering.
+            if (headlessSurface) preferredModes[preferredModeCount++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            break;
+        case PRESENT_POLICY_LOW_LATENCY:
+            preferredModes[preferredModeCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+            preferredModes[preferredModeCount++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            break;
+        case PRESENT_POLICY_VSYNC:
+            break;
+        case PRESENT_POLICY_IMMEDIATE:
+            preferredModes[preferredModeCount++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            preferredModes[preferredModeCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+            break;
+        default:
+            ASSERT(false, "Unknown presentation policy: %u.", presentPolicy);
+    }
+
+    preferredModes[preferredModeCount++] = VK_PRESENT_MODE_FIFO_KHR;
+
     sp.activePresentMode = VK_PRESENT_MODE_FIFO_KHR;
 
-    for (uint32_t i = 0; i < sp.presentModeCount; i++)
+    for (uint32_t p = 0; p < preferredModeCount; p++)
     {
-        if (sp.presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+        if (std::find(sp.presentModes, sp.presentModes + sp.presentModeCount, preferredModes[p]) !=
+            sp.presentModes + sp.presentModeCount)
         {
-            sp.activePresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            sp.activePresentMode = preferredModes[p];
+            break;
         }
     }
 
@@ -544,6 +1005,12 @@ VulkanSwapChainProperties VulkanRenderBackEnd::GetSwapChainProperties() const
 
 void VulkanRenderBackEnd::CreateSwapChain()
 {
+    TRACE_FUNCTION();
+
+    // In case the swap chain is re-created.
+    delete[] swapChainProperties.surfaceFormats;
+    delete[] swapChainProperties.presentModes;
+
     this->swapChainProperties = GetSwapChainProperties();
 
     // Triple buffering is highly desirable for max performance.
@@ -551,39 +1018,607 @@ void VulkanRenderBackEnd::CreateSwapChain()
     // https://software.intel.com/en-us/articles/sample-application-for-direct3d-12-flip-model-swap-chains
     bufferCount = 3;
     bufferCount = std::max(bufferCount, swapChainProperties.surfaceCapabilities.minImageCount);
-    bufferCount = std::min(bufferCount, swapChainProperties.surfaceCapabilities.maxImageCount);
+
+    // A maximum of 0 means that there is no limit.
+    if (swapChainProperties.surfaceCapabilities.maxImageCount > 0)
+    {
+        bufferCount = std::min(bufferCount, swapChainProperties.surfaceCapabilities.maxImageCount);
+    }
 
     // Adjust the resolution if needed.
-    if (surfaceDimensions.width  != swapChainProperties.surfaceCapabilities.currentExtent.width ||
-        surfaceDimensions.height != swapChainProperties.surfaceCapabilities.currentExtent.height)
+    swapChainDimensions = surfaceDimensions;
+
+    if (swapChainDimensions.width  != swapChainProperties.surfaceCapabilities.currentExtent.width ||
+        swapChainDimensions.height != swapChainProperties.surfaceCapabilities.currentExtent.height)
     {
-        surfaceDimensions.width  = std::max(surfaceDimensions.width,  swapChainProperties.surfaceCapabilities.minImageExtent.width);
-        surfaceDimensions.width  = std::min(surfaceDimensions.width,  swapChainProperties.surfaceCapabilities.maxImageExtent.width);
-        surfaceDimensions.height = std::max(surfaceDimensions.height, swapChainProperties.surfaceCapabilities.minImageExtent.height);
-        surfaceDimensions.height = std::min(surfaceDimensions.height, swapChainProperties.surfaceCapabilities.maxImageExtent.height);
+        swapChainDimensions.width  = std::max(swapChainDimensions.width,  swapChainProperties.surfaceCapabilities.minImageExtent.width);
+        swapChainDimensions.width  = std::min(swapChainDimensions.width,  swapChainProperties.surfaceCapabilities.maxImageExtent.width);
+        swapChainDimensions.height = std::max(swapChainDimensions.height, swapChainProperties.surfaceCapabilities.minImageExtent.height);
+        swapChainDimensions.height = std::min(swapChainDimensions.height, swapChainProperties.surfaceCapabilities.maxImageExtent.height);
     }
 
+    // If the graphics queue cannot present, the images are shared by both queue families,
+    // so that presenting them does not require a queue family ownership transfer.
+    const uint32_t queueFamilyIndices[] = { graphicsQueueFamilyIndex, presentQueueFamilyIndex };
+
+    const bool isShared = (graphicsQueueFamilyIndex != presentQueueFamilyIndex);
+
     VkSwapchainCreateInfoKHR swapChainInfo = {};
-    swapChainInfo.sType            = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    swapChainInfo.surface          = surface;
-    swapChainInfo.minImageCount    = bufferCount;
-    swapChainInfo.imageFormat      = swapChainProperties.activeSurfaceFormat.format;
-    swapChainInfo.imageColorSpace  = swapChainProperties.activeSurfaceFormat.colorSpace;
-    swapChainInfo.imageExtent      = surfaceDimensions;
-    swapChainInfo.imageArrayLayers = 1;         // Only for stereo rendering
-    swapChainInfo.imageUsage       = swapChainProperties.activeSurfaceUsageFlags;
-    swapChainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    swapChainInfo.preTransform     = swapChainProperties.activeSurfaceTransforms;
-    swapChainInfo.compositeAlpha   = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapChainInfo.presentMode      = swapChainProperties.activePresentMode;
-    swapChainInfo.clipped          = VK_TRUE;   // Skip rendering of fragments which are not visible
-    swapChainInfo.oldSwapchain     = swapChain; // In case we want to re-create it
+    swapChainInfo.sType                 = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapChainInfo.surface               = surface;
+    swapChainInfo.minImageCount         = bufferCount;
+    swapChainInfo.imageFormat           = swapChainProperties.activeSurfaceFormat.format;
+    swapChainInfo.imageColorSpace       = swapChainProperties.activeSurfaceFormat.colorSpace;
+    swapChainInfo.imageExtent           = swapChainDimensions;
+    swapChainInfo.imageArrayLayers      = 1;         // Only for stereo rendering
+    swapChainInfo.imageUsage            = swapChainProperties.activeSurfaceUsageFlags;
+    swapChainInfo.imageSharingMode      = isShared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    swapChainInfo.queueFamilyIndexCount = isShared ? 2 : 0;
+    swapChainInfo.pQueueFamilyIndices   = isShared ? queueFamilyIndices : nullptr;
+    swapChainInfo.preTransform          = swapChainProperties.activeSurfaceTransforms;
+    swapChainInfo.compositeAlpha        = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapChainInfo.presentMode           = swapChainProperties.activePresentMode;
+    swapChainInfo.clipped               = VK_TRUE;   // Skip rendering of fragments which are not visible
+    swapChainInfo.oldSwapchain          = swapChain; // In case we want to re-create it
 
     CHECK_INT(vkCreateSwapchainKHR(device, &swapChainInfo, allocator, &swapChain),
               "Failed to create a swap chain.");
+
+    // The implementation is allowed to create more images than we asked for.
+    CHECK_INT(vkGetSwapchainImagesKHR(device, swapChain, &bufferCount, nullptr),
+              "Failed to retrieve the swap chain images.");
+
+    ASSERT(bufferCount <= VK_MAX_SWAP_CHAIN_IMAGES, "Too many swap chain images: %u.", bufferCount);
+
+    CHECK_INT(vkGetSwapchainImagesKHR(device, swapChain, &bufferCount, swapChainImages),
+              "Failed to retrieve the swap chain images.");
+
+    // The presentation engine holds on to the semaphore a present waits for until the image is acquired again,
+    // which does not follow the order of the frames. So each image has its own, reused by its next present.
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        CHECK_INT(vkCreateSemaphore(device, &semaphoreInfo, allocator, &renderComplete[i]),
+                  "Failed to create a semaphore.");
+    }
 }
 
 void VulkanRenderBackEnd::DestroySwapChain()
 {
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        vkDestroySemaphore(device, renderComplete[i], allocator);
+    }
+
+    memset(renderComplete, 0, sizeof(renderComplete));
+
     vkDestroySwapchainKHR(device, swapChain, allocator);
 }
+
+void VulkanRenderBackEnd::ResizeSwapChain(const uint16_t width, const uint16_t height)
+{
+    // A minimized window has no drawable area. Keep the current swap chain.
+    if (width == 0 || height == 0) return;
+
+    if (width != surfaceDimensions.width || height != surfaceDimensions.height)
+    {
+        surfaceDimensions.width  = width;
+        surfaceDimensions.height = height;
+        isSwapChainOutdated      = true;
+    }
+}
+
+void VulkanRenderBackEnd::RecreateSwapChain()
+{
+    TRACE_FUNCTION();
+
+    // The frames in flight may still be using the old swap chain. It is passed to CreateSwapChain()
+    // (as 'oldSwapchain'), which retires it, and destroyed once the frames recorded so far have retired.
+    // None of its images are acquired at this point, so the presentation engine may release them early.
+    // The semaphores its pending presents wait for are retired along with it.
+    const VkSwapchainKHR oldSwapChain  = swapChain;
+    const uint32_t       oldImageCount = bufferCount;
+
+    VkSemaphore oldRenderComplete[VK_MAX_SWAP_CHAIN_IMAGES];
+    memcpy(oldRenderComplete, renderComplete, sizeof(renderComplete));
+
+    // The latency monitor may be waiting for a presentation to the old swap chain.
+    if (latencyMonitor)
+    {
+        latencyMonitor->Flush();
+    }
+
+    CreateSwapChain();
+
+    destructionQueue->Enqueue(VK_OBJECT_TYPE_SWAPCHAIN_KHR, oldSwapChain, frameSerial);
+
+    for (uint32_t i = 0; i < oldImageCount; i++)
+    {
+        destructionQueue->Enqueue(VK_OBJECT_TYPE_SEMAPHORE, oldRenderComplete[i], frameSerial);
+    }
+
+    // The fences refer to the images of the old swap chain.
+    memset(swapChainImageFences, 0, sizeof(swapChainImageFences));
+
+    isSwapChainOutdated = false;
+
+    PrintInfo("Re-created the swap chain: %u x %u, %u images, present mode %i.", swapChainDimensions.width,
+              swapChainDimensions.height, bufferCount, static_cast<int>(swapChainProperties.activePresentMode));
+}
+
+void VulkanRenderBackEnd::SetPresentPolicy(const PresentPolicy policy)
+{
+    if (policy != presentPolicy)
+    {
+        presentPolicy = policy;
+
+        // Otherwise, the policy is taken into account by CreateSwapChain().
+        if (swapChain)
+        {
+            isSwapChainOutdated = true;
+        }
+    }
+}
+
+void VulkanRenderBackEnd::SetFrameRateLimit(const float framesPerSecond)
+{
+    frameLimiter.SetFrameRate(framesPerSecond);
+}
+
+void VulkanRenderBackEnd::WaitForNextFrame()
+{
+    if (isNextFrameReady) return;
+
+    TRACE_FUNCTION();
+
+    VulkanFrame& frame = frames[frameIndex];
+
+    // Pace the CPU: wait until the GPU has retired the frame which last used this slot.
+    {
+        TRACE_SCOPE("WaitForFrameFence");
+
+        CHECK_INT(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX),
+                  "Failed to wait for a fence.");
+    }
+
+    // Do not queue up frames: record each one with the input sampled once the GPU is ready for it.
+    if (presentPolicy == PRESENT_POLICY_LOW_LATENCY)
+    {
+        TRACE_SCOPE("WaitForPreviousFrame");
+
+        scheduler.WaitForCompletion(VK_QUEUE_TYPE_GRAPHICS, scheduler.LastSubmittedValue(VK_QUEUE_TYPE_GRAPHICS));
+    }
+
+    frameLimiter.Wait();
+
+    isNextFrameReady = true;
+}
+
+void VulkanRenderBackEnd::BeginFrame()
+{
+    TRACE_FUNCTION();
+
+    hostAllocator->NewFrame();
+
+    VulkanFrame& frame = frames[frameIndex];
+
+    WaitForNextFrame();
+
+    // The GPU no longer reads the upload memory of the frame.
+    uploadRing->BeginFrame(frameIndex);
+
+    // The frame which previously used this slot has retired, and so have all the earlier ones.
+    if (frameSerial >= frameCount)
+    {
+        destructionQueue->Collect(frameSerial - frameCount);
+
+        if (bindlessHeap)
+        {
+            bindlessHeap->Collect(frameSerial - frameCount);
+        }
+    }
+
+    if (isSwapChainOutdated)
+    {
+        RecreateSwapChain();
+    }
+
+    VkResult result = VK_ERROR_OUT_OF_DATE_KHR;
+
+    {
+        TRACE_SCOPE("AcquireNextImage");
+
+        // The swap chain may be out of date again by the time it has been re-created (e.g. during a continuous
+        // resize). The semaphore is not signaled in this case, so it can be reused right away.
+        for (uint32_t attempt = 0; attempt < VK_MAX_ACQUIRE_ATTEMPTS && result == VK_ERROR_OUT_OF_DATE_KHR; attempt++)
+        {
+            if (attempt > 0)
+            {
+                RecreateSwapChain();
+            }
+
+            result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, frame.imageAcquired,
+                                           VK_NULL_HANDLE, &swapChainImageIndex);
+        }
+    }
+
+    ASSERT(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR,
+           "Failed to acquire a swap chain image.");
+
+    // Without an image, the frame is rendered off-screen, and not presented.
+    isImageAcquired = (result != VK_ERROR_OUT_OF_DATE_KHR);
+
+    // A suboptimal image can still be presented. Re-create the swap chain during the next frame.
+    if (result != VK_SUCCESS)
+    {
+        isSwapChainOutdated = true;
+    }
+
+    if (latencyMonitor && isImageAcquired)
+    {
+        latencyMonitor->OnAcquired(frameSerial);
+    }
+
+    // Images can be acquired out of order, and there may be more images than frames in flight.
+    // Make sure the frame which previously rendered into this image has retired.
+    if (isImageAcquired)
+    {
+        VkFence& imageFence = swapChainImageFences[swapChainImageIndex];
+
+        if (imageFence && imageFence != frame.fence)
+        {
+            CHECK_INT(vkWaitForFences(device, 1, &imageFence, VK_TRUE, UINT64_MAX),
+                      "Failed to wait for a fence.");
+        }
+
+        imageFence = frame.fence;
+    }
+
+    CHECK_INT(vkResetFences(device, 1, &frame.fence),
+              "Failed to reset a fence.");
+
+    // The GPU is done with the frame, so it is safe to recycle all of its command buffers at once.
+    CHECK_INT(vkResetCommandPool(device, frame.commandPool, 0),
+              "Failed to reset a command pool.");
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    CHECK_INT(vkBeginCommandBuffer(frame.commandBuffer, &beginInfo),
+              "Failed to begin recording a command buffer.");
+
+    // Kick off the uploads recorded during the previous frame, and take over the completed ones.
+    uploader->Submit();
+    frame.transferWait = uploader->AcquireCompleted(frame.commandBuffer);
+
+    // The frame has retired, so this also reads back its timestamps.
+    gpuProfiler.BeginFrame(frame.commandBuffer, frameIndex);
+    asyncCompute.BeginFrame(frameIndex);
+    recorder->BeginFrame(frameIndex);
+    descriptorAllocator->BeginFrame(frameIndex);
+
+    // Bound once for the entire frame (all the pipelines share the layout).
+    if (bindlessHeap)
+    {
+        bindlessHeap->Bind(frame.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+        bindlessHeap->Bind(frame.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+    }
+
+    renderGraph->Reset();
+
+    if (isImageAcquired)
+    {
+        // The presentation engine releases the image once the semaphore is signaled; its contents are irrelevant.
+        // If the present queue belongs to a different family, the images are shared concurrently
+        // (see CreateSwapChain()).
+        backBuffer = renderGraph->ImportImage("Back buffer", swapChainImages[swapChainImageIndex], VK_NULL_HANDLE,
+                                              VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                              VK_SWAP_CHAIN_WAIT_STAGES, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    }
+    else
+    {
+        // The passes are recorded as usual, into an image which is never presented.
+        VulkanGraphImageDescription description = {};
+        description.format    = swapChainProperties.activeSurfaceFormat.format;
+        description.extent    = swapChainDimensions;
+        description.mipLevels = 1;
+        description.samples   = VK_SAMPLE_COUNT_1_BIT;
+
+        backBuffer = renderGraph->CreateImage("Back buffer (not presented)", description);
+    }
+
+    const VulkanGraphAccess clearAccess = { backBuffer, VK_GRAPH_USAGE_TRANSFER_DST };
+
+    VulkanGraphPass clearPass = {};
+    clearPass.name        = "Clear";
+    clearPass.userData    = &backBuffer;
+    clearPass.accessCount = 1;
+    clearPass.accesses    = &clearAccess;
+    clearPass.record      = [](VkCommandBuffer commandBuffer, const VulkanRenderGraph& graph, void* userData)
+    {
+        const VkImageSubresourceRange colorRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        const VkClearColorValue       clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+
+        vkCmdClearColorImage(commandBuffer, graph.GetImage(*static_cast<VulkanGraphResource*>(userData)),
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &colorRange);
+    };
+
+    renderGraph->AddPass(clearPass);
+
+    if (frameRecordHook)
+    {
+        frameRecordHook(frame.commandBuffer, frameIndex, frameRecordHookData);
+
+        // The pipelines of the hook may have other layouts, which disturb the bindless set.
+        if (bindlessHeap)
+        {
+            bindlessHeap->Bind(frame.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+            bindlessHeap->Bind(frame.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+        }
+    }
+}
+
+void VulkanRenderBackEnd::EndFrame()
+{
+    TRACE_FUNCTION();
+
+    VulkanFrame& frame = frames[frameIndex];
+
+    // Executes the passes after the commands recorded directly, and transitions the image for presentation.
+    renderGraph->Compile(frameSerial);
+    renderGraph->Execute(frame.commandBuffer);
+
+    gpuProfiler.EndFrame(frame.commandBuffer);
+
+    CHECK_INT(vkEndCommandBuffer(frame.commandBuffer),
+              "Failed to end recording a command buffer.");
+
+    VulkanSubmission submission = {};
+    submission.commandBufferCount    = 1;
+    submission.commandBuffers        = &frame.commandBuffer;
+    submission.fence                 = frame.fence;
+
+    // The image layout transition has to wait for the presentation engine to release the image.
+    if (isImageAcquired)
+    {
+        submission.binaryWaitSemaphore   = frame.imageAcquired;
+        submission.binaryWaitStage       = VK_SWAP_CHAIN_WAIT_STAGES;
+        submission.binarySignalSemaphore = renderComplete[swapChainImageIndex];
+    }
+
+    uint32_t           waitCount = 0;
+    VulkanTimelineWait waits[2];
+
+    // Ownership of the uploaded resources is acquired at the beginning of the frame.
+    if (frame.transferWait > 0)
+    {
+        waits[waitCount++] = { VK_QUEUE_TYPE_TRANSFER, frame.transferWait, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+    }
+
+    // The async compute work must be submitted first. Only the consumers of its outputs wait for it.
+    const VulkanTimelineWait computeWait = asyncCompute.Submit();
+
+    if (computeWait.value > 0)
+    {
+        waits[waitCount++] = computeWait;
+    }
+
+    submission.waitCount = waitCount;
+    submission.waits     = waits;
+
+    const uint64_t timelineValue = scheduler.Submit(VK_QUEUE_TYPE_GRAPHICS, submission);
+
+    if (isImageAcquired)
+    {
+        if (latencyMonitor)
+        {
+            latencyMonitor->OnSubmitted(frameSerial, timelineValue);
+        }
+
+        Present();
+    }
+
+    // Move on to the next frame in flight.
+    frameIndex = (frameIndex + 1) % frameCount;
+    frameSerial++;
+
+    isNextFrameReady = false;
+}
+
+void VulkanRenderBackEnd::Present()
+{
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores    = &renderComplete[swapChainImageIndex];
+    presentInfo.swapchainCount     = 1;
+    presentInfo.pSwapchains        = &swapChain;
+    presentInfo.pImageIndices      = &swapChainImageIndex;
+
+    // Present IDs must increase monotonically. Serial numbers do, even across swap chains.
+    const uint64_t presentId = frameSerial + 1;
+
+    VkPresentIdKHR presentIdInfo = {};
+    presentIdInfo.sType          = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds    = &presentId;
+
+    if (latencyMonitor && latencyMonitor->UsesPresentWait())
+    {
+        presentInfo.pNext = &presentIdInfo;
+    }
+
+    VkResult result;
+
+    {
+        TRACE_SCOPE("QueuePresent");
+
+        result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    }
+
+    ASSERT(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR,
+           "Failed to present a swap chain image.");
+
+    // The frame has been submitted regardless. Re-create the swap chain during the next frame.
+    if (result != VK_SUCCESS)
+    {
+        isSwapChainOutdated = true;
+    }
+
+    // The image may not have been presented if the swap chain is out of date.
+    if (latencyMonitor && result != VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        latencyMonitor->OnPresented(frameSerial, swapChain, presentId);
+    }
+}
+
+void VulkanRenderBackEnd::SetLatencyMeasurement(const bool enable)
+{
+    if (enable && !latencyMonitor)
+    {
+        latencyMonitor = new VulkanLatencyMonitor;
+        latencyMonitor->Create(device, &scheduler, isPresentWaitSupported);
+    }
+    else if (!enable && latencyMonitor)
+    {
+        latencyMonitor->Destroy();
+
+        delete latencyMonitor;
+        latencyMonitor = nullptr;
+    }
+}
+
+uint32_t VulkanRenderBackEnd::GetFrameLatencies(FrameLatency* latencies) const
+{
+    return latencyMonitor ? latencyMonitor->GetFrameLatencies(latencies) : 0;
+}
+
+uint32_t VulkanRenderBackEnd::GetGpuTimings(const GpuScopeTiming** timings) const
+{
+    return gpuProfiler.GetScopeTimings(timings);
+}
+
+float VulkanRenderBackEnd::GetGpuFrameTime() const
+{
+    return gpuProfiler.FrameTime();
+}
+
+float VulkanRenderBackEnd::GetGpuComputeTime() const
+{
+    return asyncCompute.FrameTime();
+}
+
+void VulkanRenderBackEnd::SetAsyncCompute(const bool enable)
+{
+    isAsyncComputeEnabled = enable;
+    asyncCompute.Enable(enable);
+}
+
+void VulkanRenderBackEnd::SetFrameRecordHook(VulkanFrameRecordFunction record, void* userData)
+{
+    frameRecordHook     = record;
+    frameRecordHookData = userData;
+}
+
+void VulkanRenderBackEnd::AddComputePass(const VulkanComputePass& pass)
+{
+    asyncCompute.AddPass(frames[frameIndex].commandBuffer, pass);
+}
+
+void VulkanRenderBackEnd::RecordParallel(const uint32_t count, const uint32_t batchSize,
+                                         VulkanRecordFunction record, void* userData)
+{
+    VkCommandBuffer commandBuffer = frames[frameIndex].commandBuffer;
+
+    recorder->Record(commandBuffer, count, batchSize, record, userData);
+
+    // The state of the primary command buffer is undefined after it executes secondary ones.
+    if (bindlessHeap)
+    {
+        bindlessHeap->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+        bindlessHeap->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+    }
+}
+
+VkPipeline VulkanRenderBackEnd::RequestPipeline(const VulkanPipelineDescription& description, VkPipeline fallback)
+{
+    return pipelineStateCache->Request(description, fallback);
+}
+
+bool VulkanRenderBackEnd::IsPipelineReady(const VulkanPipelineDescription& description) const
+{
+    return pipelineStateCache->IsReady(HashPipelineDescription(description));
+}
+
+VulkanRenderGraph* VulkanRenderBackEnd::RenderGraph()
+{
+    return renderGraph;
+}
+
+VulkanGraphResource VulkanRenderBackEnd::BackBuffer() const
+{
+    return backBuffer;
+}
+
+VulkanBindlessHeap* VulkanRenderBackEnd::BindlessHeap()
+{
+    return bindlessHeap;
+}
+
+VulkanDescriptorAllocator* VulkanRenderBackEnd::DescriptorAllocator()
+{
+    return descriptorAllocator;
+}
+
+VulkanMemoryAllocator* VulkanRenderBackEnd::MemoryAllocator()
+{
+    return memoryAllocator;
+}
+
+void VulkanRenderBackEnd::WaitIdle() const
+{
+    scheduler.WaitIdle();
+}
+
+VkDevice VulkanRenderBackEnd::Device() const
+{
+    return device;
+}
+
+const VkAllocationCallbacks* VulkanRenderBackEnd::AllocationCallbacks() const
+{
+    return allocator;
+}
+
+const VulkanDeviceProperties& VulkanRenderBackEnd::DeviceProperties() const
+{
+    return deviceProperties;
+}
+
+VkExtent2D VulkanRenderBackEnd::SwapChainDimensions() const
+{
+    return swapChainDimensions;
+}
+
+uint32_t VulkanRenderBackEnd::FrameCount() const
+{
+    return frameCount;
+}
+
+VkPipelineCache VulkanRenderBackEnd::PipelineCache() const
+{
+    return pipelineCache.Cache();
+}
+
+VulkanGpuProfiler* VulkanRenderBackEnd::GpuProfiler()
+{
+    return &gpuProfiler;
+}
+
+VulkanAsyncUploader* VulkanRenderBackEnd::Uploader()
+{
+    return uploader;
+}
@@ -8,22 +8,67 @@
 
 #include <vulkan/vulkan.h>
 
+#include "asynccompute.h"
+#include "asyncuploader.h"
+#include "bindlessheap.h"
+#include "descriptorallocator.h"
+#include "destructionqueue.h"
+#include "framelimiter.h"
+#include "gpuprofiler.h"
+#include "hostallocator.h"
+#include "jobsystem.h"
+#include "latencymonitor.h"
+#include "memoryallocator.h"
+#include "parallelrecorder.h"
+#include "pipelinecache.h"
+#include "pipelinestatecache.h"
+#include "queuescheduler.h"
+#include "rendergraph.h"
+#include "rendergraphdevice.h"
+#include "uploadring.h"
+
+#define VK_MAX_FRAMES_IN_FLIGHT    4
+#define VK_MAX_SWAP_CHAIN_IMAGES   8
+
 class Window;
 
+// Records commands into the command buffer of the frame in the slot 'frameIndex'.
+using VulkanFrameRecordFunction = void (*)(VkCommandBuffer commandBuffer, const uint32_t frameIndex, void* userData);
+
+// Trade-offs between the frame rate, the latency and tearing.
+enum PresentPolicy : uint32_t
+{
+    PRESENT_POLICY_THROUGHPUT,  // MAILBOX (or FIFO); the CPU can get several frames ahead of the GPU
+    PRESENT_POLICY_LOW_LATENCY, // MAILBOX (or IMMEDIATE, or FIFO); the CPU waits for the GPU to finish each frame
+    PRESENT_POLICY_VSYNC,       // FIFO; frames are queued, and never dropped
+    PRESENT_POLICY_IMMEDIATE    // IMMEDIATE (or MAILBOX, or FIFO); allows tearing
+};
+
 // Interface - abstract (base) class containing only pure virtual functions.
 class RenderBackEnd
 {
 public:
 
+    // Allows destruction via a pointer to the interface.
+    virtual ~RenderBackEnd() = default;
+
     // TODO: extensive explanation goes here.
     virtual void CreateApiInstance()  = 0;
     virtual void DestroyApiInstance() = 0;
 
     // TODO: extensive explanation goes here.
+    // The headless variant creates a surface which is not backed by a window,
+    // so the rest of the back-end (swap chain included) works unmodified without a display.
     virtual void CreateDisplaySurface(const Window& window) = 0;
+    virtual void CreateHeadlessSurface(const uint16_t width, const uint16_t height) = 0;
     virtual void DestroyDisplaySurface() = 0;
 
-    // TODO: extensive explanation goes here.
+    // Overrides the automatic selection of the graphics device: either its index, or its UUID.
+    // Must be called before CreateGraphicsDevice(). The string must outlive the back-end.
+    virtual void SetDeviceSelector(string_t selector) = 0;
+
+    // The device with the highest score is selected (see ScorePhysicalDevice()). The decision is cached
+    // across runs, so subsequent runs only query the selected device (as long as the devices do not change).
     virtual void CreateGraphicsDevice()  = 0;
     virtual void DestroyGraphicsDevice() = 0;
 
@@ -34,6 +79,56 @@ public:
     // TODO: extensive explanation goes here.
     virtual void CreateSwapChain()  = 0;
     virtual void DestroySwapChain() = 0;
+
+    // Requests a swap chain of a different size (e.g. after the window has been resized).
+    // The swap chain is re-created at the beginning of the next frame. The old one is retired,
+    // and destroyed once the frames in flight which use it have retired, so the GPU is never drained.
+    // The swap chain is also re-created if the surface reports that it is out of date.
+    virtual void ResizeSwapChain(const uint16_t width, const uint16_t height) = 0;
+
+    // Changes the presentation mode (see PresentPolicy). If the swap chain already exists,
+    // it is re-created at the beginning of the next frame. PRESENT_POLICY_THROUGHPUT by default.
+    virtual void SetPresentPolicy(const PresentPolicy policy) = 0;
+
+    // Caps the frame rate on the CPU. 0 removes the cap (default).
+    virtual void SetFrameRateLimit(const float framesPerSecond) = 0;
+
+    // Blocks until the next frame can begin: waits for the frame in flight to retire, then for the GPU
+    // to finish the previous frame (PRESENT_POLICY_LOW_LATENCY only), and then for the frame rate limiter.
+    // Call it right before sampling the input, so that the input is as recent as possible once recorded.
+    // Optional: otherwise, BeginFrame() calls it.
+    virtual void WaitForNextFrame() = 0;
+
+    // Frames are recorded and submitted in a round-robin fashion, several frames in flight at a time.
+    // BeginFrame() blocks only if the CPU gets too far ahead of the GPU.
+    // EndFrame() submits the recorded commands and presents the frame.
+    virtual void BeginFrame() = 0;
+    virtual void EndFrame()   = 0;
+
+    // Measures the latency of every frame: from the acquisition of its image (and from its submission)
+    // to its presentation (see VulkanLatencyMonitor). Must be called after CreateSyncPrimitives(),
+    // outside of BeginFrame() / EndFrame(). Disabled by default.
+    virtual void SetLatencyMeasurement(const bool enable) = 0;
+
+    // Returns the latencies of the most recently presented frames (at most VK_LATENCY_HISTORY_SIZE),
+    // oldest first, or 0 if the measurement is disabled.
+    virtual uint32_t GetFrameLatencies(FrameLatency* latencies) const = 0;
+
+    // Returns the GPU times of the most recent frame for which the results are available.
+    // The first timing is the entire frame; it is followed by the nested scopes (passes).
+    virtual uint32_t GetGpuTimings(const GpuScopeTiming** timings) const = 0;
+
+    // Returns the GPU time (in milliseconds) of the most recent frame for which the results are available.
+    virtual float GetGpuFrameTime() const = 0;
+
+    // Returns the GPU time (in milliseconds) of the async compute work of the most recent frame
+    // for which the results are available, or 0 if compute work is not executed asynchronously.
+    virtual float GetGpuComputeTime() const = 0;
+
+    // Compute passes execute on the dedicated compute queue, concurrently with the graphics work.
+    // If disabled (or if there is no such queue), they execute on the graphics queue.
+    // Takes effect at the beginning of the next frame. Enabled by default.
+    virtual void SetAsyncCompute(const bool enable) = 0;
 };
 
 struct VulkanInstanceProperties
@@ -53,6 +148,10 @@ struct VulkanDeviceProperties
     VkPhysicalDevice              physicalDevice;
     VkPhysicalDeviceProperties    physicalDeviceProperties;
     VkPhysicalDeviceFeatures      physicalDeviceFeatures;
+    VkPhysicalDeviceVulkan12Features physicalDeviceFeatures12;
+    VkPhysicalDeviceVulkan12Properties physicalDeviceProperties12;
+    VkPhysicalDevicePresentIdFeaturesKHR   presentIdFeatures;   // Zero if VK_KHR_present_id is not supported
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures; // Zero if VK_KHR_present_wait is not supported
 
     uint32_t                      supportedExtensionCount;
     VkExtensionProperties*        supportedExtensions;
@@ -64,6 +163,17 @@ struct VulkanDeviceProperties
     VkQueueFamilyProperties*      queueFamilies;                      
 };
 
+// Resources owned by a single frame in flight.
+// They may only be reused once the GPU signals the fence.
+struct VulkanFrame
+{
+    VkFence                       fence;          // Signaled once the GPU has finished executing the frame
+    VkSemaphore                   imageAcquired;  // Signaled once the swap chain image is ready to be written to
+    VkCommandPool                 commandPool;    // Reset in bulk at the beginning of the frame
+    VkCommandBuffer               commandBuffer;
+    uint64_t                      transferWait;   // Value of the transfer queue timeline to wait for (or 0)
+};
+
 struct VulkanSwapChainProperties
 {
     VkSurfaceCapabilitiesKHR      surfaceCapabilities;
@@ -84,18 +194,89 @@ class VulkanRenderBackEnd : public RenderBackEnd
 {
 public:
 
-    VulkanRenderBackEnd();
+    // 'jobSystem': used to record commands in parallel. Must outlive the back-end.
+    // 'framesInFlight': the max. number of frames the CPU can get ahead of the GPU.
+    // It is further limited by VK_MAX_FRAMES_IN_FLIGHT and by the number of swap chain buffers.
+    VulkanRenderBackEnd(JobSystem* jobSystem, const uint32_t framesInFlight = 2);
 
     virtual void CreateApiInstance()     final;
     virtual void DestroyApiInstance()    final;
     virtual void CreateDisplaySurface(const Window& window) final;
+    virtual void CreateHeadlessSurface(const uint16_t width, const uint16_t height) final;
     virtual void DestroyDisplaySurface() final;
+    virtual void SetDeviceSelector(string_t selector) final;
     virtual void CreateGraphicsDevice()  final;
     virtual void DestroyGraphicsDevice() final;
     virtual void CreateSyncPrimitives()  final;
     virtual void DestroySyncPrimitives() final;
     virtual void CreateSwapChain()       final;
     virtual void DestroySwapChain()      final;
+    virtual void ResizeSwapChain(const uint16_t width, const uint16_t height) final;
+    virtual void SetPresentPolicy(const PresentPolicy policy) final;
+    virtual void SetFrameRateLimit(const float framesPerSecond) final;
+    virtual void WaitForNextFrame()      final;
+    virtual void BeginFrame()            final;
+    virtual void EndFrame()              final;
+    virtual void SetLatencyMeasurement(const bool enable) final;
+    virtual uint32_t GetFrameLatencies(FrameLatency* latencies) const final;
+    virtual uint32_t GetGpuTimings(const GpuScopeTiming** timings) const final;
+    virtual float    GetGpuFrameTime() const final;
+    virtual float    GetGpuComputeTime() const final;
+    virtual void     SetAsyncCompute(const bool enable) final;
+
+    // Records commands at the beginning of every frame (at the end of BeginFrame()), into the command buffer
+    // of the frame (e.g. synthetic workloads, see VulkanBenchmarkWorkloads). 'record' may bind any pipeline
+    // and descriptor set: the bindless set is bound again afterwards. Null removes the hook.
+    void SetFrameRecordHook(VulkanFrameRecordFunction record, void* userData);
+
+    // Records a compute pass into the current frame (between BeginFrame() and EndFrame()).
+    // Its outputs may be consumed by the graphics commands recorded afterwards.
+    void AddComputePass(const VulkanComputePass& pass);
+
+    // Records the items [0, 'count') into the current frame (between BeginFrame() and EndFrame())
+    // on all the workers of the job system, in batches of (at most) 'batchSize' items.
+    // The order of the items is preserved.
+    void RecordParallel(const uint32_t count, const uint32_t batchSize, VulkanRecordFunction record,
+                        void* userData);
+
+    // Returns the pipeline matching the description. Never stalls: a missing pipeline is compiled
+    // in the background, and 'fallback' is returned in the meantime. May be called from any thread.
+    VkPipeline RequestPipeline(const VulkanPipelineDescription& description, VkPipeline fallback = VK_NULL_HANDLE);
+
+    // Returns 'true' once the requested pipeline has been compiled (or has failed to compile).
+    // Its shader modules and render pass must not be destroyed before.
+    bool IsPipelineReady(const VulkanPipelineDescription& description) const;
+
+    // Passes added to the graph (between BeginFrame() and EndFrame()) execute at the end of the frame,
+    // after the commands recorded directly. The graph is reset by BeginFrame(), which adds a pass clearing
+    // the back buffer. The back buffer is presented once the passes complete.
+    VulkanRenderGraph*  RenderGraph();
+    VulkanGraphResource BackBuffer() const;
+
+    // Returns the descriptors of all the resources, or null if descriptor indexing is not supported.
+    // Its set is bound to every command buffer of the frame (primary, secondary and compute),
+    // so pipelines created with its layout only need push constants.
+    VulkanBindlessHeap* BindlessHeap();
+
+    // Allocates the descriptor sets which are not accessed via the bindless heap.
+    // Per-frame sets are valid until the end of the frame (between BeginFrame() and EndFrame()).
+    VulkanDescriptorAllocator* DescriptorAllocator();
+
+    // Sub-allocates the device memory of the resources (except for the swap chain images).
+    VulkanMemoryAllocator* MemoryAllocator();
+
+    // Waits for all the queues to become idle (e.g. before destroying resources the frames in flight may use).
+    void WaitIdle() const;
+
+    // For the modules which create resources of their own (e.g. VulkanBenchmarkWorkloads).
+    VkDevice                      Device() const;
+    const VkAllocationCallbacks*  AllocationCallbacks() const;
+    const VulkanDeviceProperties& DeviceProperties() const;
+    VkExtent2D                    SwapChainDimensions() const;
+    uint32_t                      FrameCount() const; // Of the frames in flight
+    VkPipelineCache               PipelineCache() const;
+    VulkanGpuProfiler*            GpuProfiler();
+    VulkanAsyncUploader*          Uploader();
 
 private:
 
@@ -103,24 +284,73 @@ private:
     VulkanDeviceProperties    GetDeviceProperties()    const;
     VulkanSwapChainProperties GetSwapChainProperties() const;
 
+    // Returns 'false' if the device is not compatible.
+    bool QueryDeviceProperties(VkPhysicalDevice physicalDevice, VulkanDeviceProperties* dp) const;
+
+    void RecreateSwapChain();
+
+    // Queues the image of the current frame for presentation, once its rendering is complete.
+    void Present();
+
 private:
 
     // Frequently-accessed working parts.
-    VkAllocationCallbacks*    allocator;
+    const VkAllocationCallbacks* allocator;
+    VulkanHostAllocator*      hostAllocator; // Non-POD, so it cannot be a member (see the constructor)
     VkInstance                instance;
     VkDevice                  device;
     VkQueue                   graphicsQueue;
     VkQueue                   computeQueue;
     VkQueue                   transferQueue;
     VkQueue                   presentQueue;
-    VkSemaphore               semaphore;
+    VulkanQueueScheduler      scheduler;
+    VulkanMemoryAllocator*    memoryAllocator;
+    VulkanAsyncUploader*      uploader;
+    VulkanPipelineCache       pipelineCache;
+    VulkanPipelineStateCache* pipelineStateCache;
+    VulkanBindlessHeap*       bindlessHeap;        // Optional
+    uint32_t                  graphicsQueueFamilyIndex;
+    uint32_t                  computeQueueFamilyIndex;
+    uint32_t                  transferQueueFamilyIndex;
+    uint32_t                  presentQueueFamilyIndex;
     VkSurfaceKHR              surface;
-    VkExtent2D                surfaceDimensions;
+    VkExtent2D                surfaceDimensions;   // Requested
+    VkExtent2D                swapChainDimensions; // Actual
+    bool                      headlessSurface;
     uint32_t                  bufferCount;
     VkSwapchainKHR            swapChain;
+    VkImage                   swapChainImages[VK_MAX_SWAP_CHAIN_IMAGES];
+    VkFence                   swapChainImageFences[VK_MAX_SWAP_CHAIN_IMAGES]; // Fence of the last frame which used the image
+    VkSemaphore               renderComplete[VK_MAX_SWAP_CHAIN_IMAGES];       // Signaled once the image is ready to be presented
+    uint32_t                  swapChainImageIndex;
+    bool                      isImageAcquired;     // Otherwise, the current frame is not presented
+    bool                      isSwapChainOutdated;
+    PresentPolicy             presentPolicy;
+    FrameLimiter              frameLimiter;
+    bool                      isNextFrameReady;    // WaitForNextFrame() has been called for the current frame
+    bool                      isPresentWaitSupported;
+    VulkanLatencyMonitor*     latencyMonitor;      // Optional
+    VulkanDestructionQueue*   destructionQueue;
+    uint64_t                  frameSerial;         // The number of frames submitted so far
+    uint32_t                  frameCount;
+    uint32_t                  frameIndex;
+    VulkanFrame               frames[VK_MAX_FRAMES_IN_FLIGHT];
+    VulkanGpuProfiler         gpuProfiler;
+    VulkanUploadRing*         uploadRing;
+    JobSystem*                jobSystem;
+    VulkanParallelRecorder*   recorder;
+    VulkanDescriptorAllocator* descriptorAllocator;
+    VulkanRenderGraph*        renderGraph;
+    VulkanRenderGraphDevice   renderGraphDevice;
+    VulkanGraphResource       backBuffer;          // Of the current frame
+    VulkanAsyncCompute        asyncCompute;
+    bool                      isAsyncComputeEnabled;
+    VulkanFrameRecordFunction frameRecordHook;     // Optional
+    void*                     frameRecordHookData;
 
     // Rarely-accessed introspection parts.
     VulkanInstanceProperties  instanceProperties;
     VulkanDeviceProperties    deviceProperties;
+    string_t                  deviceSelector;   // Optional
     VulkanSwapChainProperties swapChainProperties;
 };
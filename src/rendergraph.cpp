@@ -0,0 +1,891 @@
+#include "rendergraph.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// The stages, the accesses and the layout implied by a usage.
+struct VulkanGraphUsageInfo
+{
+    VkPipelineStageFlags stages;
+    VkAccessFlags        access;
+    VkImageLayout        layout;      // Of images
+    bool                 isWrite;
+    VkImageUsageFlags    imageUsage;  // Required by transient images
+    VkBufferUsageFlags   bufferUsage; // Required by transient buffers
+};
+
+static const VulkanGraphUsageInfo usageInfos[VK_GRAPH_USAGE_COUNT] =
+{
+    // VK_GRAPH_USAGE_COLOR_ATTACHMENT
+    { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0 },
+    // VK_GRAPH_USAGE_DEPTH_ATTACHMENT
+    { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true,
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 },
+    // VK_GRAPH_USAGE_DEPTH_READ
+    { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false,
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 },
+    // VK_GRAPH_USAGE_SAMPLED
+    { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false,
+      VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+    // VK_GRAPH_USAGE_STORAGE_READ
+    { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT,
+      VK_IMAGE_LAYOUT_GENERAL, false,
+      VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+    // VK_GRAPH_USAGE_STORAGE_WRITE
+    { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      VK_IMAGE_LAYOUT_GENERAL, true,
+      VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+    // VK_GRAPH_USAGE_TRANSFER_SRC
+    { VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_READ_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false,
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+    // VK_GRAPH_USAGE_TRANSFER_DST
+    { VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+    // VK_GRAPH_USAGE_INDIRECT_ARGUMENTS
+    { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, false,
+      0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT },
+    // VK_GRAPH_USAGE_VERTEX_INPUT
+    { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, false,
+      0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT }
+};
+
+static constexpr VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT |
+                                                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                                 VK_ACCESS_TRANSFER_WRITE_BIT;
+
+static VkImageAspectFlags GetFormatAspect(const VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+void VulkanRenderGraph::Create(RenderGraphDevice* device, const VkDeviceSize bufferImageGranularity)
+{
+    m_device                 = device;
+    m_bufferImageGranularity = std::max<VkDeviceSize>(bufferImageGranularity, 1);
+    m_transientHash          = 0;
+    m_transientCount         = 0;
+    m_heap                   = {};
+    m_statistics             = {};
+
+    memset(m_transients, 0, sizeof(m_transients));
+
+    Reset();
+}
+
+void VulkanRenderGraph::Destroy()
+{
+    // Nothing is in flight, so this destroys them right away.
+    RetireTransients(UINT64_MAX);
+
+    m_device->DestroyRetired();
+}
+
+void VulkanRenderGraph::Reset()
+{
+    m_passCount         = 0;
+    m_resourceCount     = 0;
+    m_imageBarrierCount = 0;
+    m_finalBarrier      = {};
+}
+
+VulkanGraphResource VulkanRenderGraph::ImportImage(string_t name, VkImage image, VkImageView view,
+                                                   const VkImageAspectFlags aspect,
+                                                   const VkImageLayout initialLayout,
+                                                   const VkPipelineStageFlags initialStages,
+                                                   const VkImageLayout finalLayout)
+{
+    ASSERT(m_resourceCount < VK_MAX_RENDER_GRAPH_RESOURCES, "Too many render graph resources.");
+
+    Resource& resource = m_resources[m_resourceCount];
+    resource               = {};
+    resource.name          = name;
+    resource.isImage       = true;
+    resource.image         = image;
+    resource.view          = view;
+    resource.aspect        = aspect;
+    resource.initialLayout = initialLayout;
+    resource.initialStages = initialStages;
+    resource.finalLayout   = finalLayout;
+
+    return m_resourceCount++;
+}
+
+VulkanGraphResource VulkanRenderGraph::ImportBuffer(string_t name, VkBuffer buffer)
+{
+    ASSERT(m_resourceCount < VK_MAX_RENDER_GRAPH_RESOURCES, "Too many render graph resources.");
+
+    Resource& resource = m_resources[m_resourceCount];
+    resource        = {};
+    resource.name   = name;
+    resource.buffer = buffer;
+
+    return m_resourceCount++;
+}
+
+VulkanGraphResource VulkanRenderGraph::CreateImage(string_t name, const VulkanGraphImageDescription& description)
+{
+    ASSERT(m_resourceCount < VK_MAX_RENDER_GRAPH_RESOURCES, "Too many render graph resources.");
+
+    Resource& resource = m_resources[m_resourceCount];
+    resource                  = {};
+    resource.name             = name;
+    resource.isImage          = true;
+    resource.isTransient      = true;
+    resource.aspect           = GetFormatAspect(description.format);
+    resource.initialLayout    = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.finalLayout      = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.imageDescription = description;
+
+    resource.imageDescription.mipLevels = std::max(description.mipLevels, 1u);
+    resource.imageDescription.samples   = description.samples ? description.samples : VK_SAMPLE_COUNT_1_BIT;
+
+    return m_resourceCount++;
+}
+
+VulkanGraphResource VulkanRenderGraph::CreateBuffer(string_t name, const VulkanGraphBufferDescription& description)
+{
+    ASSERT(m_resourceCount < VK_MAX_RENDER_GRAPH_RESOURCES, "Too many render graph resources.");
+
+    Resource& resource = m_resources[m_resourceCount];
+    resource                   = {};
+    resource.name              = name;
+    resource.isTransient       = true;
+    resource.bufferDescription = description;
+
+    return m_resourceCount++;
+}
+
+void VulkanRenderGraph::AddPass(const VulkanGraphPass& pass)
+{
+    ASSERT(m_passCount < VK_MAX_RENDER_GRAPH_PASSES, "Too many render graph passes.");
+
+    Pass& p = m_passes[m_passCount++];
+    p.name           = pass.name;
+    p.record         = pass.record;
+    p.userData       = pass.userData;
+    p.hasSideEffects = pass.hasSideEffects;
+    p.isCulled       = false;
+    p.accessCount    = 0;
+    p.barrier        = {};
+
+    for (uint32_t i = 0; i < pass.accessCount; i++)
+    {
+        const VulkanGraphAccess& access = pass.accesses[i];
+
+        assert(access.resource < m_resourceCount && access.usage < VK_GRAPH_USAGE_COUNT);
+
+        const VulkanGraphUsageInfo& info = usageInfos[access.usage];
+
+        Resource& resource = m_resources[access.resource];
+
+        resource.usageFlags |= resource.isImage ? info.imageUsage : info.bufferUsage;
+
+        // Buffers have no layout.
+        const VkImageLayout layout = resource.isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+        Access* merged = nullptr;
+
+        for (uint32_t j = 0; j < p.accessCount; j++)
+        {
+            if (p.accesses[j].resource == access.resource)
+            {
+                merged = &p.accesses[j];
+            }
+        }
+
+        if (merged)
+        {
+            merged->stages  |= info.stages;
+            merged->access  |= info.access;
+            merged->isWrite |= info.isWrite;
+
+            // E.g. a depth buffer which is both tested and sampled.
+            if (merged->layout != layout)
+            {
+                merged->layout = VK_IMAGE_LAYOUT_GENERAL;
+            }
+        }
+        else
+        {
+            ASSERT(p.accessCount < VK_MAX_RENDER_GRAPH_ACCESSES, "Too many accesses of the pass \'%s\'.", pass.name);
+
+            p.accesses[p.accessCount++] = { access.resource, info.stages, info.access, layout, info.isWrite };
+        }
+    }
+}
+
+void VulkanRenderGraph::Compile(const uint64_t frameSerial)
+{
+    TRACE_FUNCTION();
+
+    m_statistics.passCount       = m_passCount;
+    m_statistics.culledPassCount = CullPasses(m_passes, m_passCount, m_resources, m_resourceCount);
+
+    ComputeLifetimes(m_passes, m_passCount, m_resources, m_resourceCount);
+
+    // The placement of the transient resources depends on their descriptions and lifetimes only.
+    const uint64_t transientHash = HashTransients();
+
+    if (transientHash != m_transientHash)
+    {
+        RetireTransients(frameSerial);
+        CreateTransients();
+
+        m_transientHash = transientHash;
+    }
+
+    for (uint32_t r = 0; r < m_resourceCount; r++)
+    {
+        Resource& resource = m_resources[r];
+
+        if (resource.isTransient)
+        {
+            resource.image  = m_transients[r].image;
+            resource.view   = m_transients[r].view;
+            resource.buffer = m_transients[r].buffer;
+        }
+    }
+
+    m_imageBarrierCount = ComputeBarriers(m_passes, m_passCount, m_resources, m_resourceCount, m_transients,
+                                          m_imageBarriers, &m_finalBarrier);
+
+    m_statistics.barrierBatchCount  = 0;
+    m_statistics.memoryBarrierCount = 0;
+    m_statistics.imageBarrierCount  = 0;
+
+    for (uint32_t p = 0; p < m_passCount; p++)
+    {
+        if (!m_passes[p].isCulled)
+        {
+            CountBarrier(m_passes[p].barrier);
+        }
+    }
+
+    CountBarrier(m_finalBarrier);
+}
+
+void VulkanRenderGraph::CountBarrier(const Barrier& barrier)
+{
+    if (barrier.srcStages == 0) return;
+
+    m_statistics.barrierBatchCount++;
+    m_statistics.imageBarrierCount += barrier.imageBarrierCount;
+
+    if (barrier.srcAccess | barrier.dstAccess)
+    {
+        m_statistics.memoryBarrierCount++;
+    }
+}
+
+uint32_t VulkanRenderGraph::CullPasses(Pass* passes, const uint32_t passCount, const Resource* resources,
+                                       const uint32_t resourceCount)
+{
+    // The imported resources may be consumed outside of the graph. The transient ones are only needed
+    // if a pass which is needed itself reads them. Earlier writes are kept, since they may be read
+    // by the later passes (e.g. by blending).
+    bool isNeeded[VK_MAX_RENDER_GRAPH_RESOURCES];
+
+    for (uint32_t r = 0; r < resourceCount; r++)
+    {
+        isNeeded[r] = !resources[r].isTransient;
+    }
+
+    uint32_t culledPassCount = 0;
+
+    for (uint32_t p = passCount; p-- > 0; )
+    {
+        Pass& pass = passes[p];
+
+        bool isLive = pass.hasSideEffects;
+
+        for (uint32_t i = 0; i < pass.accessCount && !isLive; i++)
+        {
+            isLive = pass.accesses[i].isWrite && isNeeded[pass.accesses[i].resource];
+        }
+
+        pass.isCulled = !isLive;
+
+        if (isLive)
+        {
+            for (uint32_t i = 0; i < pass.accessCount; i++)
+            {
+                isNeeded[pass.accesses[i].resource] = true;
+            }
+        }
+        else
+        {
+            culledPassCount++;
+        }
+    }
+
+    return culledPassCount;
+}
+
+void VulkanRenderGraph::ComputeLifetimes(const Pass* passes, const uint32_t passCount, Resource* resources,
+                                         const uint32_t resourceCount)
+{
+    for (uint32_t r = 0; r < resourceCount; r++)
+    {
+        resources[r].firstPass = UINT32_MAX;
+        resources[r].lastPass  = 0;
+    }
+
+    for (uint32_t p = 0; p < passCount; p++)
+    {
+        const Pass& pass = passes[p];
+
+        if (pass.isCulled) continue;
+
+        for (uint32_t i = 0; i < pass.accessCount; i++)
+        {
+            Resource& resource = resources[pass.accesses[i].resource];
+
+            resource.firstPass = std::min(resource.firstPass, p);
+            resource.lastPass  = std::max(resource.lastPass,  p);
+        }
+    }
+}
+
+uint64_t VulkanRenderGraph::HashTransients() const
+{
+    uint64_t hash = HashBytes(&m_resourceCount, sizeof(m_resourceCount));
+
+    for (uint32_t r = 0; r < m_resourceCount; r++)
+    {
+        const Resource& resource = m_resources[r];
+
+        if (!resource.isTransient) continue;
+
+        hash = HashBytes(&r,                          sizeof(r),                          hash);
+        hash = HashBytes(&resource.isImage,           sizeof(resource.isImage),           hash);
+        hash = HashBytes(&resource.imageDescription,  sizeof(resource.imageDescription),  hash);
+        hash = HashBytes(&resource.bufferDescription, sizeof(resource.bufferDescription), hash);
+        hash = HashBytes(&resource.usageFlags,        sizeof(resource.usageFlags),        hash);
+        hash = HashBytes(&resource.firstPass,         sizeof(resource.firstPass),         hash);
+        hash = HashBytes(&resource.lastPass,          sizeof(resource.lastPass),          hash);
+    }
+
+    return hash;
+}
+
+void VulkanRenderGraph::CreateTransients()
+{
+    TRACE_FUNCTION();
+
+    uint32_t             count = 0;
+    uint32_t             indices[VK_MAX_RENDER_GRAPH_RESOURCES];
+    VkMemoryRequirements requirements[VK_MAX_RENDER_GRAPH_RESOURCES];
+
+    for (uint32_t r = 0; r < m_resourceCount; r++)
+    {
+        const Resource& resource  = m_resources[r];
+        Transient&      transient = m_transients[r];
+
+        transient = {};
+
+        // Resources only used by culled passes are not created.
+        if (!resource.isTransient || resource.firstPass == UINT32_MAX) continue;
+
+        if (resource.isImage)
+        {
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+            imageInfo.format        = resource.imageDescription.format;
+            imageInfo.extent        = { resource.imageDescription.extent.width,
+                                        resource.imageDescription.extent.height, 1 };
+            imageInfo.mipLevels     = resource.imageDescription.mipLevels;
+            imageInfo.arrayLayers   = 1;
+            imageInfo.samples       = resource.imageDescription.samples;
+            imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage         = resource.usageFlags;
+            imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            transient.image = m_device->CreateImage(resource.name, imageInfo, &requirements[r]);
+        }
+        else
+        {
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size        = resource.bufferDescription.size;
+            bufferInfo.usage       = resource.usageFlags;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            transient.buffer = m_device->CreateBuffer(resource.name, bufferInfo, &requirements[r]);
+        }
+
+        // Buffers and images may be neighbors, so respect the granularity.
+        requirements[r].alignment = std::max(requirements[r].alignment, m_bufferImageGranularity);
+        requirements[r].size      = (requirements[r].size + m_bufferImageGranularity - 1) /
+                                    m_bufferImageGranularity * m_bufferImageGranularity;
+
+        indices[count++] = r;
+    }
+
+    const VkMemoryRequirements heapRequirements = PlaceTransients(m_resources, indices, count, requirements,
+                                                                  m_transients);
+
+    m_heap = {};
+
+    if (heapRequirements.size > 0)
+    {
+        m_heap = m_device->Allocate("Render graph heap", heapRequirements, true, true);
+    }
+
+    m_transientCount            = count;
+    m_statistics.transientCount = count;
+    m_statistics.transientBytes = heapRequirements.size;
+    m_statistics.unaliasedBytes = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t  r         = indices[i];
+        const Resource& resource  = m_resources[r];
+        Transient&      transient = m_transients[r];
+
+        const VulkanAllocation* memory = &m_heap;
+        VkDeviceSize            offset = transient.offset;
+
+        if (transient.offset == UINT64_MAX)
+        {
+            transient.allocation = m_device->Allocate(resource.name, requirements[r], resource.isImage, false);
+
+            memory = &transient.allocation;
+            offset = 0;
+
+            m_statistics.transientBytes += transient.size;
+        }
+
+        m_statistics.unaliasedBytes += transient.size;
+
+        if (resource.isImage)
+        {
+            m_device->BindImageMemory(resource.name, transient.image, *memory, offset);
+
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image            = transient.image;
+            viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format           = resource.imageDescription.format;
+            viewInfo.subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+            transient.view = m_device->CreateImageView(resource.name, viewInfo);
+        }
+        else
+        {
+            m_device->BindBufferMemory(resource.name, transient.buffer, *memory, offset);
+        }
+    }
+
+    PrintInfo("Render graph: %u transient resources, %.2f MiB (%.2f MiB without aliasing).", count,
+              m_statistics.transientBytes / 1048576.0, m_statistics.unaliasedBytes / 1048576.0);
+}
+
+VkMemoryRequirements VulkanRenderGraph::PlaceTransients(const Resource* resources, const uint32_t* indices,
+                                                        const uint32_t count,
+                                                        const VkMemoryRequirements* requirements,
+                                                        Transient* transients)
+{
+    uint32_t sorted[VK_MAX_RENDER_GRAPH_RESOURCES];
+
+    std::copy(indices, indices + count, sorted);
+
+    // Place the largest resources first. The sort is stable, so that the placement is deterministic.
+    std::stable_sort(sorted, sorted + count, [requirements](const uint32_t a, const uint32_t b)
+    {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    VkMemoryRequirements heap = { 0, 1, UINT32_MAX };
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t r = sorted[i];
+
+        Transient& transient = transients[r];
+
+        transient.size = requirements[r].size;
+
+        // Resources which cannot share the memory type of the heap get allocations of their own.
+        if ((heap.memoryTypeBits & requirements[r].memoryTypeBits) == 0)
+        {
+            transient.offset = UINT64_MAX;
+            continue;
+        }
+
+        heap.memoryTypeBits &= requirements[r].memoryTypeBits;
+
+        // Ranges of the overlapping resources, sorted by offset.
+        uint32_t     rangeCount = 0;
+        VkDeviceSize rangeBegins[VK_MAX_RENDER_GRAPH_RESOURCES];
+        VkDeviceSize rangeEnds[VK_MAX_RENDER_GRAPH_RESOURCES];
+
+        for (uint32_t j = 0; j < i; j++)
+        {
+            const uint32_t   o     = sorted[j];
+            const Transient& other = transients[o];
+
+            const bool isAliveTogether = resources[o].firstPass <= resources[r].lastPass &&
+                                         resources[r].firstPass <= resources[o].lastPass;
+
+            if (isAliveTogether && other.offset != UINT64_MAX)
+            {
+                uint32_t k = rangeCount++;
+
+                for (; k > 0 && rangeBegins[k - 1] > other.offset; k--)
+                {
+                    rangeBegins[k] = rangeBegins[k - 1];
+                    rangeEnds[k]   = rangeEnds[k - 1];
+                }
+
+                rangeBegins[k] = other.offset;
+                rangeEnds[k]   = other.offset + other.size;
+            }
+        }
+
+        const VkDeviceSize alignment = requirements[r].alignment;
+
+        VkDeviceSize offset = 0;
+
+        for (uint32_t k = 0; k < rangeCount; k++)
+        {
+            if (offset + transient.size <= rangeBegins[k]) break;
+
+            offset = std::max(offset, (rangeEnds[k] + alignment - 1) / alignment * alignment);
+        }
+
+        transient.offset = offset;
+
+        heap.size      = std::max(heap.size, offset + transient.size);
+        heap.alignment = std::max(heap.alignment, alignment);
+    }
+
+    return heap;
+}
+
+void VulkanRenderGraph::RetireTransients(const uint64_t frameSerial)
+{
+    // The frames in flight may still be using them.
+    for (uint32_t r = 0; r < VK_MAX_RENDER_GRAPH_RESOURCES; r++)
+    {
+        Transient& transient = m_transients[r];
+
+        if (transient.image || transient.buffer)
+        {
+            m_device->Retire(transient.image, transient.view, transient.buffer, transient.allocation, frameSerial);
+        }
+
+        transient = {};
+    }
+
+    if (m_heap.memory)
+    {
+        m_device->Retire(VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, m_heap, frameSerial);
+    }
+
+    m_heap           = {};
+    m_transientHash  = 0;
+    m_transientCount = 0;
+}
+
+uint32_t VulkanRenderGraph::ComputeBarriers(Pass* passes, const uint32_t passCount, const Resource* resources,
+                                            const uint32_t resourceCount, Transient* transients,
+                                            VkImageMemoryBarrier* imageBarriers, Barrier* finalBarrier)
+{
+    TRACE_FUNCTION();
+
+    // Accumulate the accesses to the transient resources. The first access to a transient resource
+    // must wait for the earlier accesses to its memory: by the resources it aliases in this frame,
+    // and by all of them (itself included) in the previous frame. Any of them may be the last one.
+    for (uint32_t p = 0; p < passCount; p++)
+    {
+        const Pass& pass = passes[p];
+
+        if (pass.isCulled) continue;
+
+        for (uint32_t i = 0; i < pass.accessCount; i++)
+        {
+            const Access& access    = pass.accesses[i];
+            Transient&    transient = transients[access.resource];
+
+            if (!resources[access.resource].isTransient) continue;
+
+            transient.lastStages |= access.stages;
+            transient.lastWrites |= access.access & writeAccessMask;
+        }
+    }
+
+    // Synchronization state of a resource.
+    struct State
+    {
+        VkImageLayout        layout;
+        VkPipelineStageFlags writeStages;   // Of the last write
+        VkAccessFlags        writeAccess;
+        VkPipelineStageFlags readStages;    // Of the reads since the last write
+        VkPipelineStageFlags visibleStages; // The last write is visible to these stages and accesses
+        VkAccessFlags        visibleAccess;
+    };
+
+    State states[VK_MAX_RENDER_GRAPH_RESOURCES];
+
+    for (uint32_t r = 0; r < resourceCount; r++)
+    {
+        const Resource& resource = resources[r];
+
+        states[r]        = {};
+        states[r].layout = resource.initialLayout;
+
+        if (resource.isTransient)
+        {
+            const Transient& transient = transients[r];
+
+            for (uint32_t o = 0; o < resourceCount; o++)
+            {
+                const Transient& other = transients[o];
+
+                const bool isAliased = (o == r) ||
+                                       (resources[o].isTransient &&
+                                        transient.offset != UINT64_MAX && other.offset != UINT64_MAX &&
+                                        transient.offset < other.offset + other.size &&
+                                        other.offset < transient.offset + transient.size);
+
+                if (isAliased)
+                {
+                    states[r].writeStages |= other.lastStages;
+                    states[r].writeAccess |= other.lastWrites;
+                }
+            }
+        }
+        else
+        {
+            states[r].writeStages = resource.initialStages;
+        }
+    }
+
+    uint32_t imageBarrierCount = 0;
+
+    auto addImageBarrier = [imageBarriers, &imageBarrierCount](const Resource& resource,
+                                                               const VkAccessFlags srcAccess,
+                                                               const VkAccessFlags dstAccess,
+                                                               const VkImageLayout oldLayout,
+                                                               const VkImageLayout newLayout)
+    {
+        VkImageMemoryBarrier& barrier = imageBarriers[imageBarrierCount++];
+        barrier                     = {};
+        barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask       = srcAccess;
+        barrier.dstAccessMask       = dstAccess;
+        barrier.oldLayout           = oldLayout;
+        barrier.newLayout           = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image               = resource.image;
+        barrier.subresourceRange    = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+    };
+
+    for (uint32_t p = 0; p < passCount; p++)
+    {
+        Pass& pass = passes[p];
+
+        if (pass.isCulled) continue;
+
+        Barrier& barrier = pass.barrier;
+        barrier                   = {};
+        barrier.firstImageBarrier = imageBarrierCount;
+
+        for (uint32_t i = 0; i < pass.accessCount; i++)
+        {
+            const Access&   access   = pass.accesses[i];
+            const Resource& resource = resources[access.resource];
+            State&          state    = states[access.resource];
+
+            const bool isTransition = resource.isImage && access.layout != state.layout;
+
+            if (access.isWrite || isTransition)
+            {
+                // Write-after-read only requires an execution dependency: the readers have already
+                // waited for the previous write.
+                const VkPipelineStageFlags srcStages = state.readStages ? state.readStages : state.writeStages;
+                const VkAccessFlags        srcAccess = state.readStages ? 0 : state.writeAccess;
+
+                if (isTransition)
+                {
+                    addImageBarrier(resource, srcAccess, access.access, state.layout, access.layout);
+
+                    barrier.srcStages |= srcStages ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+                    barrier.dstStages |= access.stages;
+                }
+                else if (srcStages)
+                {
+                    barrier.srcStages |= srcStages;
+                    barrier.dstStages |= access.stages;
+                    barrier.srcAccess |= srcAccess;
+                    barrier.dstAccess |= srcAccess ? access.access : 0;
+                }
+
+                state.layout = access.layout;
+
+                if (access.isWrite)
+                {
+                    state.writeStages   = access.stages;
+                    state.writeAccess   = access.access & writeAccessMask;
+                    state.readStages    = 0;
+                    state.visibleStages = 0;
+                    state.visibleAccess = 0;
+                }
+                else
+                {
+                    // The transition made the previous write visible to this read.
+                    state.readStages    = access.stages;
+                    state.visibleStages = access.stages;
+                    state.visibleAccess = access.access;
+                }
+            }
+            else
+            {
+                const bool isVisible = (access.stages & ~state.visibleStages) == 0 &&
+                                       (access.access & ~state.visibleAccess) == 0;
+
+                // Read-after-write: the write must be made visible to the reader.
+                if (state.writeStages && !isVisible)
+                {
+                    barrier.srcStages |= state.writeStages;
+                    barrier.dstStages |= access.stages;
+                    barrier.srcAccess |= state.writeAccess;
+                    barrier.dstAccess |= state.writeAccess ? access.access : 0;
+
+                    state.visibleStages |= access.stages;
+                    state.visibleAccess |= access.access;
+                }
+
+                state.readStages |= access.stages;
+            }
+        }
+
+        barrier.imageBarrierCount = imageBarrierCount - barrier.firstImageBarrier;
+    }
+
+    // Hand the imported images over in their final layouts (e.g. for presentation).
+    *finalBarrier                   = {};
+    finalBarrier->firstImageBarrier = imageBarrierCount;
+
+    for (uint32_t r = 0; r < resourceCount; r++)
+    {
+        const Resource& resource = resources[r];
+        const State&    state    = states[r];
+
+        if (resource.isImage && !resource.isTransient && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED &&
+            resource.finalLayout != state.layout)
+        {
+            const VkPipelineStageFlags srcStages = state.readStages ? state.readStages : state.writeStages;
+            const VkAccessFlags        srcAccess = state.readStages ? 0 : state.writeAccess;
+
+            addImageBarrier(resource, srcAccess, 0, state.layout, resource.finalLayout);
+
+            finalBarrier->srcStages |= srcStages ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            finalBarrier->dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+    }
+
+    finalBarrier->imageBarrierCount = imageBarrierCount - finalBarrier->firstImageBarrier;
+
+    return imageBarrierCount;
+}
+
+void VulkanRenderGraph::RecordBarrier(VkCommandBuffer commandBuffer, const Barrier& barrier) const
+{
+    if (barrier.srcStages == 0) return;
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = barrier.srcAccess;
+    memoryBarrier.dstAccessMask = barrier.dstAccess;
+
+    const bool hasMemoryBarrier = (barrier.srcAccess | barrier.dstAccess) != 0;
+
+    m_device->PipelineBarrier(commandBuffer, barrier.srcStages, barrier.dstStages,
+                              hasMemoryBarrier ? &memoryBarrier : nullptr,
+                              barrier.imageBarrierCount, &m_imageBarriers[barrier.firstImageBarrier]);
+}
+
+void VulkanRenderGraph::Execute(VkCommandBuffer commandBuffer) const
+{
+    TRACE_FUNCTION();
+
+    for (uint32_t p = 0; p < m_passCount; p++)
+    {
+        const Pass& pass = m_passes[p];
+
+        if (pass.isCulled) continue;
+
+        RecordBarrier(commandBuffer, pass.barrier);
+
+        m_device->BeginPass(commandBuffer, pass.name);
+
+        pass.record(commandBuffer, *this, pass.userData);
+
+        m_device->EndPass(commandBuffer);
+    }
+
+    RecordBarrier(commandBuffer, m_finalBarrier);
+}
+
+VkImage VulkanRenderGraph::GetImage(const VulkanGraphResource resource) const
+{
+    assert(resource < m_resourceCount && m_resources[resource].isImage);
+
+    return m_resources[resource].image;
+}
+
+VkImageView VulkanRenderGraph::GetImageView(const VulkanGraphResource resource) const
+{
+    assert(resource < m_resourceCount && m_resources[resource].isImage);
+
+    return m_resources[resource].view;
+}
+
+VkBuffer VulkanRenderGraph::GetBuffer(const VulkanGraphResource resource) const
+{
+    assert(resource < m_resourceCount && !m_resources[resource].isImage);
+
+    return m_resources[resource].buffer;
+}
+
+const VulkanRenderGraphStatistics& VulkanRenderGraph::Statistics() const
+{
+    return m_statistics;
+}
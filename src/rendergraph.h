@@ -0,0 +1,292 @@
+#pragma once
+
+#include "memoryallocator.h"
+
+#define VK_MAX_RENDER_GRAPH_PASSES      64
+#define VK_MAX_RENDER_GRAPH_RESOURCES   64
+#define VK_MAX_RENDER_GRAPH_ACCESSES    16 // Per pass
+
+// Identifies a resource of the graph. Only valid until the graph is reset.
+using VulkanGraphResource = uint32_t;
+
+class VulkanRenderGraph;
+
+// Records the commands of a pass. The resources are looked up with VulkanRenderGraph::GetImage() (etc.).
+using VulkanGraphPassFunction = void (*)(VkCommandBuffer commandBuffer, const VulkanRenderGraph& graph,
+                                         void* userData);
+
+// How a pass accesses a resource. Determines the pipeline stages, the access mask and the image layout,
+// as well as the usage flags of the transient resources.
+enum VulkanGraphUsage : uint32_t
+{
+    VK_GRAPH_USAGE_COLOR_ATTACHMENT,   // Written (and possibly blended)
+    VK_GRAPH_USAGE_DEPTH_ATTACHMENT,   // Depth test and write
+    VK_GRAPH_USAGE_DEPTH_READ,         // Depth test only
+    VK_GRAPH_USAGE_SAMPLED,            // Read by vertex, fragment and compute shaders
+    VK_GRAPH_USAGE_STORAGE_READ,       // Read by compute shaders
+    VK_GRAPH_USAGE_STORAGE_WRITE,      // Written (and possibly read) by compute shaders
+    VK_GRAPH_USAGE_TRANSFER_SRC,
+    VK_GRAPH_USAGE_TRANSFER_DST,
+    VK_GRAPH_USAGE_INDIRECT_ARGUMENTS,
+    VK_GRAPH_USAGE_VERTEX_INPUT,       // Vertex and index buffers
+    VK_GRAPH_USAGE_COUNT
+};
+
+struct VulkanGraphAccess
+{
+    VulkanGraphResource              resource;
+    VulkanGraphUsage                 usage;
+};
+
+struct VulkanGraphPass
+{
+    string_t                         name;           // Points to a string literal
+    VulkanGraphPassFunction          record;
+    void*                            userData;
+    bool                             hasSideEffects; // Never culled (e.g. writes to memory outside of the graph)
+
+    uint32_t                         accessCount;
+    const VulkanGraphAccess*         accesses;
+};
+
+// Image which only exists during the frame. Its memory may be shared with other transient resources.
+struct VulkanGraphImageDescription
+{
+    VkFormat                         format;
+    VkExtent2D                       extent;
+    uint32_t                         mipLevels;
+    VkSampleCountFlagBits            samples;
+};
+
+// Buffer which only exists during the frame. Its memory may be shared with other transient resources.
+struct VulkanGraphBufferDescription
+{
+    VkDeviceSize                     size;
+};
+
+struct VulkanRenderGraphStatistics
+{
+    uint32_t                         passCount;          // Declared
+    uint32_t                         culledPassCount;
+    uint32_t                         barrierBatchCount;  // vkCmdPipelineBarrier() calls
+    uint32_t                         memoryBarrierCount;
+    uint32_t                         imageBarrierCount;  // Layout transitions
+    uint32_t                         transientCount;
+    VkDeviceSize                     transientBytes;     // Memory of the transient resources
+    VkDeviceSize                     unaliasedBytes;     // Memory they would occupy without aliasing
+};
+
+// Interface - abstract (base) class containing only pure virtual functions.
+// Creates the transient resources of the render graph, and records its commands.
+// Keeps the graph itself free of Vulkan calls, so that it can be tested on the CPU with a mock device.
+class RenderGraphDevice
+{
+public:
+
+    virtual ~RenderGraphDevice() = default;
+
+    // Create a resource without memory, and return its memory requirements.
+    virtual VkImage  CreateImage(string_t name, const VkImageCreateInfo& imageInfo,
+                                 VkMemoryRequirements* requirements) = 0;
+    virtual VkBuffer CreateBuffer(string_t name, const VkBufferCreateInfo& bufferInfo,
+                                  VkMemoryRequirements* requirements) = 0;
+
+    // Allocates device-local memory. See VulkanMemoryAllocator::Allocate().
+    virtual VulkanAllocation Allocate(string_t name, const VkMemoryRequirements& requirements,
+                                      const bool optimalImage, const bool dedicated) = 0;
+
+    // 'offset' is relative to the allocation.
+    virtual void BindImageMemory(string_t name, VkImage image, const VulkanAllocation& allocation,
+                                 const VkDeviceSize offset) = 0;
+    virtual void BindBufferMemory(string_t name, VkBuffer buffer, const VulkanAllocation& allocation,
+                                  const VkDeviceSize offset) = 0;
+
+    virtual VkImageView CreateImageView(string_t name, const VkImageViewCreateInfo& viewInfo) = 0;
+
+    // Destroys the objects (and frees the allocation) once the frame 'frameSerial' has retired.
+    // Null handles and allocations are ignored.
+    virtual void Retire(VkImage image, VkImageView view, VkBuffer buffer, const VulkanAllocation& allocation,
+                        const uint64_t frameSerial) = 0;
+
+    // Destroys all the retired objects. The GPU must be idle.
+    virtual void DestroyRetired() = 0;
+
+    virtual void PipelineBarrier(VkCommandBuffer commandBuffer, const VkPipelineStageFlags srcStages,
+                                 const VkPipelineStageFlags dstStages, const VkMemoryBarrier* memoryBarrier,
+                                 const uint32_t imageBarrierCount, const VkImageMemoryBarrier* imageBarriers) = 0;
+
+    // Surround the commands of a pass (e.g. to time it).
+    virtual void BeginPass(VkCommandBuffer commandBuffer, string_t name) = 0;
+    virtual void EndPass(VkCommandBuffer commandBuffer) = 0;
+};
+
+// Frame graph. Each frame, the passes declare the resources they read and write, in the order of execution.
+// Compile() then:
+// - culls the passes whose outputs are never consumed;
+// - computes the lifetimes of the transient resources, and places them into a shared heap,
+//   so that the resources whose lifetimes do not overlap alias the same memory;
+// - computes the barriers required between the passes (execution and memory dependencies, layout transitions),
+//   merged into a single vkCmdPipelineBarrier() per pass. Buffers and images which keep their layout
+//   are synchronized with a global memory barrier, images which change layout with image barriers.
+// The transient resources are only re-created (and re-placed) if the declarations change.
+// The old ones are retired via the device, so that the frames in flight may keep using them.
+// The passes are executed on a single queue, in the order of declaration.
+class VulkanRenderGraph
+{
+public:
+
+    // 'bufferImageGranularity': see VkPhysicalDeviceLimits.
+    void Create(RenderGraphDevice* device, const VkDeviceSize bufferImageGranularity);
+
+    // The GPU must be idle.
+    void Destroy();
+
+    // Discards the passes and the resources declared during the previous frame.
+    void Reset();
+
+    // The image is in 'initialLayout' once the execution of 'initialStages' by the earlier commands
+    // (or by a semaphore wait operation) is complete. It is left in 'finalLayout'. 'view' is optional.
+    VulkanGraphResource ImportImage(string_t name, VkImage image, VkImageView view, const VkImageAspectFlags aspect,
+                                    const VkImageLayout initialLayout, const VkPipelineStageFlags initialStages,
+                                    const VkImageLayout finalLayout);
+
+    // Accesses to the buffer outside of the graph must be synchronized by the caller.
+    VulkanGraphResource ImportBuffer(string_t name, VkBuffer buffer);
+
+    // The contents of the transient resources are undefined before the first pass writes them.
+    VulkanGraphResource CreateImage(string_t name, const VulkanGraphImageDescription& description);
+    VulkanGraphResource CreateBuffer(string_t name, const VulkanGraphBufferDescription& description);
+
+    // The accesses are copied. Several accesses of a pass to the same resource are merged.
+    void AddPass(const VulkanGraphPass& pass);
+
+    // 'frameSerial': of the frame being recorded (see VulkanDestructionQueue).
+    void Compile(const uint64_t frameSerial);
+
+    // Records the passes which have not been culled, and the barriers between them.
+    void Execute(VkCommandBuffer commandBuffer) const;
+
+    // Valid once the graph has been compiled.
+    VkImage     GetImage(const VulkanGraphResource resource) const;
+    VkImageView GetImageView(const VulkanGraphResource resource) const;
+    VkBuffer    GetBuffer(const VulkanGraphResource resource) const;
+
+    // Of the most recent compilation.
+    const VulkanRenderGraphStatistics& Statistics() const;
+
+    // Scheduling. The state of the graph is plain data, and the steps of the compilation which do not
+    // create resources are static functions of it.
+
+    struct Resource
+    {
+        string_t                     name;
+        bool                         isImage;
+        bool                         isTransient;
+        VkImage                      image;
+        VkImageView                  view;
+        VkBuffer                     buffer;
+        VkImageAspectFlags           aspect;
+        VkImageLayout                initialLayout;
+        VkPipelineStageFlags         initialStages;
+        VkImageLayout                finalLayout;
+        VulkanGraphImageDescription  imageDescription;
+        VulkanGraphBufferDescription bufferDescription;
+        VkFlags                      usageFlags;   // VkImageUsageFlags or VkBufferUsageFlags
+        uint32_t                     firstPass;    // Lifetime (among the passes which have not been culled)
+        uint32_t                     lastPass;
+    };
+
+    // Merged accesses of a pass to a resource.
+    struct Access
+    {
+        VulkanGraphResource          resource;
+        VkPipelineStageFlags         stages;
+        VkAccessFlags                access;
+        VkImageLayout                layout;
+        bool                         isWrite;
+    };
+
+    // Pipeline barrier recorded before a pass (or after the last one).
+    struct Barrier
+    {
+        VkPipelineStageFlags         srcStages;         // 0 if there is no barrier
+        VkPipelineStageFlags         dstStages;
+        VkAccessFlags                srcAccess;         // Of the global memory barrier
+        VkAccessFlags                dstAccess;
+        uint32_t                     firstImageBarrier;
+        uint32_t                     imageBarrierCount;
+    };
+
+    struct Pass
+    {
+        string_t                     name;
+        VulkanGraphPassFunction      record;
+        void*                        userData;
+        bool                         hasSideEffects;
+        bool                         isCulled;
+        uint32_t                     accessCount;
+        Access                       accesses[VK_MAX_RENDER_GRAPH_ACCESSES];
+        Barrier                      barrier;
+    };
+
+    // Transient resources of the current layout of the graph.
+    struct Transient
+    {
+        VkImage                      image;
+        VkImageView                  view;
+        VkBuffer                     buffer;
+        VkDeviceSize                 offset;       // Within the heap, or UINT64_MAX for a separate allocation
+        VkDeviceSize                 size;
+        VulkanAllocation             allocation;   // Separate allocation
+        VkPipelineStageFlags         lastStages;   // Of the last accesses in a frame (accumulated across frames)
+        VkAccessFlags                lastWrites;
+    };
+
+    // Marks the passes whose outputs are never consumed as culled. Returns the number of culled passes.
+    static uint32_t CullPasses(Pass* passes, const uint32_t passCount, const Resource* resources,
+                               const uint32_t resourceCount);
+
+    // Computes the range of passes (which have not been culled) accessing each resource.
+    // Resources which are not accessed get firstPass = UINT32_MAX.
+    static void ComputeLifetimes(const Pass* passes, const uint32_t passCount, Resource* resources,
+                                 const uint32_t resourceCount);
+
+    // Places the transient resources 'indices' into a shared heap, largest first. Each one goes to the lowest
+    // offset which does not overlap the resources placed so far whose lifetimes overlap its own.
+    // 'requirements' are indexed by resource, and must already respect the buffer-image granularity.
+    // Writes the offsets and sizes of 'transients' (the offset is UINT64_MAX for resources which cannot use
+    // the memory type of the heap), and returns the requirements of the heap (its size is 0 if it is empty).
+    static VkMemoryRequirements PlaceTransients(const Resource* resources, const uint32_t* indices,
+                                                const uint32_t count, const VkMemoryRequirements* requirements,
+                                                Transient* transients);
+
+    // Computes the barrier of each pass (which has not been culled), and the final barrier.
+    // Accumulates the last accesses of the frame into 'transients' (indexed by resource).
+    // The image barriers are written to 'imageBarriers'. Returns their number.
+    static uint32_t ComputeBarriers(Pass* passes, const uint32_t passCount, const Resource* resources,
+                                    const uint32_t resourceCount, Transient* transients,
+                                    VkImageMemoryBarrier* imageBarriers, Barrier* finalBarrier);
+
+private:
+
+    uint64_t HashTransients() const;
+    void     CreateTransients();
+    void     RetireTransients(const uint64_t frameSerial);
+    void     CountBarrier(const Barrier& barrier);
+    void     RecordBarrier(VkCommandBuffer commandBuffer, const Barrier& barrier) const;
+
+    RenderGraphDevice*           m_device;
+    VkDeviceSize                 m_bufferImageGranularity;
+    uint32_t                     m_passCount;
+    Pass                         m_passes[VK_MAX_RENDER_GRAPH_PASSES];
+    uint32_t                     m_resourceCount;
+    Resource                     m_resources[VK_MAX_RENDER_GRAPH_RESOURCES];
+    uint32_t                     m_imageBarrierCount;
+    VkImageMemoryBarrier         m_imageBarriers[VK_MAX_RENDER_GRAPH_PASSES * VK_MAX_RENDER_GRAPH_ACCESSES];
+    Barrier                      m_finalBarrier;    // Transitions the imported images to their final layouts
+    uint64_t                     m_transientHash;   // Of the current layout of the transient resources
+    uint32_t                     m_transientCount;
+    Transient                    m_transients[VK_MAX_RENDER_GRAPH_RESOURCES]; // Indexed by resource
+    VulkanAllocation             m_heap;            // Shared by the transient resources
+    VulkanRenderGraphStatistics  m_statistics;
+};
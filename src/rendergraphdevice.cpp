@@ -0,0 +1,131 @@
+#include "rendergraphdevice.h"
+#include "utility.h"
+
+void VulkanRenderGraphDevice::Create(VkDevice device, const VkAllocationCallbacks* allocator,
+                                     VulkanMemoryAllocator* memoryAllocator,
+                                     VulkanDestructionQueue* destructionQueue, VulkanGpuProfiler* profiler)
+{
+    m_device           = device;
+    m_allocator        = allocator;
+    m_memoryAllocator  = memoryAllocator;
+    m_destructionQueue = destructionQueue;
+    m_profiler         = profiler;
+}
+
+VkImage VulkanRenderGraphDevice::CreateImage(string_t name, const VkImageCreateInfo& imageInfo,
+                                             VkMemoryRequirements* requirements)
+{
+    VkImage image;
+
+    CHECK_INT(vkCreateImage(m_device, &imageInfo, m_allocator, &image),
+              "Failed to create the transient image \'%s\'.", name);
+
+    vkGetImageMemoryRequirements(m_device, image, requirements);
+
+    return image;
+}
+
+VkBuffer VulkanRenderGraphDevice::CreateBuffer(string_t name, const VkBufferCreateInfo& bufferInfo,
+                                               VkMemoryRequirements* requirements)
+{
+    VkBuffer buffer;
+
+    CHECK_INT(vkCreateBuffer(m_device, &bufferInfo, m_allocator, &buffer),
+              "Failed to create the transient buffer \'%s\'.", name);
+
+    vkGetBufferMemoryRequirements(m_device, buffer, requirements);
+
+    return buffer;
+}
+
+VulkanAllocation VulkanRenderGraphDevice::Allocate(string_t name, const VkMemoryRequirements& requirements,
+                                                   const bool optimalImage, const bool dedicated)
+{
+    VulkanAllocation allocation;
+
+    CHECK_INT(m_memoryAllocator->Allocate(requirements, VK_MEMORY_USAGE_GPU_ONLY, optimalImage, dedicated, this,
+                                          &allocation),
+              "Failed to allocate %llu bytes of memory for \'%s\'.",
+              static_cast<unsigned long long>(requirements.size), name);
+
+    return allocation;
+}
+
+void VulkanRenderGraphDevice::BindImageMemory(string_t name, VkImage image, const VulkanAllocation& allocation,
+                                              const VkDeviceSize offset)
+{
+    CHECK_INT(vkBindImageMemory(m_device, image, allocation.memory, allocation.offset + offset),
+              "Failed to bind the memory of the transient image \'%s\'.", name);
+}
+
+void VulkanRenderGraphDevice::BindBufferMemory(string_t name, VkBuffer buffer, const VulkanAllocation& allocation,
+                                               const VkDeviceSize offset)
+{
+    CHECK_INT(vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset + offset),
+              "Failed to bind the memory of the transient buffer \'%s\'.", name);
+}
+
+VkImageView VulkanRenderGraphDevice::CreateImageView(string_t name, const VkImageViewCreateInfo& viewInfo)
+{
+    VkImageView view;
+
+    CHECK_INT(vkCreateImageView(m_device, &viewInfo, m_allocator, &view),
+              "Failed to create a view of the transient image \'%s\'.", name);
+
+    return view;
+}
+
+void VulkanRenderGraphDevice::Retire(VkImage image, VkImageView view, VkBuffer buffer,
+                                     const VulkanAllocation& allocation, const uint64_t frameSerial)
+{
+    if (view)
+    {
+        m_destructionQueue->Enqueue(VK_OBJECT_TYPE_IMAGE_VIEW, view, frameSerial);
+    }
+
+    if (image)
+    {
+        m_destructionQueue->Enqueue(VK_OBJECT_TYPE_IMAGE, image, frameSerial);
+    }
+
+    if (buffer)
+    {
+        m_destructionQueue->Enqueue(VK_OBJECT_TYPE_BUFFER, buffer, frameSerial);
+    }
+
+    if (allocation.memory)
+    {
+        m_destructionQueue->EnqueueAllocation(allocation, frameSerial);
+    }
+}
+
+void VulkanRenderGraphDevice::DestroyRetired()
+{
+    m_destructionQueue->Collect(UINT64_MAX);
+}
+
+void VulkanRenderGraphDevice::PipelineBarrier(VkCommandBuffer commandBuffer, const VkPipelineStageFlags srcStages,
+                                              const VkPipelineStageFlags dstStages,
+                                              const VkMemoryBarrier* memoryBarrier,
+                                              const uint32_t imageBarrierCount,
+                                              const VkImageMemoryBarrier* imageBarriers)
+{
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, memoryBarrier ? 1 : 0, memoryBarrier,
+                         0, nullptr, imageBarrierCount, imageBarriers);
+}
+
+void VulkanRenderGraphDevice::BeginPass(VkCommandBuffer commandBuffer, string_t name)
+{
+    if (m_profiler)
+    {
+        m_profiler->BeginScope(commandBuffer, name);
+    }
+}
+
+void VulkanRenderGraphDevice::EndPass(VkCommandBuffer commandBuffer)
+{
+    if (m_profiler)
+    {
+        m_profiler->EndScope(commandBuffer);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "destructionqueue.h"
+#include "gpuprofiler.h"
+#include "rendergraph.h"
+
+// Implements the device-side operations of the render graph with the Vulkan device.
+// Memory comes from the memory allocator, and retired objects go through the destruction queue.
+class VulkanRenderGraphDevice : public RenderGraphDevice
+{
+public:
+
+    // 'profiler': times each pass (optional).
+    void Create(VkDevice device, const VkAllocationCallbacks* allocator, VulkanMemoryAllocator* memoryAllocator,
+                VulkanDestructionQueue* destructionQueue, VulkanGpuProfiler* profiler);
+
+    virtual VkImage          CreateImage(string_t name, const VkImageCreateInfo& imageInfo,
+                                         VkMemoryRequirements* requirements) final;
+    virtual VkBuffer         CreateBuffer(string_t name, const VkBufferCreateInfo& bufferInfo,
+                                          VkMemoryRequirements* requirements) final;
+    virtual VulkanAllocation Allocate(string_t name, const VkMemoryRequirements& requirements,
+                                      const bool optimalImage, const bool dedicated) final;
+    virtual void             BindImageMemory(string_t name, VkImage image, const VulkanAllocation& allocation,
+                                             const VkDeviceSize offset) final;
+    virtual void             BindBufferMemory(string_t name, VkBuffer buffer, const VulkanAllocation& allocation,
+                                              const VkDeviceSize offset) final;
+    virtual VkImageView      CreateImageView(string_t name, const VkImageViewCreateInfo& viewInfo) final;
+    virtual void             Retire(VkImage image, VkImageView view, VkBuffer buffer,
+                                    const VulkanAllocation& allocation, const uint64_t frameSerial) final;
+    virtual void             DestroyRetired() final;
+    virtual void             PipelineBarrier(VkCommandBuffer commandBuffer, const VkPipelineStageFlags srcStages,
+                                             const VkPipelineStageFlags dstStages,
+                                             const VkMemoryBarrier* memoryBarrier, const uint32_t imageBarrierCount,
+                                             const VkImageMemoryBarrier* imageBarriers) final;
+    virtual void             BeginPass(VkCommandBuffer commandBuffer, string_t name) final;
+    virtual void             EndPass(VkCommandBuffer commandBuffer) final;
+
+private:
+
+    VkDevice                     m_device;
+    const VkAllocationCallbacks* m_allocator;
+    VulkanMemoryAllocator*       m_memoryAllocator;
+    VulkanDestructionQueue*      m_destructionQueue;
+    VulkanGpuProfiler*           m_profiler;
+};
@@ -0,0 +1,364 @@
+#include "scene.h"
+#include "tracer.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+// Handle layout: the level (upper 8 bits) and the index within the level (lower 24 bits).
+#define SCENE_INDEX_BITS 24
+#define SCENE_MAX_NODES_PER_LEVEL (1u << SCENE_INDEX_BITS)
+
+static_assert(SCENE_MAX_LEVELS <= (1u << (32 - SCENE_INDEX_BITS)), "The level does not fit into the handle.");
+
+static inline SceneNode MakeNode(const uint32_t level, const uint32_t index)
+{
+    return (level << SCENE_INDEX_BITS) | index;
+}
+
+static inline uint32_t NodeLevel(const SceneNode node)
+{
+    return node >> SCENE_INDEX_BITS;
+}
+
+static inline uint32_t NodeIndex(const SceneNode node)
+{
+    return node & (SCENE_MAX_NODES_PER_LEVEL - 1);
+}
+
+void Scene::Create(JobSystem* jobSystem)
+{
+    m_jobSystem     = jobSystem;
+    m_levelCount    = 0;
+    m_nodeCount     = 0;
+    m_updateSerial  = 1; // The nodes are created with the serial 0
+    m_updatingLevel = 0;
+    m_workerOutputs = new WorkerOutput[jobSystem->WorkerCount()];
+    m_statistics    = {};
+}
+
+void Scene::Destroy()
+{
+    for (uint32_t l = 0; l < m_levelCount; l++)
+    {
+        m_levels[l] = Level();
+    }
+
+    delete[] m_workerOutputs;
+
+    m_workerOutputs = nullptr;
+    m_levelCount    = 0;
+    m_nodeCount     = 0;
+}
+
+SceneNode Scene::AddNode(const SceneNode parent, const SceneTransform& localTransform, const Vec4 localBounds,
+                         const SceneRenderData& renderData)
+{
+    uint32_t l = 0;
+
+    if (parent != SCENE_INVALID_NODE)
+    {
+        assert(NodeLevel(parent) < m_levelCount);
+
+        l = NodeLevel(parent) + 1;
+
+        ASSERT(l < SCENE_MAX_LEVELS, "The scene hierarchy is too deep (%u levels at most).", SCENE_MAX_LEVELS);
+    }
+
+    Level& level = m_levels[l];
+
+    const uint32_t index = static_cast<uint32_t>(level.parents.size());
+
+    ASSERT(index < SCENE_MAX_NODES_PER_LEVEL, "Too many scene nodes in a level (%u at most).",
+           SCENE_MAX_NODES_PER_LEVEL);
+
+    uint32_t nextSibling = SCENE_INVALID_NODE;
+
+    // Link the node to its parent.
+    if (parent != SCENE_INVALID_NODE)
+    {
+        uint32_t& firstChild = m_levels[l - 1].firstChildren[NodeIndex(parent)];
+
+        nextSibling = firstChild;
+        firstChild  = index;
+    }
+
+    level.parents.push_back((parent != SCENE_INVALID_NODE) ? NodeIndex(parent) : SCENE_INVALID_NODE);
+    level.firstChildren.push_back(SCENE_INVALID_NODE);
+    level.nextSiblings.push_back(nextSibling);
+    level.localTransforms.push_back(localTransform);
+    level.localBounds.push_back(localBounds);
+    level.worldMatrices.push_back(Identity());
+    level.worldBoundsX.push_back(0.0f);
+    level.worldBoundsY.push_back(0.0f);
+    level.worldBoundsZ.push_back(0.0f);
+    level.worldRadii.push_back(0.0f);
+    level.renderData.push_back(renderData);
+    level.queuedSerials.push_back(0);
+
+    m_levelCount = std::max(m_levelCount, l + 1);
+    m_nodeCount++;
+
+    const SceneNode node = MakeNode(l, index);
+
+    // The world transform is unknown.
+    SetLocalTransform(node, localTransform);
+
+    return node;
+}
+
+const SceneTransform& Scene::GetLocalTransform(const SceneNode node) const
+{
+    assert(NodeLevel(node) < m_levelCount);
+
+    return m_levels[NodeLevel(node)].localTransforms[NodeIndex(node)];
+}
+
+void Scene::SetLocalTransform(const SceneNode node, const SceneTransform& localTransform)
+{
+    assert(NodeLevel(node) < m_levelCount);
+
+    Level&         level = m_levels[NodeLevel(node)];
+    const uint32_t index = NodeIndex(node);
+
+    level.localTransforms[index] = localTransform;
+
+    // Queue the node once per update.
+    if (level.queuedSerials[index] != m_updateSerial)
+    {
+        level.queuedSerials[index] = m_updateSerial;
+        level.dirtyNodes.push_back(index);
+    }
+}
+
+void Scene::UpdateLevel(void* data, const uint32_t begin, const uint32_t end)
+{
+    TRACE_FUNCTION();
+
+    Scene* scene = static_cast<Scene*>(data);
+
+    const uint32_t l           = scene->m_updatingLevel;
+    const uint32_t serial      = scene->m_updateSerial;
+    Level&         level       = scene->m_levels[l];
+    const Level*   parentLevel = (l > 0) ? &scene->m_levels[l - 1] : nullptr;
+    Level*         childLevel  = (l + 1 < scene->m_levelCount) ? &scene->m_levels[l + 1] : nullptr;
+
+    std::vector<uint32_t>& dirtyChildren = scene->m_workerOutputs[JobSystem::WorkerIndex()].dirtyChildren;
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const uint32_t        n     = level.dirtyNodes[i];
+        const SceneTransform& local = level.localTransforms[n];
+
+        Mat4 world = Compose(local.translation, local.rotation, local.scale);
+
+        if (parentLevel)
+        {
+            world = parentLevel->worldMatrices[level.parents[n]] * world;
+        }
+
+        level.worldMatrices[n] = world;
+
+        // The radius grows with the largest scale of the axes.
+        const Vec4  bounds   = level.localBounds[n];
+        const Vec4  center   = world * MakeVec4(GetElement(bounds, 0), GetElement(bounds, 1),
+                                                GetElement(bounds, 2), 1.0f);
+        const float maxScale = sqrtf(std::max({ Dot3(world.c[0], world.c[0]), Dot3(world.c[1], world.c[1]),
+                                                Dot3(world.c[2], world.c[2]) }));
+
+        level.worldBoundsX[n] = GetElement(center, 0);
+        level.worldBoundsY[n] = GetElement(center, 1);
+        level.worldBoundsZ[n] = GetElement(center, 2);
+        level.worldRadii[n]   = GetElement(bounds, 3) * maxScale;
+
+        if (!childLevel) continue;
+
+        // The children depend on the world transform. A child has a single parent,
+        // so its serial is only written by the worker updating the parent.
+        for (uint32_t child = level.firstChildren[n]; child != SCENE_INVALID_NODE;
+             child = childLevel->nextSiblings[child])
+        {
+            if (childLevel->queuedSerials[child] != serial)
+            {
+                childLevel->queuedSerials[child] = serial;
+                dirtyChildren.push_back(child);
+            }
+        }
+    }
+}
+
+void Scene::UpdateTransforms()
+{
+    TRACE_FUNCTION();
+
+    m_statistics = { m_nodeCount, m_levelCount, 0, 0 };
+
+    for (uint32_t l = 0; l < m_levelCount; l++)
+    {
+        m_statistics.dirtyCount += static_cast<uint32_t>(m_levels[l].dirtyNodes.size());
+    }
+
+    for (uint32_t l = 0; l < m_levelCount; l++)
+    {
+        Level& level = m_levels[l];
+
+        const uint32_t dirtyCount = static_cast<uint32_t>(level.dirtyNodes.size());
+
+        if (dirtyCount == 0) continue;
+
+        m_updatingLevel = l;
+
+        // The nodes of a level are independent.
+        if (dirtyCount <= SCENE_UPDATE_BATCH_SIZE)
+        {
+            UpdateLevel(this, 0, dirtyCount);
+        }
+        else
+        {
+            JobCounter counter{ 0 };
+
+            m_jobSystem->ParallelFor(dirtyCount, SCENE_UPDATE_BATCH_SIZE, UpdateLevel, this, &counter);
+            m_jobSystem->Wait(counter);
+        }
+
+        m_statistics.updatedCount += dirtyCount;
+
+        level.dirtyNodes.clear();
+
+        if (l + 1 == m_levelCount) continue;
+
+        // Queue the children after the dirty nodes of the next level.
+        std::vector<uint32_t>& nextDirtyNodes = m_levels[l + 1].dirtyNodes;
+
+        for (uint32_t w = 0; w < m_jobSystem->WorkerCount(); w++)
+        {
+            std::vector<uint32_t>& dirtyChildren = m_workerOutputs[w].dirtyChildren;
+
+            nextDirtyNodes.insert(nextDirtyNodes.end(), dirtyChildren.begin(), dirtyChildren.end());
+            dirtyChildren.clear();
+        }
+    }
+
+    m_updateSerial++;
+}
+
+const Mat4& Scene::GetWorldMatrix(const SceneNode node) const
+{
+    assert(NodeLevel(node) < m_levelCount);
+
+    return m_levels[NodeLevel(node)].worldMatrices[NodeIndex(node)];
+}
+
+uint32_t Scene::LevelCount() const
+{
+    return m_levelCount;
+}
+
+SphereBoundsSoA Scene::WorldBounds(const uint32_t level, uint32_t* count) const
+{
+    assert(level < m_levelCount);
+
+    const Level& l = m_levels[level];
+
+    *count = static_cast<uint32_t>(l.worldRadii.size());
+
+    return { l.worldBoundsX.data(), l.worldBoundsY.data(), l.worldBoundsZ.data(), l.worldRadii.data() };
+}
+
+const SceneRenderData* Scene::RenderData(const uint32_t level) const
+{
+    assert(level < m_levelCount);
+
+    return m_levels[level].renderData.data();
+}
+
+SceneStatistics Scene::Statistics() const
+{
+    return m_statistics;
+}
+
+void BenchmarkScene(JobSystem* jobSystem, const uint32_t nodeCount)
+{
+    using Clock = std::chrono::steady_clock;
+
+    ASSERT(nodeCount > 0, "The benchmark requires nodes.");
+
+    Scene scene;
+    scene.Create(jobSystem);
+
+    // Deterministic hierarchy: roots with 4 children each, and so on, down to the last node.
+    const uint32_t rootCount = std::max(1u, nodeCount / 85); // ~4 levels
+
+    std::vector<SceneNode> nodes(nodeCount);
+
+    uint32_t seed = 1;
+
+    const auto random = [&seed](const float min, const float max)
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+        return min + (max - min) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+    };
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        const SceneNode parent = (i < rootCount) ? SCENE_INVALID_NODE : nodes[(i - rootCount) / 4];
+        const float     extent = (i < rootCount) ? 250.0f : 10.0f;
+
+        const SceneTransform local = { MakeVec4(random(-extent, extent), random(-extent, extent),
+                                                random(-extent, extent), 0.0f),
+                                       MakeVec4(0.0f, 0.0f, 0.0f, 1.0f), Splat(1.0f) };
+
+        nodes[i] = scene.AddNode(parent, local, MakeVec4(0.0f, 0.0f, 0.0f, random(0.5f, 2.0f)), { i, 0 });
+    }
+
+    scene.UpdateTransforms();
+
+    PrintInfo("Scene benchmark (%u nodes, %u levels, %u workers):", nodeCount, scene.LevelCount(),
+              jobSystem->WorkerCount());
+
+    const uint32_t fractions[] = { 0, 1, 10, 100 }; // Percentage of moving nodes
+    const uint32_t frameCount  = 20;
+
+    for (const uint32_t fraction : fractions)
+    {
+        double          totalTime  = 0.0;
+        SceneStatistics statistics = {};
+
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            // Spin the moving nodes around their vertical axes.
+            const float angle    = 0.01f * static_cast<float>(frame + 1);
+            const Vec4  rotation = MakeVec4(0.0f, sinf(0.5f * angle), 0.0f, cosf(0.5f * angle));
+
+            for (uint32_t i = 0; i < nodeCount; i++)
+            {
+                // Spread over the hierarchy (Knuth's multiplicative hash).
+                if ((i * 2654435761u) % 100 < fraction)
+                {
+                    SceneTransform local = scene.GetLocalTransform(nodes[i]);
+                    local.rotation = rotation;
+
+                    scene.SetLocalTransform(nodes[i], local);
+                }
+            }
+
+            const Clock::time_point start = Clock::now();
+
+            scene.UpdateTransforms();
+
+            const std::chrono::duration<double, std::milli> duration = Clock::now() - start;
+
+            totalTime += duration.count();
+            statistics = scene.Statistics();
+        }
+
+        const double averageTime = totalTime / frameCount;
+
+        PrintInfo("  %3u%% moving: %8u dirty, %8u updated | %8.3f ms | %6.1f ns per updated node", fraction,
+                  statistics.dirtyCount, statistics.updatedCount, averageTime,
+                  (statistics.updatedCount > 0) ? 1e6 * averageTime / statistics.updatedCount : 0.0);
+    }
+
+    scene.Destroy();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "cullingkernels.h"
+#include "jobsystem.h"
+#include "vectormath.h"
+
+#include <vector>
+
+#define SCENE_MAX_LEVELS        32          // Depth of the hierarchy
+#define SCENE_UPDATE_BATCH_SIZE 512         // Nodes per job of the transform update
+#define SCENE_INVALID_NODE      UINT32_MAX
+
+// Handle of a node: its level and its index within the level. Stable (nodes never move).
+using SceneNode = uint32_t;
+
+struct SceneTransform
+{
+    Vec4                  translation;  // 'w' is ignored
+    Vec4                  rotation;     // Unit quaternion
+    Vec4                  scale;        // 'w' is ignored
+};
+
+struct SceneRenderData
+{
+    uint32_t              mesh;
+    uint32_t              material;
+};
+
+struct SceneStatistics
+{
+    uint32_t              nodeCount;
+    uint32_t              levelCount;
+    uint32_t              dirtyCount;   // Nodes whose local transforms changed before the last update
+    uint32_t              updatedCount; // World transforms computed by the last update (the descendants included)
+};
+
+// Scene storage, data-oriented. The nodes are grouped by their depth in the hierarchy (their level),
+// and each level stores its transforms, bounds and render data in contiguous structure-of-arrays pools,
+// so that a level is updated in one linear pass, and its bounds can be culled directly (see CullSpheres()).
+// The world transforms are updated level by level, the nodes of each level in parallel,
+// since they only depend on the (already updated) previous level.
+// Only the nodes whose local transforms have changed, and their descendants, are updated:
+// each level keeps a list of its dirty nodes, so static nodes are never visited.
+// Nodes cannot be removed. Not thread-safe, except for UpdateTransforms(), which uses the job system internally.
+class Scene
+{
+public:
+
+    void Create(JobSystem* jobSystem);
+    void Destroy();
+
+    // 'parent': SCENE_INVALID_NODE for a root. 'localBounds': bounding sphere (center and radius) in local space.
+    // The world transform is computed by the next update.
+    SceneNode AddNode(const SceneNode parent, const SceneTransform& localTransform, const Vec4 localBounds,
+                      const SceneRenderData& renderData);
+
+    const SceneTransform& GetLocalTransform(const SceneNode node) const;
+
+    // The node (and its descendants) is updated by the next update.
+    void SetLocalTransform(const SceneNode node, const SceneTransform& localTransform);
+
+    // Computes the world transforms and bounds of the dirty nodes and of their descendants.
+    // Must be called by the thread which created the job system.
+    void UpdateTransforms();
+
+    // Valid once updated.
+    const Mat4& GetWorldMatrix(const SceneNode node) const;
+
+    uint32_t LevelCount() const;
+
+    // The world bounding spheres of the nodes of the level, and their number.
+    SphereBoundsSoA WorldBounds(const uint32_t level, uint32_t* count) const;
+
+    const SceneRenderData* RenderData(const uint32_t level) const;
+
+    // Of the last update.
+    SceneStatistics Statistics() const;
+
+private:
+
+    // Structure of arrays; all the arrays have the same size.
+    struct Level
+    {
+        std::vector<uint32_t>        parents;       // Index in the previous level
+        std::vector<uint32_t>        firstChildren; // Index in the next level (or SCENE_INVALID_NODE)
+        std::vector<uint32_t>        nextSiblings;  // Index in this level (or SCENE_INVALID_NODE)
+        std::vector<SceneTransform>  localTransforms;
+        std::vector<Vec4>            localBounds;
+        std::vector<Mat4>            worldMatrices;
+        std::vector<float>           worldBoundsX;
+        std::vector<float>           worldBoundsY;
+        std::vector<float>           worldBoundsZ;
+        std::vector<float>           worldRadii;
+        std::vector<SceneRenderData> renderData;
+        std::vector<uint32_t>        queuedSerials; // The serial of the update which updates the node
+        std::vector<uint32_t>        dirtyNodes;    // Updated by the next update
+    };
+
+    // Children of the dirty nodes of a level, found by a single worker.
+    struct alignas(64) WorkerOutput
+    {
+        std::vector<uint32_t>        dirtyChildren;
+    };
+
+    static void UpdateLevel(void* data, const uint32_t begin, const uint32_t end);
+
+    JobSystem*                       m_jobSystem;
+    Level                            m_levels[SCENE_MAX_LEVELS];
+    uint32_t                         m_levelCount;
+    uint32_t                         m_nodeCount;
+    uint32_t                         m_updateSerial;   // Of the next update
+    uint32_t                         m_updatingLevel;  // During the update
+    WorkerOutput*                    m_workerOutputs;  // One per worker
+    SceneStatistics                  m_statistics;
+};
+
+// Measures the update of the transforms of a scene of 'nodeCount' nodes with different fractions of moving nodes,
+// using all the workers of the job system. Prints a report.
+void BenchmarkScene(JobSystem* jobSystem, const uint32_t nodeCount);
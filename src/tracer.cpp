@@ -0,0 +1,220 @@
+#include "tracer.h"
+
+#ifdef MAGMA_TRACING
+
+#include "utility.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+
+// Must be a power of 2. Once full, the ring buffer overwrites the oldest zones.
+#define TRACE_MAX_EVENTS_PER_TRACK (1 << 16)
+
+struct TraceEvent
+{
+    string_t name;
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+// Each track is written by a single thread, and read by the exporter.
+struct TraceTrack
+{
+    std::atomic<uint64_t> eventCount; // Total number of recorded events (wraps around the ring buffer)
+    TraceTrack*           next;       // Intrusive list of all tracks
+    uint32_t              id;
+    bool                  isThread;
+    string_t              name;
+    TraceEvent            events[TRACE_MAX_EVENTS_PER_TRACK];
+};
+
+static std::atomic<bool>        g_traceEnabled{ false };
+static std::atomic<TraceTrack*> g_traceTracks{ nullptr };
+static std::atomic<uint32_t>    g_traceTrackCount{ 0 };
+
+static thread_local TraceTrack* t_traceThreadTrack = nullptr;
+static thread_local string_t    t_traceThreadName  = nullptr; // Until the track is allocated
+
+// Tracks are never freed: zones may be exported after their thread exits.
+static TraceTrack* AllocateTrack(string_t name, const bool isThread)
+{
+    TraceTrack* track = new TraceTrack;
+    track->eventCount.store(0, std::memory_order_relaxed);
+    track->id         = g_traceTrackCount.fetch_add(1, std::memory_order_relaxed);
+    track->isThread   = isThread;
+    track->name       = name;
+
+    // Lock-free push to the front of the list.
+    TraceTrack* head = g_traceTracks.load(std::memory_order_relaxed);
+
+    do
+    {
+        track->next = head;
+    } while (!g_traceTracks.compare_exchange_weak(head, track, std::memory_order_release,
+                                                               std::memory_order_relaxed));
+
+    return track;
+}
+
+// Allocated along with the first zone of the thread, so that the threads which never record any
+// (e.g. while tracing is disabled) do not hold a track.
+static TraceTrack* ThreadTrack()
+{
+    if (!t_traceThreadTrack)
+    {
+        t_traceThreadTrack = AllocateTrack(t_traceThreadName, true);
+    }
+
+    return t_traceThreadTrack;
+}
+
+static inline void RecordEvent(TraceTrack* track, string_t name, const uint64_t beginNs, const uint64_t endNs)
+{
+    // Single producer: only the owner of the track increments the count.
+    const uint64_t index = track->eventCount.load(std::memory_order_relaxed);
+
+    TraceEvent& event = track->events[index & (TRACE_MAX_EVENTS_PER_TRACK - 1)];
+    event.name    = name;
+    event.beginNs = beginNs;
+    event.endNs   = endNs;
+
+    // Publish the event to the exporter.
+    track->eventCount.store(index + 1, std::memory_order_release);
+}
+
+void TraceEnable(const bool enable)
+{
+    g_traceEnabled.store(enable, std::memory_order_relaxed);
+}
+
+bool TraceIsEnabled()
+{
+    return g_traceEnabled.load(std::memory_order_relaxed);
+}
+
+uint64_t TraceNow()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+void TraceSetThreadName(string_t name)
+{
+    t_traceThreadName = name;
+
+    if (t_traceThreadTrack)
+    {
+        t_traceThreadTrack->name = name;
+    }
+}
+
+TraceTrack* TraceCreateTrack(string_t name)
+{
+    return AllocateTrack(name, false);
+}
+
+void TraceRecordZone(TraceTrack* track, string_t name, const uint64_t beginNs, const uint64_t endNs)
+{
+    if (track && TraceIsEnabled())
+    {
+        RecordEvent(track, name, beginNs, endNs);
+    }
+}
+
+TraceZone::TraceZone(string_t name)
+{
+    m_name    = name;
+    m_beginNs = TraceIsEnabled() ? TraceNow() : 0;
+}
+
+TraceZone::~TraceZone()
+{
+    if (m_beginNs)
+    {
+        RecordEvent(ThreadTrack(), m_name, m_beginNs, TraceNow());
+    }
+}
+
+// Writes the string, escaping the characters JSON does not allow.
+static void WriteJsonString(FILE* file, string_t str)
+{
+    fputc('\"', file);
+
+    for (string_t c = str; *c; c++)
+    {
+        switch (*c)
+        {
+            case '\"': fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n",  file); break;
+            default:
+                if (static_cast<unsigned char>(*c) >= 0x20) fputc(*c, file);
+                break;
+        }
+    }
+
+    fputc('\"', file);
+}
+
+bool TraceWriteChromeJson(string_t path)
+{
+    FILE* file = OpenFile(path, "w");
+
+    if (!file)
+    {
+        PrintError("Failed to open the trace file \'%s\'.", path);
+        return false;
+    }
+
+    // CPU threads and other tracks are shown as separate processes.
+    constexpr uint32_t cpuProcessId = 0, otherProcessId = 1;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"args\":{\"name\":\"CPU\"}},\n",    cpuProcessId);
+    fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"args\":{\"name\":\"Tracks\"}}", otherProcessId);
+
+    for (TraceTrack* track = g_traceTracks.load(std::memory_order_acquire); track; track = track->next)
+    {
+        const uint32_t pid = track->isThread ? cpuProcessId : otherProcessId;
+
+        if (track->name)
+        {
+            fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":",
+                    pid, track->id);
+            WriteJsonString(file, track->name);
+            fputs("}}", file);
+        }
+
+        // Only the most recent events remain in the ring buffer.
+        const uint64_t end   = track->eventCount.load(std::memory_order_acquire);
+        const uint64_t begin = (end > TRACE_MAX_EVENTS_PER_TRACK) ? (end - TRACE_MAX_EVENTS_PER_TRACK) : 0;
+
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const TraceEvent& event = track->events[i & (TRACE_MAX_EVENTS_PER_TRACK - 1)];
+
+            // Complete events; the timestamps are in microseconds.
+            fputs(",\n{\"ph\":\"X\",\"name\":", file);
+            WriteJsonString(file, event.name);
+            fprintf(file, ",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", pid, track->id,
+                    1e-3 * static_cast<double>(event.beginNs),
+                    1e-3 * static_cast<double>(event.endNs - event.beginNs));
+        }
+    }
+
+    fputs("\n]}\n", file);
+
+    const bool success = (ferror(file) == 0);
+
+    fclose(file);
+
+    if (!success)
+    {
+        PrintError("Failed to write the trace file \'%s\'.", path);
+    }
+
+    return success;
+}
+
+#endif // MAGMA_TRACING
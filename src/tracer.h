@@ -0,0 +1,80 @@
+#pragma once
+
+#include "definitions.h"
+
+// CPU scoped-zone tracer.
+// Zones are recorded into per-thread ring buffers (no locks, no allocations after the first zone of a thread),
+// and can be exported in the Chrome trace event format (JSON), which can also be opened by Perfetto.
+// Timestamps are in nanoseconds of std::chrono::steady_clock: QueryPerformanceCounter() on Windows,
+// CLOCK_MONOTONIC on Linux. These are the host time domains of VK_EXT_calibrated_timestamps.
+// Tracing is compiled out unless MAGMA_TRACING is defined, and is disabled at run time by default.
+
+#define TRACE_CONCAT_INTERNAL(a, b) a##b
+#define TRACE_CONCAT(a, b)          TRACE_CONCAT_INTERNAL(a, b)
+
+#ifdef MAGMA_TRACING
+
+// Records the time spent in the enclosing scope. 'name' must point to a string literal.
+#define TRACE_SCOPE(name) const TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+
+// Records the time spent in the enclosing function.
+#define TRACE_FUNCTION()  TRACE_SCOPE(__func__)
+
+struct TraceTrack;
+
+// Enables or disables recording of the zones (for all threads).
+void TraceEnable(const bool enable);
+
+// Returns 'true' if the zones are being recorded.
+bool TraceIsEnabled();
+
+// Returns the current time (in nanoseconds).
+uint64_t TraceNow();
+
+// Names the calling thread. 'name' must point to a string literal (or a string which outlives the trace).
+// Allocates nothing: the track of the thread is only allocated once it records a zone.
+void TraceSetThreadName(string_t name);
+
+// Returns a track for zones which are not recorded by a CPU thread (e.g. GPU timings).
+// Zones may only be recorded into the track by one thread at a time. 'name' must point to a string literal.
+TraceTrack* TraceCreateTrack(string_t name);
+
+// Records a zone with explicit timestamps (in nanoseconds, see TraceNow()) into the track.
+void TraceRecordZone(TraceTrack* track, string_t name, const uint64_t beginNs, const uint64_t endNs);
+
+// Writes the recorded zones to the file in the Chrome trace event format.
+// The threads should not be recording at the same time. Returns 'false' on failure.
+bool TraceWriteChromeJson(string_t path);
+
+// For internal use only! Use TRACE_SCOPE() instead.
+class TraceZone
+{
+public:
+    explicit TraceZone(string_t name);
+    ~TraceZone();
+
+    TraceZone(const TraceZone&)            = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+
+    string_t m_name;
+    uint64_t m_beginNs; // 0 if tracing was disabled when the zone began
+};
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNCTION()  ((void)0)
+
+struct TraceTrack;
+
+static inline void        TraceEnable(const bool)                                                  {}
+static inline bool        TraceIsEnabled()                                                         { return false; }
+static inline uint64_t    TraceNow()                                                               { return 0; }
+static inline void        TraceSetThreadName(string_t)                                             {}
+static inline TraceTrack* TraceCreateTrack(string_t)                                               { return nullptr; }
+static inline void        TraceRecordZone(TraceTrack*, string_t, const uint64_t, const uint64_t)   {}
+static inline bool        TraceWriteChromeJson(string_t)                                           { return false; }
+
+#endif // MAGMA_TRACING
@@ -0,0 +1,100 @@
+#include "uploadring.h"
+#include "utility.h"
+
+#include <algorithm>
+
+void VulkanUploadRing::Create(VulkanMemoryAllocator* memoryAllocator, const VkPhysicalDeviceLimits& limits,
+                              const uint32_t frameCount, const VkDeviceSize frameSize)
+{
+    m_memoryAllocator  = memoryAllocator;
+    m_defaultAlignment = std::max({ limits.minUniformBufferOffsetAlignment,
+                                    limits.minStorageBufferOffsetAlignment,
+                                    limits.optimalBufferCopyOffsetAlignment,
+                                    VkDeviceSize{ 16 } });
+    m_frameSize        = (frameSize + m_defaultAlignment - 1) / m_defaultAlignment * m_defaultAlignment;
+    m_frameBegin       = 0;
+    m_peakUsage        = 0;
+
+    m_frameOffset.store(0, std::memory_order_relaxed);
+    m_overflowed.store(false, std::memory_order_relaxed);
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size               = frameCount * m_frameSize;
+    bufferInfo.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT  | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT  |
+                                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT   | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    bufferInfo.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    CHECK_INT(m_memoryAllocator->CreateBuffer(bufferInfo, VK_MEMORY_USAGE_CPU_TO_GPU, nullptr,
+                                              &m_buffer, &m_allocation),
+              "Failed to create the upload ring buffer.");
+
+    ASSERT(m_allocation.mapped, "The upload ring buffer is not host-visible.");
+}
+
+void VulkanUploadRing::Destroy()
+{
+    PrintInfo("Upload ring: peak usage %.2f of %.2f MiB per frame.",
+              static_cast<double>(m_peakUsage) / (1 << 20), static_cast<double>(m_frameSize) / (1 << 20));
+
+    m_memoryAllocator->DestroyBuffer(m_buffer, m_allocation);
+
+    m_buffer     = VK_NULL_HANDLE;
+    m_allocation = {};
+}
+
+void VulkanUploadRing::BeginFrame(const uint32_t frameIndex)
+{
+    // No other thread may allocate at this point.
+    const VkDeviceSize used = m_frameOffset.load(std::memory_order_relaxed);
+
+    m_peakUsage  = std::max(m_peakUsage, std::min(used, m_frameSize));
+    m_frameBegin = frameIndex * m_frameSize;
+
+    m_frameOffset.store(0, std::memory_order_relaxed);
+    m_overflowed.store(false, std::memory_order_relaxed);
+}
+
+VulkanUploadAllocation VulkanUploadRing::Allocate(const VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (alignment == 0) alignment = m_defaultAlignment;
+
+    VulkanUploadAllocation upload = {};
+
+    VkDeviceSize offset = m_frameOffset.load(std::memory_order_relaxed);
+    VkDeviceSize alignedOffset;
+
+    // Bump allocation. Alignment is relative to the beginning of the buffer.
+    do
+    {
+        alignedOffset = (m_frameBegin + offset + alignment - 1) / alignment * alignment - m_frameBegin;
+
+        if (alignedOffset + size > m_frameSize)
+        {
+            if (!m_overflowed.exchange(true, std::memory_order_relaxed))
+            {
+                PrintWarning("Upload ring: out of space (%llu bytes per frame).",
+                             static_cast<unsigned long long>(m_frameSize));
+            }
+
+            return upload;
+        }
+    } while (!m_frameOffset.compare_exchange_weak(offset, alignedOffset + size, std::memory_order_relaxed));
+
+    upload.buffer = m_buffer;
+    upload.offset = m_frameBegin + alignedOffset;
+    upload.data   = m_allocation.mapped + upload.offset;
+
+    return upload;
+}
+
+VkDeviceSize VulkanUploadRing::PeakUsage() const
+{
+    return m_peakUsage;
+}
+
+VkBuffer VulkanUploadRing::Buffer() const
+{
+    return m_buffer;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "memoryallocator.h"
+
+#include <atomic>
+
+#define VK_UPLOAD_RING_FRAME_SIZE (8u << 20) // Per frame in flight
+
+// Transient upload memory. Valid until the end of the frame it was allocated in.
+struct VulkanUploadAllocation
+{
+    VkBuffer     buffer;
+    VkDeviceSize offset; // Within 'buffer'
+    byte_t*      data;   // nullptr if the ring is full
+};
+
+// Persistently mapped, host-coherent ring buffer for per-frame constants and dynamic geometry.
+// The buffer is split into one region per frame in flight; a region is reclaimed in bulk
+// once the fence of the frame which used it has retired.
+// Allocations are lock-free, and may be performed by several threads recording the same frame.
+class VulkanUploadRing
+{
+public:
+
+    void Create(VulkanMemoryAllocator* memoryAllocator, const VkPhysicalDeviceLimits& limits,
+                const uint32_t frameCount, const VkDeviceSize frameSize = VK_UPLOAD_RING_FRAME_SIZE);
+    void Destroy();
+
+    // Switches to the region of the frame. The frame must have retired.
+    void BeginFrame(const uint32_t frameIndex);
+
+    // Sub-allocates 'size' bytes. If 'alignment' is 0, the allocation is suitably aligned for any use.
+    // Returns an allocation with 'data == nullptr' if the region of the frame is exhausted.
+    VulkanUploadAllocation Allocate(const VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    // Returns the maximal number of bytes used by a frame.
+    VkDeviceSize PeakUsage() const;
+
+    VkBuffer Buffer() const;
+
+private:
+
+    VulkanMemoryAllocator*    m_memoryAllocator;
+    VkBuffer                  m_buffer;
+    VulkanAllocation          m_allocation;
+    VkDeviceSize              m_frameSize;
+    VkDeviceSize              m_defaultAlignment;
+    VkDeviceSize              m_frameBegin;    // Offset of the region of the current frame
+    std::atomic<VkDeviceSize> m_frameOffset;   // Within the region of the current frame
+    VkDeviceSize              m_peakUsage;
+    std::atomic<bool>         m_overflowed;
+};
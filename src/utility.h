@@ -5,17 +5,37 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
-#include <malloc.h>
+
+#ifdef _MSC_VER
+    #include <malloc.h>
+#else
+    #include <alloca.h>
+    #include <csignal>
+#endif
+
+// Breaks into the debugger (if one is attached).
+#if defined(_MSC_VER)
+    #define DEBUG_BREAK() __debugbreak()
+#elif defined(_DEBUG)
+    #define DEBUG_BREAK() raise(SIGTRAP)
+#else
+    #define DEBUG_BREAK() ((void)0)
+#endif
 
 // For internal use only!
-static inline void PrintInternal(FILE* stream, string_t prefix, string_t fmt, const va_list args)
+static inline void PrintInternal(FILE* stream, string_t prefix, string_t fmt, va_list args)
 {
     // Print the time stamp.
     time_t rawTime;
     time(&rawTime);
     struct tm timeInfo;
+#ifdef _MSC_VER
     localtime_s(&timeInfo, &rawTime);
+#else
+    localtime_r(&rawTime, &timeInfo);
+#endif
     fprintf(stream, "[%i:%i:%i] ", timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec);
     // Print the prefix if there is one.
     if (prefix)
@@ -56,6 +76,30 @@ static inline void PrintError(string_t fmt, ...)
     fputs("\n", stderr);
 }
 
+// Opens the file (fopen() syntax). Returns nullptr on failure.
+static inline FILE* OpenFile(string_t path, string_t mode)
+{
+#ifdef _MSC_VER
+    FILE* file = nullptr;
+    return (fopen_s(&file, path, mode) == 0) ? file : nullptr;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+// Computes the 64-bit FNV-1a hash of the data. 'seed' allows the hashes to be chained.
+static inline uint64_t HashBytes(const void* data, const size_t size, uint64_t seed = 14695981039346656037ull)
+{
+    const byte_t* bytes = static_cast<const byte_t*>(data);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        seed = (seed ^ bytes[i]) * 1099511628211ull;
+    }
+
+    return seed;
+}
+
 // For internal use only!
 [[noreturn]] static inline void Panic(string_t file, const int line)
 {
@@ -66,29 +110,29 @@ static inline void PrintError(string_t fmt, ...)
 // Prints the location of the fatal error and terminates the program.
 #define TERMINATE() Panic(__FILE__, __LINE__)
 
-// Prints the C string 'errMsg' if the error code is not 0.
+// Prints the error message (printf syntax) if the error code is not 0.
 // Then prints the location of the fatal error and terminates the program.
-#define CHECK_INT(err, errMsg, ...)      \
+#define CHECK_INT(err, ...)              \
 do                                       \
 {                                        \
     volatile const sign_t result = err;  \
     if (result != 0)                     \
     {                                    \
-        PrintError(errMsg, __VA_ARGS__); \
-        __debugbreak();                  \
+        PrintError(__VA_ARGS__);         \
+        DEBUG_BREAK();                   \
         TERMINATE();                     \
     }                                    \
 } while (0)
 
-// Prints the C string 'errMsg' if the value is convertible to 'false'.
+// Prints the error message (printf syntax) if the value is convertible to 'false'.
 // Then prints the location of the fatal error and terminates the program.
-#define ASSERT(value, errMsg, ...)       \
+#define ASSERT(value, ...)               \
 do                                       \
 {                                        \
     if (!(value))                        \
     {                                    \
-        PrintError(errMsg, __VA_ARGS__); \
-        __debugbreak();                  \
+        PrintError(__VA_ARGS__);         \
+        DEBUG_BREAK();                   \
         TERMINATE();                     \
     }                                    \
 } while (0)
@@ -97,7 +141,11 @@ do                                       \
 template <typename T>
 T* StackAlloc(size_t count)
 {
+#ifdef _MSC_VER
     return static_cast<T*>(_alloca(count * sizeof(T)));
+#else
+    return static_cast<T*>(alloca(count * sizeof(T)));
+#endif
 }
 
 template <typename T>
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "definitions.h"
+
+#include <cmath>
+
+// The instruction set is selected at compile time: AVX2 if the compiler targets it (e.g. -mavx2, /arch:AVX2),
+// otherwise SSE2 on x86-64 (which always supports it), otherwise the scalar fallback.
+// Define MAGMA_NO_SIMD to force the scalar fallback.
+#if !defined(MAGMA_NO_SIMD) && defined(__AVX2__)
+    #define MAGMA_SIMD_AVX2
+    #define MAGMA_SIMD_SSE
+#elif !defined(MAGMA_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+    #define MAGMA_SIMD_SSE
+#endif
+
+#if defined(MAGMA_SIMD_AVX2)
+    #include <immintrin.h>
+    #define MAGMA_SIMD_WIDTH 8 // Floats per register of the culling kernels
+    #define MAGMA_SIMD_NAME  "AVX2"
+#elif defined(MAGMA_SIMD_SSE)
+    #include <emmintrin.h>
+    #define MAGMA_SIMD_WIDTH 4
+    #define MAGMA_SIMD_NAME  "SSE2"
+#else
+    #define MAGMA_SIMD_WIDTH 1
+    #define MAGMA_SIMD_NAME  "scalar"
+#endif
+
+// 4-component vector. With SSE, it is a register; it should be passed and returned by value.
+struct alignas(16) Vec4
+{
+#ifdef MAGMA_SIMD_SSE
+    __m128 v;
+#else
+    float  v[4];
+#endif
+};
+
+// 4x4 matrix of floats, column-major (as in GLSL). Vectors are columns: 'M * v' transforms 'v'.
+struct alignas(16) Mat4
+{
+    Vec4 c[4];
+};
+
+// Planes of a view frustum: normal (xyz) pointing inside, and distance (w). The normals are normalized,
+// so 'Dot4(plane, point)' (with 'point.w == 1') is the signed distance from the plane.
+// The planes are left, right, top, bottom, near and far.
+struct Frustum
+{
+    Vec4 planes[6];
+};
+
+static inline Vec4 MakeVec4(const float x, const float y, const float z, const float w)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_setr_ps(x, y, z, w) };
+#else
+    return { { x, y, z, w } };
+#endif
+}
+
+static inline Vec4 Splat(const float s)
+{
+    return MakeVec4(s, s, s, s);
+}
+
+// 'p' does not have to be aligned.
+static inline Vec4 LoadVec4(const float* p)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_loadu_ps(p) };
+#else
+    return { { p[0], p[1], p[2], p[3] } };
+#endif
+}
+
+static inline void StoreVec4(float* p, const Vec4 a)
+{
+#ifdef MAGMA_SIMD_SSE
+    _mm_storeu_ps(p, a.v);
+#else
+    p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3];
+#endif
+}
+
+static inline float GetX(const Vec4 a)
+{
+#ifdef MAGMA_SIMD_SSE
+    return _mm_cvtss_f32(a.v);
+#else
+    return a.v[0];
+#endif
+}
+
+static inline float GetElement(const Vec4 a, const uint32_t i)
+{
+    float f[4];
+    StoreVec4(f, a);
+    return f[i];
+}
+
+#ifdef MAGMA_SIMD_SSE
+    // Broadcasts the element 'i' of 'a'.
+    #define MAGMA_SPLAT_SSE(a, i) _mm_shuffle_ps((a), (a), _MM_SHUFFLE(i, i, i, i))
+#endif
+
+static inline Vec4 operator+(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_add_ps(a.v, b.v) };
+#else
+    return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } };
+#endif
+}
+
+static inline Vec4 operator-(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_sub_ps(a.v, b.v) };
+#else
+    return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+#endif
+}
+
+// Component-wise.
+static inline Vec4 operator*(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_mul_ps(a.v, b.v) };
+#else
+    return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } };
+#endif
+}
+
+static inline Vec4 operator*(const Vec4 a, const float s)
+{
+    return a * Splat(s);
+}
+
+static inline Vec4 Min(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_min_ps(a.v, b.v) };
+#else
+    return { { fminf(a.v[0], b.v[0]), fminf(a.v[1], b.v[1]), fminf(a.v[2], b.v[2]), fminf(a.v[3], b.v[3]) } };
+#endif
+}
+
+static inline Vec4 Max(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    return { _mm_max_ps(a.v, b.v) };
+#else
+    return { { fmaxf(a.v[0], b.v[0]), fmaxf(a.v[1], b.v[1]), fmaxf(a.v[2], b.v[2]), fmaxf(a.v[3], b.v[3]) } };
+#endif
+}
+
+static inline Vec4 Abs(const Vec4 a)
+{
+#ifdef MAGMA_SIMD_SSE
+    // Clears the sign bits.
+    return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) };
+#else
+    return { { fabsf(a.v[0]), fabsf(a.v[1]), fabsf(a.v[2]), fabsf(a.v[3]) } };
+#endif
+}
+
+static inline float Dot4(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    // Horizontal sum: (x + z, y + w), then (x + z) + (y + w).
+    const __m128 m = _mm_mul_ps(a.v, b.v);
+    const __m128 s = _mm_add_ps(m, _mm_movehl_ps(m, m));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1))));
+#else
+    return (a.v[0] * b.v[0] + a.v[2] * b.v[2]) + (a.v[1] * b.v[1] + a.v[3] * b.v[3]);
+#endif
+}
+
+// Ignores 'w'.
+static inline float Dot3(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    const __m128 m = _mm_mul_ps(a.v, b.v);
+    const __m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 z = _mm_movehl_ps(m, m);
+    return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, y), z));
+#else
+    return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+#endif
+}
+
+// Ignores 'w', and sets it to 0.
+static inline Vec4 Cross3(const Vec4 a, const Vec4 b)
+{
+#ifdef MAGMA_SIMD_SSE
+    // a.yzx * b.zxy - a.zxy * b.yzx = (a * b.yzx - a.yzx * b).yzx
+    const __m128 aYzx = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 bYzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c    = _mm_sub_ps(_mm_mul_ps(a.v, bYzx), _mm_mul_ps(aYzx, b.v));
+    return { _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)) };
+#else
+    return { { a.v[1] * b.v[2] - a.v[2] * b.v[1],
+               a.v[2] * b.v[0] - a.v[0] * b.v[2],
+               a.v[0] * b.v[1] - a.v[1] * b.v[0], 0.0f } };
+#endif
+}
+
+// Scales the vector so that its 'xyz' part has the length of 1.
+static inline Vec4 Normalize3(const Vec4 a)
+{
+    return a * (1.0f / sqrtf(Dot3(a, a)));
+}
+
+static inline Mat4 Identity()
+{
+    return { { MakeVec4(1.0f, 0.0f, 0.0f, 0.0f), MakeVec4(0.0f, 1.0f, 0.0f, 0.0f),
+               MakeVec4(0.0f, 0.0f, 1.0f, 0.0f), MakeVec4(0.0f, 0.0f, 0.0f, 1.0f) } };
+}
+
+static inline Vec4 operator*(const Mat4& m, const Vec4 a)
+{
+#ifdef MAGMA_SIMD_SSE
+    // Linear combination of the columns.
+    const __m128 x = _mm_mul_ps(m.c[0].v, MAGMA_SPLAT_SSE(a.v, 0));
+    const __m128 y = _mm_mul_ps(m.c[1].v, MAGMA_SPLAT_SSE(a.v, 1));
+    const __m128 z = _mm_mul_ps(m.c[2].v, MAGMA_SPLAT_SSE(a.v, 2));
+    const __m128 w = _mm_mul_ps(m.c[3].v, MAGMA_SPLAT_SSE(a.v, 3));
+    return { _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w)) };
+#else
+    return (m.c[0] * a.v[0] + m.c[1] * a.v[1]) + (m.c[2] * a.v[2] + m.c[3] * a.v[3]);
+#endif
+}
+
+static inline Mat4 operator*(const Mat4& a, const Mat4& b)
+{
+    return { { a * b.c[0], a * b.c[1], a * b.c[2], a * b.c[3] } };
+}
+
+static inline Mat4 Transpose(const Mat4& m)
+{
+#ifdef MAGMA_SIMD_SSE
+    Mat4 t = m;
+    _MM_TRANSPOSE4_PS(t.c[0].v, t.c[1].v, t.c[2].v, t.c[3].v);
+    return t;
+#else
+    Mat4 t;
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            t.c[i].v[j] = m.c[j].v[i];
+        }
+    }
+
+    return t;
+#endif
+}
+
+static inline Mat4 Translation(const float x, const float y, const float z)
+{
+    Mat4 m = Identity();
+    m.c[3] = MakeVec4(x, y, z, 1.0f);
+    return m;
+}
+
+static inline Mat4 Scaling(const float x, const float y, const float z)
+{
+    Mat4 m = Identity();
+    m.c[0] = MakeVec4(x, 0.0f, 0.0f, 0.0f);
+    m.c[1] = MakeVec4(0.0f, y, 0.0f, 0.0f);
+    m.c[2] = MakeVec4(0.0f, 0.0f, z, 0.0f);
+    return m;
+}
+
+// 'q': unit quaternion (x, y, z, w), with 'w' the scalar part.
+static inline Mat4 Rotation(const Vec4 q)
+{
+    float e[4];
+    StoreVec4(e, q);
+
+    const float x = e[0], y = e[1], z = e[2], w = e[3];
+
+    return { { MakeVec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f),
+               MakeVec4(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f),
+               MakeVec4(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f),
+               MakeVec4(0.0f, 0.0f, 0.0f, 1.0f) } };
+}
+
+// Translation * Rotation * Scaling, without the matrix products.
+static inline Mat4 Compose(const Vec4 translation, const Vec4 rotation, const Vec4 scale)
+{
+    const Mat4 r = Rotation(rotation);
+
+    float s[4];
+    StoreVec4(s, scale);
+
+    Mat4 m;
+    m.c[0] = r.c[0] * s[0];
+    m.c[1] = r.c[1] * s[1];
+    m.c[2] = r.c[2] * s[2];
+    m.c[3] = MakeVec4(GetElement(translation, 0), GetElement(translation, 1), GetElement(translation, 2), 1.0f);
+    return m;
+}
+
+// View space: looking down +Z, Y up. Clip space: Vulkan conventions (Y down, Z in [0, 1]).
+// 'verticalFov' is in radians.
+static inline Mat4 Perspective(const float verticalFov, const float aspectRatio, const float zNear, const float zFar)
+{
+    const float h = 1.0f / tanf(0.5f * verticalFov);
+    const float a = zFar / (zFar - zNear);
+
+    return { { MakeVec4(h / aspectRatio, 0.0f, 0.0f,          0.0f),
+               MakeVec4(0.0f,            -h,   0.0f,          0.0f),
+               MakeVec4(0.0f,            0.0f, a,             1.0f),
+               MakeVec4(0.0f,            0.0f, -zNear * a,    0.0f) } };
+}
+
+// Extracts the planes from the (view-)projection matrix (Gribb and Hartmann). Clip space: Z in [0, 1].
+static inline Frustum ExtractFrustum(const Mat4& viewProjection)
+{
+    // The rows of the matrix.
+    const Mat4 r = Transpose(viewProjection);
+
+    Frustum frustum;
+    frustum.planes[0] = Normalize3(r.c[3] + r.c[0]); // Left:   -w <= x
+    frustum.planes[1] = Normalize3(r.c[3] - r.c[0]); // Right:   x <= w
+    frustum.planes[2] = Normalize3(r.c[3] + r.c[1]); // Top:    -w <= y (Y is down in clip space)
+    frustum.planes[3] = Normalize3(r.c[3] - r.c[1]); // Bottom:  y <= w
+    frustum.planes[4] = Normalize3(r.c[2]);          // Near:    0 <= z
+    frustum.planes[5] = Normalize3(r.c[3] - r.c[2]); // Far:     z <= w
+    return frustum;
+}
@@ -49,7 +49,7 @@ Window::Window(const uint16_t width, const uint16_t height)
 
     // Create a window and store its handle.
     m_hwnd = CreateWindow(wndClass.lpszClassName, L"ReDX",
-                          WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, // Disable resizing
+                          WS_OVERLAPPEDWINDOW,                     // Resizable
                           CW_USEDEFAULT, CW_USEDEFAULT,
                           rect.right - rect.left,
                           rect.bottom - rect.top,
@@ -89,6 +89,33 @@ void Window::Hide() const
     ShowWindow(m_hwnd, SW_HIDE);
 }
 
+bool Window::ProcessMessages()
+{
+    MSG msg;
+
+    while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+    {
+        if (msg.message == WM_QUIT)
+        {
+            return false;
+        }
+
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    // The window may have been resized (or minimized, in which case the client area is empty).
+    RECT rect;
+
+    if (GetClientRect(m_hwnd, &rect))
+    {
+        m_width  = static_cast<uint16_t>(rect.right  - rect.left);
+        m_height = static_cast<uint16_t>(rect.bottom - rect.top);
+    }
+
+    return true;
+}
+
 HINSTANCE Window::Instance() const
 {
     assert(m_hinst && "Uninitialized application handle.");
@@ -19,13 +19,17 @@ public:
     // Makes the window invisible.
     void Hide() const;
 
+    // Dispatches all pending messages without blocking, and updates the dimensions of the client area.
+    // Returns 'false' once the window has been closed.
+    bool ProcessMessages();
+
     // Returns the handle of the application.
     HINSTANCE Instance() const;
 
     // Returns the handle of the window.
     HWND Handle() const;
 
-    // Returns the client (drawable) area width (in pixels).
+    // Returns the client (drawable) area width (in pixels). 0 if the window is minimized.
     uint16_t Width() const;
 
     // Returns the client (drawable) area height (in pixels).
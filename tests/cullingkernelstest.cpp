@@ -0,0 +1,249 @@
+// Tests the frustum culling kernels: the SIMD kernels must return exactly the indices of the scalar ones, for any
+// count (including the remainders of MAGMA_SIMD_WIDTH), unaligned arrays, objects exactly touching a plane, and
+// special values. The scalar kernels are checked against a double precision evaluation, away from the planes.
+
+#include "cullingkernels.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+static uint32_t failureCount = 0;
+
+#define EXPECT(condition)                                                          \
+do                                                                                 \
+{                                                                                  \
+    if (!(condition))                                                              \
+    {                                                                              \
+        fprintf(stderr, "%s:%i: expected '%s'.\n", __FILE__, __LINE__, #condition); \
+        failureCount++;                                                            \
+    }                                                                              \
+} while (0)
+
+static uint32_t seed = 1;
+
+static float Random(const float min, const float max)
+{
+    seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+    return min + (max - min) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+}
+
+// The members of the objects, one array each (see SphereBoundsSoA and BoxBoundsSoA). The arrays start at 'offset'
+// floats into their storage, so that they are not aligned.
+struct TestObjects
+{
+    std::vector<float> arrays[6];
+    uint32_t           offset;
+
+    float* Member(const uint32_t a) { return arrays[a].data() + offset; }
+
+    SphereBoundsSoA Spheres() { return { Member(0), Member(1), Member(2), Member(3) }; }
+    BoxBoundsSoA    Boxes()   { return { Member(0), Member(1), Member(2), Member(3), Member(4), Member(5) }; }
+};
+
+// Centers around the frustum, so that about half of the objects are visible.
+static void CreateTestObjects(TestObjects* objects, const uint32_t count, const uint32_t offset)
+{
+    objects->offset = offset;
+
+    for (uint32_t a = 0; a < 6; a++)
+    {
+        objects->arrays[a].resize(offset + count);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            objects->Member(a)[i] = (a < 3) ? Random(-100.0f, 100.0f) : Random(0.5f, 20.0f);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        objects->Member(2)[i] += 100.0f;
+    }
+}
+
+static Frustum TestFrustum()
+{
+    return ExtractFrustum(Perspective(1.0471976f, 16.0f / 9.0f, 0.1f, 200.0f));
+}
+
+// Runs the SIMD and the scalar kernels, and checks that they agree. Returns the visible indices.
+static std::vector<uint32_t> CullAndCompare(const Frustum& frustum, TestObjects* objects, const uint32_t count,
+                                            const bool isBox)
+{
+    std::vector<uint32_t> scalarIndices(count + 1, UINT32_MAX);
+    std::vector<uint32_t> simdIndices(count + 1, UINT32_MAX);
+
+    const uint32_t scalarCount = isBox ? CullBoxesScalar(frustum, objects->Boxes(), count, scalarIndices.data())
+                                       : CullSpheresScalar(frustum, objects->Spheres(), count, scalarIndices.data());
+    const uint32_t simdCount   = isBox ? CullBoxes(frustum, objects->Boxes(), count, simdIndices.data())
+                                       : CullSpheres(frustum, objects->Spheres(), count, simdIndices.data());
+
+    EXPECT(scalarCount <= count);
+    EXPECT(simdCount == scalarCount);
+    EXPECT(std::equal(scalarIndices.begin(), scalarIndices.begin() + scalarCount, simdIndices.begin()));
+
+    // The SIMD kernels may write past the visible indices, but not past 'count'.
+    EXPECT(scalarIndices[count] == UINT32_MAX && simdIndices[count] == UINT32_MAX);
+
+    // In order, without duplicates.
+    EXPECT(std::adjacent_find(scalarIndices.begin(), scalarIndices.begin() + scalarCount,
+                              [](const uint32_t a, const uint32_t b) { return a >= b; }) ==
+           scalarIndices.begin() + scalarCount);
+
+    scalarIndices.resize(scalarCount);
+
+    return scalarIndices;
+}
+
+static void TestRandom()
+{
+    const Frustum frustum = TestFrustum();
+
+    std::vector<uint32_t> counts;
+
+    for (uint32_t count = 0; count <= 3 * MAGMA_SIMD_WIDTH + 3; count++)
+    {
+        counts.push_back(count);
+    }
+
+    counts.push_back(10000);
+
+    for (const uint32_t count : counts)
+    {
+        for (uint32_t offset = 0; offset < MAGMA_SIMD_WIDTH; offset++)
+        {
+            TestObjects objects;
+            CreateTestObjects(&objects, count, offset);
+
+            CullAndCompare(frustum, &objects, count, false);
+            CullAndCompare(frustum, &objects, count, true);
+        }
+    }
+}
+
+// Against a double precision evaluation of the same tests. Objects closer to a plane than the rounding
+// errors of single precision may be classified either way, and are skipped.
+static void TestReference()
+{
+    const Frustum  frustum = TestFrustum();
+    const uint32_t count   = 10000;
+
+    TestObjects objects;
+    CreateTestObjects(&objects, count, 0);
+
+    double planes[6][4];
+
+    for (uint32_t p = 0; p < 6; p++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            planes[p][c] = GetElement(frustum.planes[p], c);
+        }
+    }
+
+    for (uint32_t isBox = 0; isBox < 2; isBox++)
+    {
+        const std::vector<uint32_t> visibleIndices = CullAndCompare(frustum, &objects, count, isBox != 0);
+
+        uint32_t referenceCount = 0;
+        uint32_t mismatchCount  = 0;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            double minMargin = std::numeric_limits<double>::max();
+
+            for (uint32_t p = 0; p < 6; p++)
+            {
+                const double distance = planes[p][0] * objects.Member(0)[i] + planes[p][1] * objects.Member(1)[i] +
+                                        planes[p][2] * objects.Member(2)[i] + planes[p][3];
+                const double radius   = isBox ? fabs(planes[p][0]) * objects.Member(3)[i] +
+                                                fabs(planes[p][1]) * objects.Member(4)[i] +
+                                                fabs(planes[p][2]) * objects.Member(5)[i]
+                                              : objects.Member(3)[i];
+
+                minMargin = std::min(minMargin, distance + radius);
+            }
+
+            if (fabs(minMargin) < 1e-3) continue;
+
+            const bool isVisible = std::binary_search(visibleIndices.begin(), visibleIndices.end(), i);
+
+            referenceCount += (minMargin > 0.0) ? 1 : 0;
+            mismatchCount  += (isVisible != (minMargin > 0.0)) ? 1 : 0;
+        }
+
+        EXPECT(mismatchCount == 0);
+        EXPECT(referenceCount > 0 && referenceCount < count);
+    }
+}
+
+// Spheres touching a plane exactly (in single precision) are visible; NaN is visible, as with the scalar
+// comparisons; infinite radii are visible, negative ones are not (unless inside).
+static void TestSpecialValues()
+{
+    const Frustum  frustum = TestFrustum();
+    const uint32_t count   = 8 * MAGMA_SIMD_WIDTH + 1;
+
+    const float nan      = std::numeric_limits<float>::quiet_NaN();
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    TestObjects objects;
+    CreateTestObjects(&objects, count, 0);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        switch (i % 6)
+        {
+        case 0:
+        {
+            // Outside of the left plane only, at a distance computed as by the kernels.
+            objects.Member(0)[i] = Random(-150.0f, -110.0f);
+            objects.Member(1)[i] = Random(-10.0f, 10.0f);
+            objects.Member(2)[i] = 100.0f;
+
+            float plane[4];
+            StoreVec4(plane, frustum.planes[0]);
+
+            const float distance = plane[0] * objects.Member(0)[i] + plane[1] * objects.Member(1)[i] +
+                                   plane[2] * objects.Member(2)[i] + plane[3];
+
+            objects.Member(3)[i] = -distance;
+            break;
+        }
+        case 1: objects.Member(i % 3)[i] = nan;       break;
+        case 2: objects.Member(3)[i]     = nan;       break;
+        case 3: objects.Member(3)[i]     = infinity;  break;
+        case 4: objects.Member(3)[i]     = -1.0f;     break;
+        case 5: objects.Member(0)[i]     = -infinity; break;
+        }
+    }
+
+    const std::vector<uint32_t> visibleSpheres = CullAndCompare(frustum, &objects, count, false);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const bool isVisible = std::binary_search(visibleSpheres.begin(), visibleSpheres.end(), i);
+
+        if (i % 6 <= 3) EXPECT(isVisible);
+    }
+
+    CullAndCompare(frustum, &objects, count, true);
+}
+
+int main()
+{
+    TestRandom();
+    TestReference();
+    TestSpecialValues();
+
+    if (failureCount > 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", failureCount);
+        return 1;
+    }
+
+    printf("All culling kernel tests passed (%s).\n", MAGMA_SIMD_NAME);
+    return 0;
+}
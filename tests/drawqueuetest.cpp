@@ -0,0 +1,488 @@
+// Tests the draw queue on the CPU: the radix sort against std::stable_sort, and the recording of random draws.
+// The vkCmd*() functions are replaced by fakes which track the bound state, so no Vulkan implementation is required.
+// Every submitted draw must be recorded exactly once, with its own state bound and its instance data at its
+// gl_InstanceIndex, and the recorded binds must match the statistics of the queue.
+
+#include "drawqueue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+static uint32_t failureCount = 0;
+
+#define EXPECT(condition)                                                          \
+do                                                                                 \
+{                                                                                  \
+    if (!(condition))                                                              \
+    {                                                                              \
+        fprintf(stderr, "%s:%i: expected '%s'.\n", __FILE__, __LINE__, #condition); \
+        failureCount++;                                                            \
+    }                                                                              \
+} while (0)
+
+template <typename T>
+static T FakeHandle(const uint64_t value)
+{
+    return reinterpret_cast<T>(static_cast<uintptr_t>(value));
+}
+
+static uint32_t seed = 1;
+
+static uint32_t RandomInt(const uint32_t count)
+{
+    seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+    return static_cast<uint32_t>((static_cast<uint64_t>(seed >> 8) * count) >> 24);
+}
+
+static uint64_t Random64()
+{
+    const uint64_t high = RandomInt(1u << 16);
+    const uint64_t mid  = RandomInt(1u << 24);
+    const uint64_t low  = RandomInt(1u << 24);
+
+    return (high << 48) | (mid << 24) | low;
+}
+
+// The state of the fake command buffer. The descriptor set and the push constants are lost when a pipeline
+// with another layout is bound.
+struct FakeCommandBuffer
+{
+    struct DrawCall
+    {
+        VkPipeline      pipeline;
+        VkDescriptorSet set;       // Null if no set is bound
+        uint32_t        material;
+        bool            isMaterialSet;
+        VkBuffer        vertexBuffer;
+        VkBuffer        indexBuffer;
+        VkIndexType     indexType;
+        uint32_t        indexCount;
+        uint32_t        instanceCount;
+        uint32_t        firstIndex;
+        int32_t         vertexOffset;
+        uint32_t        firstInstance;
+    };
+
+    // Of the test, to check the layouts and push constant stages used with the bound pipeline.
+    std::vector<VkPipeline>         pipelines;
+    std::vector<VkPipelineLayout>   layouts;
+    std::vector<VkShaderStageFlags> pushConstantStages;
+
+    VkPipeline       pipeline;
+    VkPipelineLayout layout;
+    VkDescriptorSet  set;
+    uint32_t         material;
+    bool             isMaterialSet;
+    VkBuffer         vertexBuffer;
+    VkBuffer         indexBuffer;
+    VkIndexType      indexType;
+
+    uint32_t pipelineBindCount;
+    uint32_t setBindCount;
+    uint32_t pushConstantCount;
+    uint32_t vertexBufferBindCount;
+    uint32_t indexBufferBindCount;
+    uint32_t redundantBindCount;  // Of a pipeline or a mesh which is already bound
+    uint32_t invalidCallCount;    // Any call with unexpected arguments
+
+    std::vector<DrawCall> drawCalls;
+
+    void Reset()
+    {
+        pipeline      = VK_NULL_HANDLE;
+        layout        = VK_NULL_HANDLE;
+        set           = VK_NULL_HANDLE;
+        material      = 0;
+        isMaterialSet = false;
+        vertexBuffer  = VK_NULL_HANDLE;
+        indexBuffer   = VK_NULL_HANDLE;
+        indexType     = VK_INDEX_TYPE_UINT16;
+
+        pipelineBindCount     = 0;
+        setBindCount          = 0;
+        pushConstantCount     = 0;
+        vertexBufferBindCount = 0;
+        indexBufferBindCount  = 0;
+        redundantBindCount    = 0;
+        invalidCallCount      = 0;
+
+        drawCalls.clear();
+    }
+
+    uint32_t PipelineIndex(VkPipeline p) const
+    {
+        return static_cast<uint32_t>(std::find(pipelines.begin(), pipelines.end(), p) - pipelines.begin());
+    }
+};
+
+static FakeCommandBuffer fakeCommandBuffer;
+
+static VkCommandBuffer FakeCommandBufferHandle()
+{
+    return FakeHandle<VkCommandBuffer>(0xC0);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint,
+                                             VkPipeline pipeline)
+{
+    FakeCommandBuffer& fake  = fakeCommandBuffer;
+    const uint32_t     index = fake.PipelineIndex(pipeline);
+
+    fake.invalidCallCount   += (commandBuffer != FakeCommandBufferHandle() ||
+                                bindPoint != VK_PIPELINE_BIND_POINT_GRAPHICS ||
+                                index == fake.pipelines.size()) ? 1 : 0;
+    fake.redundantBindCount += (pipeline == fake.pipeline) ? 1 : 0;
+
+    if (index < fake.layouts.size() && fake.layouts[index] != fake.layout)
+    {
+        fake.layout        = fake.layouts[index];
+        fake.set           = VK_NULL_HANDLE;
+        fake.isMaterialSet = false;
+    }
+
+    fake.pipeline = pipeline;
+    fake.pipelineBindCount++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint,
+                                                   VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+                                                   const VkDescriptorSet* sets, uint32_t dynamicOffsetCount,
+                                                   const uint32_t*)
+{
+    FakeCommandBuffer& fake = fakeCommandBuffer;
+
+    // Set 1 only (set 0 is the bindless set), never null, with the layout of the bound pipeline.
+    fake.invalidCallCount += (commandBuffer != FakeCommandBufferHandle() ||
+                              bindPoint != VK_PIPELINE_BIND_POINT_GRAPHICS || layout != fake.layout ||
+                              firstSet != 1 || setCount != 1 || sets[0] == VK_NULL_HANDLE ||
+                              dynamicOffsetCount != 0) ? 1 : 0;
+
+    fake.set = sets[0];
+    fake.setBindCount++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout layout,
+                                              VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size,
+                                              const void* values)
+{
+    FakeCommandBuffer& fake  = fakeCommandBuffer;
+    const uint32_t     index = fake.PipelineIndex(fake.pipeline);
+
+    // The stages must be exactly those of the push constant range of the layout.
+    fake.invalidCallCount += (commandBuffer != FakeCommandBufferHandle() || layout != fake.layout ||
+                              index == fake.pipelines.size() || stageFlags != fake.pushConstantStages[index] ||
+                              offset != 0 || size != sizeof(uint32_t)) ? 1 : 0;
+
+    fake.material      = *static_cast<const uint32_t*>(values);
+    fake.isMaterialSet = true;
+    fake.pushConstantCount++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t firstBinding,
+                                                  uint32_t bindingCount, const VkBuffer* buffers,
+                                                  const VkDeviceSize* offsets)
+{
+    FakeCommandBuffer& fake = fakeCommandBuffer;
+
+    fake.invalidCallCount   += (commandBuffer != FakeCommandBufferHandle() || firstBinding != 0 ||
+                                bindingCount != 1 || offsets[0] != 0) ? 1 : 0;
+    fake.redundantBindCount += (buffers[0] == fake.vertexBuffer) ? 1 : 0;
+
+    fake.vertexBuffer = buffers[0];
+    fake.vertexBufferBindCount++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+                                                VkIndexType indexType)
+{
+    FakeCommandBuffer& fake = fakeCommandBuffer;
+
+    fake.invalidCallCount += (commandBuffer != FakeCommandBufferHandle() || offset != 0) ? 1 : 0;
+
+    fake.indexBuffer = buffer;
+    fake.indexType   = indexType;
+    fake.indexBufferBindCount++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount,
+                                            uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset,
+                                            uint32_t firstInstance)
+{
+    FakeCommandBuffer& fake = fakeCommandBuffer;
+
+    fake.invalidCallCount += (commandBuffer != FakeCommandBufferHandle() || instanceCount == 0) ? 1 : 0;
+
+    fake.drawCalls.push_back({ fake.pipeline, fake.set, fake.material, fake.isMaterialSet, fake.vertexBuffer,
+                               fake.indexBuffer, fake.indexType, indexCount, instanceCount, firstIndex, vertexOffset,
+                               firstInstance });
+}
+
+static void TestRadixSort()
+{
+    // Full keys; keys which only differ in their low bytes (most passes are skipped); many duplicates.
+    const uint64_t masks[] = { ~0ull, 0xFFFFull, 0x0F0000000000000Full };
+    const uint32_t counts[] = { 0, 1, 2, 100, 10000 };
+
+    for (const uint64_t mask : masks)
+    {
+        for (const uint32_t count : counts)
+        {
+            std::vector<uint64_t> keys(count);
+            std::vector<uint32_t> values(count);
+
+            std::vector<std::pair<uint64_t, uint32_t>> reference(count);
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                keys[i]      = Random64() & mask;
+                values[i]    = i;
+                reference[i] = { keys[i], i };
+            }
+
+            std::vector<uint64_t> scratchKeys(count);
+            std::vector<uint32_t> scratchValues(count);
+
+            RadixSort(keys.data(), values.data(), scratchKeys.data(), scratchValues.data(), count);
+
+            // Stable: the values of equal keys stay in their original order.
+            std::stable_sort(reference.begin(), reference.end(),
+                             [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b)
+                             {
+                                 return a.first < b.first;
+                             });
+
+            uint32_t mismatchCount = 0;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                mismatchCount += (keys[i] != reference[i].first || values[i] != reference[i].second) ? 1 : 0;
+            }
+
+            EXPECT(mismatchCount == 0);
+        }
+    }
+}
+
+// The state objects of the tests. The pipelines share a few layouts, with different push constant stages.
+struct TestState
+{
+    VulkanDrawQueue              queue;
+    std::vector<VkDescriptorSet> sets;
+    std::vector<VulkanDrawMesh>  meshes;
+};
+
+static void CreateTestState(TestState* test)
+{
+    const uint32_t           pipelineCount = 8;
+    const uint32_t           layoutCount   = 3;
+    const VkShaderStageFlags stages[]      = { VK_SHADER_STAGE_ALL, VK_SHADER_STAGE_VERTEX_BIT,
+                                               VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT };
+
+    uint64_t nextHandle = 1;
+
+    test->queue.Create(1024);
+
+    fakeCommandBuffer.pipelines.clear();
+    fakeCommandBuffer.layouts.clear();
+    fakeCommandBuffer.pushConstantStages.clear();
+
+    for (uint32_t p = 0; p < pipelineCount; p++)
+    {
+        const VkPipeline       pipeline = FakeHandle<VkPipeline>(nextHandle++);
+        const VkPipelineLayout layout   = FakeHandle<VkPipelineLayout>(0x1000 + p % layoutCount);
+
+        EXPECT(test->queue.AddPipeline(pipeline, layout, stages[p % layoutCount]) == p);
+
+        fakeCommandBuffer.pipelines.push_back(pipeline);
+        fakeCommandBuffer.layouts.push_back(layout);
+        fakeCommandBuffer.pushConstantStages.push_back(stages[p % layoutCount]);
+    }
+
+    // Null sets, for the draws which only use the bindless set.
+    for (uint32_t s = 0; s < 6; s++)
+    {
+        const VkDescriptorSet set = (s % 3 == 0) ? VK_NULL_HANDLE : FakeHandle<VkDescriptorSet>(nextHandle++);
+
+        EXPECT(test->queue.AddDescriptorSet(set) == s);
+
+        test->sets.push_back(set);
+    }
+
+    for (uint32_t m = 0; m < 20; m++)
+    {
+        VulkanDrawMesh mesh = {};
+        mesh.vertexBuffer = FakeHandle<VkBuffer>(nextHandle++);
+        mesh.indexBuffer  = FakeHandle<VkBuffer>(nextHandle++);
+        mesh.indexType    = (m % 2 == 0) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        mesh.indexCount   = 3 * (m + 1);
+        mesh.firstIndex   = 100 * m;
+        mesh.vertexOffset = -static_cast<int32_t>(m);
+
+        EXPECT(test->queue.AddMesh(mesh) == m);
+
+        test->meshes.push_back(mesh);
+    }
+}
+
+// Submits the draws, records them, and checks the recorded commands. The instance data of a draw is its index.
+static void RecordAndCheck(TestState* test, const std::vector<VulkanDraw>& draws)
+{
+    VulkanDrawQueue& queue = test->queue;
+
+    queue.Reset();
+
+    for (const VulkanDraw& draw : draws)
+    {
+        queue.Submit(draw);
+    }
+
+    queue.Sort();
+
+    fakeCommandBuffer.Reset();
+    queue.Record(FakeCommandBufferHandle());
+
+    const FakeCommandBuffer&        fake       = fakeCommandBuffer;
+    const VulkanDrawQueueStatistics statistics = queue.Statistics();
+    const uint32_t                  drawCount  = static_cast<uint32_t>(draws.size());
+
+    EXPECT(fake.invalidCallCount == 0);
+    EXPECT(fake.redundantBindCount == 0);
+    EXPECT(queue.InstanceCount() == drawCount);
+
+    // Each instance of the draw calls is exactly one submitted draw, recorded with the state of that draw.
+    std::vector<uint32_t> recordCounts(drawCount, 0);
+
+    uint32_t mismatchCount = 0;
+    uint32_t instanceCount = 0;
+
+    for (const FakeCommandBuffer::DrawCall& call : fake.drawCalls)
+    {
+        for (uint32_t i = call.firstInstance; i < call.firstInstance + call.instanceCount; i++)
+        {
+            if (i >= drawCount || queue.InstanceData()[i] >= drawCount)
+            {
+                mismatchCount++;
+                continue;
+            }
+
+            const VulkanDraw&     draw = draws[queue.InstanceData()[i]];
+            const VulkanDrawMesh& mesh = test->meshes[draw.mesh];
+            const VkDescriptorSet set  = test->sets[draw.descriptorSet];
+
+            recordCounts[queue.InstanceData()[i]]++;
+
+            mismatchCount += (call.pipeline == fake.pipelines[draw.pipeline] &&
+                              (set == VK_NULL_HANDLE || call.set == set) &&
+                              call.isMaterialSet && call.material == draw.material &&
+                              call.vertexBuffer == mesh.vertexBuffer && call.indexBuffer == mesh.indexBuffer &&
+                              call.indexType == mesh.indexType && call.indexCount == mesh.indexCount &&
+                              call.firstIndex == mesh.firstIndex && call.vertexOffset == mesh.vertexOffset) ? 0 : 1;
+        }
+
+        instanceCount += call.instanceCount;
+    }
+
+    EXPECT(mismatchCount == 0);
+    EXPECT(instanceCount == drawCount);
+    EXPECT(std::all_of(recordCounts.begin(), recordCounts.end(), [](const uint32_t count) { return count == 1; }));
+
+    // Sorted by state, then front to back.
+    uint32_t unsortedCount = 0;
+
+    for (uint32_t i = 1; i < queue.InstanceCount(); i++)
+    {
+        unsortedCount += (VulkanDrawQueue::MakeKey(draws[queue.InstanceData()[i - 1]]) >
+                          VulkanDrawQueue::MakeKey(draws[queue.InstanceData()[i]])) ? 1 : 0;
+    }
+
+    EXPECT(unsortedCount == 0);
+
+    // The statistics count the binds which were actually recorded.
+    EXPECT(statistics.drawCount == drawCount);
+    EXPECT(statistics.drawCallCount == fake.drawCalls.size());
+    EXPECT(statistics.pipelineBindCount == fake.pipelineBindCount);
+    EXPECT(statistics.setBindCount == fake.setBindCount);
+    EXPECT(statistics.materialBindCount == fake.pushConstantCount);
+    EXPECT(statistics.meshBindCount == fake.vertexBufferBindCount);
+    EXPECT(statistics.meshBindCount == fake.indexBufferBindCount);
+    EXPECT(statistics.bindCount == fake.pipelineBindCount + fake.setBindCount + fake.pushConstantCount +
+                                   fake.vertexBufferBindCount + fake.indexBufferBindCount);
+}
+
+static VulkanDraw RandomDraw(const uint32_t pipelineCount, const uint32_t setCount, const uint32_t materialCount,
+                             const uint32_t meshCount)
+{
+    VulkanDraw draw;
+    draw.pipeline      = RandomInt(pipelineCount);
+    draw.descriptorSet = RandomInt(setCount);
+    draw.material      = RandomInt(materialCount);
+    draw.mesh          = RandomInt(meshCount);
+    draw.depth         = static_cast<float>(RandomInt(10000)) * 0.01f - 10.0f; // Some behind the camera
+    draw.instanceData  = 0;
+
+    return draw;
+}
+
+static void TestRecord()
+{
+    TestState test;
+    CreateTestState(&test);
+
+    // Nothing to record.
+    RecordAndCheck(&test, {});
+    EXPECT(fakeCommandBuffer.drawCalls.empty());
+    EXPECT(fakeCommandBuffer.pipelineBindCount == 0);
+
+    // The same state: a single instanced draw, which binds everything but the null set once.
+    std::vector<VulkanDraw> draws;
+
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        draws.push_back({ 1, 0, 7, 3, static_cast<float>(100 - i), i });
+    }
+
+    RecordAndCheck(&test, draws);
+    EXPECT(fakeCommandBuffer.drawCalls.size() == 1);
+    EXPECT(test.queue.Statistics().bindCount == 4);
+
+    // Random states, from a few to many draws per state. The queue is reset between the frames.
+    const uint32_t drawCounts[]     = { 1, 10, 1000, 20000 };
+    const uint32_t materialCounts[] = { 2, 50 };
+
+    for (const uint32_t drawCount : drawCounts)
+    {
+        for (const uint32_t materialCount : materialCounts)
+        {
+            draws.clear();
+
+            for (uint32_t i = 0; i < drawCount; i++)
+            {
+                draws.push_back(RandomDraw(static_cast<uint32_t>(fakeCommandBuffer.pipelines.size()),
+                                           static_cast<uint32_t>(test.sets.size()), materialCount,
+                                           static_cast<uint32_t>(test.meshes.size())));
+                draws.back().instanceData = i;
+            }
+
+            RecordAndCheck(&test, draws);
+        }
+    }
+
+    test.queue.Destroy();
+}
+
+int main()
+{
+    TestRadixSort();
+    TestRecord();
+
+    if (failureCount > 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", failureCount);
+        return 1;
+    }
+
+    printf("All draw queue tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,544 @@
+// Tests the device memory allocator on the CPU: sub-allocation and coalescing, alignment, separation of linear
+// and optimal resources, dedicated allocations, and defragmentation. The Vulkan functions it calls are defined
+// below, on top of a fake device, so no Vulkan implementation is required.
+
+#include "memoryallocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+static uint32_t failureCount = 0;
+
+#define EXPECT(condition)                                                          \
+do                                                                                 \
+{                                                                                  \
+    if (!(condition))                                                              \
+    {                                                                              \
+        fprintf(stderr, "%s:%i: expected '%s'.\n", __FILE__, __LINE__, #condition); \
+        failureCount++;                                                            \
+    }                                                                              \
+} while (0)
+
+#define MiB (VkDeviceSize{ 1 } << 20)
+
+template <typename T>
+static T FakeHandle(const uint64_t value)
+{
+    return reinterpret_cast<T>(static_cast<uintptr_t>(value));
+}
+
+// The fake device. Memory type 0 is device-local (64 MiB blocks), 1 is host-visible and coherent (32 MiB blocks).
+struct FakeMemory
+{
+    VkDeviceSize        size;
+    uint32_t            memoryType;
+    VkBuffer            dedicatedBuffer;
+    VkImage             dedicatedImage;
+    std::vector<byte_t> data;             // Once mapped
+};
+
+struct FakeResource
+{
+    VkDeviceSize size;
+    VkDeviceSize alignment;
+};
+
+static VkDeviceSize                                   fakeGranularity      = 1;
+static bool                                           fakePrefersDedicated = false;
+static uint64_t                                       fakeNextHandle       = 1;
+static std::unordered_map<VkDeviceMemory, FakeMemory> fakeMemories;
+static std::unordered_map<uint64_t, FakeResource>     fakeResources;       // Buffers and images
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* properties)
+{
+    *properties = {};
+    properties->limits.bufferImageGranularity   = fakeGranularity;
+    properties->limits.nonCoherentAtomSize      = 64;
+    properties->limits.maxMemoryAllocationCount = 4096;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice,
+                                                               VkPhysicalDeviceMemoryProperties* properties)
+{
+    *properties = {};
+    properties->memoryTypeCount = 2;
+    properties->memoryTypes[0]  = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+    properties->memoryTypes[1]  = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+    properties->memoryHeapCount = 2;
+    properties->memoryHeaps[0]  = { 1024 * MiB, 0 };
+    properties->memoryHeaps[1]  = { 256 * MiB, 0 };
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* allocateInfo,
+                                                const VkAllocationCallbacks*, VkDeviceMemory* memory)
+{
+    *memory = FakeHandle<VkDeviceMemory>(fakeNextHandle++);
+
+    FakeMemory& fakeMemory = fakeMemories[*memory];
+    fakeMemory.size        = allocateInfo->allocationSize;
+    fakeMemory.memoryType  = allocateInfo->memoryTypeIndex;
+
+    if (const VkMemoryDedicatedAllocateInfo* dedicatedInfo =
+        static_cast<const VkMemoryDedicatedAllocateInfo*>(allocateInfo->pNext))
+    {
+        fakeMemory.dedicatedBuffer = dedicatedInfo->buffer;
+        fakeMemory.dedicatedImage  = dedicatedInfo->image;
+    }
+
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+    EXPECT(fakeMemories.erase(memory) == 1);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size,
+                                           VkMemoryMapFlags, void** data)
+{
+    FakeMemory& fakeMemory = fakeMemories[memory];
+
+    EXPECT(offset == 0 && size == VK_WHOLE_SIZE);
+
+    fakeMemory.data.resize(fakeMemory.size);
+    *data = fakeMemory.data.data();
+
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkInvalidateMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* bufferInfo,
+                                              const VkAllocationCallbacks*, VkBuffer* buffer)
+{
+    fakeResources[fakeNextHandle] = { bufferInfo->size, 256 };
+    *buffer = FakeHandle<VkBuffer>(fakeNextHandle++);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo* imageInfo,
+                                             const VkAllocationCallbacks*, VkImage* image)
+{
+    // 4 bytes per texel, 64 KiB aligned.
+    const VkDeviceSize size = VkDeviceSize{ 4 } * imageInfo->extent.width * imageInfo->extent.height;
+
+    fakeResources[fakeNextHandle] = { size, 65536 };
+    *image = FakeHandle<VkImage>(fakeNextHandle++);
+    return VK_SUCCESS;
+}
+
+static void GetFakeRequirements(const uint64_t handle, VkMemoryRequirements2* requirements)
+{
+    const FakeResource& resource = fakeResources[handle];
+
+    requirements->memoryRequirements = { resource.size, resource.alignment, 0x3 };
+
+    VkMemoryDedicatedRequirements* dedicatedRequirements =
+        static_cast<VkMemoryDedicatedRequirements*>(requirements->pNext);
+
+    if (dedicatedRequirements)
+    {
+        dedicatedRequirements->prefersDedicatedAllocation  = fakePrefersDedicated;
+        dedicatedRequirements->requiresDedicatedAllocation = VK_FALSE;
+    }
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements2(VkDevice, const VkBufferMemoryRequirementsInfo2* info,
+                                                          VkMemoryRequirements2* requirements)
+{
+    GetFakeRequirements(reinterpret_cast<uintptr_t>(info->buffer), requirements);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements2(VkDevice, const VkImageMemoryRequirementsInfo2* info,
+                                                         VkMemoryRequirements2* requirements)
+{
+    GetFakeRequirements(reinterpret_cast<uintptr_t>(info->image), requirements);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory memory, VkDeviceSize)
+{
+    EXPECT(fakeMemories.count(memory) == 1);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory memory, VkDeviceSize)
+{
+    EXPECT(fakeMemories.count(memory) == 1);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*)
+{
+    fakeResources.erase(reinterpret_cast<uintptr_t>(buffer));
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*)
+{
+    fakeResources.erase(reinterpret_cast<uintptr_t>(image));
+}
+
+static void CreateAllocator(VulkanMemoryAllocator* allocator, const VkDeviceSize granularity)
+{
+    fakeGranularity = granularity;
+
+    allocator->Create(FakeHandle<VkPhysicalDevice>(1), FakeHandle<VkDevice>(1), nullptr);
+}
+
+// Also checks that all the device memory has been released.
+static void DestroyAllocator(VulkanMemoryAllocator* allocator)
+{
+    allocator->Destroy();
+
+    EXPECT(fakeMemories.empty());
+}
+
+static VkMemoryRequirements Requirements(const VkDeviceSize size, const VkDeviceSize alignment)
+{
+    return { size, alignment, 0x3 };
+}
+
+// Checks that the sub-allocations do not overlap, and lie within their blocks.
+static void ExpectDisjoint(std::vector<VulkanAllocation> allocations)
+{
+    std::sort(allocations.begin(), allocations.end(), [](const VulkanAllocation& a, const VulkanAllocation& b)
+    {
+        return (a.memory != b.memory) ? (a.memory < b.memory) : (a.offset < b.offset);
+    });
+
+    for (size_t i = 0; i < allocations.size(); i++)
+    {
+        const VulkanAllocation& allocation = allocations[i];
+
+        EXPECT(allocation.offset + allocation.size <= fakeMemories[allocation.memory].size);
+
+        if (i + 1 < allocations.size() && allocations[i + 1].memory == allocation.memory)
+        {
+            EXPECT(allocation.offset + allocation.size <= allocations[i + 1].offset);
+        }
+    }
+}
+
+static void TestAllocateFree()
+{
+    VulkanMemoryAllocator allocator;
+    CreateAllocator(&allocator, 1);
+
+    VulkanAllocation allocations[3];
+
+    for (VulkanAllocation& allocation : allocations)
+    {
+        EXPECT(allocator.Allocate(Requirements(MiB, 256), VK_MEMORY_USAGE_GPU_ONLY, false, false, nullptr,
+                                  &allocation) == VK_SUCCESS);
+
+        EXPECT(allocation.memoryType == 0);
+        EXPECT(allocation.size == MiB);
+        EXPECT(allocation.mapped == nullptr);
+        EXPECT(allocation.memory == allocations[0].memory);
+    }
+
+    ExpectDisjoint({ allocations[0], allocations[1], allocations[2] });
+
+    VulkanMemoryStatistics stats = allocator.Statistics();
+
+    EXPECT(stats.blockCount == 1);
+    EXPECT(stats.blockBytes == 64 * MiB);
+    EXPECT(stats.allocationCount == 3);
+    EXPECT(stats.allocatedBytes == 3 * MiB);
+    EXPECT(stats.freeRegionCount == 1);
+
+    // A hole in the middle.
+    allocator.Free(allocations[1]);
+
+    stats = allocator.Statistics();
+
+    EXPECT(stats.allocationCount == 2);
+    EXPECT(stats.freeRegionCount == 2);
+
+    // The hole is reused.
+    VulkanAllocation reused;
+
+    EXPECT(allocator.Allocate(Requirements(MiB, 256), VK_MEMORY_USAGE_GPU_ONLY, false, false, nullptr,
+                              &reused) == VK_SUCCESS);
+    EXPECT(reused.memory == allocations[1].memory && reused.offset == allocations[1].offset);
+
+    allocator.Free(reused);
+
+    // Adjacent free regions are merged, whichever is freed first.
+    allocator.Free(allocations[0]);
+
+    stats = allocator.Statistics();
+
+    EXPECT(stats.freeRegionCount == 2);
+    EXPECT(stats.largestFreeRegion == 61 * MiB);
+
+    allocator.Free(allocations[2]);
+
+    stats = allocator.Statistics();
+
+    EXPECT(stats.allocationCount == 0);
+    EXPECT(stats.allocatedBytes == 0);
+    EXPECT(stats.freeRegionCount == 1);
+    EXPECT(stats.largestFreeRegion == 64 * MiB);
+    EXPECT(stats.fragmentation == 0.0f);
+
+    // The last empty block is kept.
+    EXPECT(stats.blockCount == 1);
+
+    DestroyAllocator(&allocator);
+}
+
+static void TestAlignment()
+{
+    VulkanMemoryAllocator allocator;
+    CreateAllocator(&allocator, 1);
+
+    const VkDeviceSize sizes[]      = { 100, 1000, 3000, 10, 70000, 1 };
+    const VkDeviceSize alignments[] = { 1,   256,  4096, 65536, 16, 1024 };
+
+    std::vector<VulkanAllocation> allocations;
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        VulkanAllocation allocation;
+
+        EXPECT(allocator.Allocate(Requirements(sizes[i], alignments[i]), VK_MEMORY_USAGE_CPU_TO_GPU, false, false,
+                                  nullptr, &allocation) == VK_SUCCESS);
+
+        EXPECT(allocation.memoryType == 1);
+        EXPECT(allocation.offset % alignments[i] == 0);
+
+        // Persistently mapped.
+        EXPECT(allocation.mapped == fakeMemories[allocation.memory].data.data() + allocation.offset);
+
+        allocations.push_back(allocation);
+    }
+
+    ExpectDisjoint(allocations);
+
+    // The alignment padding is merged back as well.
+    for (uint32_t i : { 3, 0, 5, 1, 4, 2 })
+    {
+        allocator.Free(allocations[i]);
+    }
+
+    const VulkanMemoryStatistics stats = allocator.Statistics(1);
+
+    EXPECT(stats.allocationCount == 0);
+    EXPECT(stats.freeRegionCount == 1);
+    EXPECT(stats.largestFreeRegion == 32 * MiB);
+
+    DestroyAllocator(&allocator);
+}
+
+static void TestGranularity()
+{
+    // With a granularity, linear and optimal resources are placed into separate blocks. Without, they share one.
+    for (const VkDeviceSize granularity : { VkDeviceSize{ 1024 }, VkDeviceSize{ 1 } })
+    {
+        VulkanMemoryAllocator allocator;
+        CreateAllocator(&allocator, granularity);
+
+        VulkanAllocation linear, optimal;
+
+        EXPECT(allocator.Allocate(Requirements(1000, 256), VK_MEMORY_USAGE_GPU_ONLY, false, false, nullptr,
+                                  &linear) == VK_SUCCESS);
+        EXPECT(allocator.Allocate(Requirements(1000, 256), VK_MEMORY_USAGE_GPU_ONLY, true, false, nullptr,
+                                  &optimal) == VK_SUCCESS);
+
+        EXPECT(linear.memoryType == optimal.memoryType);
+        EXPECT((linear.memory != optimal.memory) == (granularity > 1));
+        EXPECT(allocator.Statistics().blockCount == ((granularity > 1) ? 2u : 1u));
+
+        allocator.Free(linear);
+        allocator.Free(optimal);
+
+        DestroyAllocator(&allocator);
+    }
+}
+
+static void TestDedicated()
+{
+    VulkanMemoryAllocator allocator;
+    CreateAllocator(&allocator, 1);
+
+    VulkanAllocation requested, large;
+
+    // Requested explicitly, and larger than half a block.
+    EXPECT(allocator.Allocate(Requirements(MiB, 256), VK_MEMORY_USAGE_GPU_ONLY, false, true, nullptr,
+                              &requested) == VK_SUCCESS);
+    EXPECT(allocator.Allocate(Requirements(33 * MiB, 256), VK_MEMORY_USAGE_GPU_ONLY, false, false, nullptr,
+                              &large) == VK_SUCCESS);
+
+    for (const VulkanAllocation* allocation : { &requested, &large })
+    {
+        EXPECT(allocation->pool == UINT32_MAX);
+        EXPECT(allocation->offset == 0);
+        EXPECT(fakeMemories[allocation->memory].size == allocation->size);
+    }
+
+    VulkanMemoryStatistics stats = allocator.Statistics();
+
+    EXPECT(stats.blockCount == 0);
+    EXPECT(stats.dedicatedCount == 2);
+    EXPECT(stats.allocatedBytes == 34 * MiB);
+
+    allocator.Free(requested);
+    allocator.Free(large);
+
+    // Preferred by the implementation: the memory is dedicated to the buffer.
+    fakePrefersDedicated = true;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size  = 4096;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    VkBuffer         buffer;
+    VulkanAllocation allocation;
+
+    EXPECT(allocator.CreateBuffer(bufferInfo, VK_MEMORY_USAGE_GPU_ONLY, nullptr, &buffer, &allocation) == VK_SUCCESS);
+    EXPECT(allocation.pool == UINT32_MAX);
+    EXPECT(fakeMemories[allocation.memory].dedicatedBuffer == buffer);
+
+    allocator.DestroyBuffer(buffer, allocation);
+
+    fakePrefersDedicated = false;
+
+    stats = allocator.Statistics();
+
+    EXPECT(stats.dedicatedCount == 0);
+    EXPECT(stats.allocatedBytes == 0);
+    EXPECT(fakeMemories.empty());
+    EXPECT(fakeResources.empty());
+
+    DestroyAllocator(&allocator);
+}
+
+// The owner of an allocation, as seen by Defragment().
+struct TestResource
+{
+    VulkanMemoryAllocator* allocator;
+    VulkanAllocation       allocation;
+    bool                   isMovable;
+};
+
+static bool MoveTestResource(void* userData, const VulkanAllocation& src, const VulkanAllocation& dst)
+{
+    TestResource* resource = static_cast<TestResource*>(userData);
+
+    EXPECT(src.memory == resource->allocation.memory && src.offset == resource->allocation.offset);
+    EXPECT(dst.memory != src.memory);
+    EXPECT(dst.size == src.size);
+
+    if (!resource->isMovable) return false;
+
+    // There is no GPU, so the source can be freed right away.
+    resource->allocator->Free(src);
+    resource->allocation = dst;
+
+    return true;
+}
+
+static void TestDefragment()
+{
+    VulkanMemoryAllocator allocator;
+    CreateAllocator(&allocator, 1);
+
+    // 20 allocations of 4 MiB: 16 fill the first block, and 4 spill into the second one.
+    std::vector<TestResource> resources(20);
+
+    for (TestResource& resource : resources)
+    {
+        resource.allocator = &allocator;
+        resource.isMovable = true;
+
+        EXPECT(allocator.Allocate(Requirements(4 * MiB, 256), VK_MEMORY_USAGE_GPU_ONLY, false, false, &resource,
+                                  &resource.allocation) == VK_SUCCESS);
+    }
+
+    const VkDeviceMemory firstBlock = resources[0].allocation.memory;
+
+    EXPECT(allocator.Statistics().blockCount == 2);
+    EXPECT(resources[16].allocation.memory != firstBlock);
+
+    // Free 6 allocations of the first block: its holes can absorb the second block.
+    // The resources are identified by their address, so the freed ones remain in the array, without memory.
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        allocator.Free(resources[2 * i + 1].allocation);
+        resources[2 * i + 1].allocation = {};
+    }
+
+    // Moves refused by the owners leave everything in place.
+    for (TestResource& resource : resources)
+    {
+        resource.isMovable = false;
+    }
+
+    EXPECT(allocator.Defragment(MoveTestResource, UINT64_MAX) == 0);
+    EXPECT(allocator.Statistics().allocationCount == 14);
+    EXPECT(allocator.Statistics().allocatedBytes == 56 * MiB);
+
+    for (TestResource& resource : resources)
+    {
+        resource.isMovable = true;
+    }
+
+    // At most 'maxBytes' are moved.
+    EXPECT(allocator.Defragment(MoveTestResource, 8 * MiB) == 2);
+    EXPECT(allocator.Defragment(MoveTestResource, UINT64_MAX) == 2);
+
+    std::vector<VulkanAllocation> allocations;
+
+    for (const TestResource& resource : resources)
+    {
+        if (!resource.allocation.memory) continue;
+
+        EXPECT(resource.allocation.memory == firstBlock);
+        allocations.push_back(resource.allocation);
+    }
+
+    ExpectDisjoint(allocations);
+
+    // The second block is empty, and kept as the spare block of the pool.
+    const VulkanMemoryStatistics stats = allocator.Statistics();
+
+    EXPECT(stats.blockCount == 2);
+    EXPECT(stats.allocationCount == 14);
+    EXPECT(stats.allocatedBytes == 56 * MiB);
+
+    for (const TestResource& resource : resources)
+    {
+        allocator.Free(resource.allocation);
+    }
+
+    DestroyAllocator(&allocator);
+}
+
+int main()
+{
+    TestAllocateFree();
+    TestAlignment();
+    TestGranularity();
+    TestDedicated();
+    TestDefragment();
+
+    if (failureCount > 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", failureCount);
+        return 1;
+    }
+
+    printf("All memory allocator tests passed.\n");
+    return 0;
+}
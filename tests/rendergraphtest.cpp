@@ -0,0 +1,556 @@
+// Tests the scheduling of the render graph on the CPU: pass culling, resource lifetimes,
+// placement of the transient resources, and barrier derivation. The device is a mock,
+// which hands out fake handles and records the commands, so no Vulkan implementation is required.
+
+#include "rendergraph.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static uint32_t failureCount = 0;
+
+#define EXPECT(condition)                                                          \
+do                                                                                 \
+{                                                                                  \
+    if (!(condition))                                                              \
+    {                                                                              \
+        fprintf(stderr, "%s:%i: expected '%s'.\n", __FILE__, __LINE__, #condition); \
+        failureCount++;                                                            \
+    }                                                                              \
+} while (0)
+
+template <typename T>
+static T FakeHandle(const uint64_t value)
+{
+    return reinterpret_cast<T>(static_cast<uintptr_t>(value));
+}
+
+class MockRenderGraphDevice : public RenderGraphDevice
+{
+public:
+
+    struct Binding
+    {
+        string_t         name;
+        VulkanAllocation allocation;
+        VkDeviceSize     offset;
+    };
+
+    struct PipelineBarrierCall
+    {
+        VkPipelineStageFlags              srcStages;
+        VkPipelineStageFlags              dstStages;
+        bool                              hasMemoryBarrier;
+        VkMemoryBarrier                   memoryBarrier;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+    };
+
+    virtual VkImage CreateImage(string_t, const VkImageCreateInfo& imageInfo,
+                                VkMemoryRequirements* requirements) final
+    {
+        // 4 bytes per texel, at most 64 KiB aligned, in any memory type.
+        requirements->size           = static_cast<VkDeviceSize>(imageInfo.extent.width) * imageInfo.extent.height * 4;
+        requirements->alignment      = 65536;
+        requirements->memoryTypeBits = imageMemoryTypeBits;
+
+        createdCount++;
+
+        return FakeHandle<VkImage>(nextHandle++);
+    }
+
+    virtual VkBuffer CreateBuffer(string_t, const VkBufferCreateInfo& bufferInfo,
+                                  VkMemoryRequirements* requirements) final
+    {
+        requirements->size           = bufferInfo.size;
+        requirements->alignment      = 256;
+        requirements->memoryTypeBits = bufferMemoryTypeBits;
+
+        createdCount++;
+
+        return FakeHandle<VkBuffer>(nextHandle++);
+    }
+
+    virtual VulkanAllocation Allocate(string_t, const VkMemoryRequirements& requirements, const bool,
+                                      const bool) final
+    {
+        VulkanAllocation allocation = {};
+        allocation.memory = FakeHandle<VkDeviceMemory>(nextHandle++);
+        allocation.size   = requirements.size;
+
+        allocatedBytes += requirements.size;
+
+        return allocation;
+    }
+
+    virtual void BindImageMemory(string_t name, VkImage, const VulkanAllocation& allocation,
+                                 const VkDeviceSize offset) final
+    {
+        bindings.push_back({ name, allocation, offset });
+    }
+
+    virtual void BindBufferMemory(string_t name, VkBuffer, const VulkanAllocation& allocation,
+                                  const VkDeviceSize offset) final
+    {
+        bindings.push_back({ name, allocation, offset });
+    }
+
+    virtual VkImageView CreateImageView(string_t, const VkImageViewCreateInfo&) final
+    {
+        return FakeHandle<VkImageView>(nextHandle++);
+    }
+
+    virtual void Retire(VkImage image, VkImageView, VkBuffer buffer, const VulkanAllocation&,
+                        const uint64_t) final
+    {
+        if (image || buffer)
+        {
+            retiredCount++;
+        }
+    }
+
+    virtual void DestroyRetired() final
+    {
+    }
+
+    virtual void PipelineBarrier(VkCommandBuffer, const VkPipelineStageFlags srcStages,
+                                 const VkPipelineStageFlags dstStages, const VkMemoryBarrier* memoryBarrier,
+                                 const uint32_t imageBarrierCount, const VkImageMemoryBarrier* imageBarriers) final
+    {
+        PipelineBarrierCall call = {};
+        call.srcStages        = srcStages;
+        call.dstStages        = dstStages;
+        call.hasMemoryBarrier = (memoryBarrier != nullptr);
+        call.memoryBarrier    = memoryBarrier ? *memoryBarrier : VkMemoryBarrier{};
+        call.imageBarriers.assign(imageBarriers, imageBarriers + imageBarrierCount);
+
+        commands.push_back("barrier");
+        barriers.push_back(call);
+    }
+
+    virtual void BeginPass(VkCommandBuffer, string_t name) final
+    {
+        commands.push_back(name);
+    }
+
+    virtual void EndPass(VkCommandBuffer) final
+    {
+    }
+
+    // Returns the binding of the resource, or nullptr if it has not been bound.
+    const Binding* FindBinding(string_t name) const
+    {
+        for (const Binding& binding : bindings)
+        {
+            if (strcmp(binding.name, name) == 0) return &binding;
+        }
+
+        return nullptr;
+    }
+
+    uint32_t                         imageMemoryTypeBits  = UINT32_MAX;
+    uint32_t                         bufferMemoryTypeBits = UINT32_MAX;
+    uint64_t                         nextHandle           = 1;
+    uint32_t                         createdCount         = 0;
+    uint32_t                         retiredCount         = 0;
+    VkDeviceSize                     allocatedBytes       = 0;
+    std::vector<Binding>             bindings;
+    std::vector<std::string>         commands;
+    std::vector<PipelineBarrierCall> barriers;
+};
+
+static void RecordNothing(VkCommandBuffer, const VulkanRenderGraph&, void*)
+{
+}
+
+static VulkanGraphPass MakePass(string_t name, const VulkanGraphAccess* accesses, const uint32_t accessCount)
+{
+    VulkanGraphPass pass = {};
+    pass.name        = name;
+    pass.record      = RecordNothing;
+    pass.accessCount = accessCount;
+    pass.accesses    = accesses;
+
+    return pass;
+}
+
+static const VulkanGraphImageDescription colorDescription = { VK_FORMAT_R8G8B8A8_UNORM, { 256, 256 }, 1,
+                                                              VK_SAMPLE_COUNT_1_BIT };
+
+// G-buffer -> lighting -> back buffer, with a debug pass whose output is never used.
+static void DeclareDeferredFrame(VulkanRenderGraph& graph)
+{
+    graph.Reset();
+
+    const VulkanGraphResource backBuffer = graph.ImportImage("Back buffer", FakeHandle<VkImage>(1000),
+                                                             VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT,
+                                                             VK_IMAGE_LAYOUT_UNDEFINED,
+                                                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    const VulkanGraphResource albedo   = graph.CreateImage("Albedo",   colorDescription);
+    const VulkanGraphResource lighting = graph.CreateImage("Lighting", colorDescription);
+    const VulkanGraphResource debug    = graph.CreateImage("Debug",    colorDescription);
+
+    const VulkanGraphAccess gBufferAccesses[]  = { { albedo,     VK_GRAPH_USAGE_COLOR_ATTACHMENT } };
+    const VulkanGraphAccess debugAccesses[]    = { { albedo,     VK_GRAPH_USAGE_SAMPLED },
+                                                   { debug,      VK_GRAPH_USAGE_COLOR_ATTACHMENT } };
+    const VulkanGraphAccess lightingAccesses[] = { { albedo,     VK_GRAPH_USAGE_SAMPLED },
+                                                   { lighting,   VK_GRAPH_USAGE_STORAGE_WRITE } };
+    const VulkanGraphAccess resolveAccesses[]  = { { lighting,   VK_GRAPH_USAGE_TRANSFER_SRC },
+                                                   { backBuffer, VK_GRAPH_USAGE_TRANSFER_DST } };
+
+    graph.AddPass(MakePass("G-buffer", gBufferAccesses,  1));
+    graph.AddPass(MakePass("Debug",    debugAccesses,    2));
+    graph.AddPass(MakePass("Lighting", lightingAccesses, 2));
+    graph.AddPass(MakePass("Resolve",  resolveAccesses,  2));
+}
+
+static void TestCulling()
+{
+    MockRenderGraphDevice device;
+    VulkanRenderGraph     graph;
+
+    graph.Create(&device, 1);
+
+    DeclareDeferredFrame(graph);
+
+    graph.Compile(1);
+    graph.Execute(VK_NULL_HANDLE);
+
+    // The debug image is never read, so the pass which writes it is culled, and the image is not created.
+    EXPECT(graph.Statistics().passCount       == 4);
+    EXPECT(graph.Statistics().culledPassCount == 1);
+    EXPECT(graph.Statistics().transientCount  == 2);
+    EXPECT(device.createdCount                == 2);
+    EXPECT(device.FindBinding("Debug")        == nullptr);
+
+    std::vector<std::string> passes;
+
+    for (const std::string& command : device.commands)
+    {
+        if (command != "barrier") passes.push_back(command);
+    }
+
+    EXPECT((passes == std::vector<std::string>{ "G-buffer", "Lighting", "Resolve" }));
+
+    // Side effects keep a pass alive.
+    graph.Reset();
+
+    const VulkanGraphResource scratch = graph.CreateBuffer("Scratch", { 4096 });
+
+    const VulkanGraphAccess scratchAccess = { scratch, VK_GRAPH_USAGE_STORAGE_WRITE };
+
+    VulkanGraphPass pass = MakePass("Side effects", &scratchAccess, 1);
+    pass.hasSideEffects = true;
+
+    graph.AddPass(pass);
+    graph.Compile(2);
+
+    EXPECT(graph.Statistics().culledPassCount == 0);
+
+    graph.Destroy();
+}
+
+static void TestLifetimes()
+{
+    VulkanRenderGraph::Resource resources[3] = {};
+    VulkanRenderGraph::Pass     passes[3]    = {};
+
+    for (VulkanRenderGraph::Resource& resource : resources)
+    {
+        resource.isTransient = true;
+    }
+
+    // Resource 0 is used by the passes 0 and 2, resource 1 by the pass 1 only, resource 2 by the culled pass.
+    passes[0].accessCount = 1;
+    passes[0].accesses[0] = { 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_IMAGE_LAYOUT_UNDEFINED, true };
+    passes[1].accessCount = 2;
+    passes[1].accesses[0] = { 1, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_IMAGE_LAYOUT_UNDEFINED, true };
+    passes[1].accesses[1] = { 2, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                              VK_IMAGE_LAYOUT_UNDEFINED, false };
+    passes[1].isCulled    = true;
+    passes[2].accessCount = 1;
+    passes[2].accesses[0] = { 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                              VK_IMAGE_LAYOUT_UNDEFINED, false };
+
+    VulkanRenderGraph::ComputeLifetimes(passes, 3, resources, 3);
+
+    EXPECT(resources[0].firstPass == 0 && resources[0].lastPass == 2);
+    EXPECT(resources[1].firstPass == UINT32_MAX);
+    EXPECT(resources[2].firstPass == UINT32_MAX);
+}
+
+static void TestPlacement()
+{
+    // Resources 0 and 1 are alive at the same time; resource 2 after both of them.
+    VulkanRenderGraph::Resource  resources[4]    = {};
+    VulkanRenderGraph::Transient transients[4]   = {};
+    VkMemoryRequirements         requirements[4] = {};
+
+    resources[0].firstPass = 0; resources[0].lastPass = 1;
+    resources[1].firstPass = 1; resources[1].lastPass = 2;
+    resources[2].firstPass = 3; resources[2].lastPass = 4;
+    resources[3].firstPass = 0; resources[3].lastPass = 4;
+
+    requirements[0] = { 4096, 1024, 0x3 };
+    requirements[1] = { 2048, 1024, 0x3 };
+    requirements[2] = { 6144, 1024, 0x1 };
+    requirements[3] = { 1024, 1024, 0x4 }; // Incompatible memory type
+
+    const uint32_t indices[] = { 0, 1, 2, 3 };
+
+    const VkMemoryRequirements heap = VulkanRenderGraph::PlaceTransients(resources, indices, 4, requirements,
+                                                                         transients);
+
+    // The largest one is placed first, and the others alias it where the lifetimes allow.
+    EXPECT(transients[2].offset == 0);
+    EXPECT(transients[0].offset == 0);
+    EXPECT(transients[1].offset == 4096);
+    EXPECT(transients[3].offset == UINT64_MAX);
+    EXPECT(heap.size            == 6144);
+    EXPECT(heap.alignment       == 1024);
+    EXPECT(heap.memoryTypeBits  == 0x1);
+
+    for (uint32_t r = 0; r < 3; r++)
+    {
+        EXPECT(transients[r].size == requirements[r].size);
+        EXPECT(transients[r].offset % requirements[r].alignment == 0);
+    }
+}
+
+static void TestAliasing()
+{
+    MockRenderGraphDevice device;
+    VulkanRenderGraph     graph;
+
+    // Buffers and images must not share a 64 KiB page.
+    graph.Create(&device, 65536);
+
+    graph.Reset();
+
+    const VulkanGraphResource first  = graph.CreateImage("First",  colorDescription);
+    const VulkanGraphResource second = graph.CreateImage("Second", colorDescription);
+    const VulkanGraphResource buffer = graph.CreateBuffer("Buffer", { 1000 });
+
+    const VulkanGraphAccess firstAccesses[]  = { { first,  VK_GRAPH_USAGE_STORAGE_WRITE } };
+    const VulkanGraphAccess secondAccesses[] = { { first,  VK_GRAPH_USAGE_SAMPLED },
+                                                 { second, VK_GRAPH_USAGE_STORAGE_WRITE } };
+    const VulkanGraphAccess thirdAccesses[]  = { { second, VK_GRAPH_USAGE_SAMPLED },
+                                                 { buffer, VK_GRAPH_USAGE_STORAGE_WRITE } };
+
+    graph.AddPass(MakePass("First",  firstAccesses,  1));
+    graph.AddPass(MakePass("Second", secondAccesses, 2));
+
+    VulkanGraphPass third = MakePass("Third", thirdAccesses, 2);
+    third.hasSideEffects = true;
+
+    graph.AddPass(third);
+    graph.Compile(1);
+
+    const MockRenderGraphDevice::Binding* firstBinding  = device.FindBinding("First");
+    const MockRenderGraphDevice::Binding* secondBinding = device.FindBinding("Second");
+    const MockRenderGraphDevice::Binding* bufferBinding = device.FindBinding("Buffer");
+
+    EXPECT(firstBinding && secondBinding && bufferBinding);
+
+    if (firstBinding && secondBinding && bufferBinding)
+    {
+        // 'First' and 'Second' overlap during the second pass. The buffer aliases 'First',
+        // and is rounded up to the granularity.
+        EXPECT(firstBinding->allocation.memory == secondBinding->allocation.memory);
+        EXPECT(firstBinding->offset  != secondBinding->offset);
+        EXPECT(bufferBinding->offset == firstBinding->offset);
+        EXPECT(bufferBinding->offset % 65536 == 0);
+    }
+
+    EXPECT(graph.Statistics().transientBytes == 2 * 256 * 256 * 4);
+    EXPECT(graph.Statistics().unaliasedBytes == 2 * 256 * 256 * 4 + 65536);
+
+    // The same declarations do not re-create the resources.
+    const uint32_t createdCount = device.createdCount;
+
+    graph.Compile(2);
+
+    EXPECT(device.createdCount == createdCount);
+    EXPECT(device.retiredCount == 0);
+
+    graph.Destroy();
+
+    EXPECT(device.retiredCount == 3);
+}
+
+static void TestBarriers()
+{
+    MockRenderGraphDevice device;
+    VulkanRenderGraph     graph;
+
+    graph.Create(&device, 1);
+
+    DeclareDeferredFrame(graph);
+
+    graph.Compile(1);
+    graph.Execute(VK_NULL_HANDLE);
+
+    // At most one barrier per pass, plus the final one.
+    EXPECT(device.barriers.size() == graph.Statistics().barrierBatchCount);
+    EXPECT(device.barriers.size() <= 4);
+
+    uint32_t imageBarrierCount = 0;
+
+    for (const MockRenderGraphDevice::PipelineBarrierCall& call : device.barriers)
+    {
+        EXPECT(call.srcStages != 0 && call.dstStages != 0);
+
+        imageBarrierCount += static_cast<uint32_t>(call.imageBarriers.size());
+    }
+
+    EXPECT(imageBarrierCount == graph.Statistics().imageBarrierCount);
+
+    // Finds the barrier recorded right before the pass.
+    auto findBarrier = [&device](string_t pass) -> const MockRenderGraphDevice::PipelineBarrierCall*
+    {
+        uint32_t barrierIndex = 0;
+
+        for (size_t i = 0; i < device.commands.size(); i++)
+        {
+            if (device.commands[i] == "barrier")
+            {
+                barrierIndex++;
+            }
+            else if (device.commands[i] == pass)
+            {
+                return (i > 0 && device.commands[i - 1] == "barrier") ? &device.barriers[barrierIndex - 1] : nullptr;
+            }
+        }
+
+        return nullptr;
+    };
+
+    // The albedo goes from the color attachment layout to the sampled layout, after the attachment writes.
+    const MockRenderGraphDevice::PipelineBarrierCall* lighting = findBarrier("Lighting");
+
+    EXPECT(lighting != nullptr);
+
+    if (lighting)
+    {
+        bool hasAlbedoTransition = false;
+
+        for (const VkImageMemoryBarrier& barrier : lighting->imageBarriers)
+        {
+            if (barrier.oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+                barrier.newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+            {
+                hasAlbedoTransition = true;
+
+                EXPECT(barrier.srcAccessMask & VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+                EXPECT(barrier.dstAccessMask & VK_ACCESS_SHADER_READ_BIT);
+            }
+        }
+
+        EXPECT(hasAlbedoTransition);
+        EXPECT(lighting->srcStages & VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        EXPECT(lighting->dstStages & VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    // The back buffer is left ready for presentation, after the copy.
+    EXPECT(!device.barriers.empty() && device.commands.back() == "barrier");
+
+    if (!device.barriers.empty())
+    {
+        const MockRenderGraphDevice::PipelineBarrierCall& finalCall = device.barriers.back();
+
+        EXPECT(finalCall.imageBarriers.size() == 1);
+        EXPECT(finalCall.srcStages == VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        if (finalCall.imageBarriers.size() == 1)
+        {
+            const VkImageMemoryBarrier& barrier = finalCall.imageBarriers[0];
+
+            EXPECT(barrier.image         == FakeHandle<VkImage>(1000));
+            EXPECT(barrier.oldLayout     == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            EXPECT(barrier.newLayout     == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            EXPECT(barrier.srcAccessMask == VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+    }
+
+    graph.Destroy();
+}
+
+static void TestBufferHazards()
+{
+    // Write, read, read, write of a transient buffer: a memory barrier for the first read only,
+    // and an execution dependency for the write-after-read. The first write waits for all the accesses
+    // of the previous frame.
+    VulkanRenderGraph::Resource  resources[1]  = {};
+    VulkanRenderGraph::Transient transients[1] = {};
+    VulkanRenderGraph::Pass      passes[4]     = {};
+    VkImageMemoryBarrier         imageBarriers[4];
+    VulkanRenderGraph::Barrier   finalBarrier;
+
+    resources[0].isTransient = true;
+    transients[0].offset     = UINT64_MAX;
+
+    const VulkanRenderGraph::Access write = { 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                              VK_IMAGE_LAYOUT_UNDEFINED, true };
+    const VulkanRenderGraph::Access read  = { 0, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                                              VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                              false };
+
+    const VulkanRenderGraph::Access sequence[] = { write, read, read, write };
+
+    for (uint32_t p = 0; p < 4; p++)
+    {
+        passes[p].accessCount = 1;
+        passes[p].accesses[0] = sequence[p];
+    }
+
+    const uint32_t imageBarrierCount = VulkanRenderGraph::ComputeBarriers(passes, 4, resources, 1, transients,
+                                                                          imageBarriers, &finalBarrier);
+
+    EXPECT(imageBarrierCount      == 0);
+    EXPECT(finalBarrier.srcStages == 0);
+
+    EXPECT(passes[0].barrier.srcStages == (VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT));
+    EXPECT(passes[0].barrier.srcAccess == VK_ACCESS_SHADER_WRITE_BIT);
+    EXPECT(passes[0].barrier.dstAccess == write.access);
+
+    EXPECT(passes[1].barrier.srcStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    EXPECT(passes[1].barrier.dstStages == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+    EXPECT(passes[1].barrier.srcAccess == VK_ACCESS_SHADER_WRITE_BIT);
+    EXPECT(passes[1].barrier.dstAccess == VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    EXPECT(passes[2].barrier.srcStages == 0);
+
+    EXPECT(passes[3].barrier.srcStages == VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+    EXPECT(passes[3].barrier.dstStages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    EXPECT(passes[3].barrier.srcAccess == 0);
+    EXPECT(passes[3].barrier.dstAccess == 0);
+
+    // The accesses of the frame are accumulated, for the first access of the next frame.
+    EXPECT(transients[0].lastStages == (VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT));
+    EXPECT(transients[0].lastWrites == VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+int main()
+{
+    TestCulling();
+    TestLifetimes();
+    TestPlacement();
+    TestAliasing();
+    TestBarriers();
+    TestBufferHazards();
+
+    if (failureCount > 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", failureCount);
+        return 1;
+    }
+
+    printf("All render graph tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,289 @@
+// Tests the incremental update of the scene transforms: after random edits of a random hierarchy (new nodes,
+// local transforms of single nodes, of roots, and of large fractions of the scene), the world matrices and bounds
+// must match a naive recursive evaluation of the whole hierarchy, and only the edited nodes and their descendants
+// may be updated. The levels are large enough to be updated by several workers.
+
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static uint32_t failureCount = 0;
+
+#define EXPECT(condition)                                                          \
+do                                                                                 \
+{                                                                                  \
+    if (!(condition))                                                              \
+    {                                                                              \
+        fprintf(stderr, "%s:%i: expected '%s'.\n", __FILE__, __LINE__, #condition); \
+        failureCount++;                                                            \
+    }                                                                              \
+} while (0)
+
+static uint32_t seed = 1;
+
+static uint32_t RandomInt(const uint32_t count)
+{
+    seed = seed * 1664525u + 1013904223u; // LCG (Numerical Recipes)
+    return static_cast<uint32_t>((static_cast<uint64_t>(seed >> 8) * count) >> 24);
+}
+
+static float Random(const float min, const float max)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return min + (max - min) * static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+}
+
+static SceneTransform RandomTransform()
+{
+    const float qx = Random(-1.0f, 1.0f);
+    const float qy = Random(-1.0f, 1.0f);
+    const float qz = Random(-1.0f, 1.0f);
+    const float qw = Random(-1.0f, 1.0f);
+    const float n  = 1.0f / sqrtf(qx * qx + qy * qy + qz * qz + qw * qw + 1e-6f);
+
+    SceneTransform transform;
+    transform.translation = MakeVec4(Random(-10.0f, 10.0f), Random(-10.0f, 10.0f), Random(-10.0f, 10.0f), 0.0f);
+    transform.rotation    = MakeVec4(qx * n, qy * n, qz * n, qw * n);
+    transform.scale       = MakeVec4(Random(0.5f, 1.5f), Random(0.5f, 1.5f), Random(0.5f, 1.5f), 0.0f);
+
+    return transform;
+}
+
+// The hierarchy, as known to the test.
+struct TestNode
+{
+    SceneNode handle;
+    uint32_t  parent;  // Index in the test, or SCENE_INVALID_NODE
+    uint32_t  level;
+    uint32_t  index;   // Within the level, in the order of creation
+    Vec4      localBounds;
+};
+
+struct TestScene
+{
+    Scene                 scene;
+    std::vector<TestNode> nodes;
+    std::vector<uint32_t> levelSizes;
+};
+
+static void AddTestNode(TestScene* test, const uint32_t parent)
+{
+    const uint32_t level = (parent != SCENE_INVALID_NODE) ? test->nodes[parent].level + 1 : 0;
+
+    if (level == test->levelSizes.size())
+    {
+        test->levelSizes.push_back(0);
+    }
+
+    TestNode node;
+    node.parent      = parent;
+    node.level       = level;
+    node.index       = test->levelSizes[level]++;
+    node.localBounds = MakeVec4(Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(0.1f, 2.0f));
+    node.handle      = test->scene.AddNode((parent != SCENE_INVALID_NODE) ? test->nodes[parent].handle
+                                                                          : SCENE_INVALID_NODE,
+                                           RandomTransform(), node.localBounds, { 0, 0 });
+
+    test->nodes.push_back(node);
+}
+
+// A random parent among the existing nodes, so that the hierarchy is both wide and deep.
+static void AddRandomNodes(TestScene* test, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t parent = SCENE_INVALID_NODE;
+
+        if (!test->nodes.empty() && RandomInt(10) != 0)
+        {
+            parent = RandomInt(static_cast<uint32_t>(test->nodes.size()));
+
+            if (test->nodes[parent].level + 1 == SCENE_MAX_LEVELS)
+            {
+                parent = SCENE_INVALID_NODE;
+            }
+        }
+
+        AddTestNode(test, parent);
+    }
+}
+
+// Naive recursive evaluation, from the root every time.
+static Mat4 ReferenceWorldMatrix(const TestScene& test, const uint32_t n)
+{
+    const SceneTransform& local = test.scene.GetLocalTransform(test.nodes[n].handle);
+    const Mat4            world = Compose(local.translation, local.rotation, local.scale);
+
+    if (test.nodes[n].parent == SCENE_INVALID_NODE) return world;
+
+    return ReferenceWorldMatrix(test, test.nodes[n].parent) * world;
+}
+
+static bool IsClose(const float a, const float b)
+{
+    return fabsf(a - b) <= 1e-4f * std::max(1.0f, std::max(fabsf(a), fabsf(b)));
+}
+
+static void ExpectUpToDate(const TestScene& test)
+{
+    uint32_t mismatchCount = 0;
+
+    for (uint32_t n = 0; n < static_cast<uint32_t>(test.nodes.size()); n++)
+    {
+        const TestNode& node      = test.nodes[n];
+        const Mat4      reference = ReferenceWorldMatrix(test, n);
+        const Mat4&     world     = test.scene.GetWorldMatrix(node.handle);
+
+        bool isMatch = true;
+
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            for (uint32_t r = 0; r < 4; r++)
+            {
+                isMatch = isMatch && IsClose(GetElement(world.c[c], r), GetElement(reference.c[c], r));
+            }
+        }
+
+        // The bounding sphere, in world space.
+        uint32_t              count;
+        const SphereBoundsSoA bounds   = test.scene.WorldBounds(node.level, &count);
+        const Vec4            center   = reference * MakeVec4(GetElement(node.localBounds, 0),
+                                                              GetElement(node.localBounds, 1),
+                                                              GetElement(node.localBounds, 2), 1.0f);
+        const float           maxScale = sqrtf(std::max({ Dot3(reference.c[0], reference.c[0]),
+                                                          Dot3(reference.c[1], reference.c[1]),
+                                                          Dot3(reference.c[2], reference.c[2]) }));
+
+        isMatch = isMatch && node.index < count &&
+                  IsClose(bounds.x[node.index], GetElement(center, 0)) &&
+                  IsClose(bounds.y[node.index], GetElement(center, 1)) &&
+                  IsClose(bounds.z[node.index], GetElement(center, 2)) &&
+                  IsClose(bounds.radius[node.index], GetElement(node.localBounds, 3) * maxScale);
+
+        mismatchCount += isMatch ? 0 : 1;
+    }
+
+    EXPECT(mismatchCount == 0);
+}
+
+// Updates the scene, and checks that it updated exactly the edited nodes and their descendants.
+static void UpdateAndCheck(TestScene* test, const std::vector<bool>& isEdited)
+{
+    test->scene.UpdateTransforms();
+
+    uint32_t editedCount  = 0;
+    uint32_t updatedCount = 0;
+
+    // The parents are created before their children.
+    std::vector<bool> isUpdated(test->nodes.size());
+
+    for (uint32_t n = 0; n < static_cast<uint32_t>(test->nodes.size()); n++)
+    {
+        const uint32_t parent = test->nodes[n].parent;
+
+        isUpdated[n] = isEdited[n] || (parent != SCENE_INVALID_NODE && isUpdated[parent]);
+
+        editedCount  += isEdited[n]  ? 1 : 0;
+        updatedCount += isUpdated[n] ? 1 : 0;
+    }
+
+    const SceneStatistics stats = test->scene.Statistics();
+
+    EXPECT(stats.nodeCount == test->nodes.size());
+    EXPECT(stats.levelCount == test->levelSizes.size());
+    EXPECT(stats.dirtyCount == editedCount);
+    EXPECT(stats.updatedCount == updatedCount);
+
+    ExpectUpToDate(*test);
+}
+
+static void TestUpdates()
+{
+    JobSystem jobSystem;
+    jobSystem.Create(4);
+
+    TestScene test;
+    test.scene.Create(&jobSystem);
+
+    AddRandomNodes(&test, 20000);
+
+    // Every node is new.
+    UpdateAndCheck(&test, std::vector<bool>(test.nodes.size(), true));
+
+    // Nothing has changed.
+    UpdateAndCheck(&test, std::vector<bool>(test.nodes.size(), false));
+
+    // The roots: the whole scene is updated.
+    std::vector<bool> isRootEdited(test.nodes.size(), false);
+
+    for (uint32_t n = 0; n < static_cast<uint32_t>(test.nodes.size()); n++)
+    {
+        if (test.nodes[n].parent == SCENE_INVALID_NODE)
+        {
+            test.scene.SetLocalTransform(test.nodes[n].handle, RandomTransform());
+            isRootEdited[n] = true;
+        }
+    }
+
+    UpdateAndCheck(&test, isRootEdited);
+
+    // Single nodes, and random fractions of the scene (a node may be edited several times).
+    const uint32_t editCounts[] = { 1, 10, 1000, 15000 };
+
+    for (const uint32_t editCount : editCounts)
+    {
+        std::vector<bool> isEdited(test.nodes.size(), false);
+
+        for (uint32_t i = 0; i < editCount; i++)
+        {
+            const uint32_t n = RandomInt(static_cast<uint32_t>(test.nodes.size()));
+
+            test.scene.SetLocalTransform(test.nodes[n].handle, RandomTransform());
+            isEdited[n] = true;
+        }
+
+        UpdateAndCheck(&test, isEdited);
+    }
+
+    // New nodes under existing ones, along with edits.
+    for (uint32_t round = 0; round < 3; round++)
+    {
+        const uint32_t oldCount = static_cast<uint32_t>(test.nodes.size());
+
+        std::vector<bool> isEdited(oldCount, false);
+
+        for (uint32_t i = 0; i < 100; i++)
+        {
+            const uint32_t n = RandomInt(oldCount);
+
+            test.scene.SetLocalTransform(test.nodes[n].handle, RandomTransform());
+            isEdited[n] = true;
+        }
+
+        AddRandomNodes(&test, 2000);
+
+        isEdited.resize(test.nodes.size(), true);
+
+        UpdateAndCheck(&test, isEdited);
+    }
+
+    test.scene.Destroy();
+    jobSystem.Destroy();
+}
+
+int main()
+{
+    TestUpdates();
+
+    if (failureCount > 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", failureCount);
+        return 1;
+    }
+
+    printf("All scene tests passed.\n");
+    return 0;
+}
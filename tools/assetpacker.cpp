@@ -0,0 +1,124 @@
+// Packs files into an asset archive (see 'src/assetarchive.h'), which the engine memory-maps.
+// Usage: assetpacker archive.mga [--mesh vertexSize vertexCount indexCount] [--image format width height] file ...
+// The options apply to the next file only (by default, files are packed as blobs). 'format' is a VkFormat value.
+// Each asset is named after the path of its file, as given on the command line.
+
+#include "../src/assetarchive.h"
+#include "../src/utility.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+static bool ReadFile(string_t path, std::vector<byte_t>* data)
+{
+    std::error_code error;
+
+    const uintmax_t size = std::filesystem::file_size(path, error);
+
+    FILE* file = error ? nullptr : OpenFile(path, "rb");
+
+    if (!file) return false;
+
+    data->resize(static_cast<size_t>(size));
+
+    const bool isRead = (size == 0) || (fread(data->data(), data->size(), 1, file) == 1);
+
+    fclose(file);
+
+    return isRead;
+}
+
+int main(const int argc, string_t argv[])
+{
+    ASSERT(argc >= 3, "Missing command line arguments. E.g.: archive.mga "
+                      "[--mesh vertexSize vertexCount indexCount] [--image format width height] file ...");
+
+    string_t archivePath = argv[1];
+
+    std::vector<AssetSource>         sources;
+    std::vector<std::vector<byte_t>> payloads;
+
+    AssetSource next = { nullptr, ASSET_TYPE_BLOB, 0, 0, 0, nullptr, 0 };
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--mesh") == 0 || strcmp(argv[i], "--image") == 0)
+        {
+            // The description and the file it applies to.
+            ASSERT(i + 4 < argc, "\'%s\' must be followed by 3 values and a file.", argv[i]);
+            ASSERT(next.type == ASSET_TYPE_BLOB, "\'%s\' follows a description without a file.", argv[i]);
+
+            next.type   = (strcmp(argv[i], "--mesh") == 0) ? ASSET_TYPE_MESH : ASSET_TYPE_IMAGE;
+            next.format = static_cast<uint32_t>(atoi(argv[i + 1]));
+            next.width  = static_cast<uint32_t>(atoi(argv[i + 2]));
+            next.height = static_cast<uint32_t>(atoi(argv[i + 3]));
+            i += 3;
+            continue;
+        }
+
+        payloads.emplace_back();
+
+        ASSERT(ReadFile(argv[i], &payloads.back()), "Failed to read \'%s\'.", argv[i]);
+
+        next.name = argv[i];
+        next.size = payloads.back().size();
+
+        // The sizes implied by the description must match the file.
+        if (next.type == ASSET_TYPE_MESH)
+        {
+            ASSERT(next.size == static_cast<uint64_t>(next.format) * next.width + 4ull * next.height,
+                   "\'%s\': %llu bytes, expected %u vertices of %u bytes and %u indices.", argv[i],
+                   static_cast<unsigned long long>(next.size), next.width, next.format, next.height);
+        }
+        else if (next.type == ASSET_TYPE_IMAGE)
+        {
+            const uint64_t imageSize = AssetArchive::ImageSize(next.format, next.width, next.height);
+
+            ASSERT(imageSize != 0, "\'%s\': unsupported format %u.", argv[i], next.format);
+            ASSERT(next.size == imageSize, "\'%s\': %llu bytes, expected %llu for %u x %u texels of format %u.",
+                   argv[i], static_cast<unsigned long long>(next.size), static_cast<unsigned long long>(imageSize),
+                   next.width, next.height, next.format);
+        }
+
+        sources.push_back(next);
+
+        next = { nullptr, ASSET_TYPE_BLOB, 0, 0, 0, nullptr, 0 };
+    }
+
+    // The payloads no longer move.
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        sources[i].data = payloads[i].data();
+    }
+
+    if (!AssetArchive::Write(archivePath, sources.data(), static_cast<uint32_t>(sources.size())))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Reopen the archive, as the engine would.
+    AssetArchive archive;
+
+    if (!archive.Open(archivePath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (const AssetSource& source : sources)
+    {
+        const AssetEntry* entry = archive.Find(source.name);
+
+        ASSERT(entry && entry->size == source.size &&
+               (source.size == 0 || memcmp(archive.Data(*entry), source.data, source.size) == 0),
+               "\'%s\' does not match its file.", source.name);
+    }
+
+    PrintInfo("Packed %u assets (%.1f MiB) into \'%s\'.", archive.AssetCount(),
+              static_cast<double>(archive.FileSize()) / (1 << 20), archivePath);
+
+    archive.Close();
+
+    return EXIT_SUCCESS;
+}